@@ -22,12 +22,22 @@
 
 // Standard Imports
 #include "stdafx.h"
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
 
 // Fulcrum Resource Imports
 #include "FulcrumShim.h"
 #include "SelectionBox.h"
 #include "fulcrum_jpipe.h"
+#include "fulcrum_command.h"
 #include "fulcrum_output.h"
+#include "fulcrum_deferred.h"
+#include "fulcrum_capture.h"
+#include "fulcrum_loader.h"
+#include "fulcrum_clock.h"
+#include "config.h"
 
 #ifdef _DEBUG
 #define new DEBUG_NEW
@@ -69,8 +79,15 @@ CFulcrumShim fulcrum_instance;		// Standalone fulcrum instance
 // ---------------------------------------------------------------------------------------------------------------------------------
 
 // Init our static members here
-bool CFulcrumShim::PipesConnecting;			// Bool to track connection state
 fulcrum_jpipe* CFulcrumShim::fulcrumPiper;	// Pipe injection sending logic helper
+DWORD CFulcrumShim::PipeRetryDelay;				// Wait after the last failed try
+
+// Pipes are only connected from StartupPipes() and the retry thread, never from a PassThru call once a
+// library is loaded. The lock keeps the two from connecting at the same time
+static std::mutex pipeStartupLock;
+static std::condition_variable pipeRetrySignal;
+static bool fPipeRetryStarted = false;
+static bool fPipeRetryStop = false;
 
 // ---------------------------------------------------------------------------------------------------------------------------------
 
@@ -107,6 +124,23 @@ BOOL CFulcrumShim::InitInstance()
 	return TRUE;
 }
 
+// Exit override for app shutdown
+int CFulcrumShim::ExitInstance()
+{
+	// Stop retrying the pipes. The retry thread isn't waited on since it can't exit while we hold the loader lock.
+	// The shim is pinned once it starts, so we only get here when the process exits
+	{
+		std::lock_guard<std::mutex> startupLock(pipeStartupLock);
+		fPipeRetryStop = true;
+	}
+	pipeRetrySignal.notify_all();
+
+	// Write out any poll run still being counted, then give the log writer a chance to flush everything still queued up
+	fulcrum_capture::FlushPolls();
+	fulcrum_output::StopWriterThread(1000);
+	return CWinApp::ExitInstance();
+}
+
 // Configures a new debug log file name
 CString CFulcrumShim::SetupDebugLogFile()
 {
@@ -122,8 +156,8 @@ CString CFulcrumShim::SetupDebugLogFile()
 	CString logDir;
 	logDir.Format(_T("%s\\MEAT Inc\\FulcrumShim\\FulcrumLogs"), szPath);
 	if (CreateDirectory(logDir, NULL) || ERROR_ALREADY_EXISTS == GetLastError())
-		fulcrum_output::fulcrumDebug(_T("%.3fs    Log file folder exists. Skipping creation for this directory!\n"), GetTimeSinceInit());
-	else fulcrum_output::fulcrumDebug(_T("%.3fs    Built new folder for our output logs!\n"), GetTimeSinceInit());
+		fulcrum_DEBUG(_T("%.3fs    Log file folder exists. Skipping creation for this directory!\n"), fulcrumClock_Seconds());
+	else fulcrum_DEBUG(_T("%.3fs    Built new folder for our output logs!\n"), fulcrumClock_Seconds());
 
 	// Build the log file path using the log dir above
 	CString cstrPath;
@@ -138,64 +172,92 @@ CString CFulcrumShim::SetupDebugLogFile()
 	);
 
 	// Log new file name output and open the selection box entry object.
-	fulcrum_output::fulcrumDebug(_T("%.3fs    Configured new log file correctly!\n"), GetTimeSinceInit());
-	fulcrum_output::fulcrumDebug(_T("%.3fs    Session Log File: %s\n"), GetTimeSinceInit(), cstrPath);
+	fulcrum_DEBUG(_T("%.3fs    Configured new log file correctly!\n"), fulcrumClock_Seconds());
+	fulcrum_DEBUG(_T("%.3fs    Session Log File: %s\n"), fulcrumClock_Seconds(), (LPCTSTR)cstrPath);
 
 	// Return the path of the log file here
 	return cstrPath;
 }
 
-// Build a new init method sequence.
+// Build a new init method sequence. Connects the pipes if they aren't up yet and starts the retry
+// thread, which looks after them from then on
 void CFulcrumShim::StartupPipes()
 {
-	// Check if pipes need to be configured
-	if (CFulcrumShim::fulcrumPiper == NULL) 
+	std::lock_guard<std::mutex> startupLock(pipeStartupLock);
+	if (CFulcrumShim::fulcrumPiper == NULL)
 		CFulcrumShim::fulcrumPiper = new fulcrum_jpipe();
 
-	// If they're connected, drop out and stop working on connection routines
-	if (CFulcrumShim::fulcrumPiper->PipesConnected()) { return; }
-	if (PipesConnecting) 
+	if (!CFulcrumShim::fulcrumPiper->AllPipesConnected()) ConnectPipes();
+	if (fPipeRetryStarted || fPipeRetryStop) return;
+	fPipeRetryStarted = true;
+
+	// The retry thread never exits while the app is running. Pin the shim so an app that unloads it can't
+	// unmap the code the thread is in
+	fulcrum_pinModule();
+	std::thread(&CFulcrumShim::PipeRetryThread).detach();
+}
+
+// Tries the pipes again while they're down, doubling the wait after every miss. While they're up it
+// only checks on them every PIPE_RETRY_MAX_MS so a restarted Injector gets picked up again
+void CFulcrumShim::PipeRetryThread()
+{
+	std::unique_lock<std::mutex> startupLock(pipeStartupLock);
+	while (!fPipeRetryStop)
 	{
-		// Join the thread to finish setup and return
-		fulcrum_output::fulcrumDebug(_T("-->       WARNING: Pipes were already connecting!\n"));
-		fulcrum_output::fulcrumDebug(_T("-->       Forcing execution of the setup thread to synchronize now...\n"));
-		return;
+		// Each pipe is retried on its own. The output end is a server that always comes up, so
+		// the input end can still be waiting on an Injector that hasn't started yet
+		bool fConnected = CFulcrumShim::fulcrumPiper->AllPipesConnected();
+		if (fConnected) PipeRetryDelay = 0;
+		pipeRetrySignal.wait_for(startupLock, std::chrono::milliseconds(fConnected || PipeRetryDelay == 0 ? PIPE_RETRY_MAX_MS : PipeRetryDelay));
+		if (!fPipeRetryStop && !CFulcrumShim::fulcrumPiper->AllPipesConnected()) ConnectPipes();
 	}
+}
 
-	// Set connecting to true
-	PipesConnecting = true;
-
+// One attempt at connecting both pipes. Callers hold pipeStartupLock
+void CFulcrumShim::ConnectPipes()
+{
 	// Connect our pipe instances for the reader and writer objects now
-	fulcrum_output::fulcrumDebug(_T("------------------------------------------------------------------------------------\n"));
+	fulcrum_DEBUG(_T("------------------------------------------------------------------------------------\n"));
 	bool LoadedPipeInput = CFulcrumShim::fulcrumPiper->ConnectInputPipe();
 	bool LoadedPipeOutput = CFulcrumShim::fulcrumPiper->ConnectOutputPipe();
 
 	// Log heading information so we see this on boot
-	fulcrum_output::fulcrumDebug(_T("------------------------------------------------------------------------------------\n"));
-	fulcrum_output::fulcrumDebug(_T("-->       FulcrumShim DLL - Sniffin CAN, And Crushing Neo's Morale Since 2021\n"));
+	fulcrum_DEBUG(_T("------------------------------------------------------------------------------------\n"));
+	fulcrum_DEBUG(_T("-->       FulcrumShim DLL - Sniffin CAN, And Crushing Neo's Morale Since 2021\n"));
 
 	// Now see if we're loaded correctly.
-	LoadedPipeInput && LoadedPipeOutput;
-	if (!LoadedPipeInput || !LoadedPipeOutput) fulcrum_output::fulcrumDebug(_T("-->       Failed to boot new pipe instances for our FulcrumShim Server!\n"));
+	if (!LoadedPipeInput || !LoadedPipeOutput) fulcrum_DEBUG(_T("-->       Failed to boot new pipe instances for our FulcrumShim Server!\n"));
 	else 
 	{
-		fulcrum_output::fulcrumDebug(_T("-->       Booted new pipe instances correctly!\n"));
-		fulcrum_output::fulcrumDebug(_T("-->       FulcrumInjector should now be running in the background\n"));
+		fulcrum_DEBUG(_T("-->       Booted new pipe instances correctly!\n"));
+		fulcrum_DEBUG(_T("-->       FulcrumInjector should now be running in the background\n"));
+	}
+
+	// Commands from the Injector are read and run on their own thread once the input pipe is up
+	if (LoadedPipeInput && !fulcrum_command::Start(CFulcrumShim::fulcrumPiper))
+		fulcrum_DEBUG(_T("-->       Failed to start the command reader on the input pipe!\n"));
+
+	// Schedule the next try if a pipe did not come up. Each miss doubles the wait
+	if (!LoadedPipeInput || !LoadedPipeOutput)
+	{
+		PipeRetryDelay = PipeRetryDelay == 0 ? PIPE_RETRY_MIN_MS : PipeRetryDelay * 2;
+		if (PipeRetryDelay > PIPE_RETRY_MAX_MS) PipeRetryDelay = PIPE_RETRY_MAX_MS;
+		fulcrum_DEBUG(_T("-->       Trying the pipes again in %lu ms\n"), PipeRetryDelay);
 	}
+	else PipeRetryDelay = 0;
 
 	// Log closing line output
-	fulcrum_output::fulcrumDebug(_T("------------------------------------------------------------------------------------\n"));
-	PipesConnecting = false;
+	fulcrum_DEBUG(_T("------------------------------------------------------------------------------------\n"));
 }
 void CFulcrumShim::ShutdownPipes()
 {
 	// Run the shutdown method
-	if (!CFulcrumShim::fulcrumPiper->PipesConnected()) { fulcrum_output::fulcrumDebug(_T("-->       Pipe instances were already closed!\n")); }
+	if (!CFulcrumShim::fulcrumPiper->PipesConnected()) { fulcrum_DEBUG(_T("-->       Pipe instances were already closed!\n")); }
 	else 
 	{
 		// Close pipes one at a time and log as the close out.
-		fulcrum_output::fulcrumDebug(_T("-->       Calling pipe shutdown methods now...\n"));
+		fulcrum_DEBUG(_T("-->       Calling pipe shutdown methods now...\n"));
 		CFulcrumShim::fulcrumPiper->ShutdownPipes();
-		fulcrum_output::fulcrumDebug(_T("-->       Pipe instances have been released OK!\n"));
+		fulcrum_DEBUG(_T("-->       Pipe instances have been released OK!\n"));
 	}
 }
@@ -44,11 +44,17 @@ class CFulcrumShim : public CWinApp
 		static void StartupPipes();
 		static void ShutdownPipes();
 		static CString SetupDebugLogFile();
-		static bool PipesConnecting;
 		static fulcrum_jpipe* fulcrumPiper;
+		static DWORD PipeRetryDelay;
+
+	// Pipe connect attempts and the thread that retries them
+	private:
+		static void ConnectPipes();
+		static void PipeRetryThread();
 		
 	// Overrides for starting
     public: 
 		DECLARE_MESSAGE_MAP()
-		virtual BOOL InitInstance();		
+		virtual BOOL InitInstance();
+		virtual int ExitInstance();
 };
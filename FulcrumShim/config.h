@@ -4,4 +4,52 @@
 // #define DREWTECHONLY 1
 
 // Define to get nice selection form to choose the Interface
-#define ALLOW_POPUP 0
\ No newline at end of file
+#define ALLOW_POPUP 0
+
+// Define to 0 to format debug lines on the calling thread instead of the log writer thread
+#define DEFERRED_LOGGING 1
+
+// Session logs roll over to a new segment once either limit is hit. 0 turns a limit off
+#define LOG_SEGMENT_MAX_BYTES (64 * 1024 * 1024)
+#define LOG_SEGMENT_MAX_SECONDS (10 * 60)
+
+// Oldest segments of a session get deleted once the session goes past these. 0 keeps everything
+#define LOG_RETAIN_SEGMENTS 0
+#define LOG_RETAIN_BYTES (2048ULL * 1024 * 1024)
+
+// Define to 0 to store capture records as they are instead of packing them into compressed blocks
+#define CAPTURE_COMPRESSION 1
+#define CAPTURE_BLOCK_SIZE (64 * 1024)
+
+// Define to 1 to offer the Injector a shared memory ring. The pipe is still used until the Injector attaches to it
+#define SHARED_MEMORY_TRANSPORT 0
+#define SHARED_MEMORY_RING_SIZE (4 * 1024 * 1024)
+
+// What carries the pipes. PIPE_TRANSPORT_NAMED_PIPE is what the Injector listens on. PIPE_TRANSPORT_UNIX_SOCKET
+// uses socket files with these names in the temp folder instead (Windows 10 1803 and newer)
+#define PIPE_TRANSPORT PIPE_TRANSPORT_NAMED_PIPE
+#define PIPE_SOCKET_OUTPUT_NAME "2CC3F0FB08354929BB453151BBAA5A15.sock"
+#define PIPE_SOCKET_INPUT_NAME "1D16333944F74A928A932417074DD2B3.sock"
+
+// Output pipe writes are queued and sent from a background thread. The policy picks what a full queue does:
+// PIPE_POLICY_DROP_NEWEST, PIPE_POLICY_DROP_OLDEST, PIPE_POLICY_SPILL (to a temp file) or PIPE_POLICY_BLOCK
+#define PIPE_QUEUE_BYTES (4 * 1024 * 1024)
+#define PIPE_QUEUE_POLICY PIPE_POLICY_DROP_OLDEST
+#define PIPE_SPILL_LIMIT (256ULL * 1024 * 1024)
+
+// Pipe connections that fail are retried after a delay which doubles each time up to the max.
+// Output that can't be sent in the meantime is held (up to the backlog size) and sent in order once we connect
+#define PIPE_RETRY_MIN_MS 250
+#define PIPE_RETRY_MAX_MS 30000
+#define PIPE_BACKLOG_BYTES (1024 * 1024)
+
+// Define to 1 to let more than one reader connect to the output pipe at once. Each one gets every write
+// from a shared ring of PIPE_QUEUE_BYTES. The queue policy and spill file don't apply then, the ring drops
+// its oldest writes instead. A reader a whole ring behind skips ahead, or is cut off with PIPE_FANOUT_DROP_SLOW
+#define PIPE_FANOUT 0
+#define PIPE_FANOUT_SUBSCRIBERS 8
+#define PIPE_FANOUT_DROP_SLOW 0
+
+// Define to 1 to send everything on the output pipe as checksummed, sequenced frames (see fulcrum_frame.h).
+// The Injector has to be built with the frame decoder to read them
+#define PIPE_FRAMING 0
\ No newline at end of file
@@ -0,0 +1,380 @@
+/*
+**
+** Copyright (C) 2022 MEAT Inc
+** Author: Zack Walsh <neo.smith@motorengineeringandtech.com>
+**
+** This library is free software; you can redistribute it and/or modify
+** it under the terms of the GNU Lesser General Public License as published
+** by the Free Software Foundation, either version 3 of the License, or (at
+** your option) any later version.
+**
+** This library is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+** Lesser General Public License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public
+** License along with this library; if not, <http://www.gnu.org/licenses/>.
+**
+*/
+
+
+// Standalone microbenchmarks for the shim's logging and pipe hot paths. Not part of the DLL. It's built by
+// FulcrumBenchmark.vcxproj on Windows, and by the fulcrum_benchmark target in CMakeLists.txt everywhere else
+// (its benchmark target runs it). Exits non zero when any output doesn't match what the shim used to produce
+
+// Standard Imports
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iomanip>
+#include <memory>
+#include <sstream>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Fulcrum Resource Imports
+#include "fulcrum_hexdump.h"
+#include "fulcrum_clock.h"
+#include "fulcrum_frame.h"
+#include "fulcrum_transport.h"
+#include "fulcrum_catalog.h"
+#include "fulcrum_test_registry.h"
+
+// Keeps the optimizer from throwing away results we never look at
+static volatile size_t benchSink = 0;
+
+// The hex dump the shim used before fulcrum_hexdump. Kept here so we can compare against it
+static std::wstring fulcrumBench_HexStream(const unsigned char* pData, unsigned long nBytes, unsigned long nBracketFrom)
+{
+	std::basic_ostringstream<wchar_t> ssData;
+	ssData << std::hex << std::setfill(L'0') << L"  \\__";
+	for (unsigned long x = 0; x < nBytes; x++)
+	{
+		if (x < nBracketFrom) ssData << L" " << std::setw(2) << pData[x];
+		else ssData << L" [" << std::setw(2) << pData[x] << L"]";
+	}
+	ssData << std::endl;
+	return ssData.str();
+}
+
+// Runs a body enough times to get a stable number and prints the time per call
+template<typename Body>
+static void fulcrumBench_Run(const char* szName, size_t nBytes, Body benchBody)
+{
+	// Warm up, then time enough iterations to fill about a quarter second
+	for (int warmIndex = 0; warmIndex < 100; warmIndex++) benchBody();
+	unsigned long nIterations = 100;
+	double nanoSeconds = 0;
+	for (;;)
+	{
+		std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+		for (unsigned long runIndex = 0; runIndex < nIterations; runIndex++) benchBody();
+		nanoSeconds = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - startTime).count();
+		if (nanoSeconds > 250000000.0 || nIterations > 100000000) break;
+		nIterations *= 4;
+	}
+
+	double perCall = nanoSeconds / nIterations;
+	if (nBytes == 0) printf("  %-28s              %12.1f ns/call\n", szName, perCall);
+	else printf("  %-28s %6zu bytes  %12.1f ns/call  %8.1f MB/s\n", szName, nBytes, perCall, nBytes * 1000.0 / perCall);
+}
+
+// Hex dump encoders against the old ostringstream path. Output must match byte for byte
+static int fulcrumBench_HexDump()
+{
+	static const size_t payloadSizes[] = { 8, 12, 64, 256, 4128 };
+	std::vector<unsigned char> payloadData(4128);
+	for (size_t byteIndex = 0; byteIndex < payloadData.size(); byteIndex++) payloadData[byteIndex] = (unsigned char)rand();
+	std::vector<wchar_t> hexBuffer(FULCRUM_HEXDUMP_MAX_CHARS);
+
+	static const fulcrum_hex_encoder hexEncoders[] = { HEX_ENCODER_SCALAR, HEX_ENCODER_SSE2, HEX_ENCODER_AVX2 };
+	static const char* encoderNames[] = { "hexdump scalar", "hexdump sse2", "hexdump avx2" };
+
+	int nFailures = 0;
+	printf("Hex dump (bracket from byte N-2, like a read with a checksum):\n");
+	for (size_t sizeIndex = 0; sizeIndex < sizeof(payloadSizes) / sizeof(payloadSizes[0]); sizeIndex++)
+	{
+		unsigned long nBytes = (unsigned long)payloadSizes[sizeIndex];
+		unsigned long nBracketFrom = nBytes - 2;
+		std::wstring strExpected = fulcrumBench_HexStream(&payloadData[0], nBytes, nBracketFrom);
+		fulcrumBench_Run("ostringstream (old)", nBytes, [&]() {
+			benchSink += fulcrumBench_HexStream(&payloadData[0], nBytes, nBracketFrom).size();
+		});
+
+		for (size_t encoderIndex = 0; encoderIndex < sizeof(hexEncoders) / sizeof(hexEncoders[0]); encoderIndex++)
+		{
+			if (!fulcrumHex_SetEncoder(hexEncoders[encoderIndex])) { printf("  %-28s not available (needs an x86 build and a CPU that has it)\n", encoderNames[encoderIndex]); continue; }
+			size_t nLength = fulcrumHex_Format(&payloadData[0], nBytes, nBracketFrom, &hexBuffer[0]);
+			if (strExpected.compare(0, std::wstring::npos, &hexBuffer[0], nLength) != 0) {
+				printf("  %-28s OUTPUT MISMATCH\n", encoderNames[encoderIndex]);
+				nFailures++;
+				continue;
+			}
+			fulcrumBench_Run(encoderNames[encoderIndex], nBytes, [&]() {
+				benchSink += fulcrumHex_Format(&payloadData[0], nBytes, nBracketFrom, &hexBuffer[0]);
+			});
+		}
+	}
+
+	fulcrumHex_SetEncoder(HEX_ENCODER_AUTO);
+	return nFailures;
+}
+
+// Timestamp sources against each other and against reading steady_clock directly. The TSC is also checked
+// against steady_clock over a longer stretch to see how far the calibration is off
+static int fulcrumBench_Clock()
+{
+	int nFailures = 0;
+	printf("Clock (TSC at %.3f MHz):\n", fulcrumClock_TscFrequency() / 1000000.0);
+	fulcrumBench_Run("steady_clock::now", 0, [&]() {
+		benchSink += (size_t)std::chrono::steady_clock::now().time_since_epoch().count();
+	});
+
+	static const fulcrum_clock_source clockSources[] = { CLOCK_SOURCE_STEADY, CLOCK_SOURCE_TSC };
+	static const char* sourceNames[] = { "clock steady", "clock tsc" };
+	for (size_t sourceIndex = 0; sourceIndex < sizeof(clockSources) / sizeof(clockSources[0]); sourceIndex++)
+	{
+		if (!fulcrumClock_SetSource(clockSources[sourceIndex])) { printf("  %-28s not usable on this CPU\n", sourceNames[sourceIndex]); continue; }
+		fulcrumBench_Run(sourceNames[sourceIndex], 0, [&]() { benchSink += (size_t)fulcrumClock_Now(); });
+
+		// Has to keep counting up from one read to the next
+		uint64_t lastTime = fulcrumClock_Now();
+		for (int readIndex = 0; readIndex < 1000000; readIndex++)
+		{
+			uint64_t nextTime = fulcrumClock_Now();
+			if (nextTime < lastTime) { printf("  %-28s WENT BACKWARDS\n", sourceNames[sourceIndex]); nFailures++; break; }
+			lastTime = nextTime;
+		}
+	}
+
+	if (fulcrumClock_SetSource(CLOCK_SOURCE_TSC))
+	{
+		std::chrono::steady_clock::time_point steadyStart = std::chrono::steady_clock::now();
+		uint64_t clockStart = fulcrumClock_Now();
+		std::this_thread::sleep_for(std::chrono::milliseconds(500));
+		double steadyNanos = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - steadyStart).count();
+		double clockNanos = (double)(fulcrumClock_Now() - clockStart);
+		printf("  %-28s %12.1f ppm against steady_clock\n", "tsc calibration", (clockNanos - steadyNanos) * 1000000.0 / steadyNanos);
+	}
+
+	fulcrumClock_SetSource(CLOCK_SOURCE_AUTO);
+	return nFailures;
+}
+
+// ------------------------------------------------------------------------------------------------
+
+// Where the socket benchmark listens. Relative so it fits in sun_path wherever it's run from
+#define FULCRUM_BENCH_SOCKET_PATH "fulcrum_benchmark.sock"
+
+// Same as the named pipe's buffer, so the loopback blocks the writer about as often as a real pipe would
+#define FULCRUM_BENCH_LOOPBACK_BYTES (64 * 1024)
+
+// PASSTHRU_MSG traffic pushed through the pipe. BatchSize is how many messages one WriteMsgs/ReadMsgs call logs
+struct fulcrum_bench_workload {
+	const char* Name;
+	uint32_t BatchSize;
+	uint32_t Batches;
+	uint32_t LargeEvery;	// 0 for CAN only, 1 for all 4 KB ISO15765, N for one ISO15765 transfer of random size in N
+};
+
+// Counts transport calls on the way through. On the socket and named pipe backends every Send() and Receive()
+// is at least one system call (the socket adds one more send for the length in front of each message)
+class fulcrum_bench_counter : public fulcrum_transport {
+public:
+	explicit fulcrum_bench_counter(fulcrum_transport* pInner) : m_pInner(pInner), m_nSends(0), m_nReceives(0) { }
+	virtual bool WaitForPeer() { return m_pInner->WaitForPeer(); }
+	virtual void DropPeer() { m_pInner->DropPeer(); }
+	virtual fulcrum_pipe_result Send(const void* pData, size_t nBytes) { m_nSends++; return m_pInner->Send(pData, nBytes); }
+	virtual size_t Receive(void* pBuffer, size_t nBytes) { m_nReceives++; return m_pInner->Receive(pBuffer, nBytes); }
+	virtual void Cancel() { m_pInner->Cancel(); }
+	unsigned long long Calls() const { return m_nSends.load() + m_nReceives.load(); }
+	void Reset() { m_nSends = 0; m_nReceives = 0; }
+
+private:
+	fulcrum_transport* m_pInner;
+	std::atomic<unsigned long long> m_nSends;
+	std::atomic<unsigned long long> m_nReceives;
+};
+
+// Fills one batch for a workload. Mixed traffic is mostly CAN frames with an ISO15765 transfer of random size now and then
+static void fulcrumBench_FillBatch(const fulcrum_bench_workload& benchWorkload, std::vector<PASSTHRU_MSG>& msgBatch)
+{
+	msgBatch.resize(benchWorkload.BatchSize);
+	for (uint32_t msgIndex = 0; msgIndex < benchWorkload.BatchSize; msgIndex++)
+	{
+		PASSTHRU_MSG& benchMsg = msgBatch[msgIndex];
+		memset(&benchMsg, 0, offsetof(PASSTHRU_MSG, Data));
+		bool fLarge = benchWorkload.LargeEvery != 0 && rand() % benchWorkload.LargeEvery == 0;
+		benchMsg.ProtocolID = fLarge ? ISO15765 : CAN;
+		benchMsg.Timestamp = (unsigned long)rand();
+		if (!fLarge) benchMsg.DataSize = 4 + 8;
+		else benchMsg.DataSize = benchWorkload.LargeEvery == 1 ? 4 + 4096 : 4 + 16 + rand() % 4096;
+		benchMsg.ExtraDataIndex = benchMsg.DataSize;
+		for (unsigned long byteIndex = 0; byteIndex < benchMsg.DataSize; byteIndex++) benchMsg.Data[byteIndex] = (unsigned char)rand();
+	}
+}
+
+// Nearest rank percentile of a sorted list
+static double fulcrumBench_Percentile(const std::vector<double>& sortedValues, double fPercent)
+{
+	if (sortedValues.empty()) return 0;
+	size_t nRank = (size_t)(fPercent / 100.0 * sortedValues.size());
+	return sortedValues[nRank < sortedValues.size() ? nRank : sortedValues.size() - 1];
+}
+
+// Frames batches the way fulcrum_jpipe::WritePassThruMessages does with PIPE_FRAMING on and sends them through a
+// transport pair, with a reader thread decoding them on the far side. Latency runs from packing a batch to its
+// frame coming out of the decoder. The writer never waits, so it includes any time spent behind a full buffer
+static int fulcrumBench_Transport(const char* szTransport, fulcrum_bench_counter& writeEnd, fulcrum_bench_counter& readEnd)
+{
+	static const fulcrum_bench_workload benchWorkloads[] = {
+		{ "CAN 8 bytes", 32, 20000, 0 },
+		{ "ISO15765 4 KB", 1, 20000, 1 },
+		{ "mixed", 8, 20000, 10 },
+	};
+
+	int nFailures = 0;
+	for (size_t workloadIndex = 0; workloadIndex < sizeof(benchWorkloads) / sizeof(benchWorkloads[0]); workloadIndex++)
+	{
+		// A handful of different batches is enough to keep the data from being the same every time
+		const fulcrum_bench_workload& benchWorkload = benchWorkloads[workloadIndex];
+		std::vector<std::vector<PASSTHRU_MSG> > msgBatches(16);
+		for (size_t batchIndex = 0; batchIndex < msgBatches.size(); batchIndex++) fulcrumBench_FillBatch(benchWorkload, msgBatches[batchIndex]);
+
+		std::vector<std::chrono::steady_clock::time_point> sendTimes(benchWorkload.Batches);
+		std::vector<double> latencyMicros(benchWorkload.Batches);
+		unsigned long long nMessages = 0, nWireBytes = 0, nBadFrames = 0;
+		writeEnd.Reset(); readEnd.Reset();
+
+		// Reader side. Stops once every frame is in or the transport goes away
+		std::thread readerThread([&]() {
+			fulcrum_frame_decoder frameDecoder;
+			fulcrum_frame inputFrame;
+			std::vector<uint8_t> readBuffer(64 * 1024);
+			uint32_t nFrames = 0;
+			while (nFrames < benchWorkload.Batches)
+			{
+				size_t nRead = readEnd.Receive(&readBuffer[0], readBuffer.size());
+				if (nRead == 0) break;
+				nWireBytes += nRead;
+				frameDecoder.Feed(&readBuffer[0], nRead);
+				while (frameDecoder.Next(inputFrame))
+				{
+					std::chrono::steady_clock::time_point recvTime = std::chrono::steady_clock::now();
+					if (inputFrame.Type != FRAME_MESSAGES || inputFrame.Sequence >= benchWorkload.Batches) { nBadFrames++; continue; }
+					latencyMicros[inputFrame.Sequence] = std::chrono::duration<double, std::micro>(recvTime - sendTimes[inputFrame.Sequence]).count();
+
+					// Walk the batch like the Injector would to count what came through
+					for (uint32_t nOffset = 0; nOffset + FULCRUM_FRAME_MESSAGE_HEADER <= inputFrame.Length; nMessages++)
+					{
+						const uint8_t* pSize = inputFrame.Payload + nOffset + 20;
+						nOffset += FULCRUM_FRAME_MESSAGE_HEADER + (pSize[0] | (pSize[1] << 8) | (pSize[2] << 16) | ((uint32_t)pSize[3] << 24));
+					}
+					nFrames++;
+				}
+			}
+			nBadFrames += frameDecoder.CrcErrors() + frameDecoder.FramesMissed() + (benchWorkload.Batches - nFrames);
+		});
+
+		// Writer side, packed in place the same as fulcrum_pipe::BeginFrame()/WriteFrame()
+		std::vector<uint8_t> frameBuffer;
+		std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+		for (uint32_t batchIndex = 0; batchIndex < benchWorkload.Batches; batchIndex++)
+		{
+			const std::vector<PASSTHRU_MSG>& msgBatch = msgBatches[batchIndex % msgBatches.size()];
+			sendTimes[batchIndex] = std::chrono::steady_clock::now();
+			size_t nPayload = fulcrumFrame_MessagesSize(&msgBatch[0], benchWorkload.BatchSize);
+			frameBuffer.resize(sizeof(fulcrum_frame_header) + nPayload);
+			fulcrumFrame_PackMessages(&frameBuffer[sizeof(fulcrum_frame_header)], &msgBatch[0], benchWorkload.BatchSize);
+			fulcrumFrame_Seal((fulcrum_frame_header*)&frameBuffer[0], FRAME_MESSAGES, batchIndex, &frameBuffer[sizeof(fulcrum_frame_header)], (uint32_t)nPayload);
+			if (writeEnd.Send(&frameBuffer[0], frameBuffer.size()) != PIPE_WRITE_SENT) { nFailures++; break; }
+		}
+		readerThread.join();
+		double nSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+
+		if (nBadFrames != 0) { printf("  %-10s %-14s %llu BAD FRAMES\n", szTransport, benchWorkload.Name, nBadFrames); nFailures++; continue; }
+		std::sort(latencyMicros.begin(), latencyMicros.end());
+		printf("  %-10s %-14s %11.0f msgs/s %9.1f MB/s   p50 %8.1f us  p99 %8.1f us  p999 %8.1f us  %6.3f calls/msg\n",
+			szTransport, benchWorkload.Name, nMessages / nSeconds, nWireBytes / nSeconds / 1000000.0,
+			fulcrumBench_Percentile(latencyMicros, 50), fulcrumBench_Percentile(latencyMicros, 99), fulcrumBench_Percentile(latencyMicros, 99.9),
+			(writeEnd.Calls() + readEnd.Calls()) / (double)nMessages);
+	}
+	return nFailures;
+}
+
+// Message batches through every transport that builds on this platform. The named pipe backend needs the DLL's
+// MFC build, so it isn't here; the loopback runs everywhere and is the one to track regressions with
+static int fulcrumBench_Pipe()
+{
+	int nFailures = 0;
+	printf("Pipe transports (PASSTHRU_MSG batches in FRAME_MESSAGES frames):\n");
+
+	std::unique_ptr<fulcrum_transport> loopWrite, loopRead;
+	fulcrumTransport_CreateLoopback(FULCRUM_BENCH_LOOPBACK_BYTES, loopWrite, loopRead);
+	fulcrum_bench_counter loopWriteCounter(loopWrite.get()), loopReadCounter(loopRead.get());
+	nFailures += fulcrumBench_Transport("loopback", loopWriteCounter, loopReadCounter);
+
+	// The server end waits for the client on its own thread since both are in this process
+	std::unique_ptr<fulcrum_transport> socketServer(fulcrumTransport_CreateSocketServer(FULCRUM_BENCH_SOCKET_PATH));
+	std::unique_ptr<fulcrum_transport> socketClient;
+	if (socketServer)
+	{
+		std::thread acceptThread([&]() { socketServer->WaitForPeer(); });
+		socketClient.reset(fulcrumTransport_CreateSocketClient(FULCRUM_BENCH_SOCKET_PATH));
+		if (!socketClient) socketServer->Cancel();
+		acceptThread.join();
+	}
+	if (!socketClient) { printf("  %-10s could not be set up here\n", "socket"); }
+	else
+	{
+		fulcrum_bench_counter socketWriteCounter(socketServer.get()), socketReadCounter(socketClient.get());
+		nFailures += fulcrumBench_Transport("socket", socketWriteCounter, socketReadCounter);
+	}
+	socketClient.reset(); socketServer.reset();
+	remove(FULCRUM_BENCH_SOCKET_PATH);
+	return nFailures;
+}
+
+// ------------------------------------------------------------------------------------------------
+
+// Interface catalog against a fake registry. Times a cold refresh, one with nothing to do, and parsing the
+// saved catalog. Whether they get the right answer is checked in fulcrum_tests.cpp
+static void fulcrumBench_Catalog()
+{
+	static const wchar_t* rootPaths[] = { L"Software\\PassThruSupport.04.04", L"Software\\WOW6432Node\\PassThruSupport.05.00" };
+	fulcrum_test_registry benchRegistry;
+	for (int vendorIndex = 0; vendorIndex < 16; vendorIndex++)
+	{
+		std::wstring strVendor = L"Vendor" + std::to_wstring(vendorIndex);
+		benchRegistry.SetVendor(std::wstring(rootPaths[vendorIndex % 2]) + L"\\" + strVendor, strVendor, strVendor + L".dll");
+	}
+
+	printf("Interface catalog (16 vendor keys):\n");
+	fulcrum_catalog interfaceCatalog, savedCatalog;
+	std::vector<uint8_t> catalogData;
+	interfaceCatalog.Refresh(benchRegistry);
+	interfaceCatalog.Serialize(catalogData);
+
+	fulcrumBench_Run("catalog cold refresh", 0, [&]() {
+		fulcrum_catalog coldCatalog;
+		benchSink += coldCatalog.Refresh(benchRegistry);
+	});
+	fulcrumBench_Run("catalog unchanged refresh", 0, [&]() { benchSink += interfaceCatalog.Refresh(benchRegistry); });
+	fulcrumBench_Run("catalog parse", catalogData.size(), [&]() { benchSink += savedCatalog.Parse(&catalogData[0], catalogData.size()); });
+}
+
+int main()
+{
+	int nFailures = 0;
+	nFailures += fulcrumBench_HexDump();
+	nFailures += fulcrumBench_Clock();
+	nFailures += fulcrumBench_Pipe();
+	fulcrumBench_Catalog();
+	return nFailures == 0 ? 0 : 1;
+}
@@ -0,0 +1,451 @@
+/*
+**
+** Copyright (C) 2022 MEAT Inc
+** Author: Zack Walsh <neo.smith@motorengineeringandtech.com>
+**
+** This library is free software; you can redistribute it and/or modify
+** it under the terms of the GNU Lesser General Public License as published
+** by the Free Software Foundation, either version 3 of the License, or (at
+** your option) any later version.
+**
+** This library is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+** Lesser General Public License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public
+** License along with this library; if not, <http://www.gnu.org/licenses/>.
+**
+*/
+
+
+// Standard Imports
+#include "stdafx.h"
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+// Fulcrum Resource Imports
+#include "fulcrum_j2534.h"
+#include "fulcrum_loader.h"
+#include "fulcrum_output.h"
+#include "fulcrum_capture.h"
+#include "fulcrum_frontend.h"
+#include "fulcrum_clock.h"
+#include "fulcrum_timesync.h"
+
+// Every thread builds its records in its own buffer so we only allocate while it grows
+static std::vector<unsigned char>& fulcrumCaptureBuffer()
+{
+	thread_local std::vector<unsigned char> captureBuffer;
+	return captureBuffer;
+}
+
+// Set while capture is paused. Calls that start while it's set aren't recorded at all
+static std::atomic<bool> fCapturePaused(false);
+static std::atomic<unsigned long long> nRecordsSkipped(0);
+
+// Empty polls not written out yet. Calls on other channels can flush them at any time, so they have a
+// lock of their own. The flag lets the calls that have nothing to flush skip the lock
+std::map<uint64_t, fulcrum_capture::pollrun> fulcrum_capture::m_PendingPolls;
+static std::mutex pollLock;
+static std::atomic<bool> fPollsPending(false);
+
+// CTORs for a capture. Any pending poll run goes out first, then the begin record for the call is started
+fulcrum_capture::fulcrum_capture(fulcrum_capture_function captureFunction)
+	: m_Function(captureFunction)
+	, m_Buffer(fulcrumCaptureBuffer())
+	, m_nFieldCount(0)
+	, m_nArgIndex(0)
+	, m_fPaused(fCapturePaused.load(std::memory_order_relaxed))
+{
+	FlushPolls();
+	StartRecord(CAPTURE_CALL_BEGIN, Timestamp());
+}
+fulcrum_capture::fulcrum_capture(fulcrum_capture_function captureFunction, uint64_t beginTimestamp)
+	: m_Function(captureFunction)
+	, m_Buffer(fulcrumCaptureBuffer())
+	, m_nFieldCount(0)
+	, m_nArgIndex(0)
+	, m_fPaused(fCapturePaused.load(std::memory_order_relaxed))
+{
+	FlushPolls();
+	StartRecord(CAPTURE_CALL_BEGIN, beginTimestamp);
+}
+
+// Builds and sends the record for a run of empty polls. Laid out like a begin record with the end fields after it
+fulcrum_capture::fulcrum_capture(const pollrun& pollRun)
+	: m_Function(CAPTURE_FN_READ_MSGS)
+	, m_Buffer(fulcrumCaptureBuffer())
+	, m_nFieldCount(0)
+	, m_nArgIndex(0)
+	, m_fPaused(fCapturePaused.load(std::memory_order_relaxed))
+{
+	StartRecord(CAPTURE_POLL_RUN, pollRun.FirstTimestamp);
+	((fulcrum_capture_record_header*)&m_Buffer[0])->ThreadID = pollRun.ThreadID;
+	Value(pollRun.ChannelID); Pointer(pollRun.pMsg); Pointer(pollRun.pNumMsgs); Value(0);
+	MsgCount(LABEL_READ, 0, pollRun.RequestedCount);
+
+	uint32_t fieldValue = (uint32_t)pollRun.Retval;
+	size_t dataOffset = AddField(FIELD_RETVAL, LABEL_NONE, 0, sizeof(fieldValue));
+	memcpy(&m_Buffer[dataOffset], &fieldValue, sizeof(fieldValue));
+
+	dataOffset = AddField(FIELD_POLL_COUNT, LABEL_NONE, 0, sizeof(uint32_t) + sizeof(uint64_t));
+	memcpy(&m_Buffer[dataOffset], &pollRun.Count, sizeof(uint32_t));
+	memcpy(&m_Buffer[dataOffset + sizeof(uint32_t)], &pollRun.LastTimestamp, sizeof(uint64_t));
+	SendRecord();
+}
+
+// ---------------------------------------------------------------------------------------------------------------------------------
+
+// Pausing only affects calls that start after it. A call already running records both halves
+void fulcrum_capture::SetPaused(bool fPaused) { fCapturePaused.store(fPaused, std::memory_order_relaxed); }
+bool fulcrum_capture::Paused() { return fCapturePaused.load(std::memory_order_relaxed); }
+unsigned long long fulcrum_capture::Skipped() { return nRecordsSkipped.load(std::memory_order_relaxed); }
+
+// Capture units are nanoseconds, the same as the clock hands out
+uint64_t fulcrum_capture::Timestamp()
+{
+	return fulcrumClock_Now();
+}
+
+// Folds an empty poll into the run for its thread and channel when it matches it. Anything else ends that run
+bool fulcrum_capture::CollapsePoll(unsigned long ChannelID, const PASSTHRU_MSG* pMsg, const unsigned long* pNumMsgs,
+	unsigned long reqNumMsgs, long retval, uint64_t pollTimestamp)
+{
+	// Only polls that came back with nothing can be folded
+	bool fEmptyPoll = pNumMsgs != NULL && *pNumMsgs == 0 && (retval == ERR_BUFFER_EMPTY || retval == STATUS_NOERROR);
+	if (!fEmptyPoll) { FlushPolls(); return false; }
+
+	// Same thread asking the same thing and getting the same answer just bumps the count.
+	// Runs are cut off every so often so the log keeps moving while an app sits polling
+	uint32_t threadID = GetCurrentThreadId();
+	uint64_t runKey = ((uint64_t)threadID << 32) | (uint32_t)ChannelID;
+	std::lock_guard<std::mutex> pollGuard(pollLock);
+	auto pendingEntry = m_PendingPolls.find(runKey);
+	if (pendingEntry != m_PendingPolls.end())
+	{
+		pollrun& pendingPolls = pendingEntry->second;
+		if (pendingPolls.pMsg == pMsg &&
+			pendingPolls.pNumMsgs == pNumMsgs &&
+			pendingPolls.RequestedCount == reqNumMsgs &&
+			pendingPolls.Retval == retval &&
+			pollTimestamp - pendingPolls.FirstTimestamp < FULCRUM_POLL_RUN_SPAN &&
+			pendingPolls.Count != UINT32_MAX)
+		{
+			pendingPolls.Count++;
+			pendingPolls.LastTimestamp = pollTimestamp;
+			return true;
+		}
+
+		// The run this one replaces is written before the lock is let go. Another channel flushing
+		// the new run can't get it into the log ahead of the old one
+		{ fulcrum_capture pollCapture(pendingPolls); }
+	}
+
+	pollrun& pendingPolls = m_PendingPolls[runKey];
+	pendingPolls.ThreadID = threadID;
+	pendingPolls.ChannelID = ChannelID;
+	pendingPolls.pMsg = pMsg;
+	pendingPolls.pNumMsgs = pNumMsgs;
+	pendingPolls.RequestedCount = reqNumMsgs;
+	pendingPolls.Retval = retval;
+	pendingPolls.Count = 1;
+	pendingPolls.FirstTimestamp = pollTimestamp;
+	pendingPolls.LastTimestamp = pollTimestamp;
+	fPollsPending.store(true, std::memory_order_release);
+	return true;
+}
+void fulcrum_capture::FlushPolls()
+{
+	if (!fPollsPending.load(std::memory_order_acquire)) return;
+
+	// Taking the runs and staging them happen under the same lock, so runs go out in the order they ended.
+	// Runs still open all end here, and go out in the order they started
+	std::lock_guard<std::mutex> pollGuard(pollLock);
+	std::vector<const pollrun*> pendingRuns;
+	for (auto pendingEntry = m_PendingPolls.begin(); pendingEntry != m_PendingPolls.end(); ++pendingEntry) pendingRuns.push_back(&pendingEntry->second);
+	std::sort(pendingRuns.begin(), pendingRuns.end(), [](const pollrun* pFirst, const pollrun* pSecond) { return pFirst->FirstTimestamp < pSecond->FirstTimestamp; });
+	for (size_t runIndex = 0; runIndex < pendingRuns.size(); runIndex++) { fulcrum_capture pollCapture(*pendingRuns[runIndex]); }
+	m_PendingPolls.clear();
+	fPollsPending.store(false, std::memory_order_relaxed);
+}
+void fulcrum_capture::FlushStalePolls(uint64_t nowTimestamp)
+{
+	if (!fPollsPending.load(std::memory_order_acquire)) return;
+
+	// Same ordering as FlushPolls(), only for the runs that have been open too long. Newer ones keep counting
+	std::lock_guard<std::mutex> pollGuard(pollLock);
+	std::vector<std::map<uint64_t, pollrun>::iterator> staleRuns;
+	for (auto pendingEntry = m_PendingPolls.begin(); pendingEntry != m_PendingPolls.end(); ++pendingEntry)
+		if (nowTimestamp - pendingEntry->second.FirstTimestamp >= FULCRUM_POLL_RUN_SPAN) staleRuns.push_back(pendingEntry);
+	if (staleRuns.empty()) return;
+
+	std::sort(staleRuns.begin(), staleRuns.end(), [](const std::map<uint64_t, pollrun>::iterator& firstRun, const std::map<uint64_t, pollrun>::iterator& secondRun) {
+		return firstRun->second.FirstTimestamp < secondRun->second.FirstTimestamp; });
+	for (size_t runIndex = 0; runIndex < staleRuns.size(); runIndex++) {
+		{ fulcrum_capture pollCapture(staleRuns[runIndex]->second); }
+		m_PendingPolls.erase(staleRuns[runIndex]);
+	}
+	if (m_PendingPolls.empty()) fPollsPending.store(false, std::memory_order_relaxed);
+}
+
+// ---------------------------------------------------------------------------------------------------------------------------------
+
+// Resets the buffer and writes a header for a new record. Length and field count are filled in by SendRecord()
+void fulcrum_capture::StartRecord(fulcrum_capture_record_type recordType, uint64_t recordTimestamp)
+{
+	fulcrum_capture_record_header recordHeader;
+	recordHeader.Length = 0;
+	recordHeader.Type = (uint16_t)recordType;
+	recordHeader.Function = (uint16_t)m_Function;
+	recordHeader.Timestamp = recordTimestamp;
+	recordHeader.ThreadID = GetCurrentThreadId();
+	recordHeader.FieldCount = 0;
+
+	m_Buffer.resize(sizeof(recordHeader));
+	memcpy(&m_Buffer[0], &recordHeader, sizeof(recordHeader));
+	m_nFieldCount = 0;
+}
+
+// Patches the record header and hands the record to the log writer thread
+void fulcrum_capture::SendRecord()
+{
+	if (m_fPaused) { nRecordsSkipped.fetch_add(1, std::memory_order_relaxed); return; }
+	fulcrum_capture_record_header* pHeader = (fulcrum_capture_record_header*)&m_Buffer[0];
+	pHeader->Length = (uint32_t)m_Buffer.size();
+	pHeader->FieldCount = m_nFieldCount;
+	fulcrum_output::fulcrumCapture(&m_Buffer[0], m_Buffer.size());
+}
+
+// Appends a field header and room for its data. Returns the offset the data starts at
+size_t fulcrum_capture::AddField(uint16_t fieldTag, uint8_t fieldIndex, uint8_t fieldFlags, size_t dataLength)
+{
+	fulcrum_capture_field_header fieldHeader;
+	fieldHeader.Tag = fieldTag;
+	fieldHeader.Index = fieldIndex;
+	fieldHeader.Flags = fieldFlags;
+	fieldHeader.Length = (uint32_t)dataLength;
+
+	size_t headerOffset = m_Buffer.size();
+	m_Buffer.resize(headerOffset + sizeof(fieldHeader) + dataLength);
+	memcpy(&m_Buffer[headerOffset], &fieldHeader, sizeof(fieldHeader));
+	m_nFieldCount++;
+	return headerOffset + sizeof(fieldHeader);
+}
+
+// Copies one message header and its data into a messages field
+void fulcrum_capture::AddMessage(size_t& writeOffset, const PASSTHRU_MSG* pMsg)
+{
+	fulcrum_capture_msg_header msgHeader;
+	msgHeader.ProtocolID = pMsg->ProtocolID;
+	msgHeader.RxStatus = pMsg->RxStatus;
+	msgHeader.TxFlags = pMsg->TxFlags;
+	msgHeader.Timestamp = pMsg->Timestamp;
+	msgHeader.DataSize = pMsg->DataSize;
+	msgHeader.ExtraDataIndex = pMsg->ExtraDataIndex;
+	memcpy(&m_Buffer[writeOffset], &msgHeader, sizeof(msgHeader));
+	writeOffset += sizeof(msgHeader);
+
+	// Only the bytes that are actually in use get stored
+	size_t dataLength = pMsg->DataSize < sizeof(pMsg->Data) ? pMsg->DataSize : sizeof(pMsg->Data);
+	if (dataLength > 0) memcpy(&m_Buffer[writeOffset], pMsg->Data, dataLength);
+	writeOffset += dataLength;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------------------
+
+// Call arguments. Stored in the order they're passed to the PassThru method
+void fulcrum_capture::Value(unsigned long argValue)
+{
+	uint32_t fieldValue = argValue;
+	size_t dataOffset = AddField(FIELD_ARG_VALUE, m_nArgIndex++, 0, sizeof(fieldValue));
+	memcpy(&m_Buffer[dataOffset], &fieldValue, sizeof(fieldValue));
+}
+void fulcrum_capture::Pointer(const void* argPointer)
+{
+	uint64_t fieldValue = (uint64_t)(uintptr_t)argPointer;
+	size_t dataOffset = AddField(FIELD_ARG_POINTER, m_nArgIndex++, argPointer == NULL ? FIELD_FLAG_NULL : 0, sizeof(fieldValue));
+	memcpy(&m_Buffer[dataOffset], &fieldValue, sizeof(fieldValue));
+}
+void fulcrum_capture::Begin()
+{
+	// Send the call header, then start collecting everything for the end record
+	SendRecord();
+	StartRecord(CAPTURE_CALL_END, 0);
+}
+
+// ---------------------------------------------------------------------------------------------------------------------------------
+
+// Message arrays. A NULL array or count pointer is recorded in the field flags
+void fulcrum_capture::Messages(fulcrum_capture_label msgLabel, const PASSTHRU_MSG* pMsgs, const unsigned long* pNumMsgs, bool isWrite)
+{
+	if (pMsgs == NULL || pNumMsgs == NULL)
+	{
+		uint8_t fieldFlags = isWrite ? FIELD_FLAG_WRITE : 0;
+		if (pMsgs == NULL) fieldFlags |= FIELD_FLAG_NULL;
+		if (pNumMsgs == NULL) fieldFlags |= FIELD_FLAG_COUNT_NULL;
+		AddField(FIELD_MESSAGES, (uint8_t)msgLabel, fieldFlags, 0);
+		return;
+	}
+
+	Messages(msgLabel, pMsgs, *pNumMsgs, isWrite);
+}
+void fulcrum_capture::Messages(fulcrum_capture_label msgLabel, const PASSTHRU_MSG* pMsgs, unsigned long numMsgs, bool isWrite)
+{
+	uint8_t fieldFlags = isWrite ? FIELD_FLAG_WRITE : 0;
+	if (pMsgs == NULL)
+	{
+		AddField(FIELD_MESSAGES, (uint8_t)msgLabel, fieldFlags | FIELD_FLAG_NULL, 0);
+		return;
+	}
+
+	// Size the field up front so the buffer only grows once
+	size_t dataLength = sizeof(uint32_t);
+	for (unsigned long i = 0; i < numMsgs; i++)
+		dataLength += sizeof(fulcrum_capture_msg_header) + (pMsgs[i].DataSize < sizeof(pMsgs[i].Data) ? pMsgs[i].DataSize : sizeof(pMsgs[i].Data));
+
+	size_t writeOffset = AddField(FIELD_MESSAGES, (uint8_t)msgLabel, fieldFlags, dataLength);
+	uint32_t msgCount = numMsgs;
+	memcpy(&m_Buffer[writeOffset], &msgCount, sizeof(msgCount));
+	writeOffset += sizeof(msgCount);
+	for (unsigned long i = 0; i < numMsgs; i++) AddMessage(writeOffset, &pMsgs[i]);
+}
+
+// Device and host times for messages read back on a channel. readTimestamp is when the read returned.
+// The tracker is fed even while capture is paused so it doesn't miss a wrap of the device counter
+void fulcrum_capture::MessageTimes(fulcrum_capture_label msgLabel, unsigned long ChannelID, const PASSTHRU_MSG* pMsgs, const unsigned long* pNumMsgs, uint64_t readTimestamp)
+{
+	if (pMsgs == NULL || pNumMsgs == NULL || *pNumMsgs == 0) return;
+	thread_local std::vector<fulcrum_timesync_point> msgTimes;
+	msgTimes.resize(*pNumMsgs);
+	unsigned long deviceID;
+	if (!fulcrumTimesync_Observe(ChannelID, pMsgs, *pNumMsgs, readTimestamp, deviceID, &msgTimes[0])) return;
+
+	uint32_t fieldHeader[2] = { (uint32_t)deviceID, (uint32_t)msgTimes.size() };
+	size_t timesLength = msgTimes.size() * sizeof(fulcrum_timesync_point);
+	size_t writeOffset = AddField(FIELD_MSG_TIMES, (uint8_t)msgLabel, 0, sizeof(fieldHeader) + timesLength);
+	memcpy(&m_Buffer[writeOffset], fieldHeader, sizeof(fieldHeader));
+	memcpy(&m_Buffer[writeOffset + sizeof(fieldHeader)], &msgTimes[0], timesLength);
+}
+
+// Config lists and byte arrays from PassThruIoctl
+void fulcrum_capture::SConfig(const SCONFIG_LIST* pList)
+{
+	if (pList == NULL)
+	{
+		AddField(FIELD_SCONFIG, LABEL_NONE, FIELD_FLAG_NULL, 0);
+		return;
+	}
+
+	uint32_t paramCount = pList->NumOfParams;
+	uint64_t configPointer = (uint64_t)(uintptr_t)pList->ConfigPtr;
+	size_t pairCount = pList->ConfigPtr == NULL ? 0 : paramCount;
+	size_t writeOffset = AddField(FIELD_SCONFIG, LABEL_NONE, pList->ConfigPtr == NULL ? FIELD_FLAG_DATA_NULL : 0,
+		sizeof(paramCount) + sizeof(configPointer) + pairCount * 2 * sizeof(uint32_t));
+
+	memcpy(&m_Buffer[writeOffset], &paramCount, sizeof(paramCount)); writeOffset += sizeof(paramCount);
+	memcpy(&m_Buffer[writeOffset], &configPointer, sizeof(configPointer)); writeOffset += sizeof(configPointer);
+	for (size_t i = 0; i < pairCount; i++)
+	{
+		uint32_t configPair[2] = { (uint32_t)pList->ConfigPtr[i].Parameter, (uint32_t)pList->ConfigPtr[i].Value };
+		memcpy(&m_Buffer[writeOffset], configPair, sizeof(configPair));
+		writeOffset += sizeof(configPair);
+	}
+}
+void fulcrum_capture::SByte(fulcrum_capture_label byteLabel, const SBYTE_ARRAY* pArray)
+{
+	if (pArray == NULL)
+	{
+		AddField(FIELD_SBYTE, (uint8_t)byteLabel, FIELD_FLAG_NULL, 0);
+		return;
+	}
+
+	uint32_t byteCount = pArray->NumOfBytes;
+	uint64_t bytePointer = (uint64_t)(uintptr_t)pArray->BytePtr;
+	size_t dataLength = pArray->BytePtr == NULL ? 0 : byteCount;
+	size_t writeOffset = AddField(FIELD_SBYTE, (uint8_t)byteLabel, pArray->BytePtr == NULL ? FIELD_FLAG_DATA_NULL : 0,
+		sizeof(byteCount) + sizeof(bytePointer) + dataLength);
+
+	memcpy(&m_Buffer[writeOffset], &byteCount, sizeof(byteCount)); writeOffset += sizeof(byteCount);
+	memcpy(&m_Buffer[writeOffset], &bytePointer, sizeof(bytePointer)); writeOffset += sizeof(bytePointer);
+	if (dataLength > 0) memcpy(&m_Buffer[writeOffset], pArray->BytePtr, dataLength);
+}
+
+// Small fixed size values logged around the call
+void fulcrum_capture::ConnectFlags(unsigned long connectFlags)
+{
+	uint32_t fieldValue = connectFlags;
+	size_t dataOffset = AddField(FIELD_CONNECT_FLAGS, LABEL_NONE, 0, sizeof(fieldValue));
+	memcpy(&m_Buffer[dataOffset], &fieldValue, sizeof(fieldValue));
+}
+void fulcrum_capture::MsgCount(fulcrum_capture_label countLabel, unsigned long actualCount, unsigned long requestedCount)
+{
+	uint32_t fieldValues[2] = { (uint32_t)actualCount, (uint32_t)requestedCount };
+	size_t dataOffset = AddField(FIELD_MSG_COUNT, (uint8_t)countLabel, 0, sizeof(fieldValues));
+	memcpy(&m_Buffer[dataOffset], fieldValues, sizeof(fieldValues));
+}
+void fulcrum_capture::ReturnedID(fulcrum_capture_label idLabel, const unsigned long* pID)
+{
+	if (pID == NULL)
+	{
+		AddField(FIELD_RETURNED_ID, (uint8_t)idLabel, FIELD_FLAG_NULL, 0);
+		return;
+	}
+
+	uint32_t fieldValue = *pID;
+	size_t dataOffset = AddField(FIELD_RETURNED_ID, (uint8_t)idLabel, 0, sizeof(fieldValue));
+	memcpy(&m_Buffer[dataOffset], &fieldValue, sizeof(fieldValue));
+}
+void fulcrum_capture::Voltage(fulcrum_capture_label voltLabel, unsigned long pinNumber, unsigned long milliVolts)
+{
+	uint32_t fieldValues[2] = { (uint32_t)pinNumber, (uint32_t)milliVolts };
+	size_t dataOffset = AddField(FIELD_VOLTAGE, (uint8_t)voltLabel, 0, sizeof(fieldValues));
+	memcpy(&m_Buffer[dataOffset], fieldValues, sizeof(fieldValues));
+}
+void fulcrum_capture::Text(fulcrum_capture_label textLabel, const char* szText)
+{
+	if (szText == NULL)
+	{
+		AddField(FIELD_TEXT, (uint8_t)textLabel, FIELD_FLAG_NULL, 0);
+		return;
+	}
+
+	size_t textLength = strlen(szText);
+	size_t dataOffset = AddField(FIELD_TEXT, (uint8_t)textLabel, 0, textLength);
+	if (textLength > 0) memcpy(&m_Buffer[dataOffset], szText, textLength);
+}
+
+// ---------------------------------------------------------------------------------------------------------------------------------
+
+// Stores the return value (and the error text for failures) and sends the end record
+long fulcrum_capture::End(long retval, bool includeDescription)
+{
+	// The end record is stamped when the call returns, not when it started
+	fulcrum_capture_record_header* pHeader = (fulcrum_capture_record_header*)&m_Buffer[0];
+	pHeader->Timestamp = Timestamp();
+
+	uint32_t fieldValue = (uint32_t)retval;
+	size_t dataOffset = AddField(FIELD_RETVAL, LABEL_NONE, includeDescription ? 0 : FIELD_FLAG_NO_DESCRIPTION, sizeof(fieldValue));
+	memcpy(&m_Buffer[dataOffset], &fieldValue, sizeof(fieldValue));
+
+	// Failures get the error text right away. It's gone once the app makes another call
+	if (includeDescription &&
+		retval != STATUS_NOERROR &&
+		retval != ERR_TIMEOUT &&
+		retval != ERR_BUFFER_EMPTY)
+	{
+		char szErrorDescription[80] = { 0 };
+		fulcrum_PassThruGetLastError(szErrorDescription);
+		szErrorDescription[sizeof(szErrorDescription) - 1] = '\0';
+
+		size_t textLength = strlen(szErrorDescription);
+		dataOffset = AddField(FIELD_ERROR_TEXT, LABEL_ERROR_DESCRIPTION, 0, textLength);
+		if (textLength > 0) memcpy(&m_Buffer[dataOffset], szErrorDescription, textLength);
+	}
+
+	SendRecord();
+	return retval;
+}
\ No newline at end of file
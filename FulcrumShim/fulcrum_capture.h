@@ -0,0 +1,111 @@
+/*
+**
+** Copyright (C) 2022 MEAT Inc
+** Author: Zack Walsh <neo.smith@motorengineeringandtech.com>
+**
+** This library is free software; you can redistribute it and/or modify
+** it under the terms of the GNU Lesser General Public License as published
+** by the Free Software Foundation, either version 3 of the License, or (at
+** your option) any later version.
+**
+** This library is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+** Lesser General Public License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public
+** License along with this library; if not, <http://www.gnu.org/licenses/>.
+**
+*/
+
+
+#pragma once
+
+// Standard Imports
+#include <map>
+#include <vector>
+
+// Fulcrum Resource Imports
+#include "fulcrum_j2534.h"
+#include "fulcrum_capture_format.h"
+
+// Longest a run of empty polls is held before it's written out. A poll past it starts a new run, and
+// the log writer thread writes out runs this old on its own when the app stops calling
+#define FULCRUM_POLL_RUN_SPAN (FULCRUM_CAPTURE_TIMESTAMP_UNITS)
+
+// Builds the binary capture records for a single PassThru call. Arguments are added
+// before Begin(), anything logged while the call runs is added before End().
+// Records are only copied here. Formatting them into text happens on the log writer thread
+class fulcrum_capture {
+public:
+	fulcrum_capture(fulcrum_capture_function captureFunction);
+	fulcrum_capture(fulcrum_capture_function captureFunction, uint64_t beginTimestamp);
+
+	// Current time in capture timestamp units
+	static uint64_t Timestamp();
+
+	// Capture can be paused and resumed from any thread. Records for calls made while paused are counted and thrown away
+	static void SetPaused(bool fPaused);
+	static bool Paused();
+	static unsigned long long Skipped();
+
+	// Empty PassThruReadMsgs polls with no timeout are folded into one counted record instead of
+	// a begin and end record each. Every thread and channel has a run of its own, so apps polling
+	// several channels still get theirs folded. Returns true when the poll went into a run. Every
+	// other call writes out all pending runs, oldest first, before its own records so they stay in
+	// order with real traffic. Callers hold the handle_lock for the channel
+	static bool CollapsePoll(unsigned long ChannelID, const PASSTHRU_MSG* pMsg, const unsigned long* pNumMsgs,
+		unsigned long reqNumMsgs, long retval, uint64_t pollTimestamp);
+	static void FlushPolls();
+
+	// Writes out the runs that started FULCRUM_POLL_RUN_SPAN or more before nowTimestamp. The log writer
+	// thread calls this every pass so a run isn't held forever by an app that went idle mid run
+	static void FlushStalePolls(uint64_t nowTimestamp);
+
+	// Call arguments for the header line. Sent out by Begin()
+	void Value(unsigned long argValue);
+	void Pointer(const void* argPointer);
+	void Begin();
+
+	// Data logged while the call runs. Sent out by End()
+	void Messages(fulcrum_capture_label msgLabel, const PASSTHRU_MSG* pMsgs, const unsigned long* pNumMsgs, bool isWrite);
+	void Messages(fulcrum_capture_label msgLabel, const PASSTHRU_MSG* pMsgs, unsigned long numMsgs, bool isWrite);
+	void MessageTimes(fulcrum_capture_label msgLabel, unsigned long ChannelID, const PASSTHRU_MSG* pMsgs, const unsigned long* pNumMsgs, uint64_t readTimestamp);
+	void SConfig(const SCONFIG_LIST* pList);
+	void SByte(fulcrum_capture_label byteLabel, const SBYTE_ARRAY* pArray);
+	void ConnectFlags(unsigned long connectFlags);
+	void MsgCount(fulcrum_capture_label countLabel, unsigned long actualCount, unsigned long requestedCount);
+	void ReturnedID(fulcrum_capture_label idLabel, const unsigned long* pID);
+	void Voltage(fulcrum_capture_label voltLabel, unsigned long pinNumber, unsigned long milliVolts);
+	void Text(fulcrum_capture_label textLabel, const char* szText);
+
+	// Closes out the call with its return value. Returns retval so callers can return this directly
+	long End(long retval, bool includeDescription = true);
+
+private:
+	// Run of empty polls waiting to be written
+	struct pollrun {
+		uint32_t ThreadID;
+		unsigned long ChannelID;
+		const PASSTHRU_MSG* pMsg;
+		const unsigned long* pNumMsgs;
+		unsigned long RequestedCount;
+		long Retval;
+		uint32_t Count;
+		uint64_t FirstTimestamp;
+		uint64_t LastTimestamp;
+	};
+	static std::map<uint64_t, pollrun> m_PendingPolls;	// Keyed by thread and channel
+	explicit fulcrum_capture(const pollrun& pollRun);
+
+	void StartRecord(fulcrum_capture_record_type recordType, uint64_t recordTimestamp);
+	void SendRecord();
+	size_t AddField(uint16_t fieldTag, uint8_t fieldIndex, uint8_t fieldFlags, size_t dataLength);
+	void AddMessage(size_t& writeOffset, const PASSTHRU_MSG* pMsg);
+
+	fulcrum_capture_function m_Function;
+	std::vector<unsigned char>& m_Buffer;
+	uint32_t m_nFieldCount;
+	uint8_t m_nArgIndex;
+	bool m_fPaused;
+};
\ No newline at end of file
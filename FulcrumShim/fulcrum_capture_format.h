@@ -0,0 +1,236 @@
+/*
+**
+** Copyright (C) 2022 MEAT Inc
+** Author: Zack Walsh <neo.smith@motorengineeringandtech.com>
+**
+** This library is free software; you can redistribute it and/or modify
+** it under the terms of the GNU Lesser General Public License as published
+** by the Free Software Foundation, either version 3 of the License, or (at
+** your option) any later version.
+**
+** This library is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+** Lesser General Public License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public
+** License along with this library; if not, <http://www.gnu.org/licenses/>.
+**
+*/
+
+#pragma once
+
+// Standard Imports
+#include <stdint.h>
+
+// Layout of the .shimBin capture files. This header is shared by the shim (writer)
+// and the capture reader so it must only use fixed size types and no Windows headers.
+//
+//   File:   fulcrum_capture_file_header, then records back to back until EOF (or a zero Length)
+//   Record: fulcrum_capture_record_header, then FieldCount fields
+//   Field:  fulcrum_capture_field_header, then Length bytes of field data
+//
+// All values are little endian. Every PassThru call writes a CALL_BEGIN record when it
+// starts and a CALL_END record when it returns so the records interleave correctly with
+// anything else the shim logs while the call is running.
+//
+// Live captures are written as preallocated segment files. Those have FULCRUM_CAPTURE_FLAG_SEGMENTED
+// set and a fulcrum_capture_segment_header after the file header (HeaderSize covers both). A finished
+// segment ends with a CAPTURE_SEGMENT_INDEX record whose last 8 bytes hold the offset of that record.
+// A segment that was never finished (the app crashed) just has zeros after its last record.
+//
+// Captures may also be written in compressed blocks (FULCRUM_CAPTURE_FLAG_COMPRESSED). A block is a
+// CAPTURE_COMPRESSED_BLOCK record holding a run of ordinary records packed with fulcrum_lz. Blocks
+// don't share any history, so each one can be unpacked on its own once a reader has found it.
+// Segment headers and footer indexes of a compressed capture count blocks, not the records inside them.
+//
+// Back to back PassThruReadMsgs polls with no timeout that came back empty are folded into one
+// CAPTURE_POLL_RUN record. It holds the arguments of a begin record, then the return value and a
+// FIELD_POLL_COUNT field with how many polls it covers and when the last one ran.
+//
+// Messages read back from a channel whose device is known are followed by a FIELD_MSG_TIMES field. It
+// holds each message's device counter unwrapped to 64 bits and the record timestamp that counter value
+// maps to, so reads from different channels, devices and sessions can be merged in the order they happened.
+
+#define FULCRUM_CAPTURE_MAGIC "FULCRUMB"
+#define FULCRUM_CAPTURE_MAGIC_SIZE 8
+#define FULCRUM_CAPTURE_VERSION 1
+#define FULCRUM_CAPTURE_EXTENSION ".shimBin"
+#define FULCRUM_CAPTURE_MAX_DATA 4128
+#define FULCRUM_CAPTURE_TIMESTAMP_UNITS 1000000000ULL
+
+// Bits stored in the Flags of the file header
+#define FULCRUM_CAPTURE_FLAG_SEGMENTED 0x01		// File is one segment of a capture. Segment header follows
+#define FULCRUM_CAPTURE_FLAG_COMPRESSED 0x02	// Records are stored inside compressed blocks
+
+// Types of records stored in a capture file
+enum fulcrum_capture_record_type {
+	CAPTURE_CALL_BEGIN = 1,		// Arguments for a PassThru call before we invoke the real DLL
+	CAPTURE_CALL_END = 2,		// Data logged while the call ran, outputs, and the return value
+	CAPTURE_LOG_MESSAGE = 3,	// Deferred debug line. Format ID and raw argument bytes only
+	CAPTURE_FORMAT_DEFINE = 4,	// Format string for an ID. Written before the first message using it
+	CAPTURE_SEGMENT_INDEX = 5,	// Footer index for a finished segment. Always the last record in the file
+	CAPTURE_COMPRESSED_BLOCK = 6,	// Run of records packed together. Timestamp is the first record's
+	CAPTURE_POLL_RUN = 7,		// Identical empty PassThruReadMsgs polls folded together. Timestamp is the first poll's
+};
+
+// PassThru methods which write capture records
+enum fulcrum_capture_function {
+	CAPTURE_FN_NONE = 0,
+	CAPTURE_FN_OPEN = 1,
+	CAPTURE_FN_CLOSE = 2,
+	CAPTURE_FN_CONNECT = 3,
+	CAPTURE_FN_DISCONNECT = 4,
+	CAPTURE_FN_READ_MSGS = 5,
+	CAPTURE_FN_WRITE_MSGS = 6,
+	CAPTURE_FN_START_PERIODIC_MSG = 7,
+	CAPTURE_FN_STOP_PERIODIC_MSG = 8,
+	CAPTURE_FN_START_MSG_FILTER = 9,
+	CAPTURE_FN_STOP_MSG_FILTER = 10,
+	CAPTURE_FN_SET_PROGRAMMING_VOLTAGE = 11,
+	CAPTURE_FN_READ_VERSION = 12,
+	CAPTURE_FN_GET_LAST_ERROR = 13,
+	CAPTURE_FN_IOCTL = 14,
+	CAPTURE_FN_GET_NEXT_CARDAQ = 15,
+	CAPTURE_FN_READ_DETAILS = 16,
+};
+
+// Types of fields a record can carry
+enum fulcrum_capture_field_tag {
+	FIELD_ARG_VALUE = 1,		// uint32 argument. Index is the argument position
+	FIELD_ARG_POINTER = 2,		// uint64 pointer argument. Index is the argument position
+	FIELD_RETVAL = 3,			// uint32 return value. Flags may hold FIELD_FLAG_NO_DESCRIPTION
+	FIELD_ERROR_TEXT = 4,		// Narrow error description for a failed return value
+	FIELD_MESSAGES = 5,			// uint32 count, then count x (fulcrum_capture_msg_header + DataSize bytes)
+	FIELD_SCONFIG = 6,			// uint32 count, uint64 ConfigPtr, then count x (uint32 Parameter, uint32 Value)
+	FIELD_SBYTE = 7,			// uint32 NumOfBytes, uint64 BytePtr, then NumOfBytes bytes
+	FIELD_CONNECT_FLAGS = 8,	// uint32 connect flags passed to PassThruConnect
+	FIELD_MSG_COUNT = 9,		// uint32 actual count, uint32 requested count
+	FIELD_RETURNED_ID = 10,		// uint32 ID handed back to the caller. Flags may hold FIELD_FLAG_NULL
+	FIELD_VOLTAGE = 11,			// uint32 pin, uint32 millivolts
+	FIELD_TEXT = 12,			// Narrow string as handed back by the J2534 DLL. Index is a fulcrum_capture_label
+	FIELD_LOG_ARGS = 13,		// uint32 format ID, then packed arguments (uint8 fulcrum_deferred_arg type + value)
+	FIELD_FORMAT_TEXT = 14,		// uint32 format ID, then the UTF-16LE printf format string
+	FIELD_INDEX_ENTRIES = 15,	// uint32 count, then count x fulcrum_capture_index_entry
+	FIELD_INDEX_OFFSET = 16,	// uint64 file offset of the index record itself. Always the last field
+	FIELD_BLOCK_DATA = 17,		// fulcrum_capture_block_header, then the packed records. Flags may hold FIELD_FLAG_STORED
+	FIELD_POLL_COUNT = 18,		// uint32 number of polls in the run, uint64 timestamp of the last one
+	FIELD_MSG_TIMES = 19,		// uint32 DeviceID, uint32 count, then count x (uint64 device microseconds, uint64 timestamp)
+};
+
+// Argument types packed into FIELD_LOG_ARGS
+enum fulcrum_deferred_arg {
+	DEFERRED_ARG_INT32 = 1,		// int32
+	DEFERRED_ARG_UINT32 = 2,	// uint32
+	DEFERRED_ARG_INT64 = 3,		// int64
+	DEFERRED_ARG_UINT64 = 4,	// uint64
+	DEFERRED_ARG_DOUBLE = 5,	// IEEE double
+	DEFERRED_ARG_POINTER = 6,	// uint64
+	DEFERRED_ARG_STRING = 7,	// uint32 length (0xFFFFFFFF for NULL), then narrow chars
+	DEFERRED_ARG_WSTRING = 8,	// uint32 length (0xFFFFFFFF for NULL), then UTF-16LE units
+	DEFERRED_ARG_J2534_NAME = 9,	// uint8 fulcrum_deferred_table, uint32 value. Named by the J2534 string tables when formatted
+};
+
+// String tables for DEFERRED_ARG_J2534_NAME
+enum fulcrum_deferred_table {
+	DEFERRED_NAME_RETURN = 1,
+	DEFERRED_NAME_PROTOCOL = 2,
+	DEFERRED_NAME_FILTER = 3,
+	DEFERRED_NAME_IOCTL = 4,
+	DEFERRED_NAME_PARAM = 5,
+};
+
+// Labels stored in the Index of data fields
+enum fulcrum_capture_label {
+	LABEL_NONE = 0,
+	LABEL_MSG = 1,
+	LABEL_MASK = 2,
+	LABEL_PATTERN = 3,
+	LABEL_FLOW_CONTROL = 4,
+	LABEL_INPUT = 5,
+	LABEL_OUTPUT = 6,
+	LABEL_ADD = 7,
+	LABEL_DELETE = 8,
+	LABEL_READ = 9,
+	LABEL_SENT = 10,
+	LABEL_DEVICE_ID = 11,
+	LABEL_CHANNEL_ID = 12,
+	LABEL_PERIODIC_ID = 13,
+	LABEL_FILTER_ID = 14,
+	LABEL_FIRMWARE = 15,
+	LABEL_DLL = 16,
+	LABEL_API = 17,
+	LABEL_PIN = 18,
+	LABEL_VOLTS = 19,
+	LABEL_ERROR_DESCRIPTION = 20,
+};
+
+// Bits stored in the Flags of a field header
+#define FIELD_FLAG_NULL 0x01				// The pointer for this field was NULL (no data follows)
+#define FIELD_FLAG_COUNT_NULL 0x02			// The count pointer for this field was NULL
+#define FIELD_FLAG_DATA_NULL 0x04			// The inner data pointer (ConfigPtr, BytePtr) was NULL
+#define FIELD_FLAG_WRITE 0x08				// Messages are outgoing (TxFlags) instead of incoming (RxStatus)
+#define FIELD_FLAG_NO_DESCRIPTION 0x10		// Return value is logged without the error description
+#define FIELD_FLAG_STORED 0x20				// Block data didn't compress and is stored as it is
+
+#pragma pack(push, 1)
+
+// Header written once at the start of every capture file
+struct fulcrum_capture_file_header {
+	char Magic[FULCRUM_CAPTURE_MAGIC_SIZE];		// Always FULCRUM_CAPTURE_MAGIC
+	uint16_t Version;							// FULCRUM_CAPTURE_VERSION
+	uint16_t HeaderSize;						// sizeof(fulcrum_capture_file_header)
+	uint32_t Flags;								// Reserved
+	uint64_t TimestampUnits;					// Record timestamp ticks per second (FULCRUM_CAPTURE_TIMESTAMP_UNITS)
+};
+
+// Follows the file header in segmented captures
+struct fulcrum_capture_segment_header {
+	uint32_t SegmentIndex;		// 0 for the first segment of a capture
+	uint32_t Reserved;
+	uint64_t FirstRecord;		// Number of records written to earlier segments
+	uint64_t FirstTimestamp;	// Timestamp of the first record in this segment (0 if unknown)
+};
+
+// Entry in a segment's footer index. Written every so often, not for every record
+struct fulcrum_capture_index_entry {
+	uint64_t Offset;			// File offset of the record
+	uint64_t RecordNumber;		// Record number across the whole capture
+	uint64_t Timestamp;			// Timestamp of the record
+};
+
+// Leads the data of a FIELD_BLOCK_DATA field
+struct fulcrum_capture_block_header {
+	uint32_t RawSize;			// Bytes of records once the block is unpacked
+	uint32_t RecordCount;		// Number of records in the block
+};
+
+// Header for every record in the file
+struct fulcrum_capture_record_header {
+	uint32_t Length;			// Bytes in this record including this header
+	uint16_t Type;				// fulcrum_capture_record_type
+	uint16_t Function;			// fulcrum_capture_function
+	uint64_t Timestamp;			// Time since the shim was loaded in TimestampUnits
+	uint32_t ThreadID;			// Thread which made the call
+	uint32_t FieldCount;		// Number of fields following this header
+};
+
+// Header for every field inside a record
+struct fulcrum_capture_field_header {
+	uint16_t Tag;				// fulcrum_capture_field_tag
+	uint8_t Index;				// Argument position or fulcrum_capture_label
+	uint8_t Flags;				// FIELD_FLAG_* bits
+	uint32_t Length;			// Bytes of field data following this header
+};
+
+// Copy of the PASSTHRU_MSG header with fixed size members
+struct fulcrum_capture_msg_header {
+	uint32_t ProtocolID;
+	uint32_t RxStatus;
+	uint32_t TxFlags;
+	uint32_t Timestamp;
+	uint32_t DataSize;
+	uint32_t ExtraDataIndex;
+};
+
+#pragma pack(pop)
\ No newline at end of file
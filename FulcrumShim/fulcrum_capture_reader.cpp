@@ -0,0 +1,255 @@
+/*
+**
+** Copyright (C) 2022 MEAT Inc
+** Author: Zack Walsh <neo.smith@motorengineeringandtech.com>
+**
+** This library is free software; you can redistribute it and/or modify
+** it under the terms of the GNU Lesser General Public License as published
+** by the Free Software Foundation, either version 3 of the License, or (at
+** your option) any later version.
+**
+** This library is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+** Lesser General Public License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public
+** License along with this library; if not, <http://www.gnu.org/licenses/>.
+**
+*/
+
+
+// Standard Imports
+#include <stdio.h>
+#include <string.h>
+
+// Fulcrum Resource Imports
+#include "fulcrum_capture_reader.h"
+#include "fulcrum_lz.h"
+
+// Largest record we'll believe when reading a file. Anything bigger means the file is damaged
+#define FULCRUM_CAPTURE_MAX_RECORD (64 * 1024 * 1024)
+
+// Field value helpers
+uint32_t fulcrum_capture_field::ReadUint32(size_t dataOffset) const
+{
+	uint32_t fieldValue = 0;
+	if (dataOffset + sizeof(fieldValue) <= Length) memcpy(&fieldValue, Data + dataOffset, sizeof(fieldValue));
+	return fieldValue;
+}
+uint64_t fulcrum_capture_field::ReadUint64(size_t dataOffset) const
+{
+	uint64_t fieldValue = 0;
+	if (dataOffset + sizeof(fieldValue) <= Length) memcpy(&fieldValue, Data + dataOffset, sizeof(fieldValue));
+	return fieldValue;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------------------
+
+// CTOR for an empty record
+fulcrum_capture_record::fulcrum_capture_record()
+	: m_pRecord(NULL)
+	, m_nLength(0)
+	, m_iNextField(0)
+{
+	memset(&m_Header, 0, sizeof(m_Header));
+}
+
+// Checks the record header against the buffer we were given
+bool fulcrum_capture_record::Parse(const uint8_t* pRecord, size_t nLength)
+{
+	if (pRecord == NULL || nLength < sizeof(m_Header)) return false;
+	memcpy(&m_Header, pRecord, sizeof(m_Header));
+	if (m_Header.Length < sizeof(m_Header) || m_Header.Length > nLength) return false;
+
+	m_pRecord = pRecord;
+	m_nLength = m_Header.Length;
+	m_iNextField = sizeof(m_Header);
+	return true;
+}
+void fulcrum_capture_record::Rewind()
+{
+	m_iNextField = sizeof(m_Header);
+}
+
+// Returns the next field in the record. Stops at the end or at the first damaged field
+bool fulcrum_capture_record::NextField(fulcrum_capture_field& field)
+{
+	if (m_pRecord == NULL) return false;
+	if (m_iNextField + sizeof(fulcrum_capture_field_header) > m_nLength) return false;
+
+	fulcrum_capture_field_header fieldHeader;
+	memcpy(&fieldHeader, m_pRecord + m_iNextField, sizeof(fieldHeader));
+	size_t dataOffset = m_iNextField + sizeof(fieldHeader);
+	if (fieldHeader.Length > m_nLength - dataOffset) return false;
+
+	field.Tag = fieldHeader.Tag;
+	field.Index = fieldHeader.Index;
+	field.Flags = fieldHeader.Flags;
+	field.Length = fieldHeader.Length;
+	field.Data = m_pRecord + dataOffset;
+	m_iNextField = dataOffset + fieldHeader.Length;
+	return true;
+}
+
+// Message layout is a count followed by (header, data) pairs. The count is skipped on the first call
+bool fulcrum_capture_record::NextMessage(const fulcrum_capture_field& field, size_t& dataOffset, fulcrum_capture_msg_header& msgHeader, const uint8_t*& pMsgData)
+{
+	if (field.Tag != FIELD_MESSAGES) return false;
+	if (dataOffset == 0) dataOffset = sizeof(uint32_t);
+	if (dataOffset + sizeof(msgHeader) > field.Length) return false;
+
+	memcpy(&msgHeader, field.Data + dataOffset, sizeof(msgHeader));
+	size_t dataLength = msgHeader.DataSize < FULCRUM_CAPTURE_MAX_DATA ? msgHeader.DataSize : FULCRUM_CAPTURE_MAX_DATA;
+	if (dataOffset + sizeof(msgHeader) + dataLength > field.Length) return false;
+
+	pMsgData = field.Data + dataOffset + sizeof(msgHeader);
+	dataOffset += sizeof(msgHeader) + dataLength;
+	return true;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------------------
+
+// CTOR and DCTOR for the reader
+fulcrum_capture_reader::fulcrum_capture_reader()
+	: m_pFile(NULL)
+	, m_fOwnsFile(false)
+	, m_nBlockOffset(0)
+	, m_pRecordData(NULL)
+	, m_nRecordLength(0)
+	, m_nRecordsRead(0)
+{
+	memset(&m_FileHeader, 0, sizeof(m_FileHeader));
+	memset(&m_SegmentHeader, 0, sizeof(m_SegmentHeader));
+}
+fulcrum_capture_reader::~fulcrum_capture_reader()
+{
+	Close();
+}
+
+// Opening and closing capture files
+bool fulcrum_capture_reader::Open(const char* szPath)
+{
+	Close();
+#ifdef _MSC_VER
+	if (fopen_s(&m_pFile, szPath, "rb") != 0) m_pFile = NULL;
+#else
+	m_pFile = fopen(szPath, "rb");
+#endif
+	if (m_pFile == NULL) return false;
+
+	m_fOwnsFile = true;
+	if (ReadFileHeader()) return true;
+	Close();
+	return false;
+}
+bool fulcrum_capture_reader::Open(FILE* pFile)
+{
+	Close();
+	if (pFile == NULL) return false;
+
+	m_pFile = pFile;
+	m_fOwnsFile = false;
+	if (ReadFileHeader()) return true;
+	Close();
+	return false;
+}
+void fulcrum_capture_reader::Close()
+{
+	if (m_pFile != NULL && m_fOwnsFile) fclose(m_pFile);
+	m_pFile = NULL;
+	m_fOwnsFile = false;
+	m_nRecordsRead = 0;
+	m_Buffer.clear();
+	m_Block.clear();
+	m_nBlockOffset = 0;
+	m_pRecordData = NULL;
+	m_nRecordLength = 0;
+}
+
+// Checks the magic and version, then skips any header bytes newer versions added
+bool fulcrum_capture_reader::ReadFileHeader()
+{
+	if (fread(&m_FileHeader, sizeof(m_FileHeader), 1, m_pFile) != 1) return false;
+	if (memcmp(m_FileHeader.Magic, FULCRUM_CAPTURE_MAGIC, FULCRUM_CAPTURE_MAGIC_SIZE) != 0) return false;
+	if (m_FileHeader.Version > FULCRUM_CAPTURE_VERSION) return false;
+	if (m_FileHeader.HeaderSize < sizeof(m_FileHeader)) return false;
+
+	// Segments of a live capture carry a segment header right behind the file header
+	size_t nHeaderRead = sizeof(m_FileHeader);
+	memset(&m_SegmentHeader, 0, sizeof(m_SegmentHeader));
+	if ((m_FileHeader.Flags & FULCRUM_CAPTURE_FLAG_SEGMENTED) != 0 && m_FileHeader.HeaderSize >= nHeaderRead + sizeof(m_SegmentHeader)) {
+		if (fread(&m_SegmentHeader, sizeof(m_SegmentHeader), 1, m_pFile) != 1) return false;
+		nHeaderRead += sizeof(m_SegmentHeader);
+	}
+	if (m_FileHeader.HeaderSize > nHeaderRead)
+		return fseek(m_pFile, (long)(m_FileHeader.HeaderSize - nHeaderRead), SEEK_CUR) == 0;
+
+	return true;
+}
+
+// Unpacks the block record sitting in our buffer so its records can be handed out one at a time
+bool fulcrum_capture_reader::UnpackBlock()
+{
+	fulcrum_capture_record blockRecord;
+	fulcrum_capture_field blockField;
+	if (!blockRecord.Parse(&m_Buffer[0], m_Buffer.size()) || !blockRecord.NextField(blockField)) return false;
+	if (blockField.Tag != FIELD_BLOCK_DATA || blockField.Length < sizeof(fulcrum_capture_block_header)) return false;
+
+	fulcrum_capture_block_header blockHeader;
+	memcpy(&blockHeader, blockField.Data, sizeof(blockHeader));
+	if (blockHeader.RawSize > FULCRUM_CAPTURE_MAX_RECORD) return false;
+
+	const uint8_t* pPacked = blockField.Data + sizeof(blockHeader);
+	size_t nPacked = blockField.Length - sizeof(blockHeader);
+	m_Block.resize(blockHeader.RawSize);
+	m_nBlockOffset = 0;
+	if (blockHeader.RawSize == 0) return true;
+	if ((blockField.Flags & FIELD_FLAG_STORED) == 0) return fulcrumLZ_Decompress(pPacked, nPacked, &m_Block[0], m_Block.size());
+	if (nPacked != m_Block.size()) return false;
+	memcpy(&m_Block[0], pPacked, nPacked);
+	return true;
+}
+
+// Reads the length out of the record header, then the rest of the record behind it
+bool fulcrum_capture_reader::ReadRecord(fulcrum_capture_record& record)
+{
+	if (m_pFile == NULL) return false;
+
+	for (;;)
+	{
+		// Hand out whatever is left in the block we unpacked last
+		if (m_nBlockOffset + sizeof(fulcrum_capture_record_header) <= m_Block.size())
+		{
+			if (!record.Parse(&m_Block[m_nBlockOffset], m_Block.size() - m_nBlockOffset)) return false;
+			m_pRecordData = &m_Block[m_nBlockOffset];
+			m_nRecordLength = record.Header().Length;
+			m_nBlockOffset += m_nRecordLength;
+			m_nRecordsRead++;
+			return true;
+		}
+		m_Block.clear();
+		m_nBlockOffset = 0;
+
+		fulcrum_capture_record_header recordHeader;
+		if (fread(&recordHeader, sizeof(recordHeader), 1, m_pFile) != 1) return false;
+		if (recordHeader.Length < sizeof(recordHeader) || recordHeader.Length > FULCRUM_CAPTURE_MAX_RECORD) return false;
+
+		m_Buffer.resize(recordHeader.Length);
+		memcpy(&m_Buffer[0], &recordHeader, sizeof(recordHeader));
+		size_t bodyLength = recordHeader.Length - sizeof(recordHeader);
+		if (bodyLength > 0 && fread(&m_Buffer[sizeof(recordHeader)], 1, bodyLength, m_pFile) != bodyLength) return false;
+
+		// Blocks go back around the loop to hand out their first record
+		if (recordHeader.Type == CAPTURE_COMPRESSED_BLOCK) {
+			if (!UnpackBlock()) return false;
+			continue;
+		}
+
+		if (!record.Parse(&m_Buffer[0], m_Buffer.size())) return false;
+		m_pRecordData = &m_Buffer[0];
+		m_nRecordLength = m_Buffer.size();
+		m_nRecordsRead++;
+		return true;
+	}
+}
\ No newline at end of file
@@ -0,0 +1,110 @@
+/*
+**
+** Copyright (C) 2022 MEAT Inc
+** Author: Zack Walsh <neo.smith@motorengineeringandtech.com>
+**
+** This library is free software; you can redistribute it and/or modify
+** it under the terms of the GNU Lesser General Public License as published
+** by the Free Software Foundation, either version 3 of the License, or (at
+** your option) any later version.
+**
+** This library is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+** Lesser General Public License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public
+** License along with this library; if not, <http://www.gnu.org/licenses/>.
+**
+*/
+
+
+#pragma once
+
+// Standard Imports
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <vector>
+
+// Fulcrum Resource Imports
+#include "fulcrum_capture_format.h"
+
+// Reader for .shimBin capture files. This has no Windows or MFC dependencies so it can be
+// built into tools that pull captures apart offline. Text output lives in fulcrum_capture_render
+
+// A single field inside a record. Data points into the record buffer it came from
+struct fulcrum_capture_field {
+	uint16_t Tag;
+	uint8_t Index;
+	uint8_t Flags;
+	uint32_t Length;
+	const uint8_t* Data;
+
+	// Reads a value out of the field data. Returns 0 when the field is too short
+	uint32_t ReadUint32(size_t dataOffset) const;
+	uint64_t ReadUint64(size_t dataOffset) const;
+};
+
+// A parsed record. The buffer it was parsed from must outlive it
+class fulcrum_capture_record {
+public:
+	fulcrum_capture_record();
+
+	// Validates a record buffer and gets ready to walk its fields
+	bool Parse(const uint8_t* pRecord, size_t nLength);
+	const fulcrum_capture_record_header& Header() const { return m_Header; }
+
+	// Walks the fields in the order they were written
+	bool NextField(fulcrum_capture_field& field);
+	void Rewind();
+
+	// Walks the messages stored in a FIELD_MESSAGES field. Start with dataOffset = 0
+	static bool NextMessage(const fulcrum_capture_field& field, size_t& dataOffset, fulcrum_capture_msg_header& msgHeader, const uint8_t*& pMsgData);
+
+private:
+	fulcrum_capture_record_header m_Header;
+	const uint8_t* m_pRecord;
+	size_t m_nLength;
+	size_t m_iNextField;
+};
+
+// Pulls records out of a capture file one at a time
+class fulcrum_capture_reader {
+public:
+	fulcrum_capture_reader();
+	~fulcrum_capture_reader();
+
+	// Opens a file by name, or reads from a file the caller already opened in binary mode
+	bool Open(const char* szPath);
+	bool Open(FILE* pFile);
+	void Close();
+
+	// Reads the next record. The record points into our buffer so it's only valid until the next read.
+	// Compressed blocks are unpacked as we go and only the records inside them are handed back
+	bool ReadRecord(fulcrum_capture_record& record);
+
+	// Raw bytes of the last record read
+	const uint8_t* RecordData() const { return m_pRecordData; }
+	size_t RecordLength() const { return m_nRecordLength; }
+
+	const fulcrum_capture_file_header& FileHeader() const { return m_FileHeader; }
+	const fulcrum_capture_segment_header& SegmentHeader() const { return m_SegmentHeader; }
+	bool IsSegment() const { return (m_FileHeader.Flags & FULCRUM_CAPTURE_FLAG_SEGMENTED) != 0; }
+	uint64_t RecordsRead() const { return m_nRecordsRead; }
+
+private:
+	bool ReadFileHeader();
+	bool UnpackBlock();
+
+	FILE* m_pFile;
+	bool m_fOwnsFile;
+	fulcrum_capture_file_header m_FileHeader;
+	fulcrum_capture_segment_header m_SegmentHeader;
+	std::vector<uint8_t> m_Buffer;
+	std::vector<uint8_t> m_Block;
+	size_t m_nBlockOffset;
+	const uint8_t* m_pRecordData;
+	size_t m_nRecordLength;
+	uint64_t m_nRecordsRead;
+};
\ No newline at end of file
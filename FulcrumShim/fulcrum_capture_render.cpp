@@ -0,0 +1,495 @@
+/*
+**
+** Copyright (C) 2022 MEAT Inc
+** Author: Zack Walsh <neo.smith@motorengineeringandtech.com>
+**
+** This library is free software; you can redistribute it and/or modify
+** it under the terms of the GNU Lesser General Public License as published
+** by the Free Software Foundation, either version 3 of the License, or (at
+** your option) any later version.
+**
+** This library is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+** Lesser General Public License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public
+** License along with this library; if not, <http://www.gnu.org/licenses/>.
+**
+*/
+
+
+// Standard Imports
+#include "stdafx.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include <tchar.h>
+
+// Fulcrum Resource Imports
+#include "fulcrum_j2534.h"
+#include "fulcrum_debug.h"
+#include "fulcrum_capture_format.h"
+#include "fulcrum_capture_reader.h"
+#include "fulcrum_capture_render.h"
+#include "fulcrum_deferred.h"
+#include "fulcrum_hexdump.h"
+
+// Most calls only use a handful of arguments. PTStartMsgFilter has the most with six
+#define FULCRUM_RENDER_MAX_ARGS 8
+
+// Formats a single line and hands it to the sink
+static void fulcrumRenderLine(fulcrum_render_sink pSink, void* pContext, LPCTSTR format_string, ...)
+{
+	TCHAR bufferOutputArray[1024];
+	va_list str_args; va_start(str_args, format_string);
+	int outputLength = _vsntprintf_s(bufferOutputArray, _countof(bufferOutputArray), _TRUNCATE, format_string, str_args);
+	va_end(str_args);
+
+	if (outputLength < 0) outputLength = (int)_tcslen(bufferOutputArray);
+	pSink(bufferOutputArray, outputLength, pContext);
+}
+static void fulcrumRenderString(fulcrum_render_sink pSink, void* pContext, const tstring& strLine)
+{
+	if (!strLine.empty()) pSink(strLine.c_str(), strLine.size(), pContext);
+}
+
+// Hex dump lines are built in a buffer reused for every dump this thread renders
+static void fulcrumRenderHex(fulcrum_render_sink pSink, void* pContext, const unsigned char* pData, unsigned long nBytes, unsigned long nBracketFrom)
+{
+	thread_local std::vector<TCHAR> hexBuffer(FULCRUM_HEXDUMP_MAX_CHARS);
+	size_t nLength = fulcrumHex_Length(nBytes, nBracketFrom);
+	if (hexBuffer.size() < nLength + 1) hexBuffer.resize(nLength + 1);
+	pSink(&hexBuffer[0], fulcrumHex_Format(pData, nBytes, nBracketFrom, &hexBuffer[0]), pContext);
+}
+
+// Names used for labels inside the log lines
+static LPCTSTR fulcrumRenderLabel(uint8_t fieldLabel)
+{
+	switch (fieldLabel)
+	{
+	case LABEL_MSG:			return _T("Msg");
+	case LABEL_MASK:		return _T("Mask");
+	case LABEL_PATTERN:		return _T("Pattern");
+	case LABEL_FLOW_CONTROL:	return _T("FlowControl");
+	case LABEL_INPUT:		return _T("Input");
+	case LABEL_OUTPUT:		return _T("Output");
+	case LABEL_ADD:			return _T("Add");
+	case LABEL_DELETE:		return _T("Delete");
+	case LABEL_DEVICE_ID:	return _T("DeviceID");
+	case LABEL_CHANNEL_ID:	return _T("ChannelID");
+	case LABEL_PERIODIC_ID:	return _T("PeriodicID");
+	case LABEL_FILTER_ID:	return _T("FilterID");
+	default: break;
+	}
+	return _T("?label?");
+}
+
+// ---------------------------------------------------------------------------------------------------------------------------------
+
+// Header line for a call. These match what the frontend logged before captures existed
+static void fulcrumRenderBegin(const fulcrum_capture_record_header& recordHeader, const unsigned long* pArgs, fulcrum_render_sink pSink, void* pContext)
+{
+	double timeSinceInit = recordHeader.Timestamp / (double)FULCRUM_CAPTURE_TIMESTAMP_UNITS;
+	switch (recordHeader.Function)
+	{
+	case CAPTURE_FN_OPEN:
+		fulcrumRenderLine(pSink, pContext, _T("++ %.3fs PTOpen(%s, 0x%08X)\n"), timeSinceInit, (pArgs[0] == 0) ? _T("*NULL*") : _T(""), pArgs[1]);
+		break;
+	case CAPTURE_FN_CLOSE:
+		fulcrumRenderLine(pSink, pContext, _T("-- %.3fs PTClose(%ld)\n"), timeSinceInit, pArgs[0]);
+		break;
+	case CAPTURE_FN_CONNECT:
+		fulcrumRenderLine(pSink, pContext, _T("++ %.3fs PTConnect(%ld, %s, 0x%08X, %ld, 0x%08X)\n"), timeSinceInit, pArgs[0], fulcrumDebug_prot(pArgs[1]).c_str(), pArgs[2], pArgs[3], pArgs[4]);
+		break;
+	case CAPTURE_FN_DISCONNECT:
+		fulcrumRenderLine(pSink, pContext, _T("-- %.3fs PTDisconnect(%ld)\n"), timeSinceInit, pArgs[0]);
+		break;
+	case CAPTURE_FN_READ_MSGS:
+		fulcrumRenderLine(pSink, pContext, _T("<< %.3fs PTReadMsgs(%ld, 0x%08X, 0x%08X, %ld)\n"), timeSinceInit, pArgs[0], pArgs[1], pArgs[2], pArgs[3]);
+		break;
+	case CAPTURE_FN_WRITE_MSGS:
+		fulcrumRenderLine(pSink, pContext, _T(">> %.3fs PTWriteMsgs(%ld, 0x%08X, 0x%08X, %ld)\n"), timeSinceInit, pArgs[0], pArgs[1], pArgs[2], pArgs[3]);
+		break;
+	case CAPTURE_FN_START_PERIODIC_MSG:
+		fulcrumRenderLine(pSink, pContext, _T("++ %.3fs PTStartPeriodicMsg(%ld, 0x%08X, 0x%08X, %ld)\n"), timeSinceInit, pArgs[0], pArgs[1], pArgs[2], pArgs[3]);
+		break;
+	case CAPTURE_FN_STOP_PERIODIC_MSG:
+		fulcrumRenderLine(pSink, pContext, _T("-- %.3fs PTStopPeriodicMsg(%ld, %ld)\n"), timeSinceInit, pArgs[0], pArgs[1]);
+		break;
+	case CAPTURE_FN_START_MSG_FILTER:
+		fulcrumRenderLine(pSink, pContext, _T("++ %.3fs PTStartMsgFilter(%ld, %s, 0x%08X, 0x%08X, 0x%08X, 0x%08X)\n"), timeSinceInit, pArgs[0], fulcrumDebug_filter(pArgs[1]).c_str(),
+			pArgs[2], pArgs[3], pArgs[4], pArgs[5]);
+		break;
+	case CAPTURE_FN_STOP_MSG_FILTER:
+		fulcrumRenderLine(pSink, pContext, _T("-- %.3fs PTStopMsgFilter(%ld, %ld)\n"), timeSinceInit, pArgs[0], pArgs[1]);
+		break;
+	case CAPTURE_FN_SET_PROGRAMMING_VOLTAGE:
+		fulcrumRenderLine(pSink, pContext, _T("** %.3fs PTSetProgrammingVoltage(%ld, %ld, %ld)\n"), timeSinceInit, pArgs[0], pArgs[1], pArgs[2]);
+		break;
+	case CAPTURE_FN_READ_VERSION:
+		fulcrumRenderLine(pSink, pContext, _T("** %.3fs PTReadVersion(%ld, 0x%08X, 0x%08X, 0x%08X)\n"), timeSinceInit, pArgs[0], pArgs[1], pArgs[2], pArgs[3]);
+		break;
+	case CAPTURE_FN_GET_LAST_ERROR:
+		fulcrumRenderLine(pSink, pContext, _T("** %.3fs PTGetLastError(0x%08X)\n"), timeSinceInit, pArgs[0]);
+		break;
+	case CAPTURE_FN_IOCTL:
+		fulcrumRenderLine(pSink, pContext, _T("** %.3fs PTIoctl(%ld, %s, 0x%08X, 0x%08X)\n"), timeSinceInit, pArgs[0], fulcrumDebug_ioctl(pArgs[1]).c_str(), pArgs[2], pArgs[3]);
+		break;
+	case CAPTURE_FN_GET_NEXT_CARDAQ:
+		fulcrumRenderLine(pSink, pContext, _T("++ %.3fs PTGetNextCarDAQ(0x%08X, 0x%08X, 0x%08X)\n"), timeSinceInit, pArgs[0], pArgs[1], pArgs[2]);
+		break;
+	case CAPTURE_FN_READ_DETAILS:
+		fulcrumRenderLine(pSink, pContext, _T("++ %.3fs PTReadDetails(0x%08X)\n"), timeSinceInit, pArgs[0]);
+		break;
+	default:
+		fulcrumRenderLine(pSink, pContext, _T("?? %.3fs Unknown capture function %u\n"), timeSinceInit, (unsigned int)recordHeader.Function);
+		break;
+	}
+}
+
+// Message arrays. One line per message, then its flags, then its data
+static void fulcrumRenderMessages(const fulcrum_capture_field& field, fulcrum_render_sink pSink, void* pContext)
+{
+	LPCTSTR szLabel = fulcrumRenderLabel(field.Index);
+	if (field.Flags & FIELD_FLAG_NULL) fulcrumRenderLine(pSink, pContext, _T("  %s is NULL\n"), szLabel);
+	if (field.Flags & FIELD_FLAG_COUNT_NULL) fulcrumRenderLine(pSink, pContext, _T("  numMsgs is NULL\n"));
+	if (field.Flags & (FIELD_FLAG_NULL | FIELD_FLAG_COUNT_NULL)) return;
+
+	bool isWrite = (field.Flags & FIELD_FLAG_WRITE) != 0;
+	size_t dataOffset = 0; fulcrum_capture_msg_header msgHeader; const uint8_t* pMsgData;
+	for (unsigned long i = 0; fulcrum_capture_record::NextMessage(field, dataOffset, msgHeader, pMsgData); i++)
+	{
+		if (isWrite == true)
+		{
+			fulcrumRenderLine(pSink, pContext, _T("  %s[%d] %s. %lu bytes. TxF=0x%08lx\n"),
+				szLabel,
+				i,
+				fulcrumDebug_prot(msgHeader.ProtocolID).c_str(),
+				(unsigned long)msgHeader.DataSize,
+				(unsigned long)msgHeader.TxFlags);
+
+			// Display TxFlags if this is an outgoing message
+			fulcrumRenderString(pSink, pContext, fulcrumDebug_txflags(msgHeader.TxFlags));
+		}
+		else
+		{
+			fulcrumRenderLine(pSink, pContext, _T("  %s[%d] %fs. %s. Actual data %lu of %lu bytes. RxS=0x%08lx\n"),
+				szLabel,
+				i,
+				msgHeader.Timestamp / (float)1000000,
+				fulcrumDebug_prot(msgHeader.ProtocolID).c_str(),
+				(unsigned long)msgHeader.ExtraDataIndex,
+				(unsigned long)msgHeader.DataSize,
+				(unsigned long)msgHeader.RxStatus);
+
+			// Display RxStatus if this is an incoming message
+			fulcrumRenderString(pSink, pContext, fulcrumDebug_rxstatus(msgHeader.RxStatus));
+		}
+
+		// Display Data[] except for frames containing neither data nor extradata
+		if (msgHeader.DataSize > 0)
+		{
+			unsigned long dataLength = msgHeader.DataSize < FULCRUM_CAPTURE_MAX_DATA ? msgHeader.DataSize : FULCRUM_CAPTURE_MAX_DATA;
+			fulcrumRenderHex(pSink, pContext, pMsgData, dataLength, isWrite ? dataLength : msgHeader.ExtraDataIndex);
+		}
+	}
+}
+
+// Unwrapped device counter and host time for each message read back
+static void fulcrumRenderMsgTimes(const fulcrum_capture_field& field, fulcrum_render_sink pSink, void* pContext)
+{
+	LPCTSTR szLabel = fulcrumRenderLabel(field.Index);
+	unsigned long deviceID = field.ReadUint32(0);
+	unsigned long msgCount = field.ReadUint32(sizeof(uint32_t));
+	size_t dataOffset = 2 * sizeof(uint32_t);
+	for (unsigned long i = 0; i < msgCount && dataOffset + 2 * sizeof(uint64_t) <= field.Length; i++, dataOffset += 2 * sizeof(uint64_t))
+	{
+		fulcrumRenderLine(pSink, pContext, _T("  %s[%d] device %lu at %.6fs. host %.6fs\n"),
+			szLabel,
+			i,
+			deviceID,
+			field.ReadUint64(dataOffset) / (double)1000000,
+			field.ReadUint64(dataOffset + sizeof(uint64_t)) / (double)FULCRUM_CAPTURE_TIMESTAMP_UNITS);
+	}
+}
+
+// SCONFIG_LIST and SBYTE_ARRAY contents from PTIoctl
+static void fulcrumRenderSConfig(const fulcrum_capture_field& field, fulcrum_render_sink pSink, void* pContext)
+{
+	if (field.Flags & FIELD_FLAG_NULL)
+	{
+		fulcrumRenderLine(pSink, pContext, _T("  pList is NULL\n"));
+		return;
+	}
+
+	unsigned long paramCount = field.ReadUint32(0);
+	fulcrumRenderLine(pSink, pContext, _T("  %ld parameter(s) at 0x%08X:\n"), paramCount, (unsigned long)field.ReadUint64(sizeof(uint32_t)));
+	if (field.Flags & FIELD_FLAG_DATA_NULL)
+	{
+		fulcrumRenderLine(pSink, pContext, _T("  pList->ConfigPtr is NULL\n"));
+		return;
+	}
+
+	size_t pairOffset = sizeof(uint32_t) + sizeof(uint64_t);
+	for (unsigned long i = 0; i < paramCount && pairOffset + 2 * sizeof(uint32_t) <= field.Length; i++, pairOffset += 2 * sizeof(uint32_t))
+	{
+		fulcrumRenderLine(pSink, pContext, _T("    %s = %ld\n"), fulcrumDebug_param(field.ReadUint32(pairOffset)).c_str(), (unsigned long)field.ReadUint32(pairOffset + sizeof(uint32_t)));
+	}
+}
+static void fulcrumRenderSByte(const fulcrum_capture_field& field, fulcrum_render_sink pSink, void* pContext)
+{
+	LPCTSTR szLabel = fulcrumRenderLabel(field.Index);
+	if (field.Flags & FIELD_FLAG_NULL)
+	{
+		fulcrumRenderLine(pSink, pContext, _T("  %s is NULL\n"), szLabel);
+		return;
+	}
+
+	unsigned long byteCount = field.ReadUint32(0);
+	fulcrumRenderLine(pSink, pContext, _T("  %s: %lu bytes at 0x%08X\n"), szLabel, byteCount, (unsigned long)field.ReadUint64(sizeof(uint32_t)));
+	if (field.Flags & FIELD_FLAG_DATA_NULL)
+	{
+		fulcrumRenderLine(pSink, pContext, _T("  %s->BytePtr is NULL\n"), szLabel);
+		return;
+	}
+
+	size_t dataOffset = sizeof(uint32_t) + sizeof(uint64_t);
+	unsigned long dataLength = (unsigned long)(field.Length - dataOffset);
+	if (byteCount < dataLength) dataLength = byteCount;
+	if (dataLength > 0) fulcrumRenderHex(pSink, pContext, field.Data + dataOffset, dataLength, dataLength);
+}
+
+// Version and error strings come back from the J2534 DLL as narrow text
+static void fulcrumRenderText(const fulcrum_capture_field& field, fulcrum_render_sink pSink, void* pContext)
+{
+	CStringW cstrText((LPCSTR)field.Data, (int)field.Length);
+	switch (field.Index)
+	{
+	case LABEL_FIRMWARE:
+		fulcrumRenderLine(pSink, pContext, _T("  Firmware: %s\n"), (LPCWSTR)cstrText);
+		break;
+	case LABEL_DLL:
+		fulcrumRenderLine(pSink, pContext, _T("  DLL:      %s\n"), (LPCWSTR)cstrText);
+		break;
+	case LABEL_API:
+		fulcrumRenderLine(pSink, pContext, _T("  API:      %s\n"), (LPCWSTR)cstrText);
+		break;
+	case LABEL_ERROR_DESCRIPTION:
+		if (field.Flags & FIELD_FLAG_NULL) fulcrumRenderLine(pSink, pContext, _T("  pErrorDescription is NULL\n"));
+		else fulcrumRenderLine(pSink, pContext, _T("  %s\n"), (LPCWSTR)cstrText);
+		break;
+	default:
+		fulcrumRenderLine(pSink, pContext, _T("  %s\n"), (LPCWSTR)cstrText);
+		break;
+	}
+}
+
+// Everything logged while the call ran, in the order it was logged, then the return value
+static void fulcrumRenderEnd(fulcrum_capture_record& record, fulcrum_render_sink pSink, void* pContext, bool fIncludeData)
+{
+	bool fHasRetval = false, fIncludeDescription = true;
+	unsigned long retval = 0; CStringW cstrErrorDescription;
+
+	fulcrum_capture_field field;
+	while (record.NextField(field))
+	{
+		switch (field.Tag)
+		{
+		case FIELD_CONNECT_FLAGS:
+			fulcrumRenderString(pSink, pContext, fulcrumDebug_cflags(field.ReadUint32(0)));
+			break;
+		case FIELD_MESSAGES:
+			if (fIncludeData) fulcrumRenderMessages(field, pSink, pContext);
+			break;
+		case FIELD_MSG_TIMES:
+			if (fIncludeData) fulcrumRenderMsgTimes(field, pSink, pContext);
+			break;
+		case FIELD_SCONFIG:
+			if (fIncludeData) fulcrumRenderSConfig(field, pSink, pContext);
+			break;
+		case FIELD_SBYTE:
+			if (fIncludeData) fulcrumRenderSByte(field, pSink, pContext);
+			break;
+		case FIELD_MSG_COUNT:
+			fulcrumRenderLine(pSink, pContext, field.Index == LABEL_SENT ? _T("  sent %ld of %ld messages\n") : _T("  read %ld of %ld messages\n"),
+				(unsigned long)field.ReadUint32(0), (unsigned long)field.ReadUint32(sizeof(uint32_t)));
+			break;
+		case FIELD_RETURNED_ID:
+			if (field.Flags & FIELD_FLAG_NULL) fulcrumRenderLine(pSink, pContext, _T("  p%s was NULL\n"), fulcrumRenderLabel(field.Index));
+			else fulcrumRenderLine(pSink, pContext, _T("  returning %s: %ld\n"), fulcrumRenderLabel(field.Index), (unsigned long)field.ReadUint32(0));
+			break;
+		case FIELD_VOLTAGE:
+		{
+			unsigned long pinNumber = field.ReadUint32(0);
+			unsigned long milliVolts = field.ReadUint32(sizeof(uint32_t));
+			if (field.Index == LABEL_VOLTS) fulcrumRenderLine(pSink, pContext, _T("  %f Volts\n"), milliVolts / (float)1000);
+			else if (milliVolts == VOLTAGE_OFF) fulcrumRenderLine(pSink, pContext, _T("  Pin %ld remove voltage\n"), pinNumber);
+			else if (milliVolts == SHORT_TO_GROUND) fulcrumRenderLine(pSink, pContext, _T("  Pin %ld short to ground\n"), pinNumber);
+			else fulcrumRenderLine(pSink, pContext, _T("  Pin %ld at %f Volts\n"), pinNumber, milliVolts / (float)1000);
+			break;
+		}
+		case FIELD_TEXT:
+			fulcrumRenderText(field, pSink, pContext);
+			break;
+		case FIELD_RETVAL:
+			fHasRetval = true;
+			retval = field.ReadUint32(0);
+			fIncludeDescription = (field.Flags & FIELD_FLAG_NO_DESCRIPTION) == 0;
+			break;
+		case FIELD_ERROR_TEXT:
+			cstrErrorDescription = CStringW((LPCSTR)field.Data, (int)field.Length);
+			break;
+		default:
+			break;
+		}
+	}
+
+	// Return value goes last, the same way fulcrum_printretval() logs it
+	if (!fHasRetval) return;
+	double timeSinceInit = record.Header().Timestamp / (double)FULCRUM_CAPTURE_TIMESTAMP_UNITS;
+	if (!fIncludeDescription ||
+		retval == STATUS_NOERROR ||
+		retval == ERR_TIMEOUT ||
+		retval == ERR_BUFFER_EMPTY)
+	{
+		fulcrumRenderLine(pSink, pContext, _T("  %.3fs %s\n"), timeSinceInit, fulcrumDebug_return(retval).c_str());
+	}
+	else
+	{
+		fulcrumRenderLine(pSink, pContext, _T("  %.3fs %s '%s'\n"), timeSinceInit, fulcrumDebug_return(retval).c_str(), (LPCWSTR)cstrErrorDescription);
+	}
+}
+
+// Counted runs of empty polls. The header line is what a single poll would have shown, then the count and the return value
+static void fulcrumRenderPolls(fulcrum_capture_record& record, fulcrum_render_sink pSink, void* pContext)
+{
+	unsigned long callArgs[FULCRUM_RENDER_MAX_ARGS] = { 0 };
+	unsigned long retval = 0, pollCount = 0; uint64_t lastTimestamp = record.Header().Timestamp;
+
+	fulcrum_capture_field field;
+	while (record.NextField(field))
+	{
+		if (field.Tag == FIELD_ARG_VALUE && field.Index < FULCRUM_RENDER_MAX_ARGS) callArgs[field.Index] = field.ReadUint32(0);
+		else if (field.Tag == FIELD_ARG_POINTER && field.Index < FULCRUM_RENDER_MAX_ARGS) callArgs[field.Index] = (unsigned long)field.ReadUint64(0);
+		else if (field.Tag == FIELD_RETVAL) retval = field.ReadUint32(0);
+		else if (field.Tag == FIELD_POLL_COUNT) {
+			pollCount = field.ReadUint32(0);
+			lastTimestamp = field.ReadUint64(sizeof(uint32_t));
+		}
+	}
+
+	fulcrumRenderBegin(record.Header(), callArgs, pSink, pContext);
+	fulcrumRenderLine(pSink, pContext, _T("  %lu empty polls through %.3fs\n"), pollCount, lastTimestamp / (double)FULCRUM_CAPTURE_TIMESTAMP_UNITS);
+	fulcrumRenderLine(pSink, pContext, _T("  %.3fs %s\n"), lastTimestamp / (double)FULCRUM_CAPTURE_TIMESTAMP_UNITS, fulcrumDebug_return(retval).c_str());
+}
+
+// Deferred log lines. Definitions only feed the format table, messages are formatted from it
+static void fulcrumRenderDeferred(fulcrum_capture_record& record, fulcrum_render_sink pSink, void* pContext, fulcrum_render_formats* pFormats)
+{
+	fulcrum_capture_field field;
+	while (record.NextField(field))
+	{
+		if (field.Length < sizeof(uint32_t)) continue;
+		uint32_t formatID = field.ReadUint32(0);
+		const uint8_t* pFieldData = field.Data + sizeof(uint32_t);
+		size_t nFieldData = field.Length - sizeof(uint32_t);
+
+		if (field.Tag == FIELD_FORMAT_TEXT && pFormats != NULL)
+		{
+			tstring& strFormat = (*pFormats)[formatID];
+			strFormat.resize(nFieldData / sizeof(wchar_t));
+			if (!strFormat.empty()) memcpy(&strFormat[0], pFieldData, strFormat.size() * sizeof(wchar_t));
+		}
+		else if (field.Tag == FIELD_LOG_ARGS)
+		{
+			// Offline we only know the formats the file told us about. Live we use the registry
+			LPCTSTR szFormat = NULL;
+			if (pFormats == NULL) szFormat = fulcrum_deferred::Lookup(formatID);
+			else {
+				fulcrum_render_formats::const_iterator formatEntry = pFormats->find(formatID);
+				if (formatEntry != pFormats->end()) szFormat = formatEntry->second.c_str();
+			}
+			if (szFormat == NULL) { fulcrumRenderLine(pSink, pContext, _T("-->       Log message with unknown format %u\n"), formatID); continue; }
+
+			tstring strLine;
+			fulcrum_deferred::Format(szFormat, pFieldData, nFieldData, strLine);
+			fulcrumRenderString(pSink, pContext, strLine);
+		}
+	}
+}
+
+// ---------------------------------------------------------------------------------------------------------------------------------
+
+// Renders a single record into text lines
+bool fulcrum_capture_render::RenderRecord(const unsigned char* pRecord, size_t nLength, fulcrum_render_sink pSink, void* pContext,
+	fulcrum_render_formats* pFormats, bool fIncludeData)
+{
+	fulcrum_capture_record record;
+	if (!record.Parse(pRecord, nLength)) return false;
+
+	if (record.Header().Type == CAPTURE_LOG_MESSAGE || record.Header().Type == CAPTURE_FORMAT_DEFINE)
+	{
+		fulcrumRenderDeferred(record, pSink, pContext, pFormats);
+		return true;
+	}
+
+	// Segment footers are only there for seeking. Blocks are unpacked by the reader before they get here
+	if (record.Header().Type == CAPTURE_SEGMENT_INDEX) return true;
+	if (record.Header().Type == CAPTURE_COMPRESSED_BLOCK) return true;
+	if (record.Header().Type == CAPTURE_CALL_END)
+	{
+		fulcrumRenderEnd(record, pSink, pContext, fIncludeData);
+		return true;
+	}
+	if (record.Header().Type == CAPTURE_POLL_RUN)
+	{
+		fulcrumRenderPolls(record, pSink, pContext);
+		return true;
+	}
+
+	// Begin records only carry arguments. Pull them out by position for the header line
+	unsigned long callArgs[FULCRUM_RENDER_MAX_ARGS] = { 0 };
+	fulcrum_capture_field field;
+	while (record.NextField(field))
+	{
+		if (field.Index >= FULCRUM_RENDER_MAX_ARGS) continue;
+		if (field.Tag == FIELD_ARG_VALUE) callArgs[field.Index] = field.ReadUint32(0);
+		else if (field.Tag == FIELD_ARG_POINTER) callArgs[field.Index] = (unsigned long)field.ReadUint64(0);
+	}
+
+	fulcrumRenderBegin(record.Header(), callArgs, pSink, pContext);
+	return true;
+}
+
+// Sink for RenderFile(). Writes every line straight into the text log
+static void fulcrumRenderToFile(LPCTSTR szLine, size_t nLength, void* pContext)
+{
+	_fputts(szLine, (FILE*)pContext);
+}
+
+// Rebuilds a text log from a capture file
+bool fulcrum_capture_render::RenderFile(LPCTSTR szCapturePath, LPCTSTR szLogPath)
+{
+	FILE* fpCapture = NULL;
+	_tfopen_s(&fpCapture, szCapturePath, _T("rb"));
+	if (fpCapture == NULL) return false;
+
+	fulcrum_capture_reader captureReader;
+	if (!captureReader.Open(fpCapture)) { fclose(fpCapture); return false; }
+
+	FILE* fpLog = NULL;
+	_tfopen_s(&fpLog, szLogPath, _T("w, ccs=UTF-8"));
+	if (fpLog == NULL) { fclose(fpCapture); return false; }
+
+	// Walk every record in the capture. Bad records stop the render but keep what we have so far
+	fulcrum_capture_record record;
+	fulcrum_render_formats captureFormats;
+	while (captureReader.ReadRecord(record))
+		RenderRecord(captureReader.RecordData(), captureReader.RecordLength(), fulcrumRenderToFile, fpLog, &captureFormats);
+
+	captureReader.Close();
+	fclose(fpLog); fclose(fpCapture);
+	return true;
+}
\ No newline at end of file
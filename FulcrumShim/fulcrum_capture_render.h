@@ -0,0 +1,49 @@
+/*
+**
+** Copyright (C) 2022 MEAT Inc
+** Author: Zack Walsh <neo.smith@motorengineeringandtech.com>
+**
+** This library is free software; you can redistribute it and/or modify
+** it under the terms of the GNU Lesser General Public License as published
+** by the Free Software Foundation, either version 3 of the License, or (at
+** your option) any later version.
+**
+** This library is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+** Lesser General Public License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public
+** License along with this library; if not, <http://www.gnu.org/licenses/>.
+**
+*/
+
+
+#pragma once
+
+// Standard Imports
+#include <map>
+#include <stdint.h>
+#include <tchar.h>
+
+// Fulcrum Resource Imports
+#include "fulcrum_loader.h"		// for TSTRING
+
+// Called once for every line of text a record turns into
+typedef void (*fulcrum_render_sink)(LPCTSTR szLine, size_t nLength, void* pContext);
+
+// Format strings read out of a capture file for deferred log messages, by format ID
+typedef std::map<uint32_t, tstring> fulcrum_render_formats;
+
+// Turns binary capture records back into the same text lines the shim has always logged.
+// The log writer thread uses this to build the .shimLog and pipe output, and RenderFile()
+// rebuilds a text log from a .shimBin file on demand (apps reach it through the exported
+// PassThruRenderCapture). Deferred log messages use the formats passed in, or the shim's own
+// format registry when there aren't any. Without fIncludeData the
+// message, SCONFIG and byte array dumps are left out and only the calls and their results are shown
+class fulcrum_capture_render {
+public:
+	static bool RenderRecord(const unsigned char* pRecord, size_t nLength, fulcrum_render_sink pSink, void* pContext,
+		fulcrum_render_formats* pFormats = NULL, bool fIncludeData = true);
+	static bool RenderFile(LPCTSTR szCapturePath, LPCTSTR szLogPath);
+};
\ No newline at end of file
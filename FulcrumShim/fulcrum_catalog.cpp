@@ -0,0 +1,184 @@
+/*
+**
+** Copyright (C) 2022 MEAT Inc
+** Author: Zack Walsh <neo.smith@motorengineeringandtech.com>
+**
+** This library is free software; you can redistribute it and/or modify
+** it under the terms of the GNU Lesser General Public License as published
+** by the Free Software Foundation, either version 3 of the License, or (at
+** your option) any later version.
+**
+** This library is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+** Lesser General Public License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public
+** License along with this library; if not, <http://www.gnu.org/licenses/>.
+**
+*/
+
+// Standard Imports
+#include <set>
+#include <string.h>
+
+// Fulcrum Resource Imports
+#include "fulcrum_catalog.h"
+
+// Trees the interfaces are listed under, and what goes on the end of each name to tell them apart
+static const struct {
+	const wchar_t* KeyPath;
+	const wchar_t* NameSuffix;
+} catalogRoots[] = {
+	{ L"Software\\PassThruSupport.04.04", L" (v04.04)" },
+	{ L"Software\\WOW6432Node\\PassThruSupport.05.00", L" (v05.00)" },
+};
+
+// Saved layout. All values are little endian and strings are a uint32 count of UTF-16 units, then the units
+//   Header: FULCRUM_CATALOG_MAGIC, uint16 version, uint16 reserved, uint32 entry count
+//   Entry:  uint64 LastWrite, then the key path, Vendor, Name, FunctionLibrary and ConfigApplication strings
+#define FULCRUM_CATALOG_HEADER_SIZE (FULCRUM_CATALOG_MAGIC_SIZE + 2 * sizeof(uint16_t) + sizeof(uint32_t))
+
+// ---------------------------------------------------------------------------------------------------------------------------------
+
+static void fulcrumCatalog_PutInteger(std::vector<uint8_t>& catalogData, uint64_t intValue, size_t nBytes)
+{
+	for (size_t byteIndex = 0; byteIndex < nBytes; byteIndex++) catalogData.push_back((uint8_t)(intValue >> (8 * byteIndex)));
+}
+static void fulcrumCatalog_PutString(std::vector<uint8_t>& catalogData, const std::wstring& strValue)
+{
+	fulcrumCatalog_PutInteger(catalogData, strValue.size(), sizeof(uint32_t));
+	for (size_t charIndex = 0; charIndex < strValue.size(); charIndex++) fulcrumCatalog_PutInteger(catalogData, (uint16_t)strValue[charIndex], sizeof(uint16_t));
+}
+
+// Readers move dataOffset past what they read. They fail without moving it when the data is too short
+static bool fulcrumCatalog_GetInteger(const uint8_t* pData, size_t nLength, size_t& dataOffset, size_t nBytes, uint64_t& intValue)
+{
+	if (nLength - dataOffset < nBytes) return false;
+	intValue = 0;
+	for (size_t byteIndex = 0; byteIndex < nBytes; byteIndex++) intValue |= (uint64_t)pData[dataOffset + byteIndex] << (8 * byteIndex);
+	dataOffset += nBytes;
+	return true;
+}
+static bool fulcrumCatalog_GetString(const uint8_t* pData, size_t nLength, size_t& dataOffset, std::wstring& strValue)
+{
+	uint64_t charCount;
+	size_t startOffset = dataOffset;
+	if (!fulcrumCatalog_GetInteger(pData, nLength, dataOffset, sizeof(uint32_t), charCount)) return false;
+	if ((nLength - dataOffset) / sizeof(uint16_t) < charCount) { dataOffset = startOffset; return false; }
+
+	strValue.resize((size_t)charCount);
+	for (size_t charIndex = 0; charIndex < charCount; charIndex++, dataOffset += sizeof(uint16_t))
+		strValue[charIndex] = (wchar_t)(pData[dataOffset] | (pData[dataOffset + 1] << 8));
+	return true;
+}
+
+// Missing values are left empty, the same as when the registry was read straight into the selection box
+static std::wstring fulcrumCatalog_Value(const fulcrum_registry_values& keyValues, const wchar_t* szValueName)
+{
+	fulcrum_registry_values::const_iterator keyValue = keyValues.find(szValueName);
+	return keyValue == keyValues.end() ? std::wstring() : keyValue->second;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------------------
+
+fulcrum_catalog::fulcrum_catalog()
+	: m_nKeysRead(0)
+{
+}
+
+bool fulcrum_catalog::Refresh(fulcrum_registry_provider& registryProvider)
+{
+	bool fChanged = false;
+	std::set<std::wstring> foundKeys;
+	std::vector<fulcrum_registry_subkey> subkeyList;
+	for (size_t rootIndex = 0; rootIndex < sizeof(catalogRoots) / sizeof(catalogRoots[0]); rootIndex++)
+	{
+		subkeyList.clear();
+		if (!registryProvider.ListSubkeys(catalogRoots[rootIndex].KeyPath, subkeyList)) continue;
+		for (size_t subkeyIndex = 0; subkeyIndex < subkeyList.size(); subkeyIndex++)
+		{
+			std::wstring keyPath = std::wstring(catalogRoots[rootIndex].KeyPath) + L"\\" + subkeyList[subkeyIndex].Name;
+			std::map<std::wstring, fulcrum_catalog_entry>::iterator catalogEntry = m_Entries.find(keyPath);
+			if (catalogEntry != m_Entries.end() && catalogEntry->second.LastWrite == subkeyList[subkeyIndex].LastWrite)
+			{
+				foundKeys.insert(keyPath);
+				continue;
+			}
+
+			// Keys can go away between listing them and opening them. Those get dropped below
+			fulcrum_registry_values keyValues;
+			m_nKeysRead++;
+			if (!registryProvider.ReadValues(keyPath, keyValues)) continue;
+
+			fulcrum_catalog_entry newEntry;
+			newEntry.LastWrite = subkeyList[subkeyIndex].LastWrite;
+			newEntry.Vendor = fulcrumCatalog_Value(keyValues, L"Vendor");
+			newEntry.Name = fulcrumCatalog_Value(keyValues, L"Name") + catalogRoots[rootIndex].NameSuffix;
+			newEntry.FunctionLibrary = fulcrumCatalog_Value(keyValues, L"FunctionLibrary");
+			newEntry.ConfigApplication = fulcrumCatalog_Value(keyValues, L"ConfigApplication");
+			m_Entries[keyPath] = newEntry;
+			foundKeys.insert(keyPath);
+			fChanged = true;
+		}
+	}
+
+	// Anything we didn't see this time was uninstalled
+	for (std::map<std::wstring, fulcrum_catalog_entry>::iterator catalogEntry = m_Entries.begin(); catalogEntry != m_Entries.end(); )
+	{
+		if (foundKeys.count(catalogEntry->first) != 0) { ++catalogEntry; continue; }
+		catalogEntry = m_Entries.erase(catalogEntry);
+		fChanged = true;
+	}
+
+	return fChanged;
+}
+
+void fulcrum_catalog::Serialize(std::vector<uint8_t>& catalogData) const
+{
+	catalogData.assign(FULCRUM_CATALOG_MAGIC, FULCRUM_CATALOG_MAGIC + FULCRUM_CATALOG_MAGIC_SIZE);
+	fulcrumCatalog_PutInteger(catalogData, FULCRUM_CATALOG_VERSION, sizeof(uint16_t));
+	fulcrumCatalog_PutInteger(catalogData, 0, sizeof(uint16_t));
+	fulcrumCatalog_PutInteger(catalogData, m_Entries.size(), sizeof(uint32_t));
+	for (std::map<std::wstring, fulcrum_catalog_entry>::const_iterator catalogEntry = m_Entries.begin(); catalogEntry != m_Entries.end(); ++catalogEntry)
+	{
+		fulcrumCatalog_PutInteger(catalogData, catalogEntry->second.LastWrite, sizeof(uint64_t));
+		fulcrumCatalog_PutString(catalogData, catalogEntry->first);
+		fulcrumCatalog_PutString(catalogData, catalogEntry->second.Vendor);
+		fulcrumCatalog_PutString(catalogData, catalogEntry->second.Name);
+		fulcrumCatalog_PutString(catalogData, catalogEntry->second.FunctionLibrary);
+		fulcrumCatalog_PutString(catalogData, catalogEntry->second.ConfigApplication);
+	}
+}
+
+bool fulcrum_catalog::Parse(const uint8_t* pData, size_t nLength)
+{
+	m_Entries.clear();
+	if (pData == NULL || nLength < FULCRUM_CATALOG_HEADER_SIZE) return false;
+	if (memcmp(pData, FULCRUM_CATALOG_MAGIC, FULCRUM_CATALOG_MAGIC_SIZE) != 0) return false;
+
+	size_t dataOffset = FULCRUM_CATALOG_MAGIC_SIZE;
+	uint64_t catalogVersion, reservedValue, entryCount;
+	fulcrumCatalog_GetInteger(pData, nLength, dataOffset, sizeof(uint16_t), catalogVersion);
+	fulcrumCatalog_GetInteger(pData, nLength, dataOffset, sizeof(uint16_t), reservedValue);
+	fulcrumCatalog_GetInteger(pData, nLength, dataOffset, sizeof(uint32_t), entryCount);
+	if (catalogVersion != FULCRUM_CATALOG_VERSION) return false;
+
+	for (uint64_t entryIndex = 0; entryIndex < entryCount; entryIndex++)
+	{
+		std::wstring keyPath; fulcrum_catalog_entry newEntry;
+		if (!fulcrumCatalog_GetInteger(pData, nLength, dataOffset, sizeof(uint64_t), newEntry.LastWrite) ||
+			!fulcrumCatalog_GetString(pData, nLength, dataOffset, keyPath) ||
+			!fulcrumCatalog_GetString(pData, nLength, dataOffset, newEntry.Vendor) ||
+			!fulcrumCatalog_GetString(pData, nLength, dataOffset, newEntry.Name) ||
+			!fulcrumCatalog_GetString(pData, nLength, dataOffset, newEntry.FunctionLibrary) ||
+			!fulcrumCatalog_GetString(pData, nLength, dataOffset, newEntry.ConfigApplication))
+		{
+			m_Entries.clear();
+			return false;
+		}
+		m_Entries[keyPath] = newEntry;
+	}
+
+	return true;
+}
\ No newline at end of file
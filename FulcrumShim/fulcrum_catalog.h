@@ -0,0 +1,93 @@
+/*
+**
+** Copyright (C) 2022 MEAT Inc
+** Author: Zack Walsh <neo.smith@motorengineeringandtech.com>
+**
+** This library is free software; you can redistribute it and/or modify
+** it under the terms of the GNU Lesser General Public License as published
+** by the Free Software Foundation, either version 3 of the License, or (at
+** your option) any later version.
+**
+** This library is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+** Lesser General Public License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public
+** License along with this library; if not, <http://www.gnu.org/licenses/>.
+**
+*/
+
+#pragma once
+
+// Standard Imports
+#include <stddef.h>
+#include <stdint.h>
+#include <map>
+#include <string>
+#include <vector>
+
+// Catalog of the J2534 interfaces listed under PassThruSupport.04.04 and WOW6432Node\PassThruSupport.05.00.
+// Every vendor key is remembered with its last write time, so a refresh only opens the keys that were
+// added or changed since the last one. The catalog is saved between runs, which means an autoload usually
+// just lists the two trees. The registry is read through a provider interface. The shim hands it the real
+// registry, and anything built on Linux can hand it a fake one, so like the transports this has no Windows dependencies
+
+#define FULCRUM_CATALOG_MAGIC "FULCRUMC"
+#define FULCRUM_CATALOG_MAGIC_SIZE 8
+#define FULCRUM_CATALOG_VERSION 1
+#define FULCRUM_CATALOG_EXTENSION ".shimCatalog"
+
+// Subkey found while listing a key. LastWrite is in FILETIME ticks
+struct fulcrum_registry_subkey {
+	std::wstring Name;
+	uint64_t LastWrite;
+};
+
+// String values of a key by name
+typedef std::map<std::wstring, std::wstring> fulcrum_registry_values;
+
+// Read only view of HKEY_LOCAL_MACHINE. Paths are relative to it, with backslashes between keys
+class fulcrum_registry_provider {
+public:
+	virtual ~fulcrum_registry_provider() {}
+
+	// Subkeys directly below a key along with their last write times. False when the key doesn't exist
+	virtual bool ListSubkeys(const std::wstring& keyPath, std::vector<fulcrum_registry_subkey>& subkeyList) = 0;
+
+	// Every string value of a key. False when the key doesn't exist
+	virtual bool ReadValues(const std::wstring& keyPath, fulcrum_registry_values& keyValues) = 0;
+};
+
+// One interface in the catalog. Name already carries the API version it was listed under
+struct fulcrum_catalog_entry {
+	uint64_t LastWrite;			// Last write time of the vendor key when it was read
+	std::wstring Vendor;
+	std::wstring Name;
+	std::wstring FunctionLibrary;
+	std::wstring ConfigApplication;
+};
+
+class fulcrum_catalog {
+public:
+	fulcrum_catalog();
+
+	// Brings the catalog up to date. Vendor keys whose last write time hasn't changed aren't opened.
+	// Returns true when anything was added, changed or dropped, so the caller knows to save it
+	bool Refresh(fulcrum_registry_provider& registryProvider);
+
+	// Saved form of the catalog. Parse() throws out anything that doesn't check out and leaves the
+	// catalog empty, so the next refresh reads every key again
+	void Serialize(std::vector<uint8_t>& catalogData) const;
+	bool Parse(const uint8_t* pData, size_t nLength);
+
+	// Interfaces keyed by the path of their vendor key
+	const std::map<std::wstring, fulcrum_catalog_entry>& Entries() const { return m_Entries; }
+
+	// Vendor keys opened by refreshes so far
+	unsigned long KeysRead() const { return m_nKeysRead; }
+
+private:
+	std::map<std::wstring, fulcrum_catalog_entry> m_Entries;
+	unsigned long m_nKeysRead;
+};
\ No newline at end of file
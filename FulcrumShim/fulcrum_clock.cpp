@@ -0,0 +1,173 @@
+/*
+**
+** Copyright (C) 2022 MEAT Inc
+** Author: Zack Walsh <neo.smith@motorengineeringandtech.com>
+**
+** This library is free software; you can redistribute it and/or modify
+** it under the terms of the GNU Lesser General Public License as published
+** by the Free Software Foundation, either version 3 of the License, or (at
+** your option) any later version.
+**
+** This library is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+** Lesser General Public License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public
+** License along with this library; if not, <http://www.gnu.org/licenses/>.
+**
+*/
+
+// Standard Imports
+#include <atomic>
+#include <chrono>
+#include <mutex>
+
+// Fulcrum Resource Imports
+#include "fulcrum_clock.h"
+
+// The TSC is only read on x86 targets
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#define FULCRUM_CLOCK_TSC 1
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#include <x86intrin.h>
+#endif
+#endif
+
+// How long the TSC is timed against steady_clock when the CPU doesn't tell us its frequency
+#define FULCRUM_CLOCK_CALIBRATE_MS 10
+
+// Set once when the clock starts and only read after that. Both bases are taken at the
+// same moment so switching sources doesn't make the clock jump
+static std::once_flag clockStarted;
+static std::atomic<int> clockSource(CLOCK_SOURCE_AUTO);
+static std::chrono::steady_clock::time_point steadyBase;
+static uint64_t tscBase = 0;
+static uint64_t tscFrequency = 0;
+static uint64_t tscMultiplier = 0;
+static unsigned int tscShift = 0;
+
+// ---------------------------------------------------------------------------------------------------------------------------------
+
+#if FULCRUM_CLOCK_TSC
+static void fulcrumClock_Cpuid(unsigned int cpuRegs[4], unsigned int cpuLeaf)
+{
+#if defined(_MSC_VER)
+	int cpuInfo[4];
+	__cpuidex(cpuInfo, (int)cpuLeaf, 0);
+	for (int regIndex = 0; regIndex < 4; regIndex++) cpuRegs[regIndex] = (unsigned int)cpuInfo[regIndex];
+#else
+	__cpuid_count(cpuLeaf, 0, cpuRegs[0], cpuRegs[1], cpuRegs[2], cpuRegs[3]);
+#endif
+}
+
+// Invariant TSC runs at the same rate in every power state and on every core
+static bool fulcrumClock_TscInvariant()
+{
+	unsigned int cpuRegs[4];
+	fulcrumClock_Cpuid(cpuRegs, 0x80000000);
+	if (cpuRegs[0] < 0x80000007) return false;
+	fulcrumClock_Cpuid(cpuRegs, 0x80000007);
+	return (cpuRegs[3] & (1 << 8)) != 0;
+}
+
+// Newer CPUs give the TSC rate as a ratio of the crystal clock. Otherwise we time it ourselves
+static uint64_t fulcrumClock_TscMeasure()
+{
+	unsigned int cpuRegs[4];
+	fulcrumClock_Cpuid(cpuRegs, 0);
+	if (cpuRegs[0] >= 0x15)
+	{
+		fulcrumClock_Cpuid(cpuRegs, 0x15);
+		if (cpuRegs[0] != 0 && cpuRegs[1] != 0 && cpuRegs[2] != 0)
+			return (uint64_t)cpuRegs[2] * cpuRegs[1] / cpuRegs[0];
+	}
+
+	std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+	uint64_t startTicks = __rdtsc();
+	std::chrono::steady_clock::time_point endTime;
+	do { endTime = std::chrono::steady_clock::now(); } while (endTime - startTime < std::chrono::milliseconds(FULCRUM_CLOCK_CALIBRATE_MS));
+	uint64_t endTicks = __rdtsc();
+
+	double nanoSeconds = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(endTime - startTime).count();
+	return nanoSeconds <= 0 ? 0 : (uint64_t)((endTicks - startTicks) * 1000000000.0 / nanoSeconds);
+}
+
+// Ticks to nanoseconds as a multiply and shift. The delta is split in two halves so the multiply
+// can't overflow, which also keeps it cheap in the 32 bit build
+static uint64_t fulcrumClock_TscToNanoseconds(uint64_t nTicks)
+{
+	uint64_t nHigh = ((nTicks >> 32) * tscMultiplier) << (32 - tscShift);
+	uint64_t nLow = ((nTicks & 0xFFFFFFFFULL) * tscMultiplier) >> tscShift;
+	return nHigh + nLow;
+}
+#endif
+
+// Runs once, from whichever thread reads the clock first
+static void fulcrumClock_Start()
+{
+	steadyBase = std::chrono::steady_clock::now();
+	int startSource = CLOCK_SOURCE_STEADY;
+
+#if FULCRUM_CLOCK_TSC
+	tscBase = __rdtsc();
+	uint64_t nFrequency = fulcrumClock_TscInvariant() ? fulcrumClock_TscMeasure() : 0;
+	if (nFrequency >= 1000000)
+	{
+		// Largest shift that keeps the multiplier in 32 bits
+		tscShift = 32;
+		while (tscShift > 0 && ((1000000000ULL << tscShift) / nFrequency) > 0xFFFFFFFFULL) tscShift--;
+		tscMultiplier = (1000000000ULL << tscShift) / nFrequency;
+		tscFrequency = nFrequency;
+		startSource = CLOCK_SOURCE_TSC;
+	}
+#endif
+
+	clockSource.store(startSource, std::memory_order_release);
+}
+
+// ---------------------------------------------------------------------------------------------------------------------------------
+
+uint64_t fulcrumClock_Now()
+{
+	int nSource = clockSource.load(std::memory_order_acquire);
+	if (nSource == CLOCK_SOURCE_AUTO)
+	{
+		std::call_once(clockStarted, fulcrumClock_Start);
+		nSource = clockSource.load(std::memory_order_acquire);
+	}
+
+#if FULCRUM_CLOCK_TSC
+	// Cores can be a few ticks apart right at the start. Never hand out a time before the base
+	if (nSource == CLOCK_SOURCE_TSC)
+	{
+		uint64_t nTicks = __rdtsc();
+		return nTicks > tscBase ? fulcrumClock_TscToNanoseconds(nTicks - tscBase) : 0;
+	}
+#endif
+	return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - steadyBase).count();
+}
+
+fulcrum_clock_source fulcrumClock_Source()
+{
+	if (clockSource.load(std::memory_order_acquire) == CLOCK_SOURCE_AUTO) fulcrumClock_Now();
+	return (fulcrum_clock_source)clockSource.load(std::memory_order_acquire);
+}
+bool fulcrumClock_SetSource(fulcrum_clock_source clockSourceIn)
+{
+	// Auto goes back to the TSC whenever it was usable
+	fulcrumClock_Now();
+	if (clockSourceIn == CLOCK_SOURCE_AUTO) clockSourceIn = tscFrequency != 0 ? CLOCK_SOURCE_TSC : CLOCK_SOURCE_STEADY;
+	if (clockSourceIn == CLOCK_SOURCE_TSC && tscFrequency == 0) return false;
+	clockSource.store(clockSourceIn, std::memory_order_release);
+	return true;
+}
+
+uint64_t fulcrumClock_TscFrequency()
+{
+	fulcrumClock_Now();
+	return tscFrequency;
+}
\ No newline at end of file
@@ -0,0 +1,50 @@
+/*
+**
+** Copyright (C) 2022 MEAT Inc
+** Author: Zack Walsh <neo.smith@motorengineeringandtech.com>
+**
+** This library is free software; you can redistribute it and/or modify
+** it under the terms of the GNU Lesser General Public License as published
+** by the Free Software Foundation, either version 3 of the License, or (at
+** your option) any later version.
+**
+** This library is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+** Lesser General Public License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public
+** License along with this library; if not, <http://www.gnu.org/licenses/>.
+**
+*/
+
+#pragma once
+
+// Standard Imports
+#include <stdint.h>
+
+// Timestamps for log records, captures and stats. The clock is set up the first time it's read and
+// after that reading it never takes a lock. Where the CPU has an invariant TSC it's read straight
+// off the counter and scaled to nanoseconds. Anywhere else it falls back to std::steady_clock.
+// Like the hex dump this has no Windows dependencies so the benchmark builds it on Linux too
+
+// Sources the clock can read from. Auto picks the TSC when it's invariant
+enum fulcrum_clock_source {
+	CLOCK_SOURCE_AUTO = 0,
+	CLOCK_SOURCE_STEADY = 1,
+	CLOCK_SOURCE_TSC = 2,
+};
+
+// Nanoseconds since the clock was first read. Same units as capture record timestamps
+uint64_t fulcrumClock_Now();
+
+// Seconds since the clock was first read, for log lines that print times
+inline double fulcrumClock_Seconds() { return fulcrumClock_Now() / 1000000000.0; }
+
+// Source selection. Used by the benchmark to compare the two against each other. Setting a
+// source the CPU can't run returns false and leaves the current one in place
+fulcrum_clock_source fulcrumClock_Source();
+bool fulcrumClock_SetSource(fulcrum_clock_source clockSource);
+
+// TSC ticks per second found when the clock was set up. 0 when the TSC can't be used
+uint64_t fulcrumClock_TscFrequency();
\ No newline at end of file
@@ -0,0 +1,186 @@
+/*
+**
+** Copyright (C) 2022 MEAT Inc
+** Author: Zack Walsh <neo.smith@motorengineeringandtech.com>
+**
+** This library is free software; you can redistribute it and/or modify
+** it under the terms of the GNU Lesser General Public License as published
+** by the Free Software Foundation, either version 3 of the License, or (at
+** your option) any later version.
+**
+** This library is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+** Lesser General Public License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public
+** License along with this library; if not, <http://www.gnu.org/licenses/>.
+**
+*/
+
+// Standard Imports
+#include "stdafx.h"
+#include <string.h>
+
+// Fulcrum Resource Imports
+#include "fulcrum_command.h"
+#include "fulcrum_frame.h"
+#include "fulcrum_output.h"
+#include "fulcrum_deferred.h"
+#include "fulcrum_capture.h"
+#include "fulcrum_loader.h"
+#include "fulcrum_handles.h"
+
+// Pipe the commands come in on, and the decoder for its stream. Only the input reader thread uses the decoder
+static fulcrum_pipe* pCommandPipe = NULL;
+static fulcrum_frame_decoder commandDecoder;
+
+// Fixed part of an inject command: ChannelID, ProtocolID, TxFlags, Timeout, DataSize
+static const size_t InjectHeaderSize = 5 * sizeof(uint32_t);
+
+// Command payloads are little endian on the wire
+static uint32_t fulcrumCommand_ReadUint32(const uint8_t* pData)
+{
+	return (uint32_t)pData[0] | ((uint32_t)pData[1] << 8) | ((uint32_t)pData[2] << 16) | ((uint32_t)pData[3] << 24);
+}
+
+// ------------------------------------------------------------------------------------------------
+
+bool fulcrum_command::Start(fulcrum_pipe* pPipe)
+{
+	// Frames from an earlier connection can't finish on this one
+	if (pPipe->InputReaderRunning()) return true;
+	pCommandPipe = pPipe;
+	commandDecoder = fulcrum_frame_decoder();
+	return pPipe->StartInputReader(fulcrum_command::Feed, NULL);
+}
+
+void fulcrum_command::Feed(const byte* pData, size_t nBytes, void* pContext)
+{
+	// Pull every complete frame out of what we have so far. Anything but a command is ignored
+	commandDecoder.Feed(pData, nBytes);
+	fulcrum_frame inputFrame;
+	while (commandDecoder.Next(inputFrame))
+	{
+		if (inputFrame.Type != FRAME_COMMAND) continue;
+		Dispatch(inputFrame.Payload, inputFrame.Length);
+	}
+}
+
+void fulcrum_command::Dispatch(const uint8_t* pPayload, size_t nLength)
+{
+	// Every command carries its ID and a request ID before any arguments
+	if (nLength < 2 * sizeof(uint32_t))
+	{
+		fulcrum_DEBUG(_T("%s: Command frame was too short (%lu bytes)\n"), _T(FULCRUM_COMMAND_REPLY), (unsigned long)nLength);
+		return;
+	}
+
+	uint32_t nCommandID = fulcrumCommand_ReadUint32(pPayload);
+	uint32_t nRequestID = fulcrumCommand_ReadUint32(pPayload + sizeof(uint32_t));
+	const uint8_t* pArgs = pPayload + 2 * sizeof(uint32_t);
+	size_t nArgs = nLength - 2 * sizeof(uint32_t);
+
+	switch (nCommandID)
+	{
+	case COMMAND_SET_VERBOSITY: SetVerbosity(nRequestID, pArgs, nArgs); break;
+	case COMMAND_PAUSE_CAPTURE: SetPaused(nRequestID, true); break;
+	case COMMAND_RESUME_CAPTURE: SetPaused(nRequestID, false); break;
+	case COMMAND_QUERY_STATS: QueryStats(nRequestID); break;
+	case COMMAND_INJECT_FRAME: InjectFrame(nRequestID, pArgs, nArgs); break;
+	default:
+		fulcrum_DEBUG(_T("%s %lu: Unknown command %lu\n"), _T(FULCRUM_COMMAND_REPLY), (unsigned long)nRequestID, (unsigned long)nCommandID);
+		break;
+	}
+}
+
+// ------------------------------------------------------------------------------------------------
+
+void fulcrum_command::SetVerbosity(uint32_t nRequestID, const uint8_t* pArgs, size_t nLength)
+{
+	// Check the level before we take it
+	uint32_t nVerbosity = nLength >= sizeof(uint32_t) ? fulcrumCommand_ReadUint32(pArgs) : 0xFFFFFFFF;
+	if (nVerbosity > LOG_VERBOSITY_FULL)
+	{
+		fulcrum_DEBUG(_T("%s %lu SET_VERBOSITY: Invalid level\n"), _T(FULCRUM_COMMAND_REPLY), (unsigned long)nRequestID);
+		return;
+	}
+
+	fulcrum_output::SetVerbosity((fulcrum_log_verbosity)nVerbosity);
+	fulcrum_DEBUG(_T("%s %lu SET_VERBOSITY: Level %lu\n"), _T(FULCRUM_COMMAND_REPLY), (unsigned long)nRequestID, (unsigned long)nVerbosity);
+}
+
+void fulcrum_command::SetPaused(uint32_t nRequestID, bool fPaused)
+{
+	// The reply is logged after a resume and before a pause so it always makes it into the capture
+	if (!fPaused) fulcrum_capture::SetPaused(false);
+	fulcrum_DEBUG(_T("%s %lu %s: Capture %s\n"), _T(FULCRUM_COMMAND_REPLY), (unsigned long)nRequestID,
+		fPaused ? _T("PAUSE_CAPTURE") : _T("RESUME_CAPTURE"), fPaused ? _T("paused") : _T("resumed"));
+	if (fPaused) fulcrum_capture::SetPaused(true);
+}
+
+void fulcrum_command::QueryStats(uint32_t nRequestID)
+{
+	// One line of name=value pairs so the Injector can split it without knowing the order
+	fulcrum_pipe_stats pipeStats = pCommandPipe->PipeStats();
+	fulcrum_hub_stats hubStats = pCommandPipe->HubStats();
+	fulcrum_DEBUG(_T("%s %lu QUERY_STATS: verbosity=%d paused=%d records_written=%llu records_dropped=%llu captures_dropped=%llu captures_skipped=%llu\n"),
+		_T(FULCRUM_COMMAND_REPLY), (unsigned long)nRequestID, (int)fulcrum_output::Verbosity(), fulcrum_capture::Paused(),
+		fulcrum_output::RecordsWritten(), fulcrum_output::RecordsDropped(), fulcrum_output::CapturesDropped(), fulcrum_capture::Skipped());
+	fulcrum_DEBUG(_T("%s %lu QUERY_STATS: pipe_queued=%llu pipe_written=%llu pipe_dropped=%llu pipe_spilled=%llu pipe_errors=%llu pipe_reconnects=%llu\n"),
+		_T(FULCRUM_COMMAND_REPLY), (unsigned long)nRequestID, pipeStats.Queued, pipeStats.Written, pipeStats.DroppedNewest + pipeStats.DroppedOldest,
+		pipeStats.Spilled, pipeStats.WriteErrors, pipeStats.Reconnects);
+	fulcrum_DEBUG(_T("%s %lu QUERY_STATS: hub_subscribers=%llu hub_published=%llu hub_lapped=%llu commands=%llu command_crc_errors=%llu command_bytes_skipped=%llu\n"),
+		_T(FULCRUM_COMMAND_REPLY), (unsigned long)nRequestID, hubStats.Subscribers, hubStats.Published, hubStats.Lapped,
+		commandDecoder.FramesDecoded(), commandDecoder.CrcErrors(), commandDecoder.BytesSkipped());
+}
+
+void fulcrum_command::InjectFrame(uint32_t nRequestID, const uint8_t* pArgs, size_t nLength)
+{
+	// Check the arguments before building the message
+	if (nLength < InjectHeaderSize)
+	{
+		fulcrum_DEBUG(_T("%s %lu INJECT_FRAME: Arguments were too short\n"), _T(FULCRUM_COMMAND_REPLY), (unsigned long)nRequestID);
+		return;
+	}
+
+	unsigned long ChannelID = fulcrumCommand_ReadUint32(pArgs);
+	unsigned long Timeout = fulcrumCommand_ReadUint32(pArgs + 12);
+	unsigned long DataSize = fulcrumCommand_ReadUint32(pArgs + 16);
+	if (DataSize > sizeof(((PASSTHRU_MSG*)NULL)->Data) || DataSize > nLength - InjectHeaderSize)
+	{
+		fulcrum_DEBUG(_T("%s %lu INJECT_FRAME: Invalid data size %lu\n"), _T(FULCRUM_COMMAND_REPLY), (unsigned long)nRequestID, DataSize);
+		return;
+	}
+
+	// Same lock a PassThruWriteMsgs() on the channel takes, so the library stays put while we're in it
+	// and the channel goes to the library that owns it
+	handle_lock lock(HANDLE_CHANNEL, ChannelID);
+	fulcrum_route channelRoute = fulcrum_routeHandle(HANDLE_CHANNEL, ChannelID);
+	if (channelRoute.Library == NULL || channelRoute.Library->PassThruWriteMsgs == NULL)
+	{
+		fulcrum_DEBUG(_T("%s %lu INJECT_FRAME: No J2534 library is loaded\n"), _T(FULCRUM_COMMAND_REPLY), (unsigned long)nRequestID);
+		return;
+	}
+
+	// Build the message and hand it straight to the driver
+	PASSTHRU_MSG injectMsg;
+	memset(&injectMsg, 0, sizeof(injectMsg));
+	injectMsg.ProtocolID = fulcrumCommand_ReadUint32(pArgs + 4);
+	injectMsg.TxFlags = fulcrumCommand_ReadUint32(pArgs + 8);
+	injectMsg.DataSize = DataSize;
+	injectMsg.ExtraDataIndex = DataSize;
+	memcpy(injectMsg.Data, pArgs + InjectHeaderSize, DataSize);
+
+	// Captured the same way PassThruWriteMsgs() is, so the injected frame shows up in the log with the app's traffic
+	unsigned long NumMsgs = 1;
+	fulcrum_capture capture(CAPTURE_FN_WRITE_MSGS);
+	capture.Value(ChannelID); capture.Pointer(&injectMsg); capture.Pointer(&NumMsgs); capture.Value(Timeout);
+	capture.Begin();
+	capture.Messages(LABEL_MSG, &injectMsg, &NumMsgs, true);
+	long RetVal = channelRoute.Library->PassThruWriteMsgs(channelRoute.ID, &injectMsg, &NumMsgs, Timeout);
+	capture.MsgCount(LABEL_SENT, NumMsgs, 1);
+	capture.End(RetVal);
+	fulcrum_DEBUG(_T("%s %lu INJECT_FRAME: Channel %lu, %s, %lu bytes, %lu sent, returning %s\n"), _T(FULCRUM_COMMAND_REPLY),
+		(unsigned long)nRequestID, ChannelID, fulcrumArg_prot(injectMsg.ProtocolID), DataSize, NumMsgs, fulcrumArg_return(RetVal));
+}
\ No newline at end of file
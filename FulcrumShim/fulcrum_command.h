@@ -0,0 +1,63 @@
+/*
+**
+** Copyright (C) 2022 MEAT Inc
+** Author: Zack Walsh <neo.smith@motorengineeringandtech.com>
+**
+** This library is free software; you can redistribute it and/or modify
+** it under the terms of the GNU Lesser General Public License as published
+** by the Free Software Foundation, either version 3 of the License, or (at
+** your option) any later version.
+**
+** This library is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+** Lesser General Public License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public
+** License along with this library; if not, <http://www.gnu.org/licenses/>.
+**
+*/
+
+#pragma once
+
+// Standard Imports
+#include <stddef.h>
+#include <stdint.h>
+
+// Fulcrum Resource Imports
+#include "fulcrum_pipe.h"
+
+// Prefix on the log lines that answer a command
+#define FULCRUM_COMMAND_REPLY "-->       COMMAND REPLY"
+
+// Commands the Injector can send in a FRAME_COMMAND frame. Every payload starts with the
+// command ID and a request ID (both uint32, little endian). The request ID comes back on the reply
+enum fulcrum_command_id {
+	COMMAND_SET_VERBOSITY = 1,		// uint32 fulcrum_log_verbosity
+	COMMAND_PAUSE_CAPTURE = 2,		// No arguments
+	COMMAND_RESUME_CAPTURE = 3,		// No arguments
+	COMMAND_QUERY_STATS = 4,		// No arguments
+	COMMAND_INJECT_FRAME = 5,		// uint32 ChannelID, ProtocolID, TxFlags, Timeout, DataSize, then the data bytes
+};
+
+// Reads command frames off the input pipe and runs them. Commands run on the pipe's input reader
+// thread without taking any PassThru locks, so a PassThru call blocked in the driver never holds
+// up a command. Injecting a frame is the one exception and only waits on its own channel.
+// Replies go out as log lines so they stay in order with everything else
+class fulcrum_command {
+public:
+	// Starts the input reader on the pipe. The pipe's input side must already be connected
+	static bool Start(fulcrum_pipe* pPipe);
+
+	// Input reader callback. Bytes may hold any part of one or more frames
+	static void Feed(const byte* pData, size_t nBytes, void* pContext);
+
+	// Runs one command payload
+	static void Dispatch(const uint8_t* pPayload, size_t nLength);
+
+private:
+	static void SetVerbosity(uint32_t nRequestID, const uint8_t* pArgs, size_t nLength);
+	static void SetPaused(uint32_t nRequestID, bool fPaused);
+	static void QueryStats(uint32_t nRequestID);
+	static void InjectFrame(uint32_t nRequestID, const uint8_t* pArgs, size_t nLength);
+};
\ No newline at end of file
@@ -32,12 +32,15 @@
 #include "fulcrum_j2534.h"
 #include "fulcrum_debug.h"
 #include "fulcrum_output.h"
+#include "fulcrum_deferred.h"
 #include "fulcrum_frontend.h"
+#include "fulcrum_clock.h"
 
 // In case of some internal errors we'll return ERR_FAILED, set our own internal string,
-// and return that until the app makes another PassThru function call
-bool fUseLastInternalError = false;
-TCHAR szLastInternalError[80] = {0};
+// and return that until the app makes another PassThru function call. Each thread has its own
+// since calls on different channels can run at the same time
+thread_local bool fUseLastInternalError = false;
+thread_local TCHAR szLastInternalError[80] = {0};
 void fulcrum_setInternalError(LPCTSTR format, ...)
 {
 	va_list	args;
@@ -65,18 +68,18 @@ bool fulcrum_hadInternalError()
 
 void fulcrum_printretval(unsigned long retval)
 {
+	// Only the return code and error text are copied here. The names are looked up by the log writer
 	if (retval == STATUS_NOERROR ||
 		retval == ERR_TIMEOUT ||
 		retval == ERR_BUFFER_EMPTY)
 	{
-		fulcrum_output::fulcrumDebug(_T("  %.3fs %s\n"), GetTimeSinceInit(), fulcrumDebug_return(retval).c_str());
+		fulcrum_DEBUG(_T("  %.3fs %s\n"), fulcrumClock_Seconds(), fulcrumArg_return(retval));
 	}
 	else
 	{
 		char szErrorDescription[80];
 		fulcrum_PassThruGetLastError(szErrorDescription);
-		CStringW cstrErrorDescription(szErrorDescription);
-		fulcrum_output::fulcrumDebug(_T("  %.3fs %s '%s'\n"), GetTimeSinceInit(), fulcrumDebug_return(retval).c_str(), cstrErrorDescription);
+		fulcrum_DEBUG(_T("  %.3fs %s '%s'\n"), fulcrumClock_Seconds(), fulcrumArg_return(retval), szErrorDescription);
 	}
 }
 
@@ -405,12 +408,12 @@ static LPCTSTR fulcrumDebug_cflag2str(unsigned long ConnectFlag)
 	return _T("?cflag?");
 }
 
-void fulcrumDebug_printcflag(unsigned long ConnectFlags)
+tstring fulcrumDebug_cflags(unsigned long ConnectFlags)
 {
 	std::basic_ostringstream<wchar_t> ssConnectFlags;
 
 	if (ConnectFlags == 0)
-		return;
+		return tstring();
 
 	ssConnectFlags << _T("  Flags:");
 	for (int i=0; i < 32; i++)
@@ -428,7 +431,7 @@ void fulcrumDebug_printcflag(unsigned long ConnectFlags)
 	}
 	ssConnectFlags << std::endl;
 
-	fulcrum_output::fulcrumDebug(ssConnectFlags.str().c_str());
+	return ssConnectFlags.str();
 }
 
 static LPCTSTR fulcrumDebug_rxstatus2str(unsigned long RxStatus)
@@ -467,12 +470,12 @@ static LPCTSTR fulcrumDebug_rxstatus2str(unsigned long RxStatus)
 	return _T("?rxstatus?");
 }
 
-void fulcrumDebug_printrxstatus(unsigned long RxStatus)
+tstring fulcrumDebug_rxstatus(unsigned long RxStatus)
 {
 	std::basic_ostringstream<wchar_t> ssRxStatus;
 
 	if (RxStatus == 0)
-		return;
+		return tstring();
 
 	ssRxStatus << _T("  RxStatus:");
 	for (int i=0; i < 32; i++)
@@ -490,7 +493,7 @@ void fulcrumDebug_printrxstatus(unsigned long RxStatus)
 	}
 	ssRxStatus << std::endl;
 
-	fulcrum_output::fulcrumDebug(ssRxStatus.str().c_str());
+	return ssRxStatus.str();
 }
 
 static LPCTSTR fulcrumDebug_txflag2str(unsigned long TxFlags)
@@ -526,12 +529,12 @@ static LPCTSTR fulcrumDebug_txflag2str(unsigned long TxFlags)
 	return _T("?txflag?");
 }
 
-void fulcrumDebug_printtxflags(unsigned long TxFlags)
+tstring fulcrumDebug_txflags(unsigned long TxFlags)
 {
 	std::basic_ostringstream<wchar_t> ssTxFlags;
 
 	if (TxFlags == 0)
-		return;
+		return tstring();
 
 	ssTxFlags << _T("  TxFlags:");
 	for (int i=0; i < 32; i++)
@@ -549,140 +552,5 @@ void fulcrumDebug_printtxflags(unsigned long TxFlags)
 	}
 	ssTxFlags << std::endl;
 
-	fulcrum_output::fulcrumDebug(ssTxFlags.str().c_str());
-}
-
-void fulcrumDebug_printsbyte(SBYTE_ARRAY *inAry, LPCTSTR s)
-{
-	if (inAry == NULL)
-	{
-		fulcrum_output::fulcrumDebug(_T("  %s is NULL\n"), s);
-		return;
-	}
-
-	fulcrum_output::fulcrumDebug(_T("  %s: %lu bytes at 0x%08X\n"), s, inAry->NumOfBytes, inAry->BytePtr);
-
-	if (inAry->BytePtr == NULL)
-	{
-		fulcrum_output::fulcrumDebug(_T("  %s->BytePtr is NULL\n"), inAry);
-		return;
-	}
-
-	if (inAry->NumOfBytes > 0)
-	{
-		std::basic_ostringstream<wchar_t> ssData;
-
-		ssData << std::hex << std::setfill(_T('0')) << _T("  \\__");
-		for (unsigned long i=0; i < inAry->NumOfBytes; i++)
-		{
-			ssData << _T(" ") << std::setw(2) << inAry->BytePtr[i];
-		}
-		ssData << std::endl;
-
-		fulcrum_output::fulcrumDebug(ssData.str().c_str());
-	}
-}
-
-void dbug_printsconfig(SCONFIG_LIST *pList)
-{
-	if (pList == NULL)
-	{
-		fulcrum_output::fulcrumDebug(_T("  pList is NULL\n"));
-		return;
-	}
-
-	fulcrum_output::fulcrumDebug(_T("  %ld parameter(s) at 0x%08X:\n"), pList->NumOfParams, pList->ConfigPtr);
-	if (pList->ConfigPtr == NULL)
-	{
-		fulcrum_output::fulcrumDebug(_T("  pList->ConfigPtr is NULL\n"));
-		return;
-	}
-
-	for (unsigned long i=0; i < pList->NumOfParams; i++)
-	{
-		fulcrum_output::fulcrumDebug(_T("    %s = %ld\n"), fulcrumDebug_param(pList->ConfigPtr[i].Parameter).c_str(), pList->ConfigPtr[i].Value);
-	}
-}
-
-void fulcrumDebug_printmsg(PASSTHRU_MSG mm[], LPCTSTR s, unsigned long * numMsgs, bool isWrite)
-{
-	if (mm == NULL)
-		fulcrum_output::fulcrumDebug(_T("  %s is NULL\n"), s);
-	if (numMsgs == NULL)
-		fulcrum_output::fulcrumDebug(_T("  numMsgs is NULL\n"), s);
-
-	if (mm == NULL || numMsgs == NULL)
-		return;
-
-	fulcrumDebug_printmsg(mm, s, *numMsgs, isWrite);
-}
-
-void fulcrumDebug_printmsg(PASSTHRU_MSG mm[], LPCTSTR s, unsigned long numMsgs, bool isWrite)
-{
-	if (mm == NULL)
-	{
-		fulcrum_output::fulcrumDebug(_T("  %s is NULL\n"), s);
-		return;
-	}
-
-	for (unsigned long i=0; i < numMsgs; i++)
-	{
-		if (isWrite == true)
-		{
-			fulcrum_output::fulcrumDebug(_T("  %s[%d] %s. %lu bytes. TxF=0x%08lx\n"),
-				s,
-				i,
-				//numMsgs,
-				fulcrumDebug_prot(mm[i].ProtocolID).c_str(),
-				mm[i].DataSize,
-				mm[i].TxFlags);
-		}
-		else
-		{
-			fulcrum_output::fulcrumDebug(_T("  %s[%d] %fs. %s. Actual data %lu of %lu bytes. RxS=0x%08lx\n"),
-				s,
-				i,
-				//numMsgs,
-				mm[i].Timestamp / (float) 1000000,
-				fulcrumDebug_prot(mm[i].ProtocolID).c_str(),
-				mm[i].ExtraDataIndex,
-				mm[i].DataSize,
-				mm[i].RxStatus);
-		}
-
-		// Display TxFlags if this is an outgoing message
-		if (mm[i].TxFlags != 0 && isWrite == true)
-		{
-			fulcrumDebug_printtxflags(mm[i].TxFlags);
-		}
-
-		// Display RxStatus if this is an incoming message
-		if (mm[i].RxStatus != 0 && isWrite == false)
-		{
-			fulcrumDebug_printrxstatus(mm[i].RxStatus);
-		}
-
-		// Display Data[] except for frames containing neither data nor extradata
-		if (mm[i].DataSize > 0)
-		{
-			std::basic_ostringstream<wchar_t> ssData;
-			unsigned long n = mm[i].ExtraDataIndex;
-
-			ssData << std::hex << std::setfill(_T('0')) << _T("  \\__");
-			for (unsigned long x = 0; x < mm[i].DataSize && x < sizeof(mm[i].Data); x++)
-			{
-				if (x < mm[i].ExtraDataIndex || isWrite == true)
-				{
-					ssData << _T(" ") << std::setw(2) << mm[i].Data[x];
-				}
-				else
-				{
-					ssData << _T(" [") << std::setw(2) << mm[i].Data[x] << _T("]");
-				}
-			}
-			ssData << std::endl;
-
-			fulcrum_output::fulcrumDebug(ssData.str().c_str());
-		}
-	}
+	return ssTxFlags.str();
 }
\ No newline at end of file
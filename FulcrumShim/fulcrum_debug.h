@@ -35,11 +35,8 @@ tstring fulcrumDebug_ioctl(unsigned long IoctlID);
 tstring fulcrumDebug_param(unsigned long ParamID);
 tstring fulcrumDebug_prot(unsigned long ProtocolID);
 
-void fulcrumDebug_printcflag(unsigned long ConnectFlags);
-void fulcrumDebug_printrxstatus(unsigned long RxStatus);
-void fulcrumDebug_printtxflags(unsigned long TxFlags);
+tstring fulcrumDebug_cflags(unsigned long ConnectFlags);
+tstring fulcrumDebug_rxstatus(unsigned long RxStatus);
+tstring fulcrumDebug_txflags(unsigned long TxFlags);
+
 void fulcrum_printretval(unsigned long RetVal);
-void fulcrumDebug_printsbyte(SBYTE_ARRAY *inAry, LPCTSTR s);
-void dbug_printsconfig(SCONFIG_LIST *pList);
-void fulcrumDebug_printmsg(PASSTHRU_MSG mm[], LPCTSTR s, unsigned long * numMsgs, bool isWrite);
-void fulcrumDebug_printmsg(PASSTHRU_MSG mm[], LPCTSTR s, unsigned long numMsgs, bool isWrite);
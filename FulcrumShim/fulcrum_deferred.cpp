@@ -0,0 +1,282 @@
+/*
+**
+** Copyright (C) 2022 MEAT Inc
+** Author: Zack Walsh <neo.smith@motorengineeringandtech.com>
+**
+** This library is free software; you can redistribute it and/or modify
+** it under the terms of the GNU Lesser General Public License as published
+** by the Free Software Foundation, either version 3 of the License, or (at
+** your option) any later version.
+**
+** This library is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+** Lesser General Public License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public
+** License along with this library; if not, <http://www.gnu.org/licenses/>.
+**
+*/
+
+
+// Standard Imports
+#include "stdafx.h"
+#include <atomic>
+#include <string.h>
+#include <vector>
+
+// Fulcrum Resource Imports
+#include "fulcrum_debug.h"
+#include "fulcrum_output.h"
+#include "fulcrum_deferred.h"
+#include "fulcrum_clock.h"
+
+// Registered format strings. Slots are only ever filled once so readers never need a lock
+static std::atomic<uint32_t> nFormatsRegistered(0);
+static std::atomic<LPCTSTR> formatTable[FULCRUM_DEFERRED_MAX_FORMATS];
+
+// Every thread packs its log records in its own buffer so we only allocate while it grows
+static std::vector<uint8_t>& fulcrumDeferredBuffer()
+{
+	thread_local std::vector<uint8_t> deferredBuffer;
+	return deferredBuffer;
+}
+
+// Offset of the packed arguments inside a log record
+static const size_t DeferredArgsOffset = sizeof(fulcrum_capture_record_header) + sizeof(fulcrum_capture_field_header) + sizeof(uint32_t);
+
+// ---------------------------------------------------------------------------------------------------------------------------------
+
+// Reads the next packed argument out of a log record
+struct fulcrum_deferred_value {
+	uint8_t Type;
+	uint64_t Bits;				// Integer, pointer, or double bits
+	tstring Text;				// String and J2534 name arguments
+};
+static bool fulcrumDeferredRead(const uint8_t* pArgs, size_t nLength, size_t& readOffset, fulcrum_deferred_value& argValue)
+{
+	if (readOffset >= nLength) return false;
+	argValue.Type = pArgs[readOffset++];
+	argValue.Bits = 0;
+	argValue.Text.clear();
+
+	size_t nValueSize = 0;
+	switch (argValue.Type)
+	{
+	case DEFERRED_ARG_INT32:
+	case DEFERRED_ARG_UINT32:	nValueSize = sizeof(uint32_t); break;
+	case DEFERRED_ARG_INT64:
+	case DEFERRED_ARG_UINT64:
+	case DEFERRED_ARG_DOUBLE:
+	case DEFERRED_ARG_POINTER:	nValueSize = sizeof(uint64_t); break;
+	case DEFERRED_ARG_J2534_NAME:
+	{
+		// Table and value, then look the name up the same way the PassThru logging does
+		if (readOffset + 5 > nLength) return false;
+		uint8_t nameTable = pArgs[readOffset];
+		uint32_t nameValue; memcpy(&nameValue, &pArgs[readOffset + 1], sizeof(nameValue));
+		readOffset += 5;
+		argValue.Bits = nameValue;
+		switch (nameTable)
+		{
+		case DEFERRED_NAME_RETURN:		argValue.Text = fulcrumDebug_return(nameValue); break;
+		case DEFERRED_NAME_PROTOCOL:	argValue.Text = fulcrumDebug_prot(nameValue); break;
+		case DEFERRED_NAME_FILTER:		argValue.Text = fulcrumDebug_filter(nameValue); break;
+		case DEFERRED_NAME_IOCTL:		argValue.Text = fulcrumDebug_ioctl(nameValue); break;
+		case DEFERRED_NAME_PARAM:		argValue.Text = fulcrumDebug_param(nameValue); break;
+		default:						argValue.Text = _T("(unknown)"); break;
+		}
+		return true;
+	}
+	case DEFERRED_ARG_STRING:
+	case DEFERRED_ARG_WSTRING:
+	{
+		// Length first. NULL strings print the same way the CRT prints them
+		if (readOffset + sizeof(uint32_t) > nLength) return false;
+		uint32_t nChars; memcpy(&nChars, &pArgs[readOffset], sizeof(nChars));
+		readOffset += sizeof(nChars);
+		if (nChars == 0xFFFFFFFF) { argValue.Text = _T("(null)"); return true; }
+
+		size_t nCharSize = argValue.Type == DEFERRED_ARG_STRING ? sizeof(char) : sizeof(wchar_t);
+		if (nChars > (nLength - readOffset) / nCharSize) return false;
+		if (argValue.Type == DEFERRED_ARG_STRING) {
+			// Widen narrow text with the ANSI code page the same way CStringW does
+			int nWideChars = nChars == 0 ? 0 : MultiByteToWideChar(CP_ACP, 0, (LPCSTR)&pArgs[readOffset], (int)nChars, NULL, 0);
+			argValue.Text.resize(nWideChars);
+			if (nWideChars > 0) MultiByteToWideChar(CP_ACP, 0, (LPCSTR)&pArgs[readOffset], (int)nChars, &argValue.Text[0], nWideChars);
+		}
+		else {
+			argValue.Text.resize(nChars);
+			if (nChars > 0) memcpy(&argValue.Text[0], &pArgs[readOffset], nChars * nCharSize);
+		}
+		readOffset += nChars * nCharSize;
+		return true;
+	}
+	default:
+		return false;
+	}
+
+	if (readOffset + nValueSize > nLength) return false;
+	memcpy(&argValue.Bits, &pArgs[readOffset], nValueSize);
+	readOffset += nValueSize;
+	return true;
+}
+
+// Formats one argument with a single printf specifier. The length modifier is picked from the stored
+// argument type instead of the one in the format so 32 and 64 bit values always print correctly
+static void fulcrumDeferredFormatArg(const tstring& specPrefix, TCHAR specType, const fulcrum_deferred_value& argValue, tstring& strOutput)
+{
+	TCHAR szValue[512];
+	tstring specString(specPrefix);
+	int nLength = -1;
+
+	bool isInteger = argValue.Type == DEFERRED_ARG_INT32 || argValue.Type == DEFERRED_ARG_UINT32 ||
+		argValue.Type == DEFERRED_ARG_INT64 || argValue.Type == DEFERRED_ARG_UINT64 || argValue.Type == DEFERRED_ARG_J2534_NAME;
+	bool isWide = argValue.Type == DEFERRED_ARG_INT64 || argValue.Type == DEFERRED_ARG_UINT64;
+
+	switch (specType)
+	{
+	case _T('d'): case _T('i'):
+	case _T('u'): case _T('x'): case _T('X'): case _T('o'):
+	{
+		if (!isInteger) break;
+		specString += _T("ll"); specString += specType;
+		long long signedValue = isWide ? (long long)argValue.Bits : (long long)(int32_t)(uint32_t)argValue.Bits;
+		unsigned long long unsignedValue = isWide ? argValue.Bits : (uint32_t)argValue.Bits;
+		if (specType == _T('d') || specType == _T('i')) nLength = _sntprintf_s(szValue, _countof(szValue), _TRUNCATE, specString.c_str(), signedValue);
+		else nLength = _sntprintf_s(szValue, _countof(szValue), _TRUNCATE, specString.c_str(), unsignedValue);
+		break;
+	}
+	case _T('c'):
+		if (!isInteger) break;
+		specString += specType;
+		nLength = _sntprintf_s(szValue, _countof(szValue), _TRUNCATE, specString.c_str(), (int)argValue.Bits);
+		break;
+	case _T('f'): case _T('F'): case _T('e'): case _T('E'):
+	case _T('g'): case _T('G'): case _T('a'): case _T('A'):
+	{
+		if (argValue.Type != DEFERRED_ARG_DOUBLE) break;
+		double doubleValue; memcpy(&doubleValue, &argValue.Bits, sizeof(doubleValue));
+		specString += specType;
+		nLength = _sntprintf_s(szValue, _countof(szValue), _TRUNCATE, specString.c_str(), doubleValue);
+		break;
+	}
+	case _T('p'):
+		if (argValue.Type != DEFERRED_ARG_POINTER) break;
+		specString += _T("p");
+		nLength = _sntprintf_s(szValue, _countof(szValue), _TRUNCATE, specString.c_str(), (void*)(uintptr_t)argValue.Bits);
+		break;
+	case _T('s'): case _T('S'):
+		// Strings go through the CRT too so width and precision still work. Text is always wide here
+		if (argValue.Type != DEFERRED_ARG_STRING && argValue.Type != DEFERRED_ARG_WSTRING && argValue.Type != DEFERRED_ARG_J2534_NAME) break;
+		if (specString.size() == 1) { strOutput += argValue.Text; return; }
+		specString += _T("ls");
+		nLength = _sntprintf_s(szValue, _countof(szValue), _TRUNCATE, specString.c_str(), argValue.Text.c_str());
+		break;
+	}
+
+	// Anything which didn't match its specifier is called out instead of guessed at
+	if (nLength < 0) { strOutput += _T("(bad arg)"); return; }
+	strOutput.append(szValue, nLength);
+}
+
+// ---------------------------------------------------------------------------------------------------------------------------------
+
+// Format string registry
+uint32_t fulcrum_deferred::Register(LPCTSTR szFormat)
+{
+	uint32_t formatID = nFormatsRegistered.fetch_add(1, std::memory_order_relaxed);
+	if (formatID >= FULCRUM_DEFERRED_MAX_FORMATS) return FULCRUM_DEFERRED_INVALID_ID;
+	formatTable[formatID].store(szFormat, std::memory_order_release);
+	return formatID;
+}
+LPCTSTR fulcrum_deferred::Lookup(uint32_t formatID)
+{
+	if (formatID >= FULCRUM_DEFERRED_MAX_FORMATS) return NULL;
+	return formatTable[formatID].load(std::memory_order_acquire);
+}
+
+// Walks the format string and fills in each specifier with the next packed argument
+void fulcrum_deferred::Format(LPCTSTR szFormat, const uint8_t* pArgs, size_t nLength, tstring& strOutput)
+{
+	size_t readOffset = 0;
+	fulcrum_deferred_value argValue;
+	for (LPCTSTR pFormat = szFormat; *pFormat != 0; )
+	{
+		// Plain text goes straight through
+		if (*pFormat != _T('%')) { strOutput += *pFormat++; continue; }
+		if (pFormat[1] == _T('%')) { strOutput += _T('%'); pFormat += 2; continue; }
+
+		// Flags, width, and precision are kept as they are. '*' values come from the arguments
+		tstring specPrefix(1, _T('%'));
+		pFormat++;
+		while (*pFormat != 0 && _tcschr(_T("-+ #0"), *pFormat) != NULL) specPrefix += *pFormat++;
+		for (int specPart = 0; specPart < 2; specPart++)
+		{
+			if (specPart == 1) { if (*pFormat != _T('.')) break; specPrefix += *pFormat++; }
+			if (*pFormat == _T('*')) {
+				pFormat++;
+				if (!fulcrumDeferredRead(pArgs, nLength, readOffset, argValue)) { strOutput += _T("(bad arg)"); return; }
+				TCHAR szStar[16]; _sntprintf_s(szStar, _countof(szStar), _TRUNCATE, _T("%d"), (int)argValue.Bits);
+				specPrefix += szStar;
+			}
+			else while (*pFormat >= _T('0') && *pFormat <= _T('9')) specPrefix += *pFormat++;
+		}
+
+		// The length modifier in the format is dropped. The packed type decides the size
+		while (*pFormat != 0 && _tcschr(_T("hlLjzqtwI"), *pFormat) != NULL) {
+			if (*pFormat == _T('I') && (pFormat[1] == _T('6') || pFormat[1] == _T('3'))) pFormat += 2;
+			pFormat++;
+		}
+		if (*pFormat == 0) break;
+
+		TCHAR specType = *pFormat++;
+		if (!fulcrumDeferredRead(pArgs, nLength, readOffset, argValue)) { strOutput += _T("(bad arg)"); continue; }
+		fulcrumDeferredFormatArg(specPrefix, specType, argValue, strOutput);
+	}
+}
+
+// ---------------------------------------------------------------------------------------------------------------------------------
+
+// Starts a log record in this thread's buffer. Arguments are appended after the format ID
+std::vector<uint8_t>& fulcrum_deferred::Begin(uint32_t formatID)
+{
+	std::vector<uint8_t>& recordBuffer = fulcrumDeferredBuffer();
+	recordBuffer.resize(DeferredArgsOffset);
+
+	fulcrum_capture_record_header recordHeader;
+	recordHeader.Length = 0;
+	recordHeader.Type = CAPTURE_LOG_MESSAGE;
+	recordHeader.Function = CAPTURE_FN_NONE;
+	recordHeader.Timestamp = fulcrumClock_Now();
+	recordHeader.ThreadID = GetCurrentThreadId();
+	recordHeader.FieldCount = 1;
+	memcpy(&recordBuffer[0], &recordHeader, sizeof(recordHeader));
+	memcpy(&recordBuffer[DeferredArgsOffset - sizeof(formatID)], &formatID, sizeof(formatID));
+	return recordBuffer;
+}
+
+// Finishes the record in this thread's buffer and hands it off
+void fulcrum_deferred::Send(uint32_t formatID)
+{
+	std::vector<uint8_t>& recordBuffer = fulcrumDeferredBuffer();
+	LPCTSTR szFormat = Lookup(formatID);
+	if (szFormat == NULL) return;
+
+#if DEFERRED_LOGGING
+	// Patch up the sizes and let the writer thread do the formatting
+	fulcrum_capture_field_header fieldHeader;
+	fieldHeader.Tag = FIELD_LOG_ARGS;
+	fieldHeader.Index = 0;
+	fieldHeader.Flags = 0;
+	fieldHeader.Length = (uint32_t)(recordBuffer.size() - sizeof(fulcrum_capture_record_header) - sizeof(fieldHeader));
+	memcpy(&recordBuffer[sizeof(fulcrum_capture_record_header)], &fieldHeader, sizeof(fieldHeader));
+	((fulcrum_capture_record_header*)&recordBuffer[0])->Length = (uint32_t)recordBuffer.size();
+	fulcrum_output::fulcrumCapture(&recordBuffer[0], recordBuffer.size());
+#else
+	// Deferred logging is off. Format on this thread and queue plain text like we used to
+	tstring strLine;
+	Format(szFormat, &recordBuffer[DeferredArgsOffset], recordBuffer.size() - DeferredArgsOffset, strLine);
+	fulcrum_output::fulcrumDebug(_T("%s"), strLine.c_str());
+#endif
+}
\ No newline at end of file
@@ -0,0 +1,152 @@
+/*
+**
+** Copyright (C) 2022 MEAT Inc
+** Author: Zack Walsh <neo.smith@motorengineeringandtech.com>
+**
+** This library is free software; you can redistribute it and/or modify
+** it under the terms of the GNU Lesser General Public License as published
+** by the Free Software Foundation, either version 3 of the License, or (at
+** your option) any later version.
+**
+** This library is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+** Lesser General Public License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public
+** License along with this library; if not, <http://www.gnu.org/licenses/>.
+**
+*/
+
+
+#pragma once
+
+// Standard Imports
+#include <atomic>
+#include <stdint.h>
+#include <string.h>
+#include <tchar.h>
+#include <vector>
+
+// Fulcrum Resource Imports
+#include "config.h"
+#include "fulcrum_loader.h"		// for TSTRING
+#include "fulcrum_capture_format.h"
+
+// Most format strings we'll keep track of. The shim has well under a hundred call sites
+#define FULCRUM_DEFERRED_MAX_FORMATS 4096
+#define FULCRUM_DEFERRED_INVALID_ID 0xFFFFFFFF
+
+// Wrapper for J2534 values which should be logged by name. Only the number is copied on the
+// calling thread, the name lookup (fulcrumDebug_return() and friends) happens when the line is formatted
+struct fulcrum_j2534_name {
+	uint8_t Table;
+	uint32_t Value;
+};
+inline fulcrum_j2534_name fulcrumArg_return(unsigned long RetVal) { fulcrum_j2534_name argName = { DEFERRED_NAME_RETURN, (uint32_t)RetVal }; return argName; }
+inline fulcrum_j2534_name fulcrumArg_prot(unsigned long ProtocolID) { fulcrum_j2534_name argName = { DEFERRED_NAME_PROTOCOL, (uint32_t)ProtocolID }; return argName; }
+inline fulcrum_j2534_name fulcrumArg_filter(unsigned long FilterType) { fulcrum_j2534_name argName = { DEFERRED_NAME_FILTER, (uint32_t)FilterType }; return argName; }
+inline fulcrum_j2534_name fulcrumArg_ioctl(unsigned long IoctlID) { fulcrum_j2534_name argName = { DEFERRED_NAME_IOCTL, (uint32_t)IoctlID }; return argName; }
+inline fulcrum_j2534_name fulcrumArg_param(unsigned long ParamID) { fulcrum_j2534_name argName = { DEFERRED_NAME_PARAM, (uint32_t)ParamID }; return argName; }
+
+// Logs a debug line through the deferred formatter. The format string is registered the first
+// time the call site runs. Only string literals may be used for the format
+#define fulcrum_DEBUG(format_string, ...) \
+do { \
+	static const uint32_t fulcrumFormatID = fulcrum_deferred::Register(format_string); \
+	fulcrum_deferred::Log(fulcrumFormatID, ##__VA_ARGS__); \
+} while (0)
+
+// Deferred formatting for debug lines. Every call site registers its format string once and gets an ID
+// back. After that a log call only copies the ID and the raw argument bytes into a capture record.
+// The log writer thread (or fulcrum_capture_render::RenderFile() offline) turns them into text later
+class fulcrum_deferred {
+public:
+	// Format string registry. Format strings must be literals since we only keep the pointer
+	static uint32_t Register(LPCTSTR szFormat);
+	static LPCTSTR Lookup(uint32_t formatID);
+
+	// Builds the text for a packed argument list. Walks the printf specifiers in the format one at a time
+	static void Format(LPCTSTR szFormat, const uint8_t* pArgs, size_t nLength, tstring& strOutput);
+
+	// Hot path for fulcrum_DEBUG(). Packs the arguments and hands the record to the writer thread
+	template<typename... Args>
+	static void Log(uint32_t formatID, const Args&... args)
+	{
+		std::vector<uint8_t>& recordBuffer = Begin(formatID);
+		PackAll(recordBuffer, args...);
+		Send(formatID);
+	}
+
+private:
+	static std::vector<uint8_t>& Begin(uint32_t formatID);
+	static void Send(uint32_t formatID);
+
+	// Expands the argument pack in order
+	static void PackAll(std::vector<uint8_t>&) {}
+	template<typename First, typename... Rest>
+	static void PackAll(std::vector<uint8_t>& recordBuffer, const First& firstArg, const Rest&... restArgs)
+	{
+		Pack(recordBuffer, firstArg);
+		PackAll(recordBuffer, restArgs...);
+	}
+
+	// One overload per type we can log. Anything else fails to compile instead of logging garbage
+	static void PackValue(std::vector<uint8_t>& recordBuffer, uint8_t argType, const void* pValue, size_t nSize)
+	{
+		size_t writeOffset = recordBuffer.size();
+		recordBuffer.resize(writeOffset + 1 + nSize);
+		recordBuffer[writeOffset] = argType;
+		memcpy(&recordBuffer[writeOffset + 1], pValue, nSize);
+	}
+	static void PackString(std::vector<uint8_t>& recordBuffer, uint8_t argType, const void* pString, uint32_t nChars, size_t nCharSize)
+	{
+		PackValue(recordBuffer, argType, &nChars, sizeof(nChars));
+		if (pString == NULL || nChars == 0) return;
+		size_t writeOffset = recordBuffer.size();
+		recordBuffer.resize(writeOffset + nChars * nCharSize);
+		memcpy(&recordBuffer[writeOffset], pString, nChars * nCharSize);
+	}
+	static void PackSigned(std::vector<uint8_t>& recordBuffer, int64_t argValue, size_t nSize)
+	{
+		if (nSize <= sizeof(int32_t)) { int32_t packedValue = (int32_t)argValue; PackValue(recordBuffer, DEFERRED_ARG_INT32, &packedValue, sizeof(packedValue)); }
+		else PackValue(recordBuffer, DEFERRED_ARG_INT64, &argValue, sizeof(argValue));
+	}
+	static void PackUnsigned(std::vector<uint8_t>& recordBuffer, uint64_t argValue, size_t nSize)
+	{
+		if (nSize <= sizeof(uint32_t)) { uint32_t packedValue = (uint32_t)argValue; PackValue(recordBuffer, DEFERRED_ARG_UINT32, &packedValue, sizeof(packedValue)); }
+		else PackValue(recordBuffer, DEFERRED_ARG_UINT64, &argValue, sizeof(argValue));
+	}
+
+	static void Pack(std::vector<uint8_t>& recordBuffer, bool argValue) { PackSigned(recordBuffer, argValue ? 1 : 0, sizeof(int)); }
+	static void Pack(std::vector<uint8_t>& recordBuffer, int argValue) { PackSigned(recordBuffer, argValue, sizeof(argValue)); }
+	static void Pack(std::vector<uint8_t>& recordBuffer, long argValue) { PackSigned(recordBuffer, argValue, sizeof(argValue)); }
+	static void Pack(std::vector<uint8_t>& recordBuffer, long long argValue) { PackSigned(recordBuffer, argValue, sizeof(argValue)); }
+	static void Pack(std::vector<uint8_t>& recordBuffer, unsigned int argValue) { PackUnsigned(recordBuffer, argValue, sizeof(argValue)); }
+	static void Pack(std::vector<uint8_t>& recordBuffer, unsigned long argValue) { PackUnsigned(recordBuffer, argValue, sizeof(argValue)); }
+	static void Pack(std::vector<uint8_t>& recordBuffer, unsigned long long argValue) { PackUnsigned(recordBuffer, argValue, sizeof(argValue)); }
+	static void Pack(std::vector<uint8_t>& recordBuffer, double argValue) { PackValue(recordBuffer, DEFERRED_ARG_DOUBLE, &argValue, sizeof(argValue)); }
+	static void Pack(std::vector<uint8_t>& recordBuffer, float argValue) { Pack(recordBuffer, (double)argValue); }
+	static void Pack(std::vector<uint8_t>& recordBuffer, const char* argValue)
+	{
+		PackString(recordBuffer, DEFERRED_ARG_STRING, argValue, argValue == NULL ? 0xFFFFFFFF : (uint32_t)strlen(argValue), sizeof(char));
+	}
+	static void Pack(std::vector<uint8_t>& recordBuffer, char* argValue) { Pack(recordBuffer, (const char*)argValue); }
+	static void Pack(std::vector<uint8_t>& recordBuffer, const wchar_t* argValue)
+	{
+		PackString(recordBuffer, DEFERRED_ARG_WSTRING, argValue, argValue == NULL ? 0xFFFFFFFF : (uint32_t)wcslen(argValue), sizeof(wchar_t));
+	}
+	static void Pack(std::vector<uint8_t>& recordBuffer, wchar_t* argValue) { Pack(recordBuffer, (const wchar_t*)argValue); }
+	static void Pack(std::vector<uint8_t>& recordBuffer, const fulcrum_j2534_name& argValue)
+	{
+		uint8_t packedName[5]; packedName[0] = argValue.Table;
+		memcpy(&packedName[1], &argValue.Value, sizeof(argValue.Value));
+		PackValue(recordBuffer, DEFERRED_ARG_J2534_NAME, packedName, sizeof(packedName));
+	}
+	template<typename T>
+	static void Pack(std::vector<uint8_t>& recordBuffer, T* argValue)
+	{
+		uint64_t packedValue = (uint64_t)(uintptr_t)argValue;
+		PackValue(recordBuffer, DEFERRED_ARG_POINTER, &packedValue, sizeof(packedValue));
+	}
+};
\ No newline at end of file
@@ -0,0 +1,186 @@
+/*
+**
+** Copyright (C) 2022 MEAT Inc
+** Author: Zack Walsh <neo.smith@motorengineeringandtech.com>
+**
+** This library is free software; you can redistribute it and/or modify
+** it under the terms of the GNU Lesser General Public License as published
+** by the Free Software Foundation, either version 3 of the License, or (at
+** your option) any later version.
+**
+** This library is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+** Lesser General Public License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public
+** License along with this library; if not, <http://www.gnu.org/licenses/>.
+**
+*/
+
+// Standard Imports
+#include <string.h>
+
+// Fulcrum Resource Imports
+#include "fulcrum_frame.h"
+
+// Decoded bytes are dropped from the front of the buffer once this many have piled up
+static const size_t DecoderCompactSize = 64 * 1024;
+
+// CRC-32 lookup table. Built once the first time a CRC is taken
+static bool fulcrumFrame_BuildTable(uint32_t* pTable)
+{
+	for (uint32_t i = 0; i < 256; i++)
+	{
+		uint32_t nValue = i;
+		for (int nBit = 0; nBit < 8; nBit++) nValue = (nValue & 1) ? (nValue >> 1) ^ 0xEDB88320U : nValue >> 1;
+		pTable[i] = nValue;
+	}
+	return true;
+}
+static const uint32_t* fulcrumFrame_Table()
+{
+	static uint32_t crcTable[256];
+	static bool crcTableBuilt = fulcrumFrame_BuildTable(crcTable);
+	(void)crcTableBuilt;
+	return crcTable;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------------------
+
+uint32_t fulcrumFrame_Crc32(uint32_t nCrc, const void* pData, size_t nBytes)
+{
+	const uint32_t* crcTable = fulcrumFrame_Table();
+	const uint8_t* pBytes = (const uint8_t*)pData;
+	nCrc = ~nCrc;
+	for (size_t i = 0; i < nBytes; i++) nCrc = crcTable[(nCrc ^ pBytes[i]) & 0xFF] ^ (nCrc >> 8);
+	return ~nCrc;
+}
+
+void fulcrumFrame_Seal(fulcrum_frame_header* pHeader, uint16_t frameType, uint32_t nSequence, const void* pPayload, uint32_t nLength)
+{
+	pHeader->Magic = FULCRUM_FRAME_MAGIC;
+	pHeader->Version = FULCRUM_FRAME_VERSION;
+	pHeader->Reserved = 0;
+	pHeader->Type = frameType;
+	pHeader->Sequence = nSequence;
+	pHeader->Length = nLength;
+	pHeader->Crc = 0;
+
+	uint32_t nCrc = fulcrumFrame_Crc32(0, pHeader, sizeof(fulcrum_frame_header));
+	pHeader->Crc = fulcrumFrame_Crc32(nCrc, pPayload, nLength);
+}
+
+// Little endian, same as fulcrum_bitconverter writes them
+static uint8_t* fulcrumFrame_PutUint32(uint8_t* pOutput, uint32_t nValue)
+{
+	pOutput[0] = (uint8_t)nValue;
+	pOutput[1] = (uint8_t)(nValue >> 8);
+	pOutput[2] = (uint8_t)(nValue >> 16);
+	pOutput[3] = (uint8_t)(nValue >> 24);
+	return pOutput + 4;
+}
+
+size_t fulcrumFrame_MessagesSize(const PASSTHRU_MSG* pMsgs, uint32_t numMsgs)
+{
+	size_t nBytes = 0;
+	for (uint32_t i = 0; i < numMsgs; i++) nBytes += FULCRUM_FRAME_MESSAGE_HEADER + pMsgs[i].DataSize;
+	return nBytes;
+}
+
+size_t fulcrumFrame_PackMessages(uint8_t* pOutput, const PASSTHRU_MSG* pMsgs, uint32_t numMsgs)
+{
+	uint8_t* pNext = pOutput;
+	for (uint32_t i = 0; i < numMsgs; i++)
+	{
+		pNext = fulcrumFrame_PutUint32(pNext, (uint32_t)pMsgs[i].ProtocolID);
+		pNext = fulcrumFrame_PutUint32(pNext, 0);										// made up handle
+		pNext = fulcrumFrame_PutUint32(pNext, (uint32_t)pMsgs[i].RxStatus);
+		pNext = fulcrumFrame_PutUint32(pNext, (uint32_t)pMsgs[i].TxFlags);
+		pNext = fulcrumFrame_PutUint32(pNext, (uint32_t)pMsgs[i].Timestamp);
+		pNext = fulcrumFrame_PutUint32(pNext, (uint32_t)pMsgs[i].DataSize);
+		pNext = fulcrumFrame_PutUint32(pNext, (uint32_t)pMsgs[i].ExtraDataIndex);
+		pNext = fulcrumFrame_PutUint32(pNext, (uint32_t)pMsgs[i].DataSize);				// don't care, just use size
+		memcpy(pNext, pMsgs[i].Data, pMsgs[i].DataSize);
+		pNext += pMsgs[i].DataSize;
+	}
+	return pNext - pOutput;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------------------
+
+// CTOR for a decoder. Nothing is expected about the first sequence number we see
+fulcrum_frame_decoder::fulcrum_frame_decoder()
+	: m_nOffset(0)
+	, m_fHaveSequence(false)
+	, m_nNextSequence(0)
+	, m_nFrames(0)
+	, m_nMissed(0)
+	, m_nSkipped(0)
+	, m_nCrcErrors(0)
+{
+}
+
+void fulcrum_frame_decoder::Feed(const void* pData, size_t nBytes)
+{
+	// Frames handed out last time are done with, so what's been used can go now
+	if (m_nOffset >= DecoderCompactSize || m_nOffset == m_Buffer.size())
+	{
+		m_Buffer.erase(m_Buffer.begin(), m_Buffer.begin() + m_nOffset);
+		m_nOffset = 0;
+	}
+	const uint8_t* pBytes = (const uint8_t*)pData;
+	m_Buffer.insert(m_Buffer.end(), pBytes, pBytes + nBytes);
+}
+
+bool fulcrum_frame_decoder::Next(fulcrum_frame& frame)
+{
+	while (m_Buffer.size() - m_nOffset >= sizeof(fulcrum_frame_header))
+	{
+		// Anything that can't be the start of a frame gets skipped a byte at a time
+		fulcrum_frame_header frameHeader;
+		memcpy(&frameHeader, &m_Buffer[m_nOffset], sizeof(frameHeader));
+		if (frameHeader.Magic != FULCRUM_FRAME_MAGIC ||
+			frameHeader.Version != FULCRUM_FRAME_VERSION ||
+			frameHeader.Length > FULCRUM_FRAME_MAX_PAYLOAD)
+		{
+			m_nOffset++; m_nSkipped++;
+			continue;
+		}
+
+		// Wait for the rest of it
+		if (m_Buffer.size() - m_nOffset < sizeof(frameHeader) + frameHeader.Length) return false;
+
+		// A bad checksum means this wasn't really a frame, or it was damaged. Either way look past its magic
+		const uint8_t* pPayload = &m_Buffer[m_nOffset] + sizeof(frameHeader);
+		uint32_t nCrc = frameHeader.Crc; frameHeader.Crc = 0;
+		uint32_t nCheck = fulcrumFrame_Crc32(fulcrumFrame_Crc32(0, &frameHeader, sizeof(frameHeader)), pPayload, frameHeader.Length);
+		if (nCheck != nCrc)
+		{
+			m_nOffset++; m_nSkipped++; m_nCrcErrors++;
+			continue;
+		}
+
+		// Any sequence numbers we jumped over are frames we never saw. Going backwards means the sender started over
+		uint32_t nSequenceGap = frameHeader.Sequence - m_nNextSequence;
+		if (m_fHaveSequence && nSequenceGap != 0 && nSequenceGap < 0x80000000U) m_nMissed += nSequenceGap;
+		m_fHaveSequence = true;
+		m_nNextSequence = frameHeader.Sequence + 1;
+		m_nFrames++;
+
+		frame.Type = frameHeader.Type;
+		frame.Sequence = frameHeader.Sequence;
+		frame.Length = frameHeader.Length;
+		frame.Payload = pPayload;
+		m_nOffset += sizeof(frameHeader) + frameHeader.Length;
+		return true;
+	}
+	return false;
+}
+
+// Share of frames lost out of everything that was sent since the first one we saw
+double fulcrum_frame_decoder::GapRate() const
+{
+	unsigned long long nTotal = m_nFrames + m_nMissed;
+	return nTotal == 0 ? 0.0 : m_nMissed / (double)nTotal;
+}
\ No newline at end of file
@@ -0,0 +1,119 @@
+/*
+**
+** Copyright (C) 2022 MEAT Inc
+** Author: Zack Walsh <neo.smith@motorengineeringandtech.com>
+**
+** This library is free software; you can redistribute it and/or modify
+** it under the terms of the GNU Lesser General Public License as published
+** by the Free Software Foundation, either version 3 of the License, or (at
+** your option) any later version.
+**
+** This library is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+** Lesser General Public License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public
+** License along with this library; if not, <http://www.gnu.org/licenses/>.
+**
+*/
+
+#pragma once
+
+// Standard Imports
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+// Fulcrum Resource Imports
+#include "fulcrum_j2534.h"
+
+// Framing for the output pipe. Every write goes out as one frame so a reader that joins late
+// or loses bytes can find the next frame boundary, tell how many frames it missed, and carry on.
+// Like the capture reader this has no Windows dependencies so the Injector side and offline
+// tools can build the decoder in.
+//
+//   Frame: fulcrum_frame_header, then Length payload bytes
+//   Crc:   CRC-32 (IEEE) of the header with Crc set to 0, then the payload
+//
+// Sequence numbers count up by one per frame from the first frame a pipe sends.
+
+#define FULCRUM_FRAME_MAGIC 0x4D524646		// "FFRM" when read as bytes
+#define FULCRUM_FRAME_VERSION 1
+#define FULCRUM_FRAME_MAX_PAYLOAD (16 * 1024 * 1024)
+
+// What a frame carries
+enum fulcrum_frame_type {
+	FRAME_TEXT = 1,				// Log line in UTF-8
+	FRAME_MESSAGES = 2,			// PASSTHRU_MSG batch as WritePassThruMessages lays it out
+	FRAME_SPARAM_LIST = 3,		// Count then Parameter, Value, Supported for each entry
+	FRAME_RESOURCE = 4,			// Connector, count, then the resource list
+	FRAME_UINT32_ARRAY = 5,		// Bare uint32 values
+	FRAME_SBYTE_ARRAY = 6,		// Byte count then the bytes
+	FRAME_SPARAM = 7,			// Parameter, Value, Supported for a single entry
+	FRAME_COMMAND = 8,			// Command from the Injector on the input pipe (see fulcrum_command.h)
+};
+
+#pragma pack(push, 1)
+struct fulcrum_frame_header {
+	uint32_t Magic;
+	uint8_t Version;
+	uint8_t Reserved;
+	uint16_t Type;
+	uint32_t Sequence;
+	uint32_t Length;
+	uint32_t Crc;
+};
+#pragma pack(pop)
+
+// Running CRC-32. Start with 0 and feed each piece in turn
+uint32_t fulcrumFrame_Crc32(uint32_t nCrc, const void* pData, size_t nBytes);
+
+// Fills in a frame header for a payload. The payload has to be final before this is called
+void fulcrumFrame_Seal(fulcrum_frame_header* pHeader, uint16_t frameType, uint32_t nSequence, const void* pPayload, uint32_t nLength);
+
+// PASSTHRU_MSG batch layout for FRAME_MESSAGES. Each message is eight uint32 values (ProtocolID, 0,
+// RxStatus, TxFlags, Timestamp, DataSize, ExtraDataIndex, DataSize) and then its data bytes
+#define FULCRUM_FRAME_MESSAGE_HEADER 32
+
+// Bytes a batch takes up, and the packing itself. Returns how many bytes were written to pOutput
+size_t fulcrumFrame_MessagesSize(const PASSTHRU_MSG* pMsgs, uint32_t numMsgs);
+size_t fulcrumFrame_PackMessages(uint8_t* pOutput, const PASSTHRU_MSG* pMsgs, uint32_t numMsgs);
+
+// A frame pulled out of the stream. Payload points into the decoder and is good until the next Feed()
+struct fulcrum_frame {
+	uint16_t Type;
+	uint32_t Sequence;
+	uint32_t Length;
+	const uint8_t* Payload;
+};
+
+// Streaming decoder. Bytes go in however they arrive and whole, checked frames come out.
+// Anything that isn't a good frame is skipped one byte at a time until the next magic lines up
+class fulcrum_frame_decoder {
+public:
+	fulcrum_frame_decoder();
+
+	// Adds bytes read from the stream
+	void Feed(const void* pData, size_t nBytes);
+
+	// Pulls the next complete frame. Returns false until more bytes are needed
+	bool Next(fulcrum_frame& frame);
+
+	// Stream health. Missing frames are counted from the gaps in sequence numbers
+	unsigned long long FramesDecoded() const { return m_nFrames; }
+	unsigned long long FramesMissed() const { return m_nMissed; }
+	unsigned long long BytesSkipped() const { return m_nSkipped; }
+	unsigned long long CrcErrors() const { return m_nCrcErrors; }
+	double GapRate() const;
+
+private:
+	std::vector<uint8_t> m_Buffer;
+	size_t m_nOffset;
+	bool m_fHaveSequence;
+	uint32_t m_nNextSequence;
+	unsigned long long m_nFrames;
+	unsigned long long m_nMissed;
+	unsigned long long m_nSkipped;
+	unsigned long long m_nCrcErrors;
+};
\ No newline at end of file
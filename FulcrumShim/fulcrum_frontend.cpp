@@ -37,7 +37,13 @@
 #include "fulcrum_j2534.h"
 #include "fulcrum_debug.h"
 #include "fulcrum_loader.h"
+#include "fulcrum_handles.h"
 #include "fulcrum_output.h"
+#include "fulcrum_capture.h"
+#include "fulcrum_capture_render.h"
+#include "fulcrum_deferred.h"
+#include "fulcrum_clock.h"
+#include "fulcrum_timesync.h"
 
 // Check if the DLL is loaded and usable or not
 #define fulcrum_CHECK_DLL() \
@@ -53,14 +59,36 @@
 // Checks if a function is usable for this given DLL
 #define fulcrum_CHECK_FUNCTION(fcn) \
 { \
-	if (__FUNCTION__ == NULL) \
+	if (fcn == NULL) \
 	{ \
-		fulcrum_setInternalError(_T("DLL loaded but does not export %s"), __FUNCTION__); \
+		fulcrum_setInternalError(_T("DLL loaded but does not export %s"), _T(#fcn)); \
 		fulcrum_printretval(ERR_FAILED); \
 		return ERR_FAILED; \
 	} \
 }
 
+// Same checks as above for calls being captured. Failures close out the capture instead of printing.
+// Once a library is loaded the handle is routed to the one that owns it
+#define fulcrum_CHECK_CAPTURE(capture, route, handleType, handleID, fcn) \
+{ \
+	if (! fulcrum_checkAndAutoload()) \
+	{ \
+		fulcrum_setInternalError(_T("FulcrumShim has not loaded a J2534 DLL")); \
+		return capture.End(ERR_FAILED); \
+	} \
+	route = fulcrum_routeHandle(handleType, handleID); \
+	if (route.Library == NULL) \
+	{ \
+		fulcrum_setInternalError(_T("FulcrumShim has not loaded a J2534 DLL")); \
+		return capture.End(ERR_FAILED); \
+	} \
+	if (route.Library->fcn == NULL) \
+	{ \
+		fulcrum_setInternalError(_T("DLL loaded but does not export %s"), _T(#fcn)); \
+		return capture.End(ERR_FAILED); \
+	} \
+}
+
 // ------------------------------------------------------------------------------------------------
 
 // Used to pulling infor staticly from commands.
@@ -71,6 +99,13 @@ static int lastVBATTReadThreshold = 10; // seconds
 
 // ------------------------------------------------------------------------------------------------
 
+// READ_VBATT and READ_PROG_VOLTAGE are sent to a device, every other IOCTL goes to a channel
+static fulcrum_handle_type fulcrum_ioctlHandleType(unsigned long IoctlID)
+{
+	if (IoctlID == READ_VBATT || IoctlID == READ_PROG_VOLTAGE) return HANDLE_DEVICE;
+	return HANDLE_CHANNEL;
+}
+
 // Converts a message into a void pointer object
 void PASSTHRU_MSG_ToVOIDPointer(PASSTHRU_MSG* pMsgIn, void* pMsgOut)
 {
@@ -96,7 +131,7 @@ extern "C" long J2534_API PassThruLoadLibrary(char * szFunctionLibrary)
 
 	// Clear out old error values and print init for method
 	fulcrum_clearInternalError();
-	fulcrum_output::fulcrumDebug(_T("++ %.3fs PTLoadLibrary(%s)\n"), GetTimeSinceInit(), (szFunctionLibrary==NULL)?_T("*NULL*"):_T("test")/*szLibrary*/);
+	fulcrum_DEBUG(_T("++ %.3fs PTLoadLibrary(%s)\n"), fulcrumClock_Seconds(), (szFunctionLibrary==NULL)?_T("*NULL*"):_T("test")/*szLibrary*/);
 
 	// If the lib loaded is null, throw error for no DLL
 	if (szFunctionLibrary == NULL)
@@ -107,9 +142,11 @@ extern "C" long J2534_API PassThruLoadLibrary(char * szFunctionLibrary)
 		return ERR_NULL_PARAMETER;
 	}
 
-	// Run the method, get our output value and print it out to our log file
+	// Run the method, get our output value and print it out to our log file. Libraries already loaded
+	// stay loaded, this one just becomes the one the next PassThruOpen() goes to
 	CStringW cstrLibrary(szFunctionLibrary); bool fSuccess;
-	fSuccess = fulcrum_loadLibrary(cstrLibrary);
+	fSuccess = fulcrum_loadLibrary(cstrLibrary) != NULL;
+	CFulcrumShim::StartupPipes();
 	if (!fSuccess)
 	{
 		fulcrum_setInternalError(_T("Failed to open '%s'"), cstrLibrary);
@@ -128,14 +165,14 @@ extern "C" long J2534_API PassThruUnloadLibrary()
 
 	// Unload our library here
 	fulcrum_clearInternalError();
-	fulcrum_output::fulcrumDebug(_T("++ %.3fs PTUnloadLibrary()\n"), GetTimeSinceInit());
+	fulcrum_DEBUG(_T("++ %.3fs PTUnloadLibrary()\n"), fulcrumClock_Seconds());
 	fulcrum_unloadLibrary();
 
 	// Unload pipe outputs
-	// fulcrum_output::fulcrumDebug(_T("-->       Calling pipe shutdown methods now...\n"));
+	// fulcrum_DEBUG(_T("-->       Calling pipe shutdown methods now...\n"));
 	// CFulcrumShim::fulcrumPiper->ShutdownInputPipe();
 	// CFulcrumShim::fulcrumPiper->ShutdownOutputPipe();
-	// fulcrum_output::fulcrumDebug(_T("-->       Pipe instances have been released OK!\n"));
+	// fulcrum_DEBUG(_T("-->       Pipe instances have been released OK!\n"));
 
 	// Print output result from call
 	fulcrum_printretval(STATUS_NOERROR);
@@ -147,10 +184,9 @@ extern "C" long J2534_API PassThruWriteToLogA(char *szMsg)
 {
 	// Ensure the module is running in static state and acquire a lock for it.
     AFX_MANAGE_STATE(AfxGetStaticModuleState());
-	CStringW cstrMsg(szMsg);
 
-	// Write output information for the log
-	fulcrum_output::fulcrumDebug(_T("** %.3fs '%s'\n"), GetTimeSinceInit(), cstrMsg);
+	// Write output information for the log. Narrow text is widened when the line is formatted
+	fulcrum_DEBUG(_T("** %.3fs '%s'\n"), fulcrumClock_Seconds(), szMsg);
 	return STATUS_NOERROR;
 }
 extern "C" long J2534_API PassThruWriteToLogW(wchar_t *szMsg)
@@ -159,18 +195,18 @@ extern "C" long J2534_API PassThruWriteToLogW(wchar_t *szMsg)
     AFX_MANAGE_STATE(AfxGetStaticModuleState());
 
 	// Write output information for the log
-	fulcrum_output::fulcrumDebug(_T("** %.3fs '%s'\n"), GetTimeSinceInit(), szMsg);
+	fulcrum_DEBUG(_T("** %.3fs '%s'\n"), fulcrumClock_Seconds(), szMsg);
 	return STATUS_NOERROR;
 }
 extern "C" long J2534_API PassThruSaveLog(char *szFilename)
 {
 	// Ensure the module is running in static state and acquire a lock for it.
     AFX_MANAGE_STATE(AfxGetStaticModuleState());
-	auto_lock lock;
+	handle_lock lock(HANDLE_GLOBAL, 0);
 
 	// Clear out old errors and print init for method
 	fulcrum_clearInternalError();
-	fulcrum_output::fulcrumDebug(_T("++ %.3fs PTSaveLog(%s)\n"), GetTimeSinceInit(), (szFilename==NULL)?_T("*NULL*"):_T("")/*pName*/);
+	fulcrum_DEBUG(_T("++ %.3fs PTSaveLog(%s)\n"), fulcrumClock_Seconds(), (szFilename==NULL)?_T("*NULL*"):_T("")/*pName*/);
 
 	// Get log file name and run method
 	CStringW cstrFilename(szFilename);
@@ -180,39 +216,70 @@ extern "C" long J2534_API PassThruSaveLog(char *szFilename)
 	fulcrum_printretval(STATUS_NOERROR);
 	return STATUS_NOERROR;
 }
+extern "C" long J2534_API PassThruRenderCapture(char *szCapturePath, char *szLogPath)
+{
+	// Ensure the module is running in static state. Rendering only reads the capture file so nothing is locked
+    AFX_MANAGE_STATE(AfxGetStaticModuleState());
+
+	// Clear out old errors and print init for method
+	fulcrum_clearInternalError();
+	fulcrum_DEBUG(_T("++ %.3fs PTRenderCapture(%s, %s)\n"), fulcrumClock_Seconds(),
+		(szCapturePath==NULL)?_T("*NULL*"):_T(""), (szLogPath==NULL)?_T("*NULL*"):_T(""));
+	if (szCapturePath == NULL || szLogPath == NULL)
+	{
+		fulcrum_setInternalError(_T("szCapturePath and szLogPath are both required"));
+		fulcrum_printretval(ERR_NULL_PARAMETER);
+		return ERR_NULL_PARAMETER;
+	}
+
+	// Rebuild the text log from the .shimBin file using the formats saved in it
+	CStringW cstrCapturePath(szCapturePath), cstrLogPath(szLogPath);
+	if (!fulcrum_capture_render::RenderFile(cstrCapturePath, cstrLogPath))
+	{
+		fulcrum_setInternalError(_T("Failed to render '%s' into '%s'"), (LPCWSTR)cstrCapturePath, (LPCWSTR)cstrLogPath);
+		fulcrum_printretval(ERR_FAILED);
+		return ERR_FAILED;
+	}
+
+	// Print output return value
+	fulcrum_printretval(STATUS_NOERROR);
+	return STATUS_NOERROR;
+}
 
 // Commands built out for getting the next possible passthru interface
 extern "C" long J2534_API PassThruGetNextCarDAQ(unsigned long* pName, unsigned long* pAddr, unsigned long* pVersion)
 {
 	// Ensure the module is running in static state and acquire a lock for it.
     AFX_MANAGE_STATE(AfxGetStaticModuleState());
-	auto_lock lock; unsigned long retval;
+	handle_lock lock(HANDLE_GLOBAL, 0); fulcrum_route route; unsigned long retval;
 
 	// Clear out old error. Ensure DLL supports this method
 	fulcrum_clearInternalError();
-	fulcrum_output::fulcrumDebug(_T("++ %.3fs PTGetNetCarDAQ(%s, 0x%08X, 0x%08X, 0x%08X)\n"), GetTimeSinceInit(), pName, pAddr, pVersion);
-	fulcrum_CHECK_DLL(); fulcrum_CHECK_FUNCTION(_PassThruGetNextCarDAQ);
+	fulcrum_capture capture(CAPTURE_FN_GET_NEXT_CARDAQ);
+	capture.Pointer(pName); capture.Pointer(pAddr); capture.Pointer(pVersion);
+	capture.Begin();
+	fulcrum_CHECK_CAPTURE(capture, route, HANDLE_GLOBAL, 0, PassThruGetNextCarDAQ);
 
 	// Run the method, get our output value and print it out to our log file
-	retval = _PassThruGetNextCarDAQ(pName, pAddr, pVersion);
-	fulcrum_output::fulcrumDebug(_T("  %s\n"), retval);
-	fulcrum_printretval(retval);
+	retval = route.Library->PassThruGetNextCarDAQ(pName, pAddr, pVersion);
+	return capture.End(retval);
 }
 extern "C" long J2534_API PassThruReadDetails(unsigned long* pName)
 {
 	// Ensure the module is running in static state and acquire a lock for it.
     AFX_MANAGE_STATE(AfxGetStaticModuleState());
-	auto_lock lock; unsigned long retval;
+	handle_lock lock(HANDLE_GLOBAL, 0); fulcrum_route route; unsigned long retval;
 
 	// Clear out old error. Ensure DLL supports this method
 	fulcrum_clearInternalError();
-	fulcrum_output::fulcrumDebug(_T("++ %.3fs PTReadDetails(%s, 0x%08X)\n"), GetTimeSinceInit(), pName);
-	fulcrum_CHECK_DLL(); fulcrum_CHECK_FUNCTION(_PassThruReadDetails);
+	fulcrum_capture capture(CAPTURE_FN_READ_DETAILS);
+	capture.Pointer(pName);
+	capture.Begin();
+	fulcrum_CHECK_CAPTURE(capture, route, HANDLE_GLOBAL, 0, PassThruReadDetails);
 
 	// Run the method, get our output value and print it out to our log file
-	retval = _PassThruReadDetails(pName);
-	fulcrum_printretval(retval);
-	return retval;
+	retval = route.Library->PassThruReadDetails(pName);
+	return capture.End(retval);
 }
 
 // Standard PTOpen and PTClose commands
@@ -220,43 +287,46 @@ extern "C" long J2534_API PassThruOpen(void *pName, unsigned long *pDeviceID)
 {
 	// Ensure the module is running in static state and acquire a lock for it.
     AFX_MANAGE_STATE(AfxGetStaticModuleState());
-	auto_lock lock; unsigned long retval;
+	handle_lock lock(HANDLE_GLOBAL, 0); fulcrum_route route; unsigned long retval;
 
 	// Now clear out old errors and log method init state then validate it can be run
 	fulcrum_clearInternalError();
-	fulcrum_output::fulcrumDebug(_T("++ %.3fs PTOpen(%s, 0x%08X)\n"), GetTimeSinceInit(), (pName==NULL)?_T("*NULL*"):_T("")/*pName*/, pDeviceID);
-	fulcrum_CHECK_DLL(); fulcrum_CHECK_FUNCTION(_PassThruOpen);
+	fulcrum_capture capture(CAPTURE_FN_OPEN);
+	capture.Pointer(pName); capture.Pointer(pDeviceID);
+	capture.Begin();
+	fulcrum_CHECK_CAPTURE(capture, route, HANDLE_GLOBAL, 0, PassThruOpen);
 
 	// Invoke the method here and store output
-	retval = _PassThruOpen(pName, pDeviceID);
-	fulcrum_output::fulcrumDebug(_T("  returning DeviceID: %ld\n"), *pDeviceID);
-	fulcrum_printretval(retval);
-	return retval;
+	retval = route.Library->PassThruOpen(pName, pDeviceID);
+	if (retval == STATUS_NOERROR && pDeviceID != NULL) *pDeviceID = fulcrum_addRoute(HANDLE_DEVICE, { route.Library, *pDeviceID }, 0);
+	if (pDeviceID != NULL) capture.ReturnedID(LABEL_DEVICE_ID, pDeviceID);
+	return capture.End(retval);
 }
 extern "C" long J2534_API PassThruClose(unsigned long DeviceID)
 {
 	// Ensure the module is running in static state and acquire a lock for it.
     AFX_MANAGE_STATE(AfxGetStaticModuleState());
-	auto_lock lock; long retval;
+	handle_lock lock(HANDLE_DEVICE, DeviceID); fulcrum_route route; long retval;
 
 	// Clear existing error, validate method can be run or not.
 	fulcrum_clearInternalError();
-	fulcrum_output::fulcrumDebug(_T("-- %.3fs PTClose(%ld)\n"), GetTimeSinceInit(), DeviceID);
-	fulcrum_CHECK_DLL();
-	fulcrum_CHECK_FUNCTION(_PassThruClose);
+	fulcrum_capture capture(CAPTURE_FN_CLOSE);
+	capture.Value(DeviceID);
+	capture.Begin();
+	fulcrum_CHECK_CAPTURE(capture, route, HANDLE_DEVICE, DeviceID, PassThruClose);
 
 	// Close input pipe instance
-	retval = _PassThruClose(DeviceID);
-	fulcrum_printretval(retval);
+	retval = route.Library->PassThruClose(route.ID);
+	if (retval == STATUS_NOERROR) { fulcrum_releaseHandle(HANDLE_DEVICE, DeviceID); fulcrumTimesync_DropDevice(DeviceID); }
 
 	// Unload pipe outputs
-	// fulcrum_output::fulcrumDebug(_T("-->       Calling pipe shutdown methods now...\n"));
+	// fulcrum_DEBUG(_T("-->       Calling pipe shutdown methods now...\n"));
 	// CFulcrumShim::fulcrumPiper->ShutdownInputPipe();
-	// fulcrum_output::fulcrumDebug(_T("-->       Pipe instances have been released OK!\n"));
+	// fulcrum_DEBUG(_T("-->       Pipe instances have been released OK!\n"));
 	// CFulcrumShim::fulcrumPiper->ShutdownOutputPipe();
 
 	// Get output value and return it here
-	return retval;
+	return capture.End(retval);
 }
 
 // Standard PT Connect and Disconnect Methods
@@ -264,38 +334,40 @@ extern "C" long J2534_API PassThruConnect(unsigned long DeviceID, unsigned long
 {
 	// Ensure the module is running in static state and acquire a lock for it.
     AFX_MANAGE_STATE(AfxGetStaticModuleState());
-	auto_lock lock;	long retval;
+	handle_lock lock(HANDLE_DEVICE, DeviceID); fulcrum_route route;	long retval;
 
 	// Clear existing error, validate method can be run or not.
 	fulcrum_clearInternalError();
-	fulcrum_output::fulcrumDebug(_T("++ %.3fs PTConnect(%ld, %s, 0x%08X, %ld, 0x%08X)\n"), GetTimeSinceInit(), DeviceID, fulcrumDebug_prot(ProtocolID).c_str(), Flags, Baudrate, pChannelID);
-	fulcrum_CHECK_DLL();
-	fulcrum_CHECK_FUNCTION(_PassThruConnect);
-
-	// Run our method and print out flag information for our call to connect
-	fulcrumDebug_printcflag(Flags);
-	retval = _PassThruConnect(DeviceID, ProtocolID, Flags, Baudrate, pChannelID);
-	if (pChannelID == NULL) fulcrum_output::fulcrumDebug(_T("  pChannelID was NULL\n"));
-	else fulcrum_output::fulcrumDebug(_T("  returning ChannelID: %ld\n"), *pChannelID);
-
-	// Print output and return output value
-	fulcrum_printretval(retval);
-	return retval;
+	fulcrum_capture capture(CAPTURE_FN_CONNECT);
+	capture.Value(DeviceID); capture.Value(ProtocolID); capture.Value(Flags); capture.Value(Baudrate); capture.Pointer(pChannelID);
+	capture.Begin();
+	fulcrum_CHECK_CAPTURE(capture, route, HANDLE_DEVICE, DeviceID, PassThruConnect);
+
+	// Run our method and store flag information for our call to connect
+	capture.ConnectFlags(Flags);
+	retval = route.Library->PassThruConnect(route.ID, ProtocolID, Flags, Baudrate, pChannelID);
+	if (retval == STATUS_NOERROR && pChannelID != NULL) *pChannelID = fulcrum_addRoute(HANDLE_CHANNEL, { route.Library, *pChannelID }, DeviceID);
+	capture.ReturnedID(LABEL_CHANNEL_ID, pChannelID);
+	if (retval == STATUS_NOERROR && pChannelID != NULL) fulcrumTimesync_AttachChannel(*pChannelID, DeviceID);
+
+	// Store output and return output value
+	return capture.End(retval);
 }
 extern "C" long J2534_API PassThruDisconnect(unsigned long ChannelID)
 {
 	// Ensure the module is running in static state and acquire a lock for it.
     AFX_MANAGE_STATE(AfxGetStaticModuleState());
-	auto_lock lock;	long retval;
+	handle_lock lock(HANDLE_CHANNEL, ChannelID); fulcrum_route route;	long retval;
 
 	fulcrum_clearInternalError();
-	fulcrum_output::fulcrumDebug(_T("-- %.3fs PTDisconnect(%ld)\n"), GetTimeSinceInit(), ChannelID);
-	fulcrum_CHECK_DLL();
-	fulcrum_CHECK_FUNCTION(_PassThruDisconnect);
-
-	retval = _PassThruDisconnect(ChannelID);
-	fulcrum_printretval(retval);
-	return retval;
+	fulcrum_capture capture(CAPTURE_FN_DISCONNECT);
+	capture.Value(ChannelID);
+	capture.Begin();
+	fulcrum_CHECK_CAPTURE(capture, route, HANDLE_CHANNEL, ChannelID, PassThruDisconnect);
+
+	retval = route.Library->PassThruDisconnect(route.ID);
+	if (retval == STATUS_NOERROR) { fulcrum_releaseHandle(HANDLE_CHANNEL, ChannelID); fulcrumTimesync_DetachChannel(ChannelID); }
+	return capture.End(retval);
 }
 
 // Reading and Writing Messages/Periodic messages
@@ -303,73 +375,95 @@ extern "C" long J2534_API PassThruReadMsgs(unsigned long ChannelID, PASSTHRU_MSG
 {
 	// Ensure the module is running in static state and acquire a lock for it.
     AFX_MANAGE_STATE(AfxGetStaticModuleState());
-	auto_lock lock;	long retval; unsigned long reqNumMsgs;
-
+	handle_lock lock(HANDLE_CHANNEL, ChannelID); fulcrum_route route;	long retval; unsigned long reqNumMsgs = 0;
 	fulcrum_clearInternalError();
-	fulcrum_output::fulcrumDebug(_T("<< %.3fs PTReadMsgs(%ld, 0x%08X, 0x%08X, %ld)\n"), GetTimeSinceInit(), ChannelID, pMsg, pNumMsgs, Timeout);
-	fulcrum_CHECK_DLL();
-	fulcrum_CHECK_FUNCTION(_PassThruReadMsgs);
+
+	// Apps sitting in a tight loop polling with no timeout get their empty reads counted up into one record.
+	// The DLL is called first here so we know if the poll was empty before anything gets logged for it
+	if (Timeout == 0 && pNumMsgs != NULL && fulcrum_checkAndAutoload() &&
+		(route = fulcrum_routeHandle(HANDLE_CHANNEL, ChannelID)).Library != NULL && route.Library->PassThruReadMsgs != NULL)
+	{
+		uint64_t pollTimestamp = fulcrum_capture::Timestamp();
+		reqNumMsgs = *pNumMsgs;
+		retval = route.Library->PassThruReadMsgs(route.ID, pMsg, pNumMsgs, Timeout);
+		uint64_t readTimestamp = fulcrum_capture::Timestamp();
+		if (fulcrum_capture::CollapsePoll(ChannelID, pMsg, pNumMsgs, reqNumMsgs, retval, pollTimestamp)) return retval;
+
+		fulcrum_capture capture(CAPTURE_FN_READ_MSGS, pollTimestamp);
+		capture.Value(ChannelID); capture.Pointer(pMsg); capture.Pointer(pNumMsgs); capture.Value(Timeout);
+		capture.Begin();
+		capture.MsgCount(LABEL_READ, *pNumMsgs, reqNumMsgs);
+		capture.Messages(LABEL_MSG, pMsg, pNumMsgs, false);
+		capture.MessageTimes(LABEL_MSG, ChannelID, pMsg, pNumMsgs, readTimestamp);
+		return capture.End(retval);
+	}
+
+	fulcrum_capture capture(CAPTURE_FN_READ_MSGS);
+	capture.Value(ChannelID); capture.Pointer(pMsg); capture.Pointer(pNumMsgs); capture.Value(Timeout);
+	capture.Begin();
+	fulcrum_CHECK_CAPTURE(capture, route, HANDLE_CHANNEL, ChannelID, PassThruReadMsgs);
 
 	if (pNumMsgs != NULL) reqNumMsgs = *pNumMsgs;
-	retval = _PassThruReadMsgs(ChannelID, pMsg, pNumMsgs, Timeout);
-	if (pNumMsgs != NULL) fulcrum_output::fulcrumDebug(_T("  read %ld of %ld messages\n"), *pNumMsgs, reqNumMsgs);
-	fulcrumDebug_printmsg(pMsg, _T("Msg"), pNumMsgs, FALSE);
+	retval = route.Library->PassThruReadMsgs(route.ID, pMsg, pNumMsgs, Timeout);
+	uint64_t readTimestamp = fulcrum_capture::Timestamp();
+	if (pNumMsgs != NULL) capture.MsgCount(LABEL_READ, *pNumMsgs, reqNumMsgs);
+	capture.Messages(LABEL_MSG, pMsg, pNumMsgs, false);
+	capture.MessageTimes(LABEL_MSG, ChannelID, pMsg, pNumMsgs, readTimestamp);
 
-	fulcrum_printretval(retval);
-	return retval;
+	return capture.End(retval);
 }
 extern "C" long J2534_API PassThruWriteMsgs(unsigned long ChannelID, PASSTHRU_MSG *pMsg, unsigned long *pNumMsgs, unsigned long Timeout)
 {
 	// Ensure the module is running in static state and acquire a lock for it.
     AFX_MANAGE_STATE(AfxGetStaticModuleState());
-	auto_lock lock; long retval; unsigned long reqNumMsgs = *pNumMsgs;
+	handle_lock lock(HANDLE_CHANNEL, ChannelID); fulcrum_route route; long retval; unsigned long reqNumMsgs = 0;
 
 	fulcrum_clearInternalError();
-	fulcrum_output::fulcrumDebug(_T(">> %.3fs PTWriteMsgs(%ld, 0x%08X, 0x%08X, %ld)\n"), GetTimeSinceInit(), ChannelID, pMsg, pNumMsgs, Timeout);
-	fulcrum_CHECK_DLL();
-	fulcrum_CHECK_FUNCTION(_PassThruWriteMsgs);
+	fulcrum_capture capture(CAPTURE_FN_WRITE_MSGS);
+	capture.Value(ChannelID); capture.Pointer(pMsg); capture.Pointer(pNumMsgs); capture.Value(Timeout);
+	capture.Begin();
+	fulcrum_CHECK_CAPTURE(capture, route, HANDLE_CHANNEL, ChannelID, PassThruWriteMsgs);
 
 	if (pNumMsgs != NULL) reqNumMsgs = *pNumMsgs;
-	fulcrumDebug_printmsg(pMsg, _T("Msg"), pNumMsgs, true);
-	retval = _PassThruWriteMsgs(ChannelID, pMsg, pNumMsgs, Timeout);
-	if (pNumMsgs != NULL) fulcrum_output::fulcrumDebug(_T("  sent %ld of %ld messages\n"), *pNumMsgs, reqNumMsgs);
+	capture.Messages(LABEL_MSG, pMsg, pNumMsgs, true);
+	retval = route.Library->PassThruWriteMsgs(route.ID, pMsg, pNumMsgs, Timeout);
+	if (pNumMsgs != NULL) capture.MsgCount(LABEL_SENT, *pNumMsgs, reqNumMsgs);
 
-	fulcrum_printretval(retval);
-	return retval;
+	return capture.End(retval);
 }
 extern "C" long J2534_API PassThruStartPeriodicMsg(unsigned long ChannelID, PASSTHRU_MSG *pMsg,
                       unsigned long *pMsgID, unsigned long TimeInterval)
 {
 	// Ensure the module is running in static state and acquire a lock for it.
     AFX_MANAGE_STATE(AfxGetStaticModuleState());
-	auto_lock lock; long retval;
+	handle_lock lock(HANDLE_CHANNEL, ChannelID); fulcrum_route route; long retval;
 
 	fulcrum_clearInternalError();
-	fulcrum_output::fulcrumDebug(_T("++ %.3fs PTStartPeriodicMsg(%ld, 0x%08X, 0x%08X, %ld)\n"), GetTimeSinceInit(), ChannelID, pMsg, pMsgID, TimeInterval);
-	fulcrum_CHECK_DLL();
-	fulcrum_CHECK_FUNCTION(_PassThruStartPeriodicMsg);
+	fulcrum_capture capture(CAPTURE_FN_START_PERIODIC_MSG);
+	capture.Value(ChannelID); capture.Pointer(pMsg); capture.Pointer(pMsgID); capture.Value(TimeInterval);
+	capture.Begin();
+	fulcrum_CHECK_CAPTURE(capture, route, HANDLE_CHANNEL, ChannelID, PassThruStartPeriodicMsg);
 	
-	fulcrumDebug_printmsg(pMsg, _T("Msg"), 1, true);
-	retval = _PassThruStartPeriodicMsg(ChannelID, pMsg, pMsgID, TimeInterval);
-	if (pMsgID != NULL)	fulcrum_output::fulcrumDebug(_T("  returning PeriodicID: %ld\n"), *pMsgID);
+	capture.Messages(LABEL_MSG, pMsg, 1, true);
+	retval = route.Library->PassThruStartPeriodicMsg(route.ID, pMsg, pMsgID, TimeInterval);
+	if (pMsgID != NULL) capture.ReturnedID(LABEL_PERIODIC_ID, pMsgID);
 
-	fulcrum_printretval(retval);
-	return retval;
+	return capture.End(retval);
 }
 extern "C" long J2534_API PassThruStopPeriodicMsg(unsigned long ChannelID, unsigned long MsgID)
 {
 	// Ensure the module is running in static state and acquire a lock for it.
     AFX_MANAGE_STATE(AfxGetStaticModuleState());
-	auto_lock lock; long retval;
+	handle_lock lock(HANDLE_CHANNEL, ChannelID); fulcrum_route route; long retval;
 
 	fulcrum_clearInternalError();
-	fulcrum_output::fulcrumDebug(_T("-- %.3fs PTStopPeriodicMsg(%ld, %ld)\n"), GetTimeSinceInit(), ChannelID, MsgID);
-	fulcrum_CHECK_DLL();
-	fulcrum_CHECK_FUNCTION(_PassThruStopPeriodicMsg);
+	fulcrum_capture capture(CAPTURE_FN_STOP_PERIODIC_MSG);
+	capture.Value(ChannelID); capture.Value(MsgID);
+	capture.Begin();
+	fulcrum_CHECK_CAPTURE(capture, route, HANDLE_CHANNEL, ChannelID, PassThruStopPeriodicMsg);
 
-	retval = _PassThruStopPeriodicMsg(ChannelID, MsgID);
-	fulcrum_printretval(retval);
-	return retval;
+	retval = route.Library->PassThruStopPeriodicMsg(route.ID, MsgID);
+	return capture.End(retval);
 }
 
 // Message Filtering Start/Stop commands
@@ -379,37 +473,37 @@ extern "C" long J2534_API PassThruStartMsgFilter(unsigned long ChannelID,
 {
 	// Ensure the module is running in static state and acquire a lock for it.
     AFX_MANAGE_STATE(AfxGetStaticModuleState());
-	auto_lock lock; long retval;
+	handle_lock lock(HANDLE_CHANNEL, ChannelID); fulcrum_route route; long retval;
 
 	fulcrum_clearInternalError();
-	fulcrum_output::fulcrumDebug(_T("++ %.3fs PTStartMsgFilter(%ld, %s, 0x%08X, 0x%08X, 0x%08X, 0x%08X)\n"), GetTimeSinceInit(), ChannelID, fulcrumDebug_filter(FilterType).c_str(),
-		pMaskMsg, pPatternMsg, pFlowControlMsg, pMsgID);
-	fulcrum_CHECK_DLL();
-	fulcrum_CHECK_FUNCTION(_PassThruStartMsgFilter);
-
-	fulcrumDebug_printmsg(pMaskMsg, _T("Mask"), 1, true);
-	fulcrumDebug_printmsg(pPatternMsg, _T("Pattern"), 1, true);
-	fulcrumDebug_printmsg(pFlowControlMsg, _T("FlowControl"), 1, true);
-	retval = _PassThruStartMsgFilter(ChannelID, FilterType, pMaskMsg, pPatternMsg, pFlowControlMsg, pMsgID);
-	if (pMsgID != NULL) fulcrum_output::fulcrumDebug(_T("  returning FilterID: %ld\n"), *pMsgID);
-
-	fulcrum_printretval(retval);
-	return retval;
+	fulcrum_capture capture(CAPTURE_FN_START_MSG_FILTER);
+	capture.Value(ChannelID); capture.Value(FilterType);
+	capture.Pointer(pMaskMsg); capture.Pointer(pPatternMsg); capture.Pointer(pFlowControlMsg); capture.Pointer(pMsgID);
+	capture.Begin();
+	fulcrum_CHECK_CAPTURE(capture, route, HANDLE_CHANNEL, ChannelID, PassThruStartMsgFilter);
+
+	capture.Messages(LABEL_MASK, pMaskMsg, 1, true);
+	capture.Messages(LABEL_PATTERN, pPatternMsg, 1, true);
+	capture.Messages(LABEL_FLOW_CONTROL, pFlowControlMsg, 1, true);
+	retval = route.Library->PassThruStartMsgFilter(route.ID, FilterType, pMaskMsg, pPatternMsg, pFlowControlMsg, pMsgID);
+	if (pMsgID != NULL) capture.ReturnedID(LABEL_FILTER_ID, pMsgID);
+
+	return capture.End(retval);
 }
 extern "C" long J2534_API PassThruStopMsgFilter(unsigned long ChannelID, unsigned long MsgID)
 {
 	// Ensure the module is running in static state and acquire a lock for it.
     AFX_MANAGE_STATE(AfxGetStaticModuleState());
-	auto_lock lock;	long retval;
+	handle_lock lock(HANDLE_CHANNEL, ChannelID); fulcrum_route route;	long retval;
 
 	fulcrum_clearInternalError();
-	fulcrum_output::fulcrumDebug(_T("-- %.3fs PTStopMsgFilter(%ld, %ld)\n"), GetTimeSinceInit(), ChannelID, MsgID);
-	fulcrum_CHECK_DLL();
-	fulcrum_CHECK_FUNCTION(_PassThruStopMsgFilter);
+	fulcrum_capture capture(CAPTURE_FN_STOP_MSG_FILTER);
+	capture.Value(ChannelID); capture.Value(MsgID);
+	capture.Begin();
+	fulcrum_CHECK_CAPTURE(capture, route, HANDLE_CHANNEL, ChannelID, PassThruStopMsgFilter);
 
-	retval = _PassThruStopMsgFilter(ChannelID, MsgID);
-	fulcrum_printretval(retval);
-	return retval;
+	retval = route.Library->PassThruStopMsgFilter(route.ID, MsgID);
+	return capture.End(retval);
 }
 
 // Programming Voltage and IOCTls
@@ -417,78 +511,65 @@ extern "C" long J2534_API PassThruSetProgrammingVoltage(unsigned long DeviceID,
 {
 	// Ensure the module is running in static state and acquire a lock for it.
     AFX_MANAGE_STATE(AfxGetStaticModuleState());
-	auto_lock lock; long retval;
+	handle_lock lock(HANDLE_DEVICE, DeviceID); fulcrum_route route; long retval;
 
 	fulcrum_clearInternalError();
-	fulcrum_output::fulcrumDebug(_T("** %.3fs PTSetProgrammingVoltage(%ld, %ld, %ld)\n"), GetTimeSinceInit(), DeviceID, Pin, Voltage);
-	fulcrum_CHECK_DLL();
-	fulcrum_CHECK_FUNCTION(_PassThruSetProgrammingVoltage);
+	fulcrum_capture capture(CAPTURE_FN_SET_PROGRAMMING_VOLTAGE);
+	capture.Value(DeviceID); capture.Value(Pin); capture.Value(Voltage);
+	capture.Begin();
+	fulcrum_CHECK_CAPTURE(capture, route, HANDLE_DEVICE, DeviceID, PassThruSetProgrammingVoltage);
 
-	switch (Voltage)
-	{
-	case VOLTAGE_OFF:
-		fulcrum_output::fulcrumDebug(_T("  Pin %ld remove voltage\n"), Pin);
-		break;
-	case SHORT_TO_GROUND:
-		fulcrum_output::fulcrumDebug(_T("  Pin %ld short to ground\n"), Pin);
-		break;
-	default:
-		fulcrum_output::fulcrumDebug(_T("  Pin %ld at %f Volts\n"), Pin, Voltage / (float) 1000);
-		break;
-	}
-	retval = _PassThruSetProgrammingVoltage(DeviceID, Pin, Voltage);
+	// VOLTAGE_OFF and SHORT_TO_GROUND are sorted out when the capture is rendered
+	capture.Voltage(LABEL_PIN, Pin, Voltage);
+	retval = route.Library->PassThruSetProgrammingVoltage(route.ID, Pin, Voltage);
 
-	fulcrum_printretval(retval);
-	return retval;
+	return capture.End(retval);
 }
 extern "C" long J2534_API PassThruReadVersion(unsigned long DeviceID, char *pFirmwareVersion, char *pDllVersion, char *pApiVersion)
 {
 	// Ensure the module is running in static state and acquire a lock for it.
 	AFX_MANAGE_STATE(AfxGetStaticModuleState());
-	auto_lock lock; long retval;
+	handle_lock lock(HANDLE_DEVICE, DeviceID); fulcrum_route route; long retval;
 
 	fulcrum_clearInternalError();
-	fulcrum_output::fulcrumDebug(_T("** %.3fs PTReadVersion(%ld, 0x%08X, 0x%08X, 0x%08X)\n"), GetTimeSinceInit(), DeviceID, pFirmwareVersion, pDllVersion, pApiVersion);
-	fulcrum_CHECK_DLL();
-	fulcrum_CHECK_FUNCTION(_PassThruReadVersion);
+	fulcrum_capture capture(CAPTURE_FN_READ_VERSION);
+	capture.Value(DeviceID); capture.Pointer(pFirmwareVersion); capture.Pointer(pDllVersion); capture.Pointer(pApiVersion);
+	capture.Begin();
+	fulcrum_CHECK_CAPTURE(capture, route, HANDLE_DEVICE, DeviceID, PassThruReadVersion);
 
-	retval = _PassThruReadVersion(DeviceID, pFirmwareVersion, pDllVersion, pApiVersion);
+	retval = route.Library->PassThruReadVersion(route.ID, pFirmwareVersion, pDllVersion, pApiVersion);
 
-	CStringW cstrFirmwareVersion(pFirmwareVersion);
-	CStringW cstrDllVersion(pDllVersion);
-	CStringW cstrApiVersion(pApiVersion);
+	capture.Text(LABEL_FIRMWARE, pFirmwareVersion);
+	capture.Text(LABEL_DLL, pDllVersion);
+	capture.Text(LABEL_API, pApiVersion);
 
-	fulcrum_output::fulcrumDebug(_T("  Firmware: %s\n"), cstrFirmwareVersion);
-	fulcrum_output::fulcrumDebug(_T("  DLL:      %s\n"), cstrDllVersion);
-	fulcrum_output::fulcrumDebug(_T("  API:      %s\n"), cstrApiVersion);
-
-	fulcrum_printretval(retval);
-	return retval;
+	return capture.End(retval);
 }
 extern "C" long J2534_API PassThruIoctl(unsigned long ChannelID, unsigned long IoctlID, void* pInput, void* pOutput)
 {
 	// Ensure the module is running in static state and acquire a lock for it.
     AFX_MANAGE_STATE(AfxGetStaticModuleState());
-	auto_lock lock; long retval;
+	handle_lock lock(fulcrum_ioctlHandleType(IoctlID), ChannelID); fulcrum_route route; long retval;
 
 	fulcrum_clearInternalError();
-	fulcrum_output::fulcrumDebug(_T("** %.3fs PTIoctl(%ld, %s, 0x%08X, 0x%08X)\n"), GetTimeSinceInit(), ChannelID, fulcrumDebug_ioctl(IoctlID).c_str(), pInput, pOutput);
-	fulcrum_CHECK_DLL();
-	fulcrum_CHECK_FUNCTION(_PassThruIoctl);
+	fulcrum_capture capture(CAPTURE_FN_IOCTL);
+	capture.Value(ChannelID); capture.Value(IoctlID); capture.Pointer(pInput); capture.Pointer(pOutput);
+	capture.Begin();
+	fulcrum_CHECK_CAPTURE(capture, route, fulcrum_ioctlHandleType(IoctlID), ChannelID, PassThruIoctl);
 
-	// Print any relevant info before making the call
+	// Store any relevant info before making the call
 	switch (IoctlID)
 	{
 		// Do nothing for GET_CONFIG input
 	case SET_CONFIG:
-		dbug_printsconfig((SCONFIG_LIST*)pInput);
+		capture.SConfig((SCONFIG_LIST*)pInput);
 		break;
 		// Do nothing for READ_VBATT input
 	case FIVE_BAUD_INIT:
-		fulcrumDebug_printsbyte((SBYTE_ARRAY*)pInput, _T("Input"));
+		capture.SByte(LABEL_INPUT, (SBYTE_ARRAY*)pInput);
 		break;
 	case FAST_INIT:
-		fulcrumDebug_printmsg((PASSTHRU_MSG*)pInput, _T("Input"), 1, true);
+		capture.Messages(LABEL_INPUT, (PASSTHRU_MSG*)pInput, 1, true);
 		break;
 		// Do nothing for CLEAR_TX_BUFFER
 		// Do nothing for CLEAR_RX_BUFFER
@@ -496,32 +577,32 @@ extern "C" long J2534_API PassThruIoctl(unsigned long ChannelID, unsigned long I
 		// Do nothing for CLEAR_MSG_FILTERS
 		// Do nothing for CLEAR_FUNCT_MSG_LOOKUP_TABLE
 	case ADD_TO_FUNCT_MSG_LOOKUP_TABLE:
-		fulcrumDebug_printsbyte((SBYTE_ARRAY*)pInput, _T("Add"));
+		capture.SByte(LABEL_ADD, (SBYTE_ARRAY*)pInput);
 		break;
 	case DELETE_FROM_FUNCT_MSG_LOOKUP_TABLE:
-		fulcrumDebug_printsbyte((SBYTE_ARRAY*)pInput, _T("Delete"));
+		capture.SByte(LABEL_DELETE, (SBYTE_ARRAY*)pInput);
 		break;
 		// Do nothing for READ_PROG_VOLTAGE
 	}
 
-	retval = _PassThruIoctl(ChannelID, IoctlID, pInput, pOutput);
+	retval = route.Library->PassThruIoctl(route.ID, IoctlID, pInput, pOutput);
 
-	// Print any changed info after making the call
+	// Store any changed info after making the call
 	switch (IoctlID)
 	{
 	case GET_CONFIG:
-		dbug_printsconfig((SCONFIG_LIST*)pInput);
+		capture.SConfig((SCONFIG_LIST*)pInput);
 		break;
 		// Do nothing for SET_CONFIG
 	case READ_VBATT:
 		if (pOutput != NULL)
-			fulcrum_output::fulcrumDebug(_T("  %f Volts\n"), ((*(unsigned long*)pOutput)) / (float)1000);
+			capture.Voltage(LABEL_VOLTS, 0, *(unsigned long*)pOutput);
 		break;
 	case FIVE_BAUD_INIT:
-		fulcrumDebug_printsbyte((SBYTE_ARRAY*)pInput, _T("Output"));
+		capture.SByte(LABEL_OUTPUT, (SBYTE_ARRAY*)pOutput);
 		break;
 	case FAST_INIT:
-		fulcrumDebug_printmsg((PASSTHRU_MSG*)pOutput, _T("Input"), 1, false);
+		capture.Messages(LABEL_OUTPUT, (PASSTHRU_MSG*)pOutput, 1, false);
 		break;
 		// Do nothing for CLEAR_TX_BUFFER
 		// Do nothing for CLEAR_RX_BUFFER
@@ -532,12 +613,11 @@ extern "C" long J2534_API PassThruIoctl(unsigned long ChannelID, unsigned long I
 		// Do nothing for DELETE_FROM_FUNCT_MSG_LOOKUP_TABLE:
 	case READ_PROG_VOLTAGE:
 		if (pOutput != NULL)
-			fulcrum_output::fulcrumDebug(_T("  %f Volts\n"), ((*(unsigned long*)pOutput)) / (float)1000);
+			capture.Voltage(LABEL_VOLTS, 0, *(unsigned long*)pOutput);
 		break;
 	}
 
-	fulcrum_printretval(retval);
-	return retval;
+	return capture.End(retval);
 }
 
 // Error Reporting Commands and converter for error codes
@@ -558,40 +638,35 @@ long fulcrum_PassThruGetLastError(char* pErrorDescription)
 		// These macros call fulcrum_setInternalError() which does not work the way
 		// this function is documented. They should be replaced with code that
 		// prints an error to the debug log and copies the text to pErrorDescription
-		// if the pointer is non-NULL
+		// if the pointer is non-NULL. The error belongs to whichever library this
+		// thread last called into
 		fulcrum_CHECK_DLL();
-		fulcrum_CHECK_FUNCTION(_PassThruGetLastError);
+		fulcrum_library* pLibrary = fulcrum_lastLibrary();
+		fulcrum_CHECK_FUNCTION(pLibrary->PassThruGetLastError);
 
-		return _PassThruGetLastError(pErrorDescription);
+		return pLibrary->PassThruGetLastError(pErrorDescription);
 	}
 }
 extern "C" long J2534_API PassThruGetLastError(char* pErrorDescription)
 {
 	// Ensure the module is running in static state and acquire a lock for it.
     AFX_MANAGE_STATE(AfxGetStaticModuleState());
-	auto_lock lock; long retval;
+	auto_shared_lock lock; long retval;
 
 	// pErrorDescription returns the text description for an error detected
 	// during the last function call (EXCEPT PassThruGetLastError). This
 	// function should not modify the last internal error
 
-	fulcrum_output::fulcrumDebug(_T("** %.3fs PTGetLastError(0x%08X)\n"), GetTimeSinceInit(), pErrorDescription);
-	if (pErrorDescription == NULL) fulcrum_output::fulcrumDebug(_T("%  pErrorDescription is NULL\n"));
+	fulcrum_capture capture(CAPTURE_FN_GET_LAST_ERROR);
+	capture.Pointer(pErrorDescription);
+	capture.Begin();
+	if (pErrorDescription == NULL) capture.Text(LABEL_ERROR_DESCRIPTION, NULL);
 
 	retval = fulcrum_PassThruGetLastError(pErrorDescription);
-	if (pErrorDescription != NULL)
-	{
-#ifdef UNICODE
-		CStringW cstrErrorDescriptionW(pErrorDescription);
-		fulcrum_output::fulcrumDebug(_T("  %s\n"), (LPCWSTR)cstrErrorDescriptionW);
-#else
-		fulcrum_output::fulcrumDebug(_T("  %s\n"), pErrorDescription);
-#endif
-	}
+	if (pErrorDescription != NULL) capture.Text(LABEL_ERROR_DESCRIPTION, pErrorDescription);
 
-	// Log the return value for this function without using dbg_printretval().
+	// Log the return value for this function without the error description.
 	// Even if an error occured inside this function, the error text was not
 	// updated to describe the error.
-	fulcrum_output::fulcrumDebug(_T("  %.3fs %s\n"), GetTimeSinceInit(), fulcrumDebug_return(retval).c_str());
-	return retval;
+	return capture.End(retval, false);
 }
\ No newline at end of file
@@ -50,6 +50,7 @@ extern "C"
 	long J2534_API PassThruWriteToLogA(char *szMsg);
 	long J2534_API PassThruWriteToLogW(wchar_t *szMsg);
 	long J2534_API PassThruSaveLog(char *szFilename);
+	long J2534_API PassThruRenderCapture(char *szCapturePath, char *szLogPath);
 	long J2534_API PassThruUnloadLibrary();
 }
 
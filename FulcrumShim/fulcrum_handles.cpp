@@ -0,0 +1,134 @@
+/*
+**
+** Copyright (C) 2022 MEAT Inc
+** Author: Zack Walsh <neo.smith@motorengineeringandtech.com>
+**
+** This library is free software; you can redistribute it and/or modify
+** it under the terms of the GNU Lesser General Public License as published
+** by the Free Software Foundation, either version 3 of the License, or (at
+** your option) any later version.
+**
+** This library is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+** Lesser General Public License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public
+** License along with this library; if not, <http://www.gnu.org/licenses/>.
+**
+*/
+
+// Standard Imports
+#include "stdafx.h"
+#include <atomic>
+#include <map>
+#include <stdint.h>
+
+// Fulcrum Resource Imports
+#include "fulcrum_handles.h"
+
+// Locks for every handle we've seen, keyed by type and ID
+static std::mutex handleTableLock;
+static std::map<uint64_t, std::shared_ptr<std::mutex> > handleTable;
+
+// Handles handed out by the libraries. Only handles the app has been given are in here
+struct fulcrum_route_entry {
+	fulcrum_route Route;
+	unsigned long DeviceID;		// Device a channel was connected on
+};
+static std::mutex routeTableLock;
+static std::map<uint64_t, fulcrum_route_entry> routeTable;
+
+// Library each thread last made a call into. The generation goes up whenever the libraries are unloaded
+// so a thread never goes back into one that's gone
+static std::atomic<unsigned long> routeGeneration(0);
+static thread_local fulcrum_library* pLastLibrary = NULL;
+static thread_local unsigned long lastGeneration = 0;
+
+static uint64_t fulcrumHandle_Key(fulcrum_handle_type handleType, unsigned long handleID)
+{
+	return ((uint64_t)handleType << 32) | (uint32_t)handleID;
+}
+
+// Finds or makes the lock for a handle. The table lock is only held long enough to look it up
+static std::shared_ptr<std::mutex> fulcrumHandle_Find(fulcrum_handle_type handleType, unsigned long handleID)
+{
+	std::lock_guard<std::mutex> tableGuard(handleTableLock);
+	std::shared_ptr<std::mutex>& pHandleLock = handleTable[fulcrumHandle_Key(handleType, handleID)];
+	if (!pHandleLock) pHandleLock = std::make_shared<std::mutex>();
+	return pHandleLock;
+}
+
+// ------------------------------------------------------------------------------------------------
+
+// The library is always taken before the handle, and a call only ever holds one handle
+handle_lock::handle_lock(fulcrum_handle_type handleType, unsigned long handleID)
+	: m_LibraryLock()
+	, m_pHandleLock(fulcrumHandle_Find(handleType, handleID))
+{
+	m_pHandleLock->lock();
+}
+handle_lock::~handle_lock() { m_pHandleLock->unlock(); }
+
+void fulcrum_releaseHandle(fulcrum_handle_type handleType, unsigned long handleID)
+{
+	{
+		std::lock_guard<std::mutex> tableGuard(handleTableLock);
+		handleTable.erase(fulcrumHandle_Key(handleType, handleID));
+	}
+
+	std::lock_guard<std::mutex> tableGuard(routeTableLock);
+	routeTable.erase(fulcrumHandle_Key(handleType, handleID));
+	if (handleType != HANDLE_DEVICE) return;
+	for (auto routeEntry = routeTable.begin(); routeEntry != routeTable.end(); )
+	{
+		bool isChannel = (routeEntry->first >> 32) == HANDLE_CHANNEL;
+		if (isChannel && routeEntry->second.DeviceID == handleID) routeEntry = routeTable.erase(routeEntry);
+		else ++routeEntry;
+	}
+}
+
+// ------------------------------------------------------------------------------------------------
+
+fulcrum_route fulcrum_routeHandle(fulcrum_handle_type handleType, unsigned long handleID)
+{
+	fulcrum_route handleRoute = { fulcrum_defaultLibrary(), handleID };
+	if (handleType != HANDLE_GLOBAL)
+	{
+		std::lock_guard<std::mutex> tableGuard(routeTableLock);
+		auto routeEntry = routeTable.find(fulcrumHandle_Key(handleType, handleID));
+		if (routeEntry != routeTable.end()) handleRoute = routeEntry->second.Route;
+	}
+
+	pLastLibrary = handleRoute.Library;
+	lastGeneration = routeGeneration;
+	return handleRoute;
+}
+fulcrum_library* fulcrum_lastLibrary()
+{
+	if (pLastLibrary == NULL || lastGeneration != routeGeneration) return fulcrum_defaultLibrary();
+	return pLastLibrary;
+}
+
+// Keeps the library's own number when nothing else has it, so with one library loaded nothing changes
+unsigned long fulcrum_addRoute(fulcrum_handle_type handleType, const fulcrum_route& handleRoute, unsigned long deviceID)
+{
+	std::lock_guard<std::mutex> tableGuard(routeTableLock);
+	unsigned long appID = handleRoute.ID;
+	auto routeEntry = routeTable.find(fulcrumHandle_Key(handleType, appID));
+	if (routeEntry != routeTable.end() && routeEntry->second.Route.Library != handleRoute.Library)
+	{
+		appID = 1;
+		while (routeTable.count(fulcrumHandle_Key(handleType, appID)) != 0) appID++;
+	}
+
+	fulcrum_route_entry newEntry = { handleRoute, deviceID };
+	routeTable[fulcrumHandle_Key(handleType, appID)] = newEntry;
+	return appID;
+}
+void fulcrum_clearRoutes()
+{
+	std::lock_guard<std::mutex> tableGuard(routeTableLock);
+	routeTable.clear();
+	routeGeneration++;
+}
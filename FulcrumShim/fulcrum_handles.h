@@ -0,0 +1,72 @@
+/*
+**
+** Copyright (C) 2022 MEAT Inc
+** Author: Zack Walsh <neo.smith@motorengineeringandtech.com>
+**
+** This library is free software; you can redistribute it and/or modify
+** it under the terms of the GNU Lesser General Public License as published
+** by the Free Software Foundation, either version 3 of the License, or (at
+** your option) any later version.
+**
+** This library is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+** Lesser General Public License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public
+** License along with this library; if not, <http://www.gnu.org/licenses/>.
+**
+*/
+
+#pragma once
+
+// Standard Imports
+#include <memory>
+#include <mutex>
+
+// Fulcrum Resource Imports
+#include "fulcrum_loader.h"
+
+// What a J2534 handle names. Devices and channels are numbered separately by the driver, so the same
+// number can be both a device and a channel. Calls that aren't tied to either use HANDLE_GLOBAL
+enum fulcrum_handle_type {
+	HANDLE_GLOBAL = 0,
+	HANDLE_DEVICE = 1,
+	HANDLE_CHANNEL = 2,
+};
+
+// Lock for one device or channel, so calls on independent channels run at the same time. A
+// PassThruReadMsgs() sitting in its timeout only holds up other calls on the same channel.
+// Also holds the library shared, so the DLL can't be unloaded while a call is still in it
+class handle_lock
+{
+public:
+	handle_lock(fulcrum_handle_type handleType, unsigned long handleID);
+	~handle_lock();
+
+private:
+	auto_shared_lock m_LibraryLock;
+	std::shared_ptr<std::mutex> m_pHandleLock;
+};
+
+// Where a device or channel the app was handed really lives. Each library numbers its own handles, so
+// when a second library hands back a number the first one already uses, the app gets a free one instead
+struct fulcrum_route {
+	fulcrum_library* Library;
+	unsigned long ID;			// Handle number the library knows it by
+};
+
+// Finds the library and driver handle for a call. HANDLE_GLOBAL and handles we never handed out go to the
+// default library as they are. Also notes the library for this thread's next PassThruGetLastError()
+fulcrum_route fulcrum_routeHandle(fulcrum_handle_type handleType, unsigned long handleID);
+fulcrum_library* fulcrum_lastLibrary();
+
+// Records a handle a library just handed back and returns the number the app should see. Channels
+// are tied to the device they were connected on so they go away with it
+unsigned long fulcrum_addRoute(fulcrum_handle_type handleType, const fulcrum_route& handleRoute, unsigned long deviceID);
+void fulcrum_clearRoutes();
+
+// Drops the lock and the route for a handle once the driver has closed it. Anybody still holding the
+// lock keeps their copy, and the next call with the same number gets a new one. Releasing a device
+// drops the routes of the channels on it too
+void fulcrum_releaseHandle(fulcrum_handle_type handleType, unsigned long handleID);
\ No newline at end of file
@@ -0,0 +1,326 @@
+/*
+**
+** Copyright (C) 2022 MEAT Inc
+** Author: Zack Walsh <neo.smith@motorengineeringandtech.com>
+**
+** This library is free software; you can redistribute it and/or modify
+** it under the terms of the GNU Lesser General Public License as published
+** by the Free Software Foundation, either version 3 of the License, or (at
+** your option) any later version.
+**
+** This library is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+** Lesser General Public License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public
+** License along with this library; if not, <http://www.gnu.org/licenses/>.
+**
+*/
+
+
+// Standard Imports
+#include <stdint.h>
+#include <string.h>
+
+// Fulcrum Resource Imports
+#include "fulcrum_hexdump.h"
+
+// SIMD kernels need an x86 target. They build 16 bit characters, which are widened on the way out
+// where wchar_t is 32 bits (Linux), so the same kernels run and get benchmarked there too
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#define FULCRUM_HEX_SIMD 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define FULCRUM_TARGET_AVX2
+#else
+#include <cpuid.h>
+#define FULCRUM_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+// Digits for the scalar encoder. Lower case to match what std::hex has always printed
+static const wchar_t fulcrumHexDigits[] = L"0123456789abcdef";
+
+// Encoders write exactly 3 characters per byte for plain runs
+typedef void (*fulcrum_hex_kernel)(const unsigned char* pData, size_t nBytes, wchar_t* pOutput);
+static fulcrum_hex_encoder activeEncoder = HEX_ENCODER_AUTO;
+static fulcrum_hex_kernel activeKernel = NULL;
+
+// ---------------------------------------------------------------------------------------------------------------------------------
+
+// Byte at a time encoder. Used for short runs, the tail of long ones, and CPUs without SSE2
+static void fulcrumHex_EncodeScalar(const unsigned char* pData, size_t nBytes, wchar_t* pOutput)
+{
+	for (size_t byteIndex = 0; byteIndex < nBytes; byteIndex++)
+	{
+		pOutput[0] = L' ';
+		pOutput[1] = fulcrumHexDigits[pData[byteIndex] >> 4];
+		pOutput[2] = fulcrumHexDigits[pData[byteIndex] & 0x0F];
+		pOutput += 3;
+	}
+}
+
+#if FULCRUM_HEX_SIMD
+
+// Word masks for spreading hex pairs into " xx" groups. Each output register holds 8 characters
+// and 8 input bytes make exactly 3 registers:
+//   R0: _ h0 l0 _ h1 l1 _ h2    R1: l2 _ h3 l3 _ h4 l4 _    R2: h5 l5 _ h6 l6 _ h7 l7
+#define FULCRUM_HEX_WORDS(w0, w1, w2, w3, w4, w5, w6, w7) { (short)(w0), (short)(w1), (short)(w2), (short)(w3), (short)(w4), (short)(w5), (short)(w6), (short)(w7) }
+static const short fulcrumHexMasks[9][8] = {
+	FULCRUM_HEX_WORDS(0, -1, -1, 0, 0, 0, 0, 0),				// R0 <- A << 1 word
+	FULCRUM_HEX_WORDS(0, 0, 0, 0, -1, -1, 0, 0),				// R0 <- A << 2 words
+	FULCRUM_HEX_WORDS(0, 0, 0, 0, 0, 0, 0, -1),					// R0 <- A << 3 words
+	FULCRUM_HEX_WORDS(-1, 0, 0, 0, 0, 0, 0, 0),					// R1 <- A >> 5 words
+	FULCRUM_HEX_WORDS(0, 0, -1, -1, 0, 0, 0, 0),				// R1 <- A >> 4 words
+	FULCRUM_HEX_WORDS(0, 0, 0, 0, 0, -1, -1, 0),				// R1 <- B << 5 words
+	FULCRUM_HEX_WORDS(-1, -1, 0, 0, 0, 0, 0, 0),				// R2 <- B >> 2 words
+	FULCRUM_HEX_WORDS(0, 0, 0, -1, -1, 0, 0, 0),				// R2 <- B >> 1 word
+	FULCRUM_HEX_WORDS(0, 0, 0, 0, 0, 0, -1, -1),				// R2 <- B
+};
+static const short fulcrumHexSpaces[3][8] = {
+	FULCRUM_HEX_WORDS(' ', 0, 0, ' ', 0, 0, ' ', 0),
+	FULCRUM_HEX_WORDS(0, ' ', 0, 0, ' ', 0, 0, ' '),
+	FULCRUM_HEX_WORDS(0, 0, ' ', 0, 0, ' ', 0, 0),
+};
+
+// Turns 16 bytes into 16 high digit and 16 low digit characters
+static inline void fulcrumHex_DigitsSSE2(__m128i byteValues, __m128i& highDigits, __m128i& lowDigits)
+{
+	const __m128i nibbleMask = _mm_set1_epi8(0x0F);
+	const __m128i nineValue = _mm_set1_epi8(9);
+	const __m128i zeroChar = _mm_set1_epi8('0');
+	const __m128i letterOffset = _mm_set1_epi8('a' - '0' - 10);
+
+	__m128i highNibbles = _mm_and_si128(_mm_srli_epi16(byteValues, 4), nibbleMask);
+	__m128i lowNibbles = _mm_and_si128(byteValues, nibbleMask);
+	highDigits = _mm_add_epi8(_mm_add_epi8(highNibbles, zeroChar), _mm_and_si128(_mm_cmpgt_epi8(highNibbles, nineValue), letterOffset));
+	lowDigits = _mm_add_epi8(_mm_add_epi8(lowNibbles, zeroChar), _mm_and_si128(_mm_cmpgt_epi8(lowNibbles, nineValue), letterOffset));
+}
+
+// Spreads 8 bytes worth of wide hex pairs (A = pairs 0-3, B = pairs 4-7) into 24 output characters
+static inline void fulcrumHex_SpreadSSE2(__m128i pairsA, __m128i pairsB, __m128i spreadOut[3])
+{
+	const __m128i* pMasks = (const __m128i*)fulcrumHexMasks;
+	const __m128i* pSpaces = (const __m128i*)fulcrumHexSpaces;
+
+	spreadOut[0] = _mm_or_si128(_mm_or_si128(
+		_mm_and_si128(_mm_slli_si128(pairsA, 2), _mm_loadu_si128(pMasks + 0)),
+		_mm_and_si128(_mm_slli_si128(pairsA, 4), _mm_loadu_si128(pMasks + 1))), _mm_or_si128(
+		_mm_and_si128(_mm_slli_si128(pairsA, 6), _mm_loadu_si128(pMasks + 2)), _mm_loadu_si128(pSpaces + 0)));
+	spreadOut[1] = _mm_or_si128(_mm_or_si128(
+		_mm_and_si128(_mm_srli_si128(pairsA, 10), _mm_loadu_si128(pMasks + 3)),
+		_mm_and_si128(_mm_srli_si128(pairsA, 8), _mm_loadu_si128(pMasks + 4))), _mm_or_si128(
+		_mm_and_si128(_mm_slli_si128(pairsB, 10), _mm_loadu_si128(pMasks + 5)), _mm_loadu_si128(pSpaces + 1)));
+	spreadOut[2] = _mm_or_si128(_mm_or_si128(
+		_mm_and_si128(_mm_srli_si128(pairsB, 4), _mm_loadu_si128(pMasks + 6)),
+		_mm_and_si128(_mm_srli_si128(pairsB, 2), _mm_loadu_si128(pMasks + 7))), _mm_or_si128(
+		_mm_and_si128(pairsB, _mm_loadu_si128(pMasks + 8)), _mm_loadu_si128(pSpaces + 2)));
+}
+
+// Writes 8 characters built as 16 bit words. 32 bit wchar_t gets each word zero extended first
+static inline void fulcrumHex_StoreSSE2(wchar_t* pOutput, __m128i wordChars)
+{
+#if WCHAR_MAX <= 0xFFFF
+	_mm_storeu_si128((__m128i*)pOutput, wordChars);
+#else
+	_mm_storeu_si128((__m128i*)(pOutput + 0), _mm_unpacklo_epi16(wordChars, _mm_setzero_si128()));
+	_mm_storeu_si128((__m128i*)(pOutput + 4), _mm_unpackhi_epi16(wordChars, _mm_setzero_si128()));
+#endif
+}
+
+// 16 bytes per pass. Hex pairs are built as bytes, widened to characters, then spread out
+static void fulcrumHex_EncodeSSE2(const unsigned char* pData, size_t nBytes, wchar_t* pOutput)
+{
+	const __m128i zeroValue = _mm_setzero_si128();
+	__m128i spreadOut[3];
+	for (; nBytes >= 16; nBytes -= 16, pData += 16, pOutput += 48)
+	{
+		__m128i highDigits, lowDigits;
+		fulcrumHex_DigitsSSE2(_mm_loadu_si128((const __m128i*)pData), highDigits, lowDigits);
+		__m128i pairsLow = _mm_unpacklo_epi8(highDigits, lowDigits);
+		__m128i pairsHigh = _mm_unpackhi_epi8(highDigits, lowDigits);
+
+		fulcrumHex_SpreadSSE2(_mm_unpacklo_epi8(pairsLow, zeroValue), _mm_unpackhi_epi8(pairsLow, zeroValue), spreadOut);
+		fulcrumHex_StoreSSE2(pOutput + 0, spreadOut[0]);
+		fulcrumHex_StoreSSE2(pOutput + 8, spreadOut[1]);
+		fulcrumHex_StoreSSE2(pOutput + 16, spreadOut[2]);
+		fulcrumHex_SpreadSSE2(_mm_unpacklo_epi8(pairsHigh, zeroValue), _mm_unpackhi_epi8(pairsHigh, zeroValue), spreadOut);
+		fulcrumHex_StoreSSE2(pOutput + 24, spreadOut[0]);
+		fulcrumHex_StoreSSE2(pOutput + 32, spreadOut[1]);
+		fulcrumHex_StoreSSE2(pOutput + 40, spreadOut[2]);
+	}
+	fulcrumHex_EncodeScalar(pData, nBytes, pOutput);
+}
+
+// Same spread as the SSE2 version. AVX2 shifts stay inside each 128 bit lane so both lanes
+// run the SSE2 layout at once: the low lane for the first 16 bytes, the high lane for the next 16
+FULCRUM_TARGET_AVX2 static inline void fulcrumHex_SpreadAVX2(__m256i pairsA, __m256i pairsB, __m256i spreadOut[3])
+{
+	const __m128i* pMasks = (const __m128i*)fulcrumHexMasks;
+	const __m128i* pSpaces = (const __m128i*)fulcrumHexSpaces;
+	#define FULCRUM_HEX_LANES(pValue) _mm256_broadcastsi128_si256(_mm_loadu_si128(pValue))
+
+	spreadOut[0] = _mm256_or_si256(_mm256_or_si256(
+		_mm256_and_si256(_mm256_slli_si256(pairsA, 2), FULCRUM_HEX_LANES(pMasks + 0)),
+		_mm256_and_si256(_mm256_slli_si256(pairsA, 4), FULCRUM_HEX_LANES(pMasks + 1))), _mm256_or_si256(
+		_mm256_and_si256(_mm256_slli_si256(pairsA, 6), FULCRUM_HEX_LANES(pMasks + 2)), FULCRUM_HEX_LANES(pSpaces + 0)));
+	spreadOut[1] = _mm256_or_si256(_mm256_or_si256(
+		_mm256_and_si256(_mm256_srli_si256(pairsA, 10), FULCRUM_HEX_LANES(pMasks + 3)),
+		_mm256_and_si256(_mm256_srli_si256(pairsA, 8), FULCRUM_HEX_LANES(pMasks + 4))), _mm256_or_si256(
+		_mm256_and_si256(_mm256_slli_si256(pairsB, 10), FULCRUM_HEX_LANES(pMasks + 5)), FULCRUM_HEX_LANES(pSpaces + 1)));
+	spreadOut[2] = _mm256_or_si256(_mm256_or_si256(
+		_mm256_and_si256(_mm256_srli_si256(pairsB, 4), FULCRUM_HEX_LANES(pMasks + 6)),
+		_mm256_and_si256(_mm256_srli_si256(pairsB, 2), FULCRUM_HEX_LANES(pMasks + 7))), _mm256_or_si256(
+		_mm256_and_si256(pairsB, FULCRUM_HEX_LANES(pMasks + 8)), FULCRUM_HEX_LANES(pSpaces + 2)));
+
+	#undef FULCRUM_HEX_LANES
+}
+
+// Writes 16 characters built as 16 bit words, widened the same way as fulcrumHex_StoreSSE2()
+FULCRUM_TARGET_AVX2 static inline void fulcrumHex_StoreAVX2(wchar_t* pOutput, __m256i wordChars)
+{
+#if WCHAR_MAX <= 0xFFFF
+	_mm256_storeu_si256((__m256i*)pOutput, wordChars);
+#else
+	_mm256_storeu_si256((__m256i*)(pOutput + 0), _mm256_cvtepu16_epi32(_mm256_castsi256_si128(wordChars)));
+	_mm256_storeu_si256((__m256i*)(pOutput + 8), _mm256_cvtepu16_epi32(_mm256_extracti128_si256(wordChars, 1)));
+#endif
+}
+
+// 32 bytes per pass. Falls back to SSE2 and then scalar for what's left
+FULCRUM_TARGET_AVX2 static void fulcrumHex_EncodeAVX2(const unsigned char* pData, size_t nBytes, wchar_t* pOutput)
+{
+	const __m256i nibbleMask = _mm256_set1_epi8(0x0F);
+	const __m256i nineValue = _mm256_set1_epi8(9);
+	const __m256i zeroChar = _mm256_set1_epi8('0');
+	const __m256i letterOffset = _mm256_set1_epi8('a' - '0' - 10);
+	const __m256i zeroValue = _mm256_setzero_si256();
+
+	__m256i spreadLow[3], spreadHigh[3];
+	for (; nBytes >= 32; nBytes -= 32, pData += 32, pOutput += 96)
+	{
+		__m256i byteValues = _mm256_loadu_si256((const __m256i*)pData);
+		__m256i highNibbles = _mm256_and_si256(_mm256_srli_epi16(byteValues, 4), nibbleMask);
+		__m256i lowNibbles = _mm256_and_si256(byteValues, nibbleMask);
+		__m256i highDigits = _mm256_add_epi8(_mm256_add_epi8(highNibbles, zeroChar), _mm256_and_si256(_mm256_cmpgt_epi8(highNibbles, nineValue), letterOffset));
+		__m256i lowDigits = _mm256_add_epi8(_mm256_add_epi8(lowNibbles, zeroChar), _mm256_and_si256(_mm256_cmpgt_epi8(lowNibbles, nineValue), letterOffset));
+
+		// Pairs for bytes 0-7 of each lane, then bytes 8-15 of each lane
+		__m256i pairsLow = _mm256_unpacklo_epi8(highDigits, lowDigits);
+		__m256i pairsHigh = _mm256_unpackhi_epi8(highDigits, lowDigits);
+		fulcrumHex_SpreadAVX2(_mm256_unpacklo_epi8(pairsLow, zeroValue), _mm256_unpackhi_epi8(pairsLow, zeroValue), spreadLow);
+		fulcrumHex_SpreadAVX2(_mm256_unpacklo_epi8(pairsHigh, zeroValue), _mm256_unpackhi_epi8(pairsHigh, zeroValue), spreadHigh);
+
+		// Low lanes hold the first 48 characters, high lanes the next 48
+		fulcrumHex_StoreAVX2(pOutput + 0, _mm256_permute2x128_si256(spreadLow[0], spreadLow[1], 0x20));
+		fulcrumHex_StoreAVX2(pOutput + 16, _mm256_permute2x128_si256(spreadLow[2], spreadHigh[0], 0x20));
+		fulcrumHex_StoreAVX2(pOutput + 32, _mm256_permute2x128_si256(spreadHigh[1], spreadHigh[2], 0x20));
+		fulcrumHex_StoreAVX2(pOutput + 48, _mm256_permute2x128_si256(spreadLow[0], spreadLow[1], 0x31));
+		fulcrumHex_StoreAVX2(pOutput + 64, _mm256_permute2x128_si256(spreadLow[2], spreadHigh[0], 0x31));
+		fulcrumHex_StoreAVX2(pOutput + 80, _mm256_permute2x128_si256(spreadHigh[1], spreadHigh[2], 0x31));
+	}
+	fulcrumHex_EncodeSSE2(pData, nBytes, pOutput);
+}
+
+// CPU feature checks. AVX2 also needs the OS to save the YMM registers for us
+static void fulcrumHex_Cpuid(int cpuInfo[4], int cpuLeaf)
+{
+#if defined(_MSC_VER)
+	__cpuidex(cpuInfo, cpuLeaf, 0);
+#else
+	unsigned int cpuRegs[4] = { 0 };
+	__cpuid_count(cpuLeaf, 0, cpuRegs[0], cpuRegs[1], cpuRegs[2], cpuRegs[3]);
+	for (int regIndex = 0; regIndex < 4; regIndex++) cpuInfo[regIndex] = (int)cpuRegs[regIndex];
+#endif
+}
+static bool fulcrumHex_CpuSupports(fulcrum_hex_encoder hexEncoder)
+{
+	int cpuInfo[4];
+	fulcrumHex_Cpuid(cpuInfo, 0);
+	int nMaxLeaf = cpuInfo[0];
+	fulcrumHex_Cpuid(cpuInfo, 1);
+	if (hexEncoder == HEX_ENCODER_SSE2) return (cpuInfo[3] & (1 << 26)) != 0;
+	if (hexEncoder != HEX_ENCODER_AVX2 || nMaxLeaf < 7) return false;
+
+	// OSXSAVE and AVX, then XMM and YMM state enabled in XCR0, then AVX2 itself
+	if ((cpuInfo[2] & (1 << 27)) == 0 || (cpuInfo[2] & (1 << 28)) == 0) return false;
+#if defined(_MSC_VER)
+	unsigned long long xcrFeatures = _xgetbv(0);
+#else
+	unsigned int xcrLow, xcrHigh;
+	__asm__ volatile("xgetbv" : "=a"(xcrLow), "=d"(xcrHigh) : "c"(0));
+	unsigned long long xcrFeatures = ((unsigned long long)xcrHigh << 32) | xcrLow;
+#endif
+	if ((xcrFeatures & 6) != 6) return false;
+	fulcrumHex_Cpuid(cpuInfo, 7);
+	return (cpuInfo[1] & (1 << 5)) != 0;
+}
+
+#else
+static bool fulcrumHex_CpuSupports(fulcrum_hex_encoder) { return false; }
+#endif
+
+// ---------------------------------------------------------------------------------------------------------------------------------
+
+// Encoder selection
+fulcrum_hex_encoder fulcrumHex_Encoder()
+{
+	if (activeKernel == NULL) fulcrumHex_SetEncoder(HEX_ENCODER_AUTO);
+	return activeEncoder;
+}
+bool fulcrumHex_SetEncoder(fulcrum_hex_encoder hexEncoder)
+{
+	// Auto takes the widest encoder this CPU can run
+	if (hexEncoder == HEX_ENCODER_AUTO) {
+		if (fulcrumHex_CpuSupports(HEX_ENCODER_AVX2)) hexEncoder = HEX_ENCODER_AVX2;
+		else if (fulcrumHex_CpuSupports(HEX_ENCODER_SSE2)) hexEncoder = HEX_ENCODER_SSE2;
+		else hexEncoder = HEX_ENCODER_SCALAR;
+	}
+	else if (hexEncoder != HEX_ENCODER_SCALAR && !fulcrumHex_CpuSupports(hexEncoder)) return false;
+
+	// Any thread picking the encoder lands on the same answer, so racing here is harmless
+	fulcrum_hex_kernel selectedKernel = fulcrumHex_EncodeScalar;
+#if FULCRUM_HEX_SIMD
+	if (hexEncoder == HEX_ENCODER_SSE2) selectedKernel = fulcrumHex_EncodeSSE2;
+	if (hexEncoder == HEX_ENCODER_AVX2) selectedKernel = fulcrumHex_EncodeAVX2;
+#endif
+	activeEncoder = hexEncoder;
+	activeKernel = selectedKernel;
+	return true;
+}
+
+// Dump line sizes and the dump itself
+size_t fulcrumHex_Length(size_t nBytes, size_t nBracketFrom)
+{
+	size_t nPlain = nBracketFrom < nBytes ? nBracketFrom : nBytes;
+	return (sizeof(FULCRUM_HEXDUMP_PREFIX) / sizeof(wchar_t) - 1) + nPlain * 3 + (nBytes - nPlain) * 5 + 1;
+}
+size_t fulcrumHex_Format(const unsigned char* pData, size_t nBytes, size_t nBracketFrom, wchar_t* pOutput)
+{
+	if (activeKernel == NULL) fulcrumHex_SetEncoder(HEX_ENCODER_AUTO);
+
+	// Prefix first, then the plain run through the selected kernel
+	const size_t nPrefix = sizeof(FULCRUM_HEXDUMP_PREFIX) / sizeof(wchar_t) - 1;
+	memcpy(pOutput, FULCRUM_HEXDUMP_PREFIX, nPrefix * sizeof(wchar_t));
+	wchar_t* pWrite = pOutput + nPrefix;
+	size_t nPlain = nBracketFrom < nBytes ? nBracketFrom : nBytes;
+	activeKernel(pData, nPlain, pWrite);
+	pWrite += nPlain * 3;
+
+	// Extra data is rare and short. Do it a byte at a time
+	for (size_t byteIndex = nPlain; byteIndex < nBytes; byteIndex++)
+	{
+		pWrite[0] = L' ';
+		pWrite[1] = L'[';
+		pWrite[2] = fulcrumHexDigits[pData[byteIndex] >> 4];
+		pWrite[3] = fulcrumHexDigits[pData[byteIndex] & 0x0F];
+		pWrite[4] = L']';
+		pWrite += 5;
+	}
+
+	*pWrite++ = L'\n';
+	*pWrite = 0;
+	return (size_t)(pWrite - pOutput);
+}
\ No newline at end of file
@@ -0,0 +1,54 @@
+/*
+**
+** Copyright (C) 2022 MEAT Inc
+** Author: Zack Walsh <neo.smith@motorengineeringandtech.com>
+**
+** This library is free software; you can redistribute it and/or modify
+** it under the terms of the GNU Lesser General Public License as published
+** by the Free Software Foundation, either version 3 of the License, or (at
+** your option) any later version.
+**
+** This library is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+** Lesser General Public License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public
+** License along with this library; if not, <http://www.gnu.org/licenses/>.
+**
+*/
+
+
+#pragma once
+
+// Standard Imports
+#include <stddef.h>
+#include <wchar.h>
+
+// Hex dumps for message and SBYTE_ARRAY payloads. Every byte is written as " xx", and bytes from
+// the bracket index on (extra data like checksums) as " [xx]", straight into a caller owned buffer.
+// Plain runs are encoded 16 or 32 bytes at a time with SSE2/AVX2 on x86 builds when the CPU has them
+
+// Largest line fulcrumHex_Format() can build for a single PASSTHRU_MSG (4128 bytes, all bracketed)
+#define FULCRUM_HEXDUMP_PREFIX L"  \\__"
+#define FULCRUM_HEXDUMP_MAX_CHARS (5 + 4128 * 5 + 2)
+
+// Encoders we can pick from. Auto picks the best one the CPU supports
+enum fulcrum_hex_encoder {
+	HEX_ENCODER_AUTO = 0,
+	HEX_ENCODER_SCALAR = 1,
+	HEX_ENCODER_SSE2 = 2,
+	HEX_ENCODER_AVX2 = 3,
+};
+
+// Number of characters fulcrumHex_Format() writes for a payload, not counting the terminator
+size_t fulcrumHex_Length(size_t nBytes, size_t nBracketFrom);
+
+// Builds the whole dump line (prefix, bytes, newline, terminator). The output buffer must hold
+// fulcrumHex_Length() + 1 characters. Returns the number of characters written without the terminator
+size_t fulcrumHex_Format(const unsigned char* pData, size_t nBytes, size_t nBracketFrom, wchar_t* pOutput);
+
+// Encoder selection. Used by the benchmark to compare the kernels against each other.
+// Setting an encoder the CPU can't run returns false and leaves the current one in place
+fulcrum_hex_encoder fulcrumHex_Encoder();
+bool fulcrumHex_SetEncoder(fulcrum_hex_encoder hexEncoder);
\ No newline at end of file
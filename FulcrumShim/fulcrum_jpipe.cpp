@@ -20,19 +20,23 @@
 
 // Standard Imports
 #include "stdafx.h"
+#include <climits>
 
 // Fulcrum Resource Imports
 #include "fulcrum_pipe.h"
 #include "fulcrum_jpipe.h"
 #include "fulcrum_bitconverter.h"
+#include "fulcrum_frame.h"
 
 void fulcrum_jpipe::WriteSByteArray(SBYTE_ARRAY* ary)
 {
 	if (ary == NULL)
 		throw& CPipExceptionNULLParameter();
 
-	WriteUint32(ary->NumOfBytes);
-	WriteBytesOut(ary->BytePtr, ary->NumOfBytes);
+	BeginFrame(4 + ary->NumOfBytes);
+	FrameUint32(ary->NumOfBytes);
+	FrameBytes(ary->BytePtr, ary->NumOfBytes);
+	WriteFrame(FRAME_SBYTE_ARRAY);
 }
 
 void fulcrum_jpipe::ReadSByteArray(SBYTE_ARRAY* ary)
@@ -59,9 +63,16 @@ void fulcrum_jpipe::WriteSParamList(SPARAM_LIST* list)
 	if (list == NULL)
 		throw& CPipExceptionNULLParameter();
 
-	WriteUint32(list->NumOfParams);
+	// Count and every parameter go out together
+	BeginFrame(4 + list->NumOfParams * 12);
+	FrameUint32(list->NumOfParams);
 	for (unsigned int i = 0; i < list->NumOfParams; i++)
-		WriteSParam(&list->ParamPtr[i]);
+	{
+		FrameUint32(list->ParamPtr[i].Parameter);
+		FrameUint32(list->ParamPtr[i].Value);
+		FrameUint32(list->ParamPtr[i].Supported);
+	}
+	WriteFrame(FRAME_SPARAM_LIST);
 }
 
 void fulcrum_jpipe::ReadSParamList(SPARAM_LIST* list)
@@ -69,17 +80,32 @@ void fulcrum_jpipe::ReadSParamList(SPARAM_LIST* list)
 	if (list == NULL)
 		throw& CPipExceptionNULLParameter();
 
-	list->NumOfParams = ReadUint32();
+	// The count going in is how many params the caller has room for. Anything more is a bad reply
+	unsigned long paramCapacity = list->NumOfParams;
+	unsigned long paramCount = ReadUint32();
+	if (paramCount > paramCapacity || paramCount > INT_MAX / 12)
+		throw& CPipeException(std::string(("too many params")));
+
+	// Every parameter is decoded straight out of the read buffer
+	list->NumOfParams = paramCount;
+	byte* pParams = (byte*)ReadBytesView((int)(paramCount * 12));
 	for (unsigned int i = 0; i < list->NumOfParams; i++)
-		ReadSParam(&list->ParamPtr[i]);
+	{
+		list->ParamPtr[i].Parameter = fulcrum_bitconverter::bytes_to_uint32(pParams, i * 12);
+		list->ParamPtr[i].Value = fulcrum_bitconverter::bytes_to_uint32(pParams, i * 12 + 4);
+		list->ParamPtr[i].Supported = fulcrum_bitconverter::bytes_to_uint32(pParams, i * 12 + 8);
+	}
 }
 
 // (10/18/19 TAB)
 void fulcrum_jpipe::WriteResourceStruct(RESOURCE_STRUCT res)
 {
-	WriteUint32(res.Connector);
-	WriteUint32(res.NumOfResources);
-	WriteUint32(res.ResourceListPtr, res.NumOfResources);
+	BeginFrame(8 + res.NumOfResources * 4);
+	FrameUint32(res.Connector);
+	FrameUint32(res.NumOfResources);
+	for (unsigned int i = 0; i < res.NumOfResources; i++)
+		FrameUint32(res.ResourceListPtr[i]);
+	WriteFrame(FRAME_RESOURCE);
 }
 
 void fulcrum_jpipe::IssueGetProtocolInfo(unsigned int protocolID, SPARAM_LIST* paramlist)
@@ -121,17 +147,23 @@ void fulcrum_jpipe::ReadPassThruMessages(PASSTHRU_MSG* pMsgs, uint32_t numMsgs)
 	if (pMsgs == NULL)
 		throw& CPipExceptionNULLParameter();
 
+	// Headers are decoded out of the read buffer. Only the payload gets copied
 	for (unsigned int i = 0; i < numMsgs; i++)
 	{
-		pMsgs[i].ProtocolID = (protocol_id_t)ReadUint32();
-		ReadUint32();															// eat msgHandle
-		pMsgs[i].RxStatus = (rx_status_t)ReadUint32();
-		pMsgs[i].TxFlags = (tx_flag_t)ReadUint32();
-		pMsgs[i].Timestamp = ReadUint32();
-		pMsgs[i].DataSize = ReadUint32();
-		pMsgs[i].ExtraDataIndex = ReadUint32();
-		ReadUint32();															// eat dataBufferSize
+		byte* pHeader = (byte*)ReadBytesView(32);
+		pMsgs[i].ProtocolID = (protocol_id_t)fulcrum_bitconverter::bytes_to_uint32(pHeader, 0);
+																				// skip msgHandle
+		pMsgs[i].RxStatus = (rx_status_t)fulcrum_bitconverter::bytes_to_uint32(pHeader, 8);
+		pMsgs[i].TxFlags = (tx_flag_t)fulcrum_bitconverter::bytes_to_uint32(pHeader, 12);
+		pMsgs[i].Timestamp = fulcrum_bitconverter::bytes_to_uint32(pHeader, 16);
+		pMsgs[i].DataSize = fulcrum_bitconverter::bytes_to_uint32(pHeader, 20);
+		pMsgs[i].ExtraDataIndex = fulcrum_bitconverter::bytes_to_uint32(pHeader, 24);
+																				// skip dataBufferSize
+		// Anything past the end of Data is dropped so the next header still lines up
+		unsigned long payloadSize = pMsgs[i].DataSize;
+		if (pMsgs[i].DataSize > sizeof(pMsgs[i].Data)) pMsgs[i].DataSize = sizeof(pMsgs[i].Data);
 		ReadBytesIn((byte*)pMsgs[i].Data, (int*)&pMsgs[i].DataSize);
+		if (payloadSize > pMsgs[i].DataSize) ReadBytesView((int)(payloadSize - pMsgs[i].DataSize));
 	}
 }
 
@@ -140,16 +172,9 @@ void fulcrum_jpipe::WritePassThruMessages(PASSTHRU_MSG* pMsgs, uint32_t numMsgs)
 	if (pMsgs == NULL)
 		throw& CPipExceptionNULLParameter();
 
-	for (unsigned int i = 0; i < numMsgs; i++)
-	{
-		WriteUint32(pMsgs[i].ProtocolID);
-		WriteUint32(0);															// made up handle
-		WriteUint32(pMsgs[i].RxStatus);
-		WriteUint32(pMsgs[i].TxFlags);
-		WriteUint32(pMsgs[i].Timestamp);
-		WriteUint32(pMsgs[i].DataSize);
-		WriteUint32(pMsgs[i].ExtraDataIndex);
-		WriteUint32(pMsgs[i].DataSize);											// don't care, just use size
-		WriteBytesOut((byte*)pMsgs[i].Data, pMsgs[i].DataSize);
-	}
+	// Size the whole batch first so it's packed into one buffer and written once
+	size_t frameBytes = fulcrumFrame_MessagesSize(pMsgs, numMsgs);
+	BeginFrame(frameBytes);
+	fulcrumFrame_PackMessages(FrameSpace(frameBytes), pMsgs, numMsgs);
+	WriteFrame(FRAME_MESSAGES);
 }
\ No newline at end of file
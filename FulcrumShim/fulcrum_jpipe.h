@@ -23,6 +23,7 @@
 // Fulcrum Resource Imports
 #include "fulcrum_pipe.h"
 #include "fulcrum_j2534.h"
+#include "fulcrum_frame.h"
 
 class fulcrum_jpipe : public fulcrum_pipe
 {
@@ -39,9 +40,11 @@ public:
 		if (param == NULL)
 			throw& CPipExceptionNULLParameter();
 
-		WriteUint32(param->Parameter);
-		WriteUint32(param->Value);
-		WriteUint32(param->Supported);
+		BeginFrame(12);
+		FrameUint32(param->Parameter);
+		FrameUint32(param->Value);
+		FrameUint32(param->Supported);
+		WriteFrame(FRAME_SPARAM);
 	}
 	void ReadSParam(SPARAM* param);
 
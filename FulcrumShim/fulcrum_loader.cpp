@@ -22,10 +22,14 @@
 #include "stdafx.h"
 #include "config.h"
 #include <afxmt.h>
+#include <atomic>
 #include <fstream>
 #include <string>
 #include <streambuf>
 #include <iostream>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
 #include <sstream>
 #include <vector>
 
@@ -34,251 +38,154 @@
 #include "fulcrum_j2534.h"
 #include "fulcrum_debug.h"
 #include "fulcrum_loader.h"
+#include "fulcrum_handles.h"
+#include "fulcrum_catalog.h"
 #include "fulcrum_output.h"
+#include "fulcrum_deferred.h"
 #include "FulcrumShim.h"
 
 // Using callout
 using namespace std;
 
-// Pointers to J2534 API functions in the loaded library
-PTOPEN _PassThruOpen = 0;
-PTCLOSE _PassThruClose = 0;
-PTGETNEXTCARDAQ _PassThruGetNextCarDAQ = 0;
-PTREADDETAILS _PassThruReadDetails = 0;
-PTCONNECT _PassThruConnect = 0;
-PTDISCONNECT _PassThruDisconnect = 0;
-PTREADMSGS _PassThruReadMsgs = 0;
-PTWRITEMSGS _PassThruWriteMsgs = 0;
-PTSTARTPERIODICMSG _PassThruStartPeriodicMsg = 0;
-PTSTOPPERIODICMSG _PassThruStopPeriodicMsg = 0;
-PTSTARTMSGFILTER _PassThruStartMsgFilter = 0;
-PTSTOPMSGFILTER _PassThruStopMsgFilter = 0;
-PTSETPROGRAMMINGVOLTAGE _PassThruSetProgrammingVoltage = 0;
-PTREADVERSION _PassThruReadVersion = 0;
-PTGETLASTERROR _PassThruGetLastError = 0;
-PTIOCTL _PassThruIoctl = 0;
-
-static HINSTANCE hDLL = NULL;
-
-static bool fLibLoaded = false;
-static LARGE_INTEGER ticksPerSecond;
-static LARGE_INTEGER tick;
-static CRITICAL_SECTION mAutoLock;
-
-// Vista-forward has a great function InitOnceExecuteOnce() to thread-safe execute
-// a callback exactly once, but we want to support Windows XP. Instead we'll guard
-// with a globally initialized CCriticalSection.
-static CCriticalSection CritSectionPerformanceCounter;
-static bool fPerformanceCounterInitialized = false;
-static CCriticalSection CritSectionAutoLock;
-static bool fAutoLockInitialized = false;
-
+// Every library loaded so far, in the order they were loaded. The list only changes while loading or
+// unloading, which hold the library lock on their own (or run the autoload before anything else could
+// have reached a library), so calls can keep the pointers they were routed to
+// The list is never destroyed. Static teardown runs under the loader lock, where FreeLibrary() isn't allowed,
+// so libraries are only freed by fulcrum_unloadLibrary() and anything still loaded at exit stays loaded
+static std::vector<std::unique_ptr<fulcrum_library>>& loadedLibraries = *new std::vector<std::unique_ptr<fulcrum_library>>();
+static std::mutex libraryListLock;
+static std::atomic<fulcrum_library*> pDefaultLibrary(NULL);
+
+// Library lock. Loading and unloading take it on their own, every other call shares it.
+// Built with the DLL's other statics, before any exported call can reach it
+static std::shared_timed_mutex mLibraryLock;
+
+// Calls on different channels can get to fulcrum_checkAndAutoload() at the same time. Only one of
+// them loads the library and boots the pipes, the rest wait for it here
+static CCriticalSection CritSectionAutoload;
+
+// Interfaces found in the registry. Only touched by the autoload, which runs one at a time
+static fulcrum_catalog interfaceCatalog;
+static bool fCatalogRead = false;
 static void EnumPassThruInterfaces(std::set<cPassThruInfo> &registryList);
 
 auto_lock::auto_lock()
 {
-	// ONCE -- the first time somebody creates an autolock we need to initialize the mutex
-	CritSectionAutoLock.Lock();
-	if (!fAutoLockInitialized) {
-		InitializeCriticalSection(&mAutoLock);
-		fAutoLockInitialized = true;
-	}
-
-	// Unlock auto selected object
-	CritSectionAutoLock.Unlock();
-
-	// Try and reset the lock state. Fail out if this fails.
-	if (TryEnterCriticalSection(&mAutoLock)) return;
-	fulcrum_output::fulcrumDebug(_T("Multi-threading error"));
-	EnterCriticalSection(&mAutoLock);
+	// Every call still in the driver has to finish before the library can change
+	if (mLibraryLock.try_lock()) return;
+	fulcrum_DEBUG(_T("-->       Waiting for calls in progress before changing the library\n"));
+	mLibraryLock.lock();
 }
+auto_lock::~auto_lock() { mLibraryLock.unlock(); }
 
-auto_lock::~auto_lock() { LeaveCriticalSection(&mAutoLock); }
-
-// Find all J2534 v04.04 interfaces listed in the registry
-static void EnumPassThruInterfaces(std::set<cPassThruInfo>& registryList)
-{
-	// Values for reg keys and info for this method.
-	HKEY softwareKey, reg0404Key;
-	HKEY wowNodeKey, reg0500Key = NULL;
-	HKEY VendorKey_v0404, VendorKey_v0500;
-
-	// Other information about key entries as we loop them
-	FILETIME FTime_v0404, FTime_v0500;
-	long hKey2RetVal_v0404, hKey2RetVal_v0500;
-	DWORD VendorIndex_v0404, VendorIndex_v0500;
-	DWORD KeyType_v0404, KeyType_v0500;
-	DWORD KeySize_v0404, KeySize_v0500;
-
-	// Clear out/init our return list.
-	registryList.clear();
+auto_shared_lock::auto_shared_lock() { mLibraryLock.lock_shared(); }
+auto_shared_lock::~auto_shared_lock() { mLibraryLock.unlock_shared(); }
 
-	// Open the software key and the WOW6432Node Key objects here. If this fails, return out.
-	if (RegOpenKeyEx(HKEY_LOCAL_MACHINE, _T("Software"), 0, KEY_READ, &softwareKey) != ERROR_SUCCESS) return;
-
-	// Store values for the 04.04 DLLs first then try and pull out our v05.00 DLLs.
-	RegOpenKeyEx(softwareKey, _T("PassThruSupport.04.04"), 0, KEY_READ, &reg0404Key);
-	if (RegOpenKeyEx(softwareKey, _T("WOW6432Node"), 0, KEY_READ, &wowNodeKey) == ERROR_SUCCESS) {
-		RegOpenKeyEx(wowNodeKey, _T("PassThruSupport.05.00"), 0, KEY_READ, &reg0500Key);
-		RegCloseKey(wowNodeKey);
-	}
-
-	// Close the software key entry now.
-	RegCloseKey(softwareKey);
-
-	// ------------------------------------------------------------------------------------------------
-
-	// Determine the maximum subkey length for HKLM/Software/PassThruSupport.04.04/*
-	VendorIndex_v0404 = 0;
-	DWORD lMaxSubKeyLen_v0404;
-	RegQueryInfoKey(reg0404Key, NULL, NULL, NULL, NULL, &lMaxSubKeyLen_v0404, NULL, NULL, NULL, NULL, NULL, NULL);
-	TCHAR * KeyValue_v0404 = new TCHAR[lMaxSubKeyLen_v0404+1];
-
-	// Iterate through HKLM/Software/PassThruSupport.04.04/*
-	do
+// The real registry for the interface catalog. Buffers are sized from RegQueryInfoKey and every key opened is closed again
+class fulcrum_registry_windows : public fulcrum_registry_provider {
+public:
+	virtual bool ListSubkeys(const std::wstring& keyPath, std::vector<fulcrum_registry_subkey>& subkeyList)
 	{
-		// Get the name of HKLM/Software/PassThruSupport.04.04/VendorDevice[i]
-		KeySize_v0404 = lMaxSubKeyLen_v0404+1;
-		hKey2RetVal_v0404 = RegEnumKeyEx(reg0404Key, VendorIndex_v0404++, KeyValue_v0404, &KeySize_v0404, NULL, NULL, NULL, &FTime_v0404);
-		if (hKey2RetVal_v0404 != ERROR_SUCCESS) { continue; }
+		HKEY hKey;
+		if (RegOpenKeyEx(HKEY_LOCAL_MACHINE, keyPath.c_str(), 0, KEY_READ, &hKey) != ERROR_SUCCESS) return false;
 
-		// Open HKLM/Software/PassThruSupport.04.04/Vendor[i]
-		if (RegOpenKeyEx(reg0404Key, KeyValue_v0404, 0, KEY_READ, &VendorKey_v0404) == ERROR_SUCCESS)
+		DWORD maxNameLength = 0;
+		RegQueryInfoKey(hKey, NULL, NULL, NULL, NULL, &maxNameLength, NULL, NULL, NULL, NULL, NULL, NULL);
+		std::vector<TCHAR> nameBuffer(maxNameLength + 1);
+		for (DWORD keyIndex = 0; ; keyIndex++)
 		{
-			// Return value state and strings for DLL information
-			LSTATUS retval;
-			tstring strVendor, strName, strFunctionLibrary, strConfigApplication;
-
-			// Determine the maximum value length for HKLM/Software/PassThruSupport.04.04/VendorDevice[i]/*
-			DWORD lMaxValueLen;
-			retval = RegQueryInfoKey(VendorKey_v0404, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, &lMaxValueLen, NULL, NULL);
-
-			// Allocate a buffer large enough to hold that name
-			TCHAR * KeyValue_v0404 = new TCHAR[lMaxValueLen+1];
-
-			// Query HKLM/Software/PassThruSupport.04.04/VendorDevice[i]/Vendor
-			KeySize_v0404 = lMaxValueLen+1;
-			if (RegQueryValueEx(VendorKey_v0404, _T("Vendor"), 0, &KeyType_v0404, (LPBYTE)KeyValue_v0404, &KeySize_v0404) == ERROR_SUCCESS)
-				strVendor = KeyValue_v0404;
-
-			// Query HKLM/Software/PassThruSupport.04.04/VendorDevice[i]/Name
-			KeySize_v0404 = lMaxValueLen+1;
-			if (RegQueryValueEx(VendorKey_v0404, _T("Name"), 0, &KeyType_v0404, (LPBYTE)KeyValue_v0404, &KeySize_v0404) == ERROR_SUCCESS)
-				strName = KeyValue_v0404; strName += L" (v04.04)";
-
-			// Read HKLM/Software/PassThruSupport.04.04/VendorDevice[i]/FunctionLibrary
-			KeySize_v0404 = lMaxValueLen+1;
-			if (RegQueryValueEx(VendorKey_v0404, _T("FunctionLibrary"), 0, &KeyType_v0404, (LPBYTE)KeyValue_v0404, &KeySize_v0404) == ERROR_SUCCESS)
-				strFunctionLibrary = KeyValue_v0404;
-
-			// Read HKLM/Software/PassThruSupport.04.04/VendorDevice[i]/ConfigApplication
-			KeySize_v0404 = lMaxValueLen+1;
-			if (RegQueryValueEx(VendorKey_v0404, _T("ConfigApplication"), 0, &KeyType_v0404, (LPBYTE)KeyValue_v0404, &KeySize_v0404) == ERROR_SUCCESS)
-				strConfigApplication = KeyValue_v0404;
-
-			// Clsoe our key, clear the memory allocation for it.
-			RegCloseKey(VendorKey_v0404); delete KeyValue_v0404;
-
-			// If everything was successful then add it to the list
-			cPassThruInfo registryEntry(strVendor, strName, strFunctionLibrary, strConfigApplication);
-			registryList.insert(registryEntry);
+			DWORD nameLength = (DWORD)nameBuffer.size(); FILETIME writeTime;
+			LONG enumResult = RegEnumKeyEx(hKey, keyIndex, &nameBuffer[0], &nameLength, NULL, NULL, NULL, &writeTime);
+			if (enumResult != ERROR_SUCCESS) break;
+
+			fulcrum_registry_subkey foundKey;
+			foundKey.Name.assign(&nameBuffer[0], nameLength);
+			foundKey.LastWrite = ((uint64_t)writeTime.dwHighDateTime << 32) | writeTime.dwLowDateTime;
+			subkeyList.push_back(foundKey);
 		}
-	} while (hKey2RetVal_v0404 == ERROR_SUCCESS);
-	RegCloseKey(reg0404Key);
 
-	// ------------------------------------------------------------------------------------------------
-
-	// Stop here if this key is null
-	if (reg0500Key == NULL) return;
-
-	// Determine the maximum subkey length for HKLM/Software/WOW6432Node/PassThruSupport.05.00/*
-	VendorIndex_v0500 = 0;
-	DWORD lMaxSubKeyLen_v0500;
-	RegQueryInfoKey(reg0500Key, NULL, NULL, NULL, NULL, &lMaxSubKeyLen_v0500, NULL, NULL, NULL, NULL, NULL, NULL);
-	TCHAR* KeyValue_v0500 = new TCHAR[lMaxSubKeyLen_v0500 + 1];
+		RegCloseKey(hKey);
+		return true;
+	}
 
-	// Iterate through HKLM/Software/WOW6432Node/PassThruSupport.05.00/*
-	do
+	virtual bool ReadValues(const std::wstring& keyPath, fulcrum_registry_values& keyValues)
 	{
-		// Get the name of HKLM/Software/WOW6432Node/PassThruSupport.05.00/VendorDevice[i]
-		KeySize_v0500 = lMaxSubKeyLen_v0500 + 1;
-		hKey2RetVal_v0500 = RegEnumKeyEx(reg0500Key, VendorIndex_v0500++, KeyValue_v0500, &KeySize_v0500, NULL, NULL, NULL, &FTime_v0500);
-		if (hKey2RetVal_v0500 != ERROR_SUCCESS) { continue; }
-
-		// HKLM/Software/WOW6432Node/PassThruSupport.05.00/Vendor[i]
-		if (RegOpenKeyEx(reg0500Key, KeyValue_v0500, 0, KEY_READ, &VendorKey_v0500) == ERROR_SUCCESS)
+		HKEY hKey;
+		if (RegOpenKeyEx(HKEY_LOCAL_MACHINE, keyPath.c_str(), 0, KEY_READ, &hKey) != ERROR_SUCCESS) return false;
+
+		DWORD maxNameLength = 0, maxDataLength = 0;
+		RegQueryInfoKey(hKey, NULL, NULL, NULL, NULL, NULL, NULL, NULL, &maxNameLength, &maxDataLength, NULL, NULL);
+		std::vector<TCHAR> nameBuffer(maxNameLength + 1);
+		std::vector<TCHAR> dataBuffer(maxDataLength / sizeof(TCHAR) + 1);
+		for (DWORD valueIndex = 0; ; valueIndex++)
 		{
-			// Return value state and strings for DLL information
-			LSTATUS retval;
-			tstring strVendor, strName, strFunctionLibrary, strConfigApplication;
-
-			// Determine the maximum value length for HKLM/Software/WOW6432Node/PassThruSupport.05.00/VendorDevice[i]/*
-			DWORD lMaxValueLen;
-			retval = RegQueryInfoKey(VendorKey_v0500, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, &lMaxValueLen, NULL, NULL);
-
-			// Allocate a buffer large enough to hold that name
-			TCHAR* KeyValue_v0500 = new TCHAR[lMaxValueLen + 1];
-
-			// Query HKLM/Software/WOW6432Node/PassThruSupport.05.00/VendorDevice[i]/Vendor
-			KeySize_v0500 = lMaxValueLen + 1;
-			if (RegQueryValueEx(VendorKey_v0500, _T("Vendor"), 0, &KeyType_v0500, (LPBYTE)KeyValue_v0500, &KeySize_v0500) == ERROR_SUCCESS)
-				strVendor = KeyValue_v0500;
-
-			// Query HKLM/Software/WOW6432Node/PassThruSupport.05.00/VendorDevice[i]/Name
-			KeySize_v0500 = lMaxValueLen + 1;
-			if (RegQueryValueEx(VendorKey_v0500, _T("Name"), 0, &KeyType_v0500, (LPBYTE)KeyValue_v0500, &KeySize_v0500) == ERROR_SUCCESS)
-				strName = KeyValue_v0500; strName += L" (v05.00)";
-
-			// Read HKLM/Software/WOW6432Node/PassThruSupport.05.00/VendorDevice[i]/FunctionLibrary
-			KeySize_v0500 = lMaxValueLen + 1;
-			if (RegQueryValueEx(VendorKey_v0500, _T("FunctionLibrary"), 0, &KeyType_v0500, (LPBYTE)KeyValue_v0500, &KeySize_v0500) == ERROR_SUCCESS)
-				strFunctionLibrary = KeyValue_v0500;
-
-			// Read HKLM/Software/WOW6432Node/PassThruSupport.05.00/VendorDevice[i]/ConfigApplication
-			KeySize_v0500 = lMaxValueLen + 1;
-			if (RegQueryValueEx(VendorKey_v0500, _T("ConfigApplication"), 0, &KeyType_v0500, (LPBYTE)KeyValue_v0500, &KeySize_v0500) == ERROR_SUCCESS)
-				strConfigApplication = KeyValue_v0500;
-
-			// Clsoe our key, clear the memory allocation for it.
-			RegCloseKey(VendorKey_v0500); delete KeyValue_v0500;
-
-			// If everything was successful then add it to the list
-			cPassThruInfo registryEntry(strVendor, strName, strFunctionLibrary, strConfigApplication);
-			registryList.insert(registryEntry);
+			DWORD nameLength = (DWORD)nameBuffer.size(), dataLength = maxDataLength, valueType;
+			LONG enumResult = RegEnumValue(hKey, valueIndex, &nameBuffer[0], &nameLength, NULL, &valueType, (LPBYTE)&dataBuffer[0], &dataLength);
+			if (enumResult != ERROR_SUCCESS) break;
+			if (valueType != REG_SZ && valueType != REG_EXPAND_SZ) continue;
+
+			// Stored strings don't always carry their terminator
+			size_t charCount = dataLength / sizeof(TCHAR);
+			while (charCount > 0 && dataBuffer[charCount - 1] == 0) charCount--;
+			keyValues[std::wstring(&nameBuffer[0], nameLength)] = std::wstring(&dataBuffer[0], charCount);
 		}
-	} while (hKey2RetVal_v0500 == ERROR_SUCCESS);
-	RegCloseKey(reg0500Key);
+
+		RegCloseKey(hKey);
+		return true;
+	}
+};
+
+// Saved next to the pipe spill files so it's somewhere every user can write
+static tstring fulcrum_catalogPath()
+{
+	TCHAR szTempPath[MAX_PATH];
+	DWORD pathLength = GetTempPath(MAX_PATH, szTempPath);
+	if (pathLength == 0 || pathLength >= MAX_PATH) return tstring();
+	return tstring(szTempPath) + _T("FulcrumShim") + _T(FULCRUM_CATALOG_EXTENSION);
 }
 
-double GetTimeSinceInit()
+// Find all J2534 v04.04 and v05.00 interfaces listed in the registry. The catalog is read from disk the first time
+// through, then only the vendor keys that changed since are read again. It's written back when anything changed
+static void EnumPassThruInterfaces(std::set<cPassThruInfo>& registryList)
 {
-	LARGE_INTEGER tock;
-    double time;
+	tstring catalogPath = fulcrum_catalogPath();
+	if (!fCatalogRead && !catalogPath.empty())
+	{
+		std::ifstream catalogStream(catalogPath.c_str(), std::ios::binary);
+		std::vector<uint8_t> catalogData((std::istreambuf_iterator<char>(catalogStream)), std::istreambuf_iterator<char>());
+		if (!catalogData.empty()) interfaceCatalog.Parse(&catalogData[0], catalogData.size());
+		fCatalogRead = true;
+	}
 
-	// ONCE -- the first time somebody gets a timestamp set the timer to 0.000s
-	CritSectionPerformanceCounter.Lock();
-	if (fPerformanceCounterInitialized) CritSectionPerformanceCounter.Unlock();
-	else
+	fulcrum_registry_windows registryProvider;
+	if (interfaceCatalog.Refresh(registryProvider) && !catalogPath.empty())
 	{
-		QueryPerformanceFrequency(&ticksPerSecond);
-		QueryPerformanceCounter(&tick);
-		fPerformanceCounterInitialized = true;
+		std::vector<uint8_t> catalogData;
+		interfaceCatalog.Serialize(catalogData);
+		std::ofstream catalogStream(catalogPath.c_str(), std::ios::binary | std::ios::trunc);
+		catalogStream.write((const char*)&catalogData[0], catalogData.size());
 	}
 
-	// Now find the time value.
-	QueryPerformanceCounter(&tock);
-	time = (double)(tock.QuadPart-tick.QuadPart)/(double)ticksPerSecond.QuadPart;
-	return time;
+	registryList.clear();
+	const std::map<std::wstring, fulcrum_catalog_entry>& catalogEntries = interfaceCatalog.Entries();
+	for (auto catalogEntry = catalogEntries.begin(); catalogEntry != catalogEntries.end(); ++catalogEntry)
+	{
+		const fulcrum_catalog_entry& interfaceEntry = catalogEntry->second;
+		registryList.insert(cPassThruInfo(interfaceEntry.Vendor, interfaceEntry.Name, interfaceEntry.FunctionLibrary, interfaceEntry.ConfigApplication));
+	}
 }
 
 bool fulcrum_checkAndAutoload(void)
 {
-	// Boot pipes if the need to be started up.
-	CFulcrumShim::StartupPipes();
+	// We're OK if a library is loaded. Every PassThru call comes through here, so this has to stay lock free
+	if (fulcrum_hasLibraryLoaded())
+		return true;
 
-	// We're OK if a library is loaded
-	if (fLibLoaded)
+	// Boot pipes if the need to be started up. After this the pipe retry thread keeps them going
+	CSingleLock autoloadLock(&CritSectionAutoload, TRUE);
+	if (fulcrum_hasLibraryLoaded())
 		return true;
+	CFulcrumShim::StartupPipes();
 
 	// Read the JSON Configuration file out of the FulcrumInjector Application
 #if _DEBUG
@@ -316,9 +223,8 @@ bool fulcrum_checkAndAutoload(void)
 		CString function_lib(tokens[2].c_str());
 
 		// Load the default library for our selected PassThru interface
-		bool fSuccess = fulcrum_loadLibrary(function_lib);
-		if (fSuccess) fLibLoaded = true;
-		else
+		bool fSuccess = fulcrum_loadLibrary(function_lib) != NULL;
+		if (!fSuccess)
 		{
 			// Log failed to load and show the failure
 			fulcrum_setInternalError(_T("Failed to open '%s'"), function_lib);
@@ -353,9 +259,8 @@ bool fulcrum_checkAndAutoload(void)
 			cPassThruInfo* tmp = Dlg.GetSelectedPassThru();
 
 			bool fSuccess;
-			fSuccess = fulcrum_loadLibrary(tmp->FunctionLibrary.c_str());
-			if (fSuccess) fLibLoaded = true;
-			else
+			fSuccess = fulcrum_loadLibrary(tmp->FunctionLibrary.c_str()) != NULL;
+			if (!fSuccess)
 			{
 				fulcrum_setInternalError(_T("Failed to open '%s'"), tmp->FunctionLibrary.c_str());
 				fulcrum_printretval(ERR_FAILED);
@@ -370,76 +275,108 @@ bool fulcrum_checkAndAutoload(void)
 	}
 }
 
-bool fulcrum_loadLibrary(LPCTSTR szDLL)
+// ---------------------------------------------------------------------------------------------------------------------------------
+
+fulcrum_library::fulcrum_library()
+	: PassThruOpen(NULL), PassThruClose(NULL), PassThruGetNextCarDAQ(NULL), PassThruReadDetails(NULL)
+	, PassThruConnect(NULL), PassThruDisconnect(NULL), PassThruReadMsgs(NULL), PassThruWriteMsgs(NULL)
+	, PassThruStartPeriodicMsg(NULL), PassThruStopPeriodicMsg(NULL), PassThruStartMsgFilter(NULL), PassThruStopMsgFilter(NULL)
+	, PassThruSetProgrammingVoltage(NULL), PassThruReadVersion(NULL), PassThruGetLastError(NULL), PassThruIoctl(NULL)
+	, m_hDLL(NULL)
 {
-	// Can't load a library if the string is NULL
-	if (szDLL == NULL) return false;
+}
+fulcrum_library::~fulcrum_library()
+{
+}
 
-	// Can't load a library if there's one currently loaded
-	if (fLibLoaded)	return false;
+// Only called while nothing can be running in the library. Never from DllMain
+void fulcrum_library::Unload()
+{
+	if (m_hDLL != NULL) FreeLibrary(m_hDLL);
+	m_hDLL = NULL;
+}
 
-	hDLL = LoadLibrary(szDLL);
-	if (hDLL == NULL)
+bool fulcrum_library::Load(LPCTSTR szDLL)
+{
+	m_hDLL = LoadLibrary(szDLL);
+	if (m_hDLL == NULL)
 	{
 		// Try to get the error text
 		// Set the internal error text based on the win32 message
 		return false;
 	}
 
-	// Set loaded to true. 
-	fLibLoaded = true;
-
 	// Find our method locations via pointers inside the other DLLs
-	_PassThruOpen = (PTOPEN)GetProcAddress(hDLL, "PassThruOpen");
-	_PassThruClose = (PTCLOSE)GetProcAddress(hDLL, "PassThruClose");
-	_PassThruGetNextCarDAQ = (PTGETNEXTCARDAQ)GetProcAddress(hDLL, "PassThruGetNextCarDAQ");
-	_PassThruReadDetails = (PTREADDETAILS)GetProcAddress(hDLL, "PassThruReadDetails");
-	_PassThruConnect = (PTCONNECT)GetProcAddress(hDLL, "PassThruConnect");
-	_PassThruDisconnect = (PTDISCONNECT)GetProcAddress(hDLL, "PassThruDisconnect");
-	_PassThruReadMsgs = (PTREADMSGS)GetProcAddress(hDLL, "PassThruReadMsgs");
-	_PassThruWriteMsgs = (PTWRITEMSGS)GetProcAddress(hDLL, "PassThruWriteMsgs");
-	_PassThruStartPeriodicMsg = (PTSTARTPERIODICMSG)GetProcAddress(hDLL, "PassThruStartPeriodicMsg");
-	_PassThruStopPeriodicMsg = (PTSTOPPERIODICMSG)GetProcAddress(hDLL, "PassThruStopPeriodicMsg");
-	_PassThruStartMsgFilter = (PTSTARTMSGFILTER)GetProcAddress(hDLL, "PassThruStartMsgFilter");
-	_PassThruStopMsgFilter = (PTSTOPMSGFILTER)GetProcAddress(hDLL, "PassThruStopMsgFilter");
-	_PassThruSetProgrammingVoltage = (PTSETPROGRAMMINGVOLTAGE)GetProcAddress(hDLL, "PassThruSetProgrammingVoltage");
-	_PassThruReadVersion = (PTREADVERSION)GetProcAddress(hDLL, "PassThruReadVersion");
-	_PassThruGetLastError = (PTGETLASTERROR)GetProcAddress(hDLL, "PassThruGetLastError");
-	_PassThruIoctl = (PTIOCTL)GetProcAddress(hDLL, "PassThruIoctl");
+	m_strPath = szDLL;
+	PassThruOpen = (PTOPEN)GetProcAddress(m_hDLL, "PassThruOpen");
+	PassThruClose = (PTCLOSE)GetProcAddress(m_hDLL, "PassThruClose");
+	PassThruGetNextCarDAQ = (PTGETNEXTCARDAQ)GetProcAddress(m_hDLL, "PassThruGetNextCarDAQ");
+	PassThruReadDetails = (PTREADDETAILS)GetProcAddress(m_hDLL, "PassThruReadDetails");
+	PassThruConnect = (PTCONNECT)GetProcAddress(m_hDLL, "PassThruConnect");
+	PassThruDisconnect = (PTDISCONNECT)GetProcAddress(m_hDLL, "PassThruDisconnect");
+	PassThruReadMsgs = (PTREADMSGS)GetProcAddress(m_hDLL, "PassThruReadMsgs");
+	PassThruWriteMsgs = (PTWRITEMSGS)GetProcAddress(m_hDLL, "PassThruWriteMsgs");
+	PassThruStartPeriodicMsg = (PTSTARTPERIODICMSG)GetProcAddress(m_hDLL, "PassThruStartPeriodicMsg");
+	PassThruStopPeriodicMsg = (PTSTOPPERIODICMSG)GetProcAddress(m_hDLL, "PassThruStopPeriodicMsg");
+	PassThruStartMsgFilter = (PTSTARTMSGFILTER)GetProcAddress(m_hDLL, "PassThruStartMsgFilter");
+	PassThruStopMsgFilter = (PTSTOPMSGFILTER)GetProcAddress(m_hDLL, "PassThruStopMsgFilter");
+	PassThruSetProgrammingVoltage = (PTSETPROGRAMMINGVOLTAGE)GetProcAddress(m_hDLL, "PassThruSetProgrammingVoltage");
+	PassThruReadVersion = (PTREADVERSION)GetProcAddress(m_hDLL, "PassThruReadVersion");
+	PassThruGetLastError = (PTGETLASTERROR)GetProcAddress(m_hDLL, "PassThruGetLastError");
+	PassThruIoctl = (PTIOCTL)GetProcAddress(m_hDLL, "PassThruIoctl");
 
 	// Return passed.
 	return true;
 }
 
+// ---------------------------------------------------------------------------------------------------------------------------------
+
+fulcrum_library* fulcrum_loadLibrary(LPCTSTR szDLL)
+{
+	// Can't load a library if the string is NULL
+	if (szDLL == NULL) return NULL;
+
+	std::unique_ptr<fulcrum_library> pLibrary(new fulcrum_library());
+	if (!pLibrary->Load(szDLL)) return NULL;
+
+	// Loading the same DLL again just makes it the default. Windows hands back the same module for it
+	std::lock_guard<std::mutex> listLock(libraryListLock);
+	for (auto& pLoaded : loadedLibraries)
+	{
+		if (pLoaded->Module() != pLibrary->Module()) continue;
+		pLibrary->Unload();
+		pDefaultLibrary = pLoaded.get();
+		return pLoaded.get();
+	}
+
+	fulcrum_DEBUG(_T("-->       Loaded library %d: %s\n"), (int)loadedLibraries.size() + 1, szDLL);
+	loadedLibraries.push_back(std::move(pLibrary));
+	pDefaultLibrary = loadedLibraries.back().get();
+	return loadedLibraries.back().get();
+}
+
 void fulcrum_unloadLibrary()
 {
 	// Can't unload a library if there's nothing loaded
-	if (!fLibLoaded) return;
-
-	// Set loaded to false
-	fLibLoaded = false;
-
-	// Invalidate the function pointers
-	_PassThruOpen = NULL;
-	_PassThruClose = NULL;
-	_PassThruGetNextCarDAQ = NULL;
-	_PassThruReadDetails = NULL;
-	_PassThruConnect = NULL;
-	_PassThruDisconnect = NULL;
-	_PassThruReadMsgs = NULL;
-	_PassThruWriteMsgs = NULL;
-	_PassThruStartPeriodicMsg = NULL;
-	_PassThruStopPeriodicMsg = NULL;
-	_PassThruStartMsgFilter = NULL;
-	_PassThruStopMsgFilter = NULL;
-	_PassThruSetProgrammingVoltage = NULL;
-	_PassThruReadVersion = NULL;
-	_PassThruGetLastError = NULL;
-	_PassThruIoctl = NULL;
-
-	// Set results out and free the lib.
-	BOOL fSuccess;
-	fSuccess = FreeLibrary(hDLL);
+	if (!fulcrum_hasLibraryLoaded()) return;
+
+	// Devices and channels routed to the libraries go with them before the libs are freed
+	fulcrum_clearRoutes();
+	std::lock_guard<std::mutex> listLock(libraryListLock);
+	pDefaultLibrary = NULL;
+	for (auto& pLoaded : loadedLibraries) pLoaded->Unload();
+	loadedLibraries.clear();
 }
 
-bool fulcrum_hasLibraryLoaded() { return fLibLoaded; }
\ No newline at end of file
+fulcrum_library* fulcrum_defaultLibrary() { return pDefaultLibrary; }
+bool fulcrum_hasLibraryLoaded() { return pDefaultLibrary != NULL; }
+
+void fulcrum_pinModule()
+{
+	static std::once_flag pinOnce;
+	std::call_once(pinOnce, []() {
+		HMODULE hShim = NULL;
+		if (!GetModuleHandleEx(GET_MODULE_HANDLE_EX_FLAG_FROM_ADDRESS | GET_MODULE_HANDLE_EX_FLAG_PIN, (LPCTSTR)&fulcrum_pinModule, &hShim))
+			fulcrum_DEBUG(_T("-->       Failed to pin the shim module (error %lu)\n"), GetLastError());
+	});
+}
\ No newline at end of file
@@ -52,33 +52,70 @@ public:
 	// Should also record the supported protocols
 };
 
+// Library lock. auto_lock is for loading and unloading the library and waits for every call
+// in progress. auto_shared_lock is held by everything else (see handle_lock in fulcrum_handles.h)
 class auto_lock
 {
 public:
     auto_lock();
     ~auto_lock();
 };
+class auto_shared_lock
+{
+public:
+    auto_shared_lock();
+    ~auto_shared_lock();
+};
+
+// One J2534 library and the PassThru functions it exports. Functions it doesn't export are NULL.
+// Several can be loaded at once, so two interfaces can be used side by side. Every device is
+// routed to the library that opened it (see fulcrum_route in fulcrum_handles.h)
+class fulcrum_library
+{
+public:
+	fulcrum_library();
+	~fulcrum_library();
+
+	// Unload() frees the DLL. The destructor leaves it loaded, since it can run at static teardown
+	bool Load(LPCTSTR szDLL);
+	void Unload();
+	HINSTANCE Module() const { return m_hDLL; }
+	const tstring& Path() const { return m_strPath; }
 
-double GetTimeSinceInit();
+	PTOPEN PassThruOpen;
+	PTCLOSE PassThruClose;
+	PTGETNEXTCARDAQ PassThruGetNextCarDAQ;
+	PTREADDETAILS PassThruReadDetails;
+	PTCONNECT PassThruConnect;
+	PTDISCONNECT PassThruDisconnect;
+	PTREADMSGS PassThruReadMsgs;
+	PTWRITEMSGS PassThruWriteMsgs;
+	PTSTARTPERIODICMSG PassThruStartPeriodicMsg;
+	PTSTOPPERIODICMSG PassThruStopPeriodicMsg;
+	PTSTARTMSGFILTER PassThruStartMsgFilter;
+	PTSTOPMSGFILTER PassThruStopMsgFilter;
+	PTSETPROGRAMMINGVOLTAGE PassThruSetProgrammingVoltage;
+	PTREADVERSION PassThruReadVersion;
+	PTGETLASTERROR PassThruGetLastError;
+	PTIOCTL PassThruIoctl;
+
+private:
+	fulcrum_library(const fulcrum_library&);
+	fulcrum_library& operator=(const fulcrum_library&);
+
+	HINSTANCE m_hDLL;
+	tstring m_strPath;
+};
 
 bool fulcrum_checkAndAutoload(void);
-bool fulcrum_loadLibrary(LPCTSTR szDLL);
-void fulcrum_unloadLibrary();
 bool fulcrum_hasLibraryLoaded();
 
-extern PTOPEN _PassThruOpen;
-extern PTCLOSE _PassThruClose;
-extern PTGETNEXTCARDAQ _PassThruGetNextCarDAQ;
-extern PTREADDETAILS _PassThruReadDetails;
-extern PTCONNECT _PassThruConnect;
-extern PTDISCONNECT _PassThruDisconnect;
-extern PTREADMSGS _PassThruReadMsgs;
-extern PTWRITEMSGS _PassThruWriteMsgs;
-extern PTSTARTPERIODICMSG _PassThruStartPeriodicMsg;
-extern PTSTOPPERIODICMSG _PassThruStopPeriodicMsg;
-extern PTSTARTMSGFILTER _PassThruStartMsgFilter;
-extern PTSTOPMSGFILTER _PassThruStopMsgFilter;
-extern PTSETPROGRAMMINGVOLTAGE _PassThruSetProgrammingVoltage;
-extern PTREADVERSION _PassThruReadVersion;
-extern PTGETLASTERROR _PassThruGetLastError;
-extern PTIOCTL _PassThruIoctl;
+// Loading a library while another is loaded adds it next to the first. The library loaded last is
+// the default one, which PassThruOpen() and calls without a handle go to. Unloading drops them all
+fulcrum_library* fulcrum_loadLibrary(LPCTSTR szDLL);
+void fulcrum_unloadLibrary();
+fulcrum_library* fulcrum_defaultLibrary();
+
+// Keeps the shim mapped until the process exits. Called before starting any thread that outlives the
+// PassThru call that started it, so an app that FreeLibrary()s the shim can't pull the code out from under them
+void fulcrum_pinModule();
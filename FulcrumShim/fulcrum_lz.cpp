@@ -0,0 +1,185 @@
+/*
+**
+** Copyright (C) 2022 MEAT Inc
+** Author: Zack Walsh <neo.smith@motorengineeringandtech.com>
+**
+** This library is free software; you can redistribute it and/or modify
+** it under the terms of the GNU Lesser General Public License as published
+** by the Free Software Foundation, either version 3 of the License, or (at
+** your option) any later version.
+**
+** This library is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+** Lesser General Public License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public
+** License along with this library; if not, <http://www.gnu.org/licenses/>.
+**
+*/
+
+
+// Standard Imports
+#include <stdint.h>
+#include <string.h>
+
+// Fulcrum Resource Imports
+#include "fulcrum_lz.h"
+
+// Match finder hash table size and the farthest back a match can reach
+#define FULCRUM_LZ_HASH_BITS 12
+#define FULCRUM_LZ_MAX_OFFSET 65535
+
+// Matches are at least 4 bytes. The last bytes of a block are always literals
+static const size_t MinMatch = 4;
+static const size_t LastLiterals = 5;
+static const size_t MatchSearchEnd = 12;
+
+// Unaligned 32 bit read
+static uint32_t fulcrumLZ_Read32(const unsigned char* pData)
+{
+	uint32_t nValue;
+	memcpy(&nValue, pData, sizeof(nValue));
+	return nValue;
+}
+
+// Hash of the 4 bytes at a position
+static uint32_t fulcrumLZ_Hash(uint32_t nSequence)
+{
+	return (nSequence * 2654435761U) >> (32 - FULCRUM_LZ_HASH_BITS);
+}
+
+// Writes a length that didn't fit in its token nibble
+static unsigned char* fulcrumLZ_WriteLength(unsigned char* pOutput, size_t nLength)
+{
+	for (; nLength >= 255; nLength -= 255) *pOutput++ = 255;
+	*pOutput++ = (unsigned char)nLength;
+	return pOutput;
+}
+
+// Reads a length that didn't fit in its token nibble
+static bool fulcrumLZ_ReadLength(const unsigned char*& pInput, const unsigned char* pInputEnd, size_t& nLength)
+{
+	unsigned char nByte;
+	do {
+		if (pInput >= pInputEnd) return false;
+		nByte = *pInput++;
+		nLength += nByte;
+	} while (nByte == 255);
+	return true;
+}
+
+// Writes one sequence. A match length of 0 means this is the last sequence and only has literals
+static unsigned char* fulcrumLZ_WriteSequence(unsigned char* pOutput, unsigned char* pOutputEnd,
+	const unsigned char* pLiterals, size_t nLiterals, size_t nOffset, size_t nMatch)
+{
+	// Worst case for this sequence so we only check the output space once
+	size_t nNeeded = 1 + nLiterals / 255 + 1 + nLiterals + 2 + nMatch / 255 + 1;
+	if ((size_t)(pOutputEnd - pOutput) < nNeeded) return NULL;
+
+	size_t nMatchCode = nMatch == 0 ? 0 : nMatch - MinMatch;
+	unsigned char* pToken = pOutput++;
+	*pToken = (unsigned char)(((nLiterals < 15 ? nLiterals : 15) << 4) | (nMatchCode < 15 ? nMatchCode : 15));
+	if (nLiterals >= 15) pOutput = fulcrumLZ_WriteLength(pOutput, nLiterals - 15);
+	if (nLiterals > 0) memcpy(pOutput, pLiterals, nLiterals);
+	pOutput += nLiterals;
+	if (nMatch == 0) return pOutput;
+
+	*pOutput++ = (unsigned char)(nOffset & 0xFF);
+	*pOutput++ = (unsigned char)(nOffset >> 8);
+	if (nMatchCode >= 15) pOutput = fulcrumLZ_WriteLength(pOutput, nMatchCode - 15);
+	return pOutput;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------------------
+
+size_t fulcrumLZ_Bound(size_t nBytes)
+{
+	return nBytes + nBytes / 255 + 16;
+}
+
+// Greedy single probe match finder. Plenty for the repetitive records a capture is made of
+size_t fulcrumLZ_Compress(const unsigned char* pInput, size_t nInput, unsigned char* pOutput, size_t nCapacity)
+{
+	uint32_t hashTable[1 << FULCRUM_LZ_HASH_BITS];
+	memset(hashTable, 0, sizeof(hashTable));
+
+	unsigned char* pWrite = pOutput;
+	unsigned char* pOutputEnd = pOutput + nCapacity;
+	size_t iAnchor = 0;
+	size_t iPosition = 0;
+
+	// Blocks too short to hold a match are written as one literal run
+	if (nInput > MatchSearchEnd)
+	{
+		size_t iSearchEnd = nInput - MatchSearchEnd;
+		size_t iMatchEnd = nInput - LastLiterals;
+		while (iPosition < iSearchEnd)
+		{
+			// Candidates come out of the hash table and are checked byte for byte, so stale entries are harmless
+			uint32_t nSequence = fulcrumLZ_Read32(pInput + iPosition);
+			uint32_t nHash = fulcrumLZ_Hash(nSequence);
+			size_t iCandidate = hashTable[nHash];
+			hashTable[nHash] = (uint32_t)iPosition;
+			if (iCandidate >= iPosition || iPosition - iCandidate > FULCRUM_LZ_MAX_OFFSET || fulcrumLZ_Read32(pInput + iCandidate) != nSequence) {
+				iPosition++;
+				continue;
+			}
+
+			// Run the match out as far as it goes
+			size_t nMatch = MinMatch;
+			while (iPosition + nMatch < iMatchEnd && pInput[iCandidate + nMatch] == pInput[iPosition + nMatch]) nMatch++;
+			pWrite = fulcrumLZ_WriteSequence(pWrite, pOutputEnd, pInput + iAnchor, iPosition - iAnchor, iPosition - iCandidate, nMatch);
+			if (pWrite == NULL) return 0;
+
+			// Seed the table from inside the match so the next repeat is found right away
+			iPosition += nMatch;
+			iAnchor = iPosition;
+			if (iPosition - 2 < iSearchEnd) hashTable[fulcrumLZ_Hash(fulcrumLZ_Read32(pInput + iPosition - 2))] = (uint32_t)(iPosition - 2);
+		}
+	}
+
+	// Whatever is left over goes out as literals
+	pWrite = fulcrumLZ_WriteSequence(pWrite, pOutputEnd, pInput + iAnchor, nInput - iAnchor, 0, 0);
+	if (pWrite == NULL) return 0;
+	return (size_t)(pWrite - pOutput);
+}
+
+// Every length and offset is checked against both buffers before it's used
+bool fulcrumLZ_Decompress(const unsigned char* pInput, size_t nInput, unsigned char* pOutput, size_t nOutput)
+{
+	const unsigned char* pInputEnd = pInput + nInput;
+	size_t iWrite = 0;
+
+	while (pInput < pInputEnd)
+	{
+		unsigned char nToken = *pInput++;
+
+		// Literal run
+		size_t nLiterals = nToken >> 4;
+		if (nLiterals == 15 && !fulcrumLZ_ReadLength(pInput, pInputEnd, nLiterals)) return false;
+		if (nLiterals > (size_t)(pInputEnd - pInput) || nLiterals > nOutput - iWrite) return false;
+		if (nLiterals > 0) memcpy(pOutput + iWrite, pInput, nLiterals);
+		pInput += nLiterals;
+		iWrite += nLiterals;
+
+		// The last sequence ends with its literals
+		if (pInput == pInputEnd) break;
+
+		// Match. Overlapping copies repeat the bytes just written so they go a byte at a time
+		if (pInputEnd - pInput < 2) return false;
+		size_t nOffset = pInput[0] | ((size_t)pInput[1] << 8);
+		pInput += 2;
+		size_t nMatch = nToken & 0x0F;
+		if (nMatch == 15 && !fulcrumLZ_ReadLength(pInput, pInputEnd, nMatch)) return false;
+		nMatch += MinMatch;
+		if (nOffset == 0 || nOffset > iWrite || nMatch > nOutput - iWrite) return false;
+
+		const unsigned char* pMatch = pOutput + iWrite - nOffset;
+		if (nOffset >= nMatch) memcpy(pOutput + iWrite, pMatch, nMatch);
+		else for (size_t byteIndex = 0; byteIndex < nMatch; byteIndex++) pOutput[iWrite + byteIndex] = pMatch[byteIndex];
+		iWrite += nMatch;
+	}
+
+	return iWrite == nOutput;
+}
\ No newline at end of file
@@ -0,0 +1,45 @@
+/*
+**
+** Copyright (C) 2022 MEAT Inc
+** Author: Zack Walsh <neo.smith@motorengineeringandtech.com>
+**
+** This library is free software; you can redistribute it and/or modify
+** it under the terms of the GNU Lesser General Public License as published
+** by the Free Software Foundation, either version 3 of the License, or (at
+** your option) any later version.
+**
+** This library is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+** Lesser General Public License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public
+** License along with this library; if not, <http://www.gnu.org/licenses/>.
+**
+*/
+
+
+#pragma once
+
+// Standard Imports
+#include <stddef.h>
+
+// Small LZ77 block compressor for capture output. Every block is compressed on its own with no
+// history carried between blocks, so a reader can pick any block out of a file and unpack it.
+// Like the capture reader this has no Windows dependencies so offline tools can build it in.
+//
+//   Block:    sequences back to back until the end of the input
+//   Sequence: token byte (high nibble literal count, low nibble match length - 4),
+//             extra literal count bytes, literals, then unless this is the last sequence
+//             a 16 bit little endian match offset and extra match length bytes
+//
+// A nibble of 15 means more length bytes follow. Each one adds its value and a byte below 255 ends the run
+
+// Most bytes fulcrumLZ_Compress() can write for an input of nBytes
+size_t fulcrumLZ_Bound(size_t nBytes);
+
+// Compresses a block. Returns the compressed size, or 0 when it won't fit in the output buffer
+size_t fulcrumLZ_Compress(const unsigned char* pInput, size_t nInput, unsigned char* pOutput, size_t nCapacity);
+
+// Unpacks a block. The output size must be exactly what was compressed. Damaged blocks return false
+bool fulcrumLZ_Decompress(const unsigned char* pInput, size_t nInput, unsigned char* pOutput, size_t nOutput);
\ No newline at end of file
@@ -22,34 +22,454 @@
 #include "stdafx.h"
 #include <tchar.h>
 #include <varargs.h>
+#include <atomic>
 #include <memory>
 #include <stdexcept>
+#include <string>
+#include <vector>
 
 // Fulcrum Resource Imports
 #include "FulcrumShim.h"
-#include "fulcrum_cfifo.h"
 #include "fulcrum_output.h"
+#include "fulcrum_staging.h"
+#include "fulcrum_recordring.h"
+#include "fulcrum_session.h"
+#include "fulcrum_shmring.h"
+#include "fulcrum_capture.h"
+#include "fulcrum_capture_format.h"
+#include "fulcrum_capture_render.h"
+#include "fulcrum_deferred.h"
+#include "config.h"
 
-// Public FIFO members. Used to trigger when to write to file or not.
-FILE* fp;
-fulcrum_cfifo logFifo;
-static bool fLogToFile = false;
-static bool fInitalized = false;
+// Session log and the backlog of lines logged before we had one. The backlog keeps the newest lines
+// when it fills up. Only the writer thread touches the session and the backlog cursor
+static fulcrum_session logSession;
+static fulcrum_recordring logBacklog(256 * 1024, RING_OVERWRITE_OLDEST);
+static fulcrum_ringcursor backlogCursor = { 0, 0, 0 };
+static const fulcrum_session_limits sessionLimits = { LOG_SEGMENT_MAX_BYTES, LOG_SEGMENT_MAX_SECONDS, LOG_RETAIN_SEGMENTS, LOG_RETAIN_BYTES };
+
+// Binary capture records are written into the session next to the text. Captures logged before
+// we have a session are held in memory (up to a limit) the same way the backlog holds text
+static std::vector<unsigned char> captureBacklog;
+static const size_t CaptureBacklogLimit = 16 * 1024 * 1024;
+static std::atomic<unsigned long long> nCapturesDropped(0);
+
+// Deferred log formats already written into the current capture target. Every capture file (and
+// every segment of a session) carries the definitions for the messages in it so it can be decoded on its own
+static std::vector<bool> formatsDefined;
+
+// Per-thread staging buffers holding records waiting to be written out by our writer thread
+static fulcrum_staging logStaging;
+
+// Shared memory ring for the Injector. Only the writer thread publishes into it
+static fulcrum_shmring logRing;
+
+// Lines for the Injector held while neither the pipe nor the ring is up. The oldest go first when it fills
+static fulcrum_recordring pipeBacklog(PIPE_BACKLOG_BYTES, RING_OVERWRITE_OLDEST);
+static fulcrum_ringcursor pipeBacklogCursor = { 0, 0, 0 };
+
+// Writer thread state and wakeup events
+static HANDLE hWriterThread = NULL;
+static HANDLE hWriterWake = NULL;
+static HANDLE hWriterDrained = NULL;
+static HANDLE hControlDone = NULL;
+static std::atomic<bool> fWriterStarted(false);
+static std::atomic<bool> fWriterSleeping(false);
+static std::atomic<bool> fWriterStopping(false);
+
+// Counters for the writer thread and log file control requests
+static std::atomic<unsigned long long> nRecordsWritten(0);
+static std::atomic<unsigned long long> nControlsRequested(0);
+static std::atomic<unsigned long long> nControlsDone(0);
+
+// How much of each capture gets rendered into text
+static std::atomic<int> nLogVerbosity(LOG_VERBOSITY_FULL);
+
+// ---------------------------------------------------------------------------------------------------------------------------------
+
+// Sends a UTF-8 line to whichever transport the Injector is using
+static void fulcrumSendToInjector(const std::string& pipeString, bool fRingConnected)
+{
+	if (fRingConnected) logRing.Publish(SHMRING_TEXT, pipeString.data(), pipeString.size());
+	else CFulcrumShim::fulcrumPiper->WriteStringOut(pipeString);
+}
+
+// Sends everything held while the Injector was away, oldest first
+static void fulcrumFlushPipeBacklog(bool fRingConnected)
+{
+	fulcrum_ringrecord heldRecord; std::string heldString;
+	unsigned long long nMissedBefore = pipeBacklogCursor.Missed;
+	while (pipeBacklog.Read(pipeBacklogCursor, heldRecord))
+	{
+		heldString.assign(heldRecord.Data.begin(), heldRecord.Data.end());
+		fulcrumSendToInjector(heldString, fRingConnected);
+	}
+	pipeBacklog.Trim(pipeBacklogCursor);
+
+	// Say so if the backlog had to throw lines away
+	if (pipeBacklogCursor.Missed == nMissedBefore) return;
+	char szWarning[128];
+	int nLength = _snprintf_s(szWarning, sizeof(szWarning), _TRUNCATE, "-->       WARNING: %llu lines were lost while the Injector was disconnected\n",
+		pipeBacklogCursor.Missed - nMissedBefore);
+	fulcrumSendToInjector(std::string(szWarning, nLength > 0 ? nLength : 0), fRingConnected);
+}
+
+// Writes a single line out to the log file (or the FIFO) and the output pipe
+static void fulcrumWriteText(LPCTSTR szText, size_t nLength, std::string& pipeString)
+{
+	// Store the line in our file if we have one. Otherwise keep it in memory until we do
+	if (logSession.IsOpen()) logSession.WriteText(szText, nLength);
+	else logBacklog.Put(LOGRECORD_TEXT, szText, (nLength + 1) * sizeof(TCHAR));
+
+	// Once the Injector attaches to the shared memory ring it takes lines from there instead of the pipe
+	bool fRingConnected = logRing.Connected();
+	bool fPipeConnected = CFulcrumShim::fulcrumPiper != NULL && CFulcrumShim::fulcrumPiper->OutputConnected;
+
+	// Convert the line into UTF-8 for the pipe reader
+#ifdef UNICODE
+	int nBytes = WideCharToMultiByte(CP_UTF8, 0, szText, (int)nLength, NULL, 0, NULL, NULL);
+	pipeString.resize(nBytes);
+	if (nBytes > 0) WideCharToMultiByte(CP_UTF8, 0, szText, (int)nLength, &pipeString[0], nBytes, NULL, NULL);
+#else
+	pipeString.assign(szText, nLength);
+#endif
+
+	// Nowhere to send it yet. Hold the line until the Injector shows up, then send the held lines first
+	if (!fRingConnected && !fPipeConnected) {
+		pipeBacklog.Put(0, pipeString.data(), pipeString.size());
+		return;
+	}
+	fulcrumFlushPipeBacklog(fRingConnected);
+	fulcrumSendToInjector(pipeString, fRingConnected);
+}
+
+// Render sink for capture records. Context is the pipe conversion buffer
+static void fulcrumWriteRenderedLine(LPCTSTR szLine, size_t nLength, void* pContext)
+{
+	fulcrumWriteText(szLine, nLength, *(std::string*)pContext);
+}
+
+// Stores a capture record in the capture file or in memory until we have one
+static bool fulcrumWriteCapture(const unsigned char* pRecord, size_t nLength)
+{
+	if (logSession.CaptureOpen()) {
+		uint32_t nSegmentIndex = logSession.SegmentIndex();
+		bool fWritten = logSession.WriteCapture(pRecord, nLength);
+		if (logSession.SegmentIndex() != nSegmentIndex) formatsDefined.clear();
+		return fWritten;
+	}
+	if (captureBacklog.size() + nLength > CaptureBacklogLimit) { nCapturesDropped.fetch_add(1, std::memory_order_relaxed); return false; }
+	captureBacklog.insert(captureBacklog.end(), pRecord, pRecord + nLength);
+	return true;
+}
+
+// Writes the format definition for a deferred log message the first time its ID shows up in the capture
+static void fulcrumDefineFormat(const unsigned char* pRecord, size_t nLength, std::vector<unsigned char>& defineBuffer)
+{
+	// Format ID sits right after the record and field headers
+	const size_t formatOffset = sizeof(fulcrum_capture_record_header) + sizeof(fulcrum_capture_field_header);
+	if (nLength < formatOffset + sizeof(uint32_t)) return;
+	uint32_t formatID; memcpy(&formatID, pRecord + formatOffset, sizeof(formatID));
+	if (formatID < formatsDefined.size() && formatsDefined[formatID]) return;
+	LPCTSTR szFormat = fulcrum_deferred::Lookup(formatID);
+	if (szFormat == NULL) return;
+
+	// Definition record. Same timestamp and thread as the message that needed it
+	size_t nFormatBytes = _tcslen(szFormat) * sizeof(TCHAR);
+	defineBuffer.resize(formatOffset + sizeof(formatID) + nFormatBytes);
+	fulcrum_capture_record_header recordHeader;
+	memcpy(&recordHeader, pRecord, sizeof(recordHeader));
+	recordHeader.Length = (uint32_t)defineBuffer.size();
+	recordHeader.Type = CAPTURE_FORMAT_DEFINE;
+	recordHeader.FieldCount = 1;
+	fulcrum_capture_field_header fieldHeader;
+	fieldHeader.Tag = FIELD_FORMAT_TEXT;
+	fieldHeader.Index = 0;
+	fieldHeader.Flags = 0;
+	fieldHeader.Length = (uint32_t)(sizeof(formatID) + nFormatBytes);
+	memcpy(&defineBuffer[0], &recordHeader, sizeof(recordHeader));
+	memcpy(&defineBuffer[sizeof(recordHeader)], &fieldHeader, sizeof(fieldHeader));
+	memcpy(&defineBuffer[formatOffset], &formatID, sizeof(formatID));
+	memcpy(&defineBuffer[formatOffset + sizeof(formatID)], szFormat, nFormatBytes);
+
+	// Only remember it once it actually made it into the capture
+	if (!fulcrumWriteCapture(&defineBuffer[0], defineBuffer.size())) return;
+	if (formatID >= formatsDefined.size()) formatsDefined.resize(formatID + 1, false);
+	formatsDefined[formatID] = true;
+}
+
+// Writes every backlog line we haven't written yet into a file and frees them.
+// Lines the backlog had to throw away are called out where they went missing
+static void fulcrumWriteBacklog(FILE* fpTarget)
+{
+	fulcrum_ringrecord backlogRecord;
+	unsigned long long nMissed = backlogCursor.Missed;
+	while (logBacklog.Read(backlogCursor, backlogRecord))
+	{
+		if (backlogCursor.Missed != nMissed) {
+			_ftprintf(fpTarget, _T("-->       WARNING: Log backlog was full! Dropped %llu lines here\n"), backlogCursor.Missed - nMissed);
+			nMissed = backlogCursor.Missed;
+		}
+		_fputts((LPCTSTR)&backlogRecord.Data[0], fpTarget);
+	}
+	logBacklog.Trim(backlogCursor);
+}
+
+// Capture file name matching a log file name (same name, .shimBin extension)
+static CString fulcrumCapturePath(LPCTSTR szLogFilename)
+{
+	CString strCapturePath(szLogFilename);
+	int iExtension = strCapturePath.ReverseFind(_T('.'));
+	int iDirectory = strCapturePath.ReverseFind(_T('\\'));
+	if (iExtension > iDirectory) strCapturePath = strCapturePath.Left(iExtension);
+	strCapturePath += _T(FULCRUM_CAPTURE_EXTENSION);
+	return strCapturePath;
+}
+
+// Starts the rolling session for a new log file and moves anything logged before it into the first segment
+static bool fulcrumOpenSession(LPCTSTR szLogFilename)
+{
+	if (!logSession.Open(szLogFilename, sessionLimits, CAPTURE_COMPRESSION ? CAPTURE_BLOCK_SIZE : 0)) return false;
+	fulcrumWriteBacklog(logSession.LogFile());
+	for (size_t readOffset = 0; readOffset + sizeof(fulcrum_capture_record_header) <= captureBacklog.size(); )
+	{
+		uint32_t nRecordLength = ((const fulcrum_capture_record_header*)&captureBacklog[readOffset])->Length;
+		if (nRecordLength < sizeof(fulcrum_capture_record_header) || readOffset + nRecordLength > captureBacklog.size()) break;
+		logSession.WriteCapture(&captureBacklog[readOffset], nRecordLength);
+		readOffset += nRecordLength;
+	}
+
+	captureBacklog.clear();
+	return true;
+}
+
+// Writes a flat capture file holding whatever is in the backlog. Used when saving without a live log
+static void fulcrumSaveCaptureFile(LPCTSTR szLogFilename)
+{
+	FILE* fpOpened = NULL;
+	_tfopen_s(&fpOpened, fulcrumCapturePath(szLogFilename), _T("wb"));
+	if (fpOpened == NULL) return;
+
+	fulcrum_capture_file_header fileHeader;
+	memcpy(fileHeader.Magic, FULCRUM_CAPTURE_MAGIC, FULCRUM_CAPTURE_MAGIC_SIZE);
+	fileHeader.Version = FULCRUM_CAPTURE_VERSION;
+	fileHeader.HeaderSize = sizeof(fileHeader);
+	fileHeader.Flags = 0;
+	fileHeader.TimestampUnits = FULCRUM_CAPTURE_TIMESTAMP_UNITS;
+	fwrite(&fileHeader, sizeof(fileHeader), 1, fpOpened);
+
+	if (!captureBacklog.empty()) fwrite(&captureBacklog[0], 1, captureBacklog.size(), fpOpened);
+	fclose(fpOpened);
+}
+
+// Runs a log file request. Records staged before this one have already been written out
+static void fulcrumRunControl(const fulcrum_stagedrecord* pRecord)
+{
+	if (pRecord->Kind == LOGRECORD_OPEN_FILE)
+	{
+		// Close out any old session, start the new one, and dump anything buffered in memory into it
+		logSession.Close(); formatsDefined.clear();
+		fulcrumOpenSession(pRecord->Text());
+	}
+	else
+	{
+		// Write the memory-buffers to files and close them. Don't touch the current log files
+		FILE* fpSave = NULL;
+		_tfopen_s(&fpSave, pRecord->Text(), _T("w, ccs=UTF-8"));
+		if (fpSave == NULL) return;
+		fulcrumWriteBacklog(fpSave); fclose(fpSave);
+
+		fulcrumSaveCaptureFile(pRecord->Text());
+	}
+}
+
+// Collects what every thread has staged and writes it out in sequence order. Only one thread may drain at a time.
+// The last drain takes everything, even records that were still being staged on other threads as we collected
+static void fulcrumDrainStaged(std::string& pipeString, std::vector<unsigned char>& defineBuffer, bool fFinalDrain)
+{
+	// Pull records out until we reach one that may still have records in front of it
+	bool fWroteRecords = false;
+	fulcrum_stagedrecord stagedRecord;
+	const fulcrum_stagedrecord* pRecord = &stagedRecord;
+	logStaging.Collect(fFinalDrain);
+	while (logStaging.Next(stagedRecord))
+	{
+		// Move on to a new session segment before a record that would put this one past its limits
+		if (pRecord->Kind == LOGRECORD_TEXT || pRecord->Kind == LOGRECORD_CAPTURE) {
+			if (logSession.RollIfNeeded(pRecord->Kind == LOGRECORD_CAPTURE ? pRecord->Length : 0)) formatsDefined.clear();
+		}
+
+		// Write text lines out, and run control records in order with the text around them
+		if (pRecord->Kind == LOGRECORD_TEXT) {
+			fulcrumWriteText(pRecord->Text(), pRecord->TextLength(), pipeString);
+			nRecordsWritten.fetch_add(1, std::memory_order_relaxed);
+			fWroteRecords = true;
+		}
+
+		// Captures are stored as they are and rendered into text for the log file and pipe
+		// Deferred log messages need their format defined in the capture before the first use
+		else if (pRecord->Kind == LOGRECORD_CAPTURE) {
+			if (((const fulcrum_capture_record_header*)pRecord->Data())->Type == CAPTURE_LOG_MESSAGE)
+				fulcrumDefineFormat(pRecord->Data(), pRecord->Length, defineBuffer);
+			fulcrumWriteCapture(pRecord->Data(), pRecord->Length);
+			if (logRing.Connected()) logRing.Publish(SHMRING_CAPTURE, pRecord->Data(), pRecord->Length);
+			int nVerbosity = nLogVerbosity.load(std::memory_order_relaxed);
+			bool fShimMessage = ((const fulcrum_capture_record_header*)pRecord->Data())->Type == CAPTURE_LOG_MESSAGE;
+			if (nVerbosity != LOG_VERBOSITY_QUIET || fShimMessage)
+				fulcrum_capture_render::RenderRecord(pRecord->Data(), pRecord->Length, fulcrumWriteRenderedLine, &pipeString, NULL, nVerbosity == LOG_VERBOSITY_FULL);
+			nRecordsWritten.fetch_add(1, std::memory_order_relaxed);
+			fWroteRecords = true;
+		}
+		else {
+			fulcrumRunControl(pRecord);
+			nControlsDone.fetch_add(1, std::memory_order_release);
+			if (hControlDone != NULL) SetEvent(hControlDone);
+		}
+	}
+
+	// Push the batch out to disk once instead of once per line, and wake the Injector once for it
+	// A compressed block that's only partly full still goes out once it's been waiting a while
+	if (fWroteRecords || logSession.HasPendingBlock()) logSession.Flush();
+	logRing.Ring();
+}
+
+// Main routine for the log writer thread
+static DWORD WINAPI fulcrumWriterThread(LPVOID lpParameter)
+{
+	// Conversion buffers reused for every line we send to the pipe and every format we define
+	std::string pipeString;
+	std::vector<unsigned char> defineBuffer;
+	unsigned long long nLastDropped = 0, nLastRingDropped = 0;
+
+	// Put the shared memory ring up for the Injector. We stay on the pipe if this fails
+#if SHARED_MEMORY_TRANSPORT
+	logRing.Create(SHARED_MEMORY_RING_SIZE);
+#endif
+
+	for (;;)
+	{
+		// Poll runs left open by an app that stopped calling go out once they're too old. They're staged
+		// from here, so they go out with the drain right after
+		fulcrum_capture::FlushStalePolls(fulcrum_capture::Timestamp());
+
+		// Write out everything that's staged right now
+		fulcrumDrainStaged(pipeString, defineBuffer, false);
+
+		// If we had to throw away records since the last pass, say so in the log
+		unsigned long long nDropped = logStaging.Dropped();
+		if (nDropped != nLastDropped)
+		{
+			TCHAR szWarning[128];
+			int nLength = _stprintf_s(szWarning, _countof(szWarning),
+				_T("-->       WARNING: Log staging buffer was full! Dropped %llu records so far\n"), nDropped);
+			fulcrumWriteText(szWarning, nLength, pipeString);
+			nLastDropped = nDropped;
+		}
+		if (logRing.Dropped() != nLastRingDropped)
+		{
+			TCHAR szWarning[128];
+			int nLength = _stprintf_s(szWarning, _countof(szWarning),
+				_T("-->       WARNING: Injector shared memory ring was full! Dropped %llu entries so far\n"), logRing.Dropped());
+			// Counted after the warning in case the warning itself didn't fit either
+			fulcrumWriteText(szWarning, nLength, pipeString);
+			nLastRingDropped = logRing.Dropped();
+		}
+
+		// Stop once we've been asked to, after one last pass that takes everything left
+		if (fWriterStopping.load(std::memory_order_acquire)) {
+			fulcrumDrainStaged(pipeString, defineBuffer, true);
+			break;
+		}
+
+		// Sleep until a producer wakes us up. The timeout covers any wakeup we missed
+		fWriterSleeping.store(true, std::memory_order_seq_cst);
+		if (!logStaging.HasNew()) WaitForSingleObject(hWriterWake, 50);
+		fWriterSleeping.store(false, std::memory_order_relaxed);
+	}
+
+	// Flush our files and tell whoever stopped us that we're done
+	logSession.Flush();
+	SetEvent(hWriterDrained);
+	return 0;
+}
+
+// Stages a record on this thread and wakes the writer thread if it's asleep
+static bool fulcrumQueueRecord(fulcrum_logrecord_kind recordKind, const void* pData, size_t nBytes)
+{
+	// Boot the writer thread the first time anyone logs anything
+	if (!fWriterStarted.load(std::memory_order_acquire)) fulcrum_output::StartWriterThread();
+	if (!logStaging.Stage(recordKind, pData, nBytes)) return false;
+
+	// Only pay for the wakeup when the writer is actually waiting on it
+	if (fWriterSleeping.load(std::memory_order_relaxed) && fWriterSleeping.exchange(false))
+		SetEvent(hWriterWake);
+
+	return true;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------------------
+
+// Writer thread setup and teardown
+void fulcrum_output::StartWriterThread()
+{
+	// Only the first caller gets to build the thread
+	bool fExpected = false;
+	if (!fWriterStarted.compare_exchange_strong(fExpected, true)) return;
+
+	// Build our events and then boot the thread
+	hWriterWake = CreateEvent(NULL, FALSE, FALSE, NULL);
+	hWriterDrained = CreateEvent(NULL, TRUE, FALSE, NULL);
+	hControlDone = CreateEvent(NULL, FALSE, FALSE, NULL);
+	hWriterThread = CreateThread(NULL, 0, fulcrumWriterThread, NULL, 0, NULL);
+}
+void fulcrum_output::StopWriterThread(DWORD dwWaitMilliseconds)
+{
+	// Nothing to stop if we never booted the thread
+	if (!fWriterStarted.load(std::memory_order_acquire) || hWriterThread == NULL) return;
+
+	// Ask the writer to finish up and wait for it to drain the queue
+	fWriterStopping.store(true, std::memory_order_release);
+	SetEvent(hWriterWake);
+	HANDLE hWaitHandles[2] = { hWriterDrained, hWriterThread };
+	DWORD dwWaitResult = WaitForMultipleObjects(2, hWaitHandles, FALSE, dwWaitMilliseconds);
+
+	// When the process is exiting our thread may already be gone. Write out what's left ourselves
+	if (dwWaitResult == WAIT_OBJECT_0 + 1) {
+		std::string pipeString;
+		std::vector<unsigned char> defineBuffer;
+		fulcrumDrainStaged(pipeString, defineBuffer, true);
+	}
+
+	// The session only gets finished (last block written, footer index written, capture trimmed, manifest
+	// closed out) once nobody else can be writing to it. A writer that's still busy flushes its own files
+	if (dwWaitResult != WAIT_TIMEOUT) logSession.Shutdown(dwWaitMilliseconds);
+}
+
+// Rendering verbosity
+void fulcrum_output::SetVerbosity(fulcrum_log_verbosity logVerbosity) { nLogVerbosity.store(logVerbosity, std::memory_order_relaxed); }
+fulcrum_log_verbosity fulcrum_output::Verbosity() { return (fulcrum_log_verbosity)nLogVerbosity.load(std::memory_order_relaxed); }
+
+// Log counters
+unsigned long long fulcrum_output::RecordsWritten() { return nRecordsWritten.load(std::memory_order_relaxed); }
+unsigned long long fulcrum_output::RecordsDropped() { return logStaging.Dropped(); }
+unsigned long long fulcrum_output::CapturesDropped() { return nCapturesDropped.load(std::memory_order_relaxed); }
+
+// ---------------------------------------------------------------------------------------------------------------------------------
 
 // Logging Methods Appends are for single targets
 void fulcrum_output::writeNewLogFile(LPCTSTR szFilename, bool in_fLogToFile)
 {
-	// Write the memory-buffer to a file. Then either close the file, or keep the file open
-	// and set a flag that redirects all future log messages directly to the file
-	if (in_fLogToFile) {
-		// Open the file object here and get the handle from it
-		_tfopen_s(&fp, szFilename, _T("w, ccs=UTF-8"));
-		logFifo.Get(fp); fLogToFile = true;
-	}
-	else {
-		// Open the file object handle here and close the stream to it.
-		_tfopen_s(&fp, szFilename, _T("w, ccs=UTF-8"));
-		logFifo.Get(fp); fclose(fp);
+	// Queue the file request behind all the records already logged. Then either the writer
+	// keeps the file open and sends all future log messages to it, or it dumps the memory-buffer and closes it
+	fulcrum_logrecord_kind recordKind = in_fLogToFile ? LOGRECORD_OPEN_FILE : LOGRECORD_SAVE_FILE;
+	unsigned long long nTicket = nControlsRequested.fetch_add(1) + 1;
+	while (!fulcrumQueueRecord(recordKind, szFilename, _tcslen(szFilename) * sizeof(TCHAR))) Sleep(1);
+
+	// Wait for the writer to get to our request so callers see the file once we return
+	for (int nWaitCount = 0; nWaitCount < 500; nWaitCount++) {
+		if (nControlsDone.load(std::memory_order_acquire) >= nTicket) return;
+		if (hControlDone == NULL) Sleep(10);
+		else WaitForSingleObject(hControlDone, 10);
 	}
 }
 void fulcrum_output::fulcrumDebug(LPCTSTR format_string, ...)
@@ -58,20 +478,9 @@ void fulcrum_output::fulcrumDebug(LPCTSTR format_string, ...)
 	TCHAR bufferOutputArray[10240];							// Char array for output string. (This value may need work)
 	va_list str_args; va_start(str_args, format_string);	// Args formating for log output. List of args and setup command
 
-	// If logging directly to file write it out here.
-	if (!fLogToFile) logFifo.Put(bufferOutputArray);
-	else _vftprintf_s(fp, format_string, str_args); 
-
-	// Write Directly to our log file. If the pipe is closed, return
-	if (CFulcrumShim::fulcrumPiper == NULL) CFulcrumShim::StartupPipes();
-	if (!CFulcrumShim::fulcrumPiper->OutputConnected) {
-		va_end(str_args);
-		return;
-	}
-
-	// Now build our output string and write it to our pipe
+	// Now build our output string
 	size_t bufferSize = sizeof(bufferOutputArray) / sizeof(bufferOutputArray[0]);
-	_vsntprintf_s(
+	int outputLength = _vsntprintf_s(
 		bufferOutputArray,	// Output Array
 		bufferSize,			// Size to add in
 		_TRUNCATE,			// Truncate Mode.
@@ -79,11 +488,15 @@ void fulcrum_output::fulcrumDebug(LPCTSTR format_string, ...)
 		str_args			// Args being formatted.
 	);
 
-	// Send to pipe server only if our pipe instances are currently open and connected
-	std::wstring charString(bufferOutputArray);
-	std::string outputString(charString.begin(), charString.end());
-	CFulcrumShim::fulcrumPiper->WriteStringOut(outputString);
-
-	// End our argument formatting.
+	// End our argument formatting. Truncated lines report -1 so find the length ourselves
 	va_end(str_args);
+	if (outputLength < 0) outputLength = (int)_tcslen(bufferOutputArray);
+
+	// Hand the line off to the writer thread. It goes to the file and pipe from there
+	fulcrumQueueRecord(LOGRECORD_TEXT, bufferOutputArray, outputLength * sizeof(TCHAR));
+}
+void fulcrum_output::fulcrumCapture(const void* pRecord, size_t nBytes)
+{
+	// Binary records skip formatting entirely. The writer thread renders them
+	fulcrumQueueRecord(LOGRECORD_CAPTURE, pRecord, nBytes);
 }
\ No newline at end of file
@@ -23,9 +23,30 @@
 // Standard Imports
 #include <tchar.h>
 
+// How much of each captured call is rendered into the text log and the pipe. The capture file always gets everything
+enum fulcrum_log_verbosity {
+	LOG_VERBOSITY_QUIET = 0,	// Only lines the shim logs itself. Calls are left in the capture file
+	LOG_VERBOSITY_CALLS = 1,	// Calls and their results without the message data
+	LOG_VERBOSITY_FULL = 2,		// Everything. This is the default
+};
+
 class fulcrum_output {
 public:
 	// Writes for our output target types
 	static void fulcrumDebug(LPCTSTR format_string, ...);
 	static void writeNewLogFile(LPCTSTR szFilename, bool in_fLogToFile);
+	static void fulcrumCapture(const void* pRecord, size_t nBytes);
+
+	// Background writer thread controls. Log calls only queue records, this thread writes them out
+	static void StartWriterThread();
+	static void StopWriterThread(DWORD dwWaitMilliseconds);
+
+	// Verbosity can be changed from any thread. It applies from the next record the writer renders
+	static void SetVerbosity(fulcrum_log_verbosity logVerbosity);
+	static fulcrum_log_verbosity Verbosity();
+
+	// Counters for the log pipeline
+	static unsigned long long RecordsWritten();
+	static unsigned long long RecordsDropped();
+	static unsigned long long CapturesDropped();
 };
\ No newline at end of file
@@ -28,6 +28,12 @@
 #include "fulcrum_pipe.h"
 #include "fulcrum_debug.h"
 #include "fulcrum_output.h"
+#include "fulcrum_deferred.h"
+#include "fulcrum_bitconverter.h"
+#include "fulcrum_frame.h"
+#include "fulcrum_pipetransport.h"
+#include "fulcrum_loader.h"
+#include "config.h"
 
 // CTOR and DCTOR for pipe objects
 fulcrum_pipe::fulcrum_pipe() { }
@@ -38,6 +44,15 @@ bool fulcrum_pipe::PipesConnected() {
 	return OutputConnected == true || InputConnected == true;
 }
 
+// Socket files live in the temp folder under the same names as the pipes
+static std::string fulcrumSocketPath(const char* szSocketName)
+{
+	char szTempPath[MAX_PATH];
+	DWORD dwLength = GetTempPathA(_countof(szTempPath), szTempPath);
+	if (dwLength == 0 || dwLength >= _countof(szTempPath)) return std::string(szSocketName);
+	return std::string(szTempPath) + szSocketName;
+}
+
 // Connection methods and closing methods for our pipe objects
 bool fulcrum_pipe::ConnectOutputPipe()
 {
@@ -45,70 +60,89 @@ bool fulcrum_pipe::ConnectOutputPipe()
 	if (_pipesConnected || OutputConnected)
 	{
 		// Log information, store state of pipes, and return it.
-		fulcrum_output::fulcrumDebug(_T("-->       Fulcrum Pipe 1 (Output Pipe) was already open!\n"));
+		fulcrum_DEBUG(_T("-->       Fulcrum Pipe 1 (Output Pipe) was already open!\n"));
 		_pipesConnected = InputConnected;
 
 		// Check if loaded now
-		if (_pipesConnected) fulcrum_output::fulcrumDebug(_T("-->       Both Fulcrum Pipes are already open!\n"));
+		if (_pipesConnected) fulcrum_DEBUG(_T("-->       Both Fulcrum Pipes are already open!\n"));
 		return true;
 	}
-	
-	// Configure new pipe name object output
-	LPTSTR OutputPipeLocation = TEXT("\\\\.\\pipe\\2CC3F0FB08354929BB453151BBAA5A15");
-	hFulcrumWriter = CreateNamedPipe(
-		OutputPipeLocation,					// Name of the pipe
-		PIPE_ACCESS_OUTBOUND,				// Pipe direction (In and Out)
-		PIPE_TYPE_MESSAGE | PIPE_WAIT,		// Pipe types for sending output
-		100,							    // Number of instances (Set to 100 since we need to be aware of open and closes)
-		1024 * 16,							// Output buffer size
-		1024 * 16,							// Input buffer size
-		NMPWAIT_USE_DEFAULT_WAIT,			// Timeout Time value
-		NULL								// Default security wait
-	);
+
+	// Build the output end for whichever transport we're set up to use
+	fulcrum_transport* pTransport = NULL;
+	if (PIPE_TRANSPORT == PIPE_TRANSPORT_UNIX_SOCKET) pTransport = fulcrumTransport_CreateSocketServer(fulcrumSocketPath(PIPE_SOCKET_OUTPUT_NAME).c_str());
+	else pTransport = fulcrumTransport_CreatePipeServer(FULCRUM_OUTPUT_PIPE_NAME);
 
 	// Check if the pipe was built or not.
-	if ((hFulcrumWriter == NULL || hFulcrumWriter == INVALID_HANDLE_VALUE))
+	if (pTransport == NULL)
+	{
+		fulcrum_DEBUG(_T("-->       ERROR: Fulcrum Pipe 1 (Output Pipe) could not be opened!\n"));
+		fulcrum_DEBUG(_T("-->       \\__ Pipe handle was invalid! (error %d)\n"), GetLastError());
+		return false;
+	}
+	return AttachOutputTransport(pTransport);
+}
+bool fulcrum_pipe::AttachOutputTransport(fulcrum_transport* pTransport)
+{
+	if (OutputConnected) ShutdownOutputPipe();
+	_outputTransport.reset(pTransport);
+
+	// Boot the thread which does the actual writing for us
+#if PIPE_FANOUT
+	if (!_pipeHub.Start(_outputTransport.get(), PIPE_QUEUE_BYTES, PIPE_FANOUT_SUBSCRIBERS, PIPE_FANOUT_DROP_SLOW != 0))
+#else
+	if (!_pipeWriter.Start(_outputTransport.get(), PIPE_QUEUE_BYTES, PIPE_QUEUE_POLICY, PIPE_SPILL_LIMIT))
+#endif
 	{
-		fulcrum_output::fulcrumDebug(_T("-->       ERROR: Fulcrum Pipe 1 (Output Pipe) could not be opened!\n"));
-		if (hFulcrumWriter == NULL) { fulcrum_output::fulcrumDebug(_T("-->           \\__ Pipe was NULL! (error % d)\n"), GetLastError()); }
-		else {fulcrum_output::fulcrumDebug(_T("-->       \\__ Pipe handle was invalid!(error % d)\n"), GetLastError()); }
+		fulcrum_DEBUG(_T("-->       ERROR: Fulcrum Pipe 1 (Output Pipe) writer thread could not be started!\n"));
+		_outputTransport.reset();
 		return false;
 	}
 
 	// Log information and return output
-	fulcrum_output::fulcrumDebug(_T("-->       Fulcrum Pipe 1 (Output Pipe) has been opened OK!\n"));
+	fulcrum_DEBUG(_T("-->       Fulcrum Pipe 1 (Output Pipe) has been opened OK!\n"));
 	OutputConnected = true;
 	return true;
 }
 bool fulcrum_pipe::ConnectInputPipe()
 {
+	// The reader already quit on a pipe the Injector closed. Clear it out so we open a fresh one
+	if (_inputDropped.load(std::memory_order_acquire)) ShutdownInputPipe();
+
 	// Check if this pipe is loaded or not
 	if (_pipesConnected || InputConnected)
 	{
 		// Log information, store state of pipes, and return it.
-		fulcrum_output::fulcrumDebug(_T("-->       Fulcrum Pipe 2 (Input Pipe) was already open!\n"));
+		fulcrum_DEBUG(_T("-->       Fulcrum Pipe 2 (Input Pipe) was already open!\n"));
 		_pipesConnected = OutputConnected;
 
 		// Check if loaded now
-		if (_pipesConnected) fulcrum_output::fulcrumDebug(_T("-->       Both Fulcrum Pipes are already open!\n"));
+		if (_pipesConnected) fulcrum_DEBUG(_T("-->       Both Fulcrum Pipes are already open!\n"));
 		return true;
 	}
 
-	// Configure new pipe name object output
-	LPTSTR InputPipeLocation = TEXT("\\\\.\\pipe\\1D16333944F74A928A932417074DD2B3");
-	hFulcrumReader = CreateFile(InputPipeLocation, GENERIC_READ, 0, NULL, CREATE_ALWAYS, 0, NULL);
+	// Open the input end for whichever transport we're set up to use
+	fulcrum_transport* pTransport = NULL;
+	if (PIPE_TRANSPORT == PIPE_TRANSPORT_UNIX_SOCKET) pTransport = fulcrumTransport_CreateSocketClient(fulcrumSocketPath(PIPE_SOCKET_INPUT_NAME).c_str());
+	else pTransport = fulcrumTransport_CreatePipeClient(FULCRUM_INPUT_PIPE_NAME);
 
 	// Check if the pipe was built or not.
-	if ((hFulcrumReader == NULL || hFulcrumReader == INVALID_HANDLE_VALUE))
+	if (pTransport == NULL)
 	{
-		fulcrum_output::fulcrumDebug(_T("-->       ERROR: Fulcrum Pipe 2 (Input Pipe) could not be opened!\n"));
-		if (hFulcrumReader == NULL) { fulcrum_output::fulcrumDebug(_T("-->       \\__ Pipe was NULL! (error % d)\n"), GetLastError()); }
-		else { fulcrum_output::fulcrumDebug(_T("-->       \\__ Pipe handle was invalid! (error %d)\n"), GetLastError()); }
+		fulcrum_DEBUG(_T("-->       ERROR: Fulcrum Pipe 2 (Input Pipe) could not be opened!\n"));
+		fulcrum_DEBUG(_T("-->       \\__ Pipe handle was invalid! (error %d)\n"), GetLastError());
 		return false;
 	}
+	return AttachInputTransport(pTransport);
+}
+bool fulcrum_pipe::AttachInputTransport(fulcrum_transport* pTransport)
+{
+	if (InputConnected) ShutdownInputPipe();
+	_inputTransport.reset(pTransport);
+	_readOffset = _readLength = 0;
 
 	// Log information and return output then close our handle output
-	fulcrum_output::fulcrumDebug(_T("-->       Fulcrum Pipe 2 (Input Pipe) has been opened OK!\n"));
+	fulcrum_DEBUG(_T("-->       Fulcrum Pipe 2 (Input Pipe) has been opened OK!\n"));
 	InputConnected = true;
 	return true;
 }
@@ -119,79 +153,219 @@ void fulcrum_pipe::ShutdownPipes()
 	// Close out both pipes here
 	fulcrum_pipe::ShutdownInputPipe();
 	fulcrum_pipe::ShutdownOutputPipe();
-	fulcrum_output::fulcrumDebug(_T("-->       Closed output pipe for FulcrumShim Server correctly!\n"));
+	fulcrum_DEBUG(_T("-->       Closed output pipe for FulcrumShim Server correctly!\n"));
 }
 void fulcrum_pipe::ShutdownOutputPipe()
 {
 	// Check if already closed or not
-	if (hFulcrumWriter == NULL) {
-		fulcrum_output::fulcrumDebug(_T("-->       Fulcrum Pipe 1 (Output Pipe) was already closed!\n"));
+	if (!_outputTransport) {
+		fulcrum_DEBUG(_T("-->       Fulcrum Pipe 1 (Output Pipe) was already closed!\n"));
 		OutputConnected = false; _pipesConnected = false;
 		return;
 	}
 
-	// Close it out now
-	CloseHandle(hFulcrumWriter); hFulcrumWriter = nullptr;
-	fulcrum_output::fulcrumDebug(_T("-->       Fulcrum Pipe 1 (Output Pipe) has been closed! Pipe handle is now NULL!\n"));
+	// Give the writer a moment to send what's queued, then close it out now
+	_pipeWriter.Stop(500);
+	_pipeHub.Stop(500);
+	_outputTransport.reset();
+	fulcrum_DEBUG(_T("-->       Fulcrum Pipe 1 (Output Pipe) has been closed! Pipe handle is now NULL!\n"));
 	OutputConnected = false; _pipesConnected = false;
 }
 void fulcrum_pipe::ShutdownInputPipe()
 {
 	// Check if already closed or not
-	if (hFulcrumReader == NULL) {
-		fulcrum_output::fulcrumDebug(_T("-->       Fulcrum Pipe 2 (Input Pipe) was already closed!\n"));
+	if (!_inputTransport) {
+		fulcrum_DEBUG(_T("-->       Fulcrum Pipe 2 (Input Pipe) was already closed!\n"));
 		InputConnected = false; _pipesConnected = false;
 		return;
 	}
 
-	// Close it out now
-	CloseHandle(hFulcrumReader); hFulcrumReader = nullptr;
-	fulcrum_output::fulcrumDebug(_T("-->       Fulcrum Pipe 2 (Input Pipe) has been closed! Pipe handle is now NULL!\n"));
+	// Stop anything reading from it, then close it out now
+	StopInputReader();
+	_inputTransport.reset();
+	_inputDropped.store(false, std::memory_order_release);
+	fulcrum_DEBUG(_T("-->       Fulcrum Pipe 2 (Input Pipe) has been closed! Pipe handle is now NULL!\n"));
 	InputConnected = false; _pipesConnected = false;
 }
 
 
+// Starts the input reader. Only one runs at a time
+bool fulcrum_pipe::StartInputReader(fulcrum_input_handler pHandler, void* pContext)
+{
+	if (_hInputReader != NULL) return true;
+	if (!_inputTransport || pHandler == NULL) return false;
+
+	// The reader only stops with the input pipe, which an app unloading the shim never shuts down
+	fulcrum_pinModule();
+	_inputHandler = pHandler;
+	_inputContext = pContext;
+	_hInputReader = CreateThread(NULL, 0, InputReaderThread, this, 0, NULL);
+	return _hInputReader != NULL;
+}
+void fulcrum_pipe::StopInputReader()
+{
+	if (_hInputReader == NULL) return;
+
+	// A cancelled transport fails every read from here on, which is what ends the thread
+	_inputTransport->Cancel();
+	WaitForSingleObject(_hInputReader, INFINITE);
+	CloseHandle(_hInputReader); _hInputReader = NULL;
+}
+
+// Main routine for the input reader. Reads until the Injector goes away or we're cancelled. Either
+// way the input end is marked dropped so the pipe retry opens it again and restarts the reader
+DWORD WINAPI fulcrum_pipe::InputReaderThread(LPVOID lpParameter)
+{
+	fulcrum_pipe* pPipe = (fulcrum_pipe*)lpParameter;
+	std::vector<byte> inputBuffer(FULCRUM_PIPE_READ_CHUNK);
+	for (;;)
+	{
+		size_t bytes_read = pPipe->_inputTransport->Receive(&inputBuffer[0], inputBuffer.size());
+		if (bytes_read == 0) break;
+		pPipe->_inputHandler(&inputBuffer[0], bytes_read, pPipe->_inputContext);
+	}
+
+	pPipe->_inputDropped.store(true, std::memory_order_release);
+	return 0;
+}
+
+
 // Writes data to our pipe streams
 void fulcrum_pipe::WriteStringOut(std::string msgString)
 {
-	DWORD bytesWritten;
-	DWORD bytesToWrite = (DWORD)strlen(msgString.c_str());
-	BOOL resultValue = WriteFile(hFulcrumWriter, msgString.c_str(), bytesToWrite, &bytesWritten, NULL);
+#if PIPE_FRAMING
+	BeginFrame(msgString.size());
+	FrameBytes((const byte*)msgString.c_str(), (int)strlen(msgString.c_str()));
+	WriteFrame(FRAME_TEXT);
+	return;
+#endif
+	QueueOut(msgString.c_str(), strlen(msgString.c_str()));
 }
 void fulcrum_pipe::WriteBytesOut(byte byteValues[], int byteLength)
 {
-	DWORD bytesWritten;
-	BOOL resultValue = WriteFile(hFulcrumWriter, byteValues, byteLength, &bytesWritten, NULL);
+	if (byteLength > 0) QueueOut(byteValues, byteLength);
+}
+void fulcrum_pipe::QueueOut(const void* pData, size_t nBytes)
+{
+#if PIPE_FANOUT
+	_pipeHub.Publish(pData, nBytes);
+#else
+	_pipeWriter.Write(pData, nBytes);
+#endif
 }
 void fulcrum_pipe::WriteUint32(unsigned int writeNumber) {
-	WriteBytesOut((byte*)&writeNumber, 4);
+	WriteUint32(&writeNumber, 1);
 }
 void fulcrum_pipe::WriteUint32(unsigned int* writeNumber, unsigned int uintLen) {
-	for (unsigned int i = 0; i < uintLen; i++) WriteUint32(writeNumber[i]);
+	BeginFrame(uintLen * 4);
+	for (unsigned int i = 0; i < uintLen; i++) FrameUint32(writeNumber[i]);
+	WriteFrame(FRAME_UINT32_ARRAY);
 }
 void fulcrum_pipe::Writeint32(int writeNumber) {
-	WriteBytesOut((byte*)&writeNumber, 4); 
+	WriteUint32((unsigned int*)&writeNumber, 1);
+}
+
+// Builds up a frame of values so a whole batch goes out in a single write.
+// Room for the frame header is left at the front and filled in by WriteFrame()
+void fulcrum_pipe::BeginFrame(size_t reserveBytes)
+{
+	_frameBuffer.reserve(sizeof(fulcrum_frame_header) + reserveBytes);
+	_frameBuffer.assign(sizeof(fulcrum_frame_header), 0);
+}
+void fulcrum_pipe::FrameUint32(unsigned int frameNumber)
+{
+	size_t frameOffset = _frameBuffer.size();
+	_frameBuffer.resize(frameOffset + 4);
+	fulcrum_bitconverter::uint32_to_bytes(frameNumber, &_frameBuffer[0], (int)frameOffset);
+}
+void fulcrum_pipe::FrameBytes(const byte byteValues[], int byteLength)
+{
+	if (byteLength <= 0) return;
+	_frameBuffer.insert(_frameBuffer.end(), byteValues, byteValues + byteLength);
+}
+byte* fulcrum_pipe::FrameSpace(size_t byteLength)
+{
+	// Room at the end of the frame for a caller to fill in place
+	size_t frameOffset = _frameBuffer.size();
+	_frameBuffer.resize(frameOffset + byteLength);
+	return _frameBuffer.data() + frameOffset;
+}
+void fulcrum_pipe::WriteFrame(uint16_t frameType)
+{
+	size_t payloadSize = _frameBuffer.size() - sizeof(fulcrum_frame_header);
+#if PIPE_FRAMING
+	fulcrumFrame_Seal((fulcrum_frame_header*)&_frameBuffer[0], frameType, _frameSequence++,
+		_frameBuffer.data() + sizeof(fulcrum_frame_header), (uint32_t)payloadSize);
+	WriteBytesOut(&_frameBuffer[0], (int)_frameBuffer.size());
+#else
+	if (payloadSize == 0) return;
+	WriteBytesOut(&_frameBuffer[sizeof(fulcrum_frame_header)], (int)payloadSize);
+#endif
 }
 
 // Reads data from our pipe streams
+// Pulls more input into the read buffer until at least minimumBytes are waiting in it.
+// Each ReadFile asks for a whole chunk so small fields don't cost a call apiece
+bool fulcrum_pipe::FillReadBuffer(size_t minimumBytes)
+{
+	// Slide what's left to the front so the next chunk lands right after it
+	if (_readOffset > 0)
+	{
+		_readLength -= _readOffset;
+		if (_readLength > 0) memmove(&_readBuffer[0], &_readBuffer[_readOffset], _readLength);
+		_readOffset = 0;
+	}
+
+	size_t bufferSize = minimumBytes > FULCRUM_PIPE_READ_CHUNK ? minimumBytes : FULCRUM_PIPE_READ_CHUNK;
+	if (_readBuffer.size() < bufferSize) _readBuffer.resize(bufferSize);
+	while (_readLength < minimumBytes)
+	{
+		// A message bigger than what's left comes back over more than one pass
+		if (!_inputTransport) return false;
+		size_t bytes_read = _inputTransport->Receive(&_readBuffer[_readLength], _readBuffer.size() - _readLength);
+		if (bytes_read == 0) return false;
+		_readLength += bytes_read;
+	}
+	return true;
+}
+
 std::string fulcrum_pipe::ReadStringIn()
 {
-	char read_buffer[100] = { 0 };
-	DWORD bytes_read;
-	DWORD bytes_to_read = 100;
-	BOOL res = ReadFile(hFulcrumReader, read_buffer, bytes_to_read, &bytes_read, NULL);
+	// Hand back whatever is buffered (up to 100 bytes) or wait for the next read
+	size_t bytes_read = _readLength - _readOffset;
+	if (bytes_read == 0 && FillReadBuffer(1)) bytes_read = _readLength - _readOffset;
+	if (bytes_read > 100) bytes_read = 100;
+	if (bytes_read == 0) return std::string();
 
-	std::string str(read_buffer, bytes_read);
+	std::string str((const char*)&_readBuffer[_readOffset], bytes_read);
+	_readOffset += bytes_read;
 	return str;
 }
 void fulcrum_pipe::ReadBytesIn(byte inputByteBuffer[], int* bufferLength)
 {
-	DWORD bytes_read = 0;
-	DWORD bytes_to_read = *bufferLength;
+	size_t bytes_read = 0;
+	size_t bytes_to_read = *bufferLength > 0 ? *bufferLength : 0;
 
 	// (01/23/18 TAB) - don't try to read 0 bytes, it might block forever if nothing is added at the other end
-	if (bytes_to_read > 0) BOOL res = ReadFile(hFulcrumReader, inputByteBuffer, bytes_to_read, &bytes_read, NULL);
-	*bufferLength = bytes_read;
+	if (bytes_to_read > 0)
+	{
+		if (_readLength - _readOffset < bytes_to_read) FillReadBuffer(bytes_to_read);
+		bytes_read = _readLength - _readOffset;
+		if (bytes_read > bytes_to_read) bytes_read = bytes_to_read;
+		if (bytes_read > 0) memcpy(inputByteBuffer, &_readBuffer[_readOffset], bytes_read);
+		_readOffset += bytes_read;
+	}
+	*bufferLength = (int)bytes_read;
+}
+const byte* fulcrum_pipe::ReadBytesView(int byteLength)
+{
+	size_t bytes_to_read = byteLength > 0 ? byteLength : 0;
+	if (_readLength - _readOffset < bytes_to_read && !FillReadBuffer(bytes_to_read))
+		throw& CPipeException(std::string(("not enough bytes")));
+
+	const byte* pBytes = _readBuffer.empty() ? NULL : &_readBuffer[_readOffset];
+	_readOffset += bytes_to_read;
+	return pBytes;
 }
 void fulcrum_pipe::ReadBytes(byte inputByteBuffer[], int bufferLength)
 {
@@ -202,13 +376,9 @@ void fulcrum_pipe::ReadBytes(byte inputByteBuffer[], int bufferLength)
 }
 unsigned int fulcrum_pipe::ReadUint32()
 {
-	unsigned int num;
-	ReadBytes((byte*)&num, 4);
-	return num;
+	return fulcrum_bitconverter::bytes_to_uint32((byte*)ReadBytesView(4), 0);
 }
 int fulcrum_pipe::ReadInt32()
 {
-	int num;
-	ReadBytes((byte*)&num, 4);
-	return num;
+	return fulcrum_bitconverter::bytes_to_int32((byte*)ReadBytesView(4), 0);
 }
\ No newline at end of file
@@ -21,7 +21,14 @@
 #pragma once
 
 // Standard Imports
+#include <atomic>
+#include <memory>
 #include <string>
+#include <vector>
+
+// Fulcrum Resource Imports
+#include "fulcrum_pipewriter.h"
+#include "fulcrum_pipehub.h"
 
 class CPipeException : public CSimpleException
 {
@@ -40,6 +47,18 @@ public:
 	virtual ~CPipExceptionNULLParameter() {}
 };
 
+// Bytes pulled from the input pipe per read. Matches the pipe buffer size
+#define FULCRUM_PIPE_READ_CHUNK (1024 * 16)
+
+// Called on the input reader thread with each batch of bytes that arrives
+typedef void (*fulcrum_input_handler)(const byte* pData, size_t nBytes, void* pContext);
+
+// What carries the pipes. Picked with PIPE_TRANSPORT in config.h
+enum fulcrum_pipe_transport_type {
+	PIPE_TRANSPORT_NAMED_PIPE = 0,	// Windows named pipes. What the Injector listens on
+	PIPE_TRANSPORT_UNIX_SOCKET = 1,	// Unix domain sockets in the temp folder
+};
+
 class fulcrum_pipe {
 public:
 	// Methods for pipe object setup and shutdown.
@@ -51,15 +70,31 @@ public:
 
 	// Connect Pipe Routines
 	bool PipesConnected();
+	bool AllPipesConnected() const { return InputConnected && !_inputDropped && OutputConnected; }
 	bool ConnectInputPipe();
 	bool ConnectOutputPipe();
 
+	// Runs the pipes over transports built somewhere else (like a loopback for tests and benchmarks).
+	// The pipe takes ownership. The Connect routines build their own when nothing was attached
+	bool AttachInputTransport(fulcrum_transport* pTransport);
+	bool AttachOutputTransport(fulcrum_transport* pTransport);
+
+	// Counters for the output queue, or for the fan-out hub when PIPE_FANOUT is on
+	fulcrum_pipe_stats PipeStats() const { return _pipeWriter.Stats(); }
+	fulcrum_hub_stats HubStats() const { return _pipeHub.Stats(); }
+
+	// Hands everything that arrives on the input pipe to a handler on a reader thread of its own.
+	// Nothing else may read the input pipe while it runs. Shutting the input pipe down stops it
+	bool StartInputReader(fulcrum_input_handler pHandler, void* pContext);
+	void StopInputReader();
+	bool InputReaderRunning() const { return _hInputReader != NULL; }
+
 	// Shut down pipe routines.
 	void ShutdownPipes();
 	void ShutdownInputPipe();
 	void ShutdownOutputPipe();
 
-	// Writing operations
+	// Writing operations. With PIPE_FRAMING on everything but WriteBytesOut goes out as a frame
 	void Writeint32(int writeNumber);
 	void WriteStringOut(std::string msgString);
 	void WriteUint32(unsigned int writeNumber);
@@ -73,10 +108,47 @@ public:
 	void ReadBytes(byte inputByteBuffer[], int bufferLength);
 	void ReadBytesIn(byte inputByteBuffer[], int* bufferLength);
 
+	// Next bytes from the input pipe without copying them out. The pointer is only
+	// good until the next read. Throws when the pipe runs dry first
+	const byte* ReadBytesView(int byteLength);
+
+protected:
+	// Batched writes. Values are packed into the frame buffer and sent with one WriteFile.
+	// The type is one of fulcrum_frame_type and only goes on the wire when PIPE_FRAMING is on
+	void BeginFrame(size_t reserveBytes);
+	void FrameUint32(unsigned int frameNumber);
+	void FrameBytes(const byte byteValues[], int byteLength);
+	byte* FrameSpace(size_t byteLength);
+	void WriteFrame(uint16_t frameType);
+
 private:
 	// Pipe state values.
 	bool _pipesConnected = false;
-	HANDLE hFulcrumWriter, hFulcrumReader;
+	std::unique_ptr<fulcrum_transport> _inputTransport;
+	std::unique_ptr<fulcrum_transport> _outputTransport;
+
+	// Output is queued here and written by a background thread so a stalled Injector never holds us up.
+	// With PIPE_FANOUT on the hub takes its place and every reader that connects gets its own copy
+	fulcrum_pipewriter _pipeWriter;
+	fulcrum_pipehub _pipeHub;
+	void QueueOut(const void* pData, size_t nBytes);
+
+	// Reused between frames so batches don't allocate once it has grown
+	std::vector<byte> _frameBuffer;
+	uint32_t _frameSequence = 0;
+
+	// Input reader thread and where it sends what it reads. The reader sets _inputDropped when the Injector
+	// goes away, and the next ConnectInputPipe() closes out the dead pipe before opening a new one
+	static DWORD WINAPI InputReaderThread(LPVOID lpParameter);
+	HANDLE _hInputReader = NULL;
+	std::atomic<bool> _inputDropped{ false };
+	fulcrum_input_handler _inputHandler = NULL;
+	void* _inputContext = NULL;
+
+	// Input is read a chunk at a time and fields are decoded out of this buffer
+	std::vector<byte> _readBuffer;
+	size_t _readOffset = 0, _readLength = 0;
+	bool FillReadBuffer(size_t minimumBytes);
 };
 
 
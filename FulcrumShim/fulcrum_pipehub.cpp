@@ -0,0 +1,249 @@
+/*
+**
+** Copyright (C) 2022 MEAT Inc
+** Author: Zack Walsh <neo.smith@motorengineeringandtech.com>
+**
+** This library is free software; you can redistribute it and/or modify
+** it under the terms of the GNU Lesser General Public License as published
+** by the Free Software Foundation, either version 3 of the License, or (at
+** your option) any later version.
+**
+** This library is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+** Lesser General Public License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public
+** License along with this library; if not, <http://www.gnu.org/licenses/>.
+**
+*/
+
+// Standard Imports
+#include "stdafx.h"
+
+// Fulcrum Resource Imports
+#include "fulcrum_pipehub.h"
+#include "fulcrum_loader.h"
+#include "config.h"
+
+// CTOR and DCTOR. Nothing runs until Start()
+fulcrum_pipehub::fulcrum_pipehub()
+	: m_pListener(NULL)
+	, m_fDropSlow(false)
+	, m_hListenThread(NULL)
+	, m_hStop(NULL)
+	, m_fStopping(false)
+	, m_nAccepted(0)
+	, m_nRefused(0)
+	, m_nDroppedSlow(0)
+	, m_nLapped(0)
+{
+}
+fulcrum_pipehub::~fulcrum_pipehub()
+{
+	Stop(0);
+}
+
+// ---------------------------------------------------------------------------------------------------------------------------------
+
+// Builds the ring and the subscriber slots and boots the listener
+bool fulcrum_pipehub::Start(fulcrum_transport* pListener, size_t nRingBytes, size_t nMaxSubscribers, bool fDropSlow)
+{
+	if (IsRunning()) return true;
+
+	m_pListener = pListener;
+	m_fDropSlow = fDropSlow;
+	m_pRing.reset(new fulcrum_recordring(nRingBytes, RING_OVERWRITE_OLDEST));
+	m_fStopping.store(false, std::memory_order_relaxed);
+	for (size_t i = 0; i < nMaxSubscribers; i++)
+	{
+		std::unique_ptr<subscriber> pSlot(new subscriber);
+		pSlot->pHub = this;
+		pSlot->pTransport = NULL;
+		pSlot->hThread = NULL;
+		pSlot->hWake = CreateEvent(NULL, FALSE, FALSE, NULL);
+		pSlot->fActive.store(false, std::memory_order_relaxed);
+		pSlot->fSleeping.store(false, std::memory_order_relaxed);
+		if (pSlot->hWake == NULL) break;
+		m_Subscribers.push_back(std::move(pSlot));
+	}
+
+	// The threads run until Stop(), which an app unloading the shim never calls
+	fulcrum_pinModule();
+	m_hStop = CreateEvent(NULL, TRUE, FALSE, NULL);
+	if (m_hStop != NULL && !m_Subscribers.empty())
+		m_hListenThread = CreateThread(NULL, 0, ListenThread, this, 0, NULL);
+	if (m_hListenThread != NULL) return true;
+
+	// Couldn't get going. Close whatever we did get
+	for (size_t i = 0; i < m_Subscribers.size(); i++) CloseHandle(m_Subscribers[i]->hWake);
+	m_Subscribers.clear();
+	if (m_hStop != NULL) CloseHandle(m_hStop);
+	m_hStop = NULL;
+	return false;
+}
+
+// Stops taking subscribers, gives the ones we have until the wait runs out to catch up, then cuts them off
+void fulcrum_pipehub::Stop(DWORD dwWaitMilliseconds)
+{
+	if (!IsRunning()) return;
+
+	m_fStopping.store(true, std::memory_order_release);
+	m_pListener->Cancel();
+	WaitForSingleObject(m_hListenThread, INFINITE);
+	CloseHandle(m_hListenThread); m_hListenThread = NULL;
+
+	// The listener is gone so the slots can't change under us now
+	bool fTimedOut = false;
+	ULONGLONG nDeadline = GetTickCount64() + dwWaitMilliseconds;
+	for (size_t i = 0; i < m_Subscribers.size(); i++) SetEvent(m_Subscribers[i]->hWake);
+	for (size_t i = 0; i < m_Subscribers.size() && !fTimedOut; i++)
+	{
+		if (m_Subscribers[i]->hThread == NULL) continue;
+		ULONGLONG nNow = GetTickCount64();
+		DWORD dwLeft = nNow < nDeadline ? (DWORD)(nDeadline - nNow) : 0;
+		fTimedOut = WaitForSingleObject(m_Subscribers[i]->hThread, dwLeft) == WAIT_TIMEOUT;
+	}
+	if (fTimedOut)
+	{
+		SetEvent(m_hStop);
+		for (size_t i = 0; i < m_Subscribers.size(); i++)
+			if (m_Subscribers[i]->pTransport != NULL) m_Subscribers[i]->pTransport->Cancel();
+	}
+
+	for (size_t i = 0; i < m_Subscribers.size(); i++)
+	{
+		subscriber* pSlot = m_Subscribers[i].get();
+		if (pSlot->hThread != NULL) { WaitForSingleObject(pSlot->hThread, INFINITE); CloseHandle(pSlot->hThread); }
+		delete pSlot->pTransport;
+		CloseHandle(pSlot->hWake);
+	}
+	m_Subscribers.clear();
+	CloseHandle(m_hStop); m_hStop = NULL;
+	m_pListener = NULL;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------------------
+
+// Puts the write in the ring once and wakes whoever is asleep waiting for it
+bool fulcrum_pipehub::Publish(const void* pData, size_t nBytes)
+{
+	if (!IsRunning() || nBytes == 0) return false;
+	if (!m_pRing->Put(0, pData, nBytes)) return false;
+
+	// Pairs with the fence in SubscriberThread so a subscriber going to sleep either sees this write or gets woken
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	for (size_t i = 0; i < m_Subscribers.size(); i++)
+	{
+		subscriber* pSlot = m_Subscribers[i].get();
+		if (pSlot->fSleeping.load(std::memory_order_relaxed) && pSlot->fSleeping.exchange(false, std::memory_order_acq_rel))
+			SetEvent(pSlot->hWake);
+	}
+	return true;
+}
+
+// Finds a slot whose subscriber has left. Its old transport is thrown out here
+fulcrum_pipehub::subscriber* fulcrum_pipehub::FreeSlot()
+{
+	for (size_t i = 0; i < m_Subscribers.size(); i++)
+	{
+		subscriber* pSlot = m_Subscribers[i].get();
+		if (pSlot->fActive.load(std::memory_order_acquire)) continue;
+		if (pSlot->hThread != NULL) { WaitForSingleObject(pSlot->hThread, INFINITE); CloseHandle(pSlot->hThread); }
+		delete pSlot->pTransport;
+		pSlot->hThread = NULL;
+		pSlot->pTransport = NULL;
+		return pSlot;
+	}
+	return NULL;
+}
+
+// Main routine for the listener thread. Each new reader gets a slot and a thread of its own
+DWORD WINAPI fulcrum_pipehub::ListenThread(LPVOID lpParameter)
+{
+	fulcrum_pipehub* pHub = (fulcrum_pipehub*)lpParameter;
+	DWORD dwRetryDelay = PIPE_RETRY_MIN_MS;
+	while (!pHub->m_fStopping.load(std::memory_order_acquire))
+	{
+		// Failed accepts are retried on a growing delay, the same as the pipe writer's reconnects
+		fulcrum_transport* pPeer = pHub->m_pListener->AcceptPeer();
+		if (pPeer == NULL)
+		{
+			if (pHub->m_fStopping.load(std::memory_order_acquire)) break;
+			if (WaitForSingleObject(pHub->m_hStop, dwRetryDelay) == WAIT_OBJECT_0) break;
+			dwRetryDelay = dwRetryDelay * 2 > PIPE_RETRY_MAX_MS ? PIPE_RETRY_MAX_MS : dwRetryDelay * 2;
+			continue;
+		}
+		dwRetryDelay = PIPE_RETRY_MIN_MS;
+
+		subscriber* pSlot = pHub->FreeSlot();
+		if (pSlot == NULL) {
+			delete pPeer;
+			pHub->m_nRefused.fetch_add(1, std::memory_order_relaxed);
+			continue;
+		}
+
+		pSlot->pTransport = pPeer;
+		pSlot->fActive.store(true, std::memory_order_release);
+		pSlot->hThread = CreateThread(NULL, 0, SubscriberThread, pSlot, 0, NULL);
+		if (pSlot->hThread == NULL) { pSlot->fActive.store(false, std::memory_order_release); continue; }
+		pHub->m_nAccepted.fetch_add(1, std::memory_order_relaxed);
+	}
+	return 0;
+}
+
+// Main routine for a subscriber thread. Sends from its own cursor until the reader goes away,
+// falls too far behind (when we drop slow readers), or we stop
+DWORD WINAPI fulcrum_pipehub::SubscriberThread(LPVOID lpParameter)
+{
+	subscriber* pSlot = (subscriber*)lpParameter;
+	fulcrum_pipehub* pHub = pSlot->pHub;
+	fulcrum_ringcursor hubCursor; fulcrum_ringrecord hubRecord;
+	pHub->m_pRing->Attach(hubCursor);
+
+	for (;;)
+	{
+		if (WaitForSingleObject(pHub->m_hStop, 0) == WAIT_OBJECT_0) break;
+
+		unsigned long long nStored = pHub->m_pRing->Stored();
+		unsigned long long nMissedBefore = hubCursor.Missed;
+		if (pHub->m_pRing->Read(hubCursor, hubRecord))
+		{
+			if (hubCursor.Missed != nMissedBefore)
+			{
+				pHub->m_nLapped.fetch_add(hubCursor.Missed - nMissedBefore, std::memory_order_relaxed);
+				if (pHub->m_fDropSlow) { pHub->m_nDroppedSlow.fetch_add(1, std::memory_order_relaxed); break; }
+			}
+			if (pSlot->pTransport->Send(&hubRecord.Data[0], hubRecord.Data.size()) != PIPE_WRITE_SENT) break;
+			continue;
+		}
+
+		// Caught up. Leave if we're stopping, otherwise sleep unless something landed since we looked
+		if (pHub->m_fStopping.load(std::memory_order_acquire)) break;
+		pSlot->fSleeping.store(true, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (pHub->m_pRing->Stored() == nStored) WaitForSingleObject(pSlot->hWake, 50);
+		pSlot->fSleeping.store(false, std::memory_order_relaxed);
+	}
+
+	// Let the reader see we're done. The transport itself goes once the slot is reused or we stop
+	pSlot->pTransport->DropPeer();
+	pSlot->fActive.store(false, std::memory_order_release);
+	return 0;
+}
+
+// Counters for the hub
+fulcrum_hub_stats fulcrum_pipehub::Stats() const
+{
+	fulcrum_hub_stats hubStats;
+	hubStats.Published = m_pRing ? m_pRing->Stored() : 0;
+	hubStats.Overwritten = m_pRing ? m_pRing->Overwritten() : 0;
+	hubStats.Accepted = m_nAccepted.load(std::memory_order_relaxed);
+	hubStats.Refused = m_nRefused.load(std::memory_order_relaxed);
+	hubStats.DroppedSlow = m_nDroppedSlow.load(std::memory_order_relaxed);
+	hubStats.Lapped = m_nLapped.load(std::memory_order_relaxed);
+	hubStats.Subscribers = 0;
+	for (size_t i = 0; i < m_Subscribers.size(); i++)
+		if (m_Subscribers[i]->fActive.load(std::memory_order_relaxed)) hubStats.Subscribers++;
+	return hubStats;
+}
\ No newline at end of file
@@ -0,0 +1,94 @@
+/*
+**
+** Copyright (C) 2022 MEAT Inc
+** Author: Zack Walsh <neo.smith@motorengineeringandtech.com>
+**
+** This library is free software; you can redistribute it and/or modify
+** it under the terms of the GNU Lesser General Public License as published
+** by the Free Software Foundation, either version 3 of the License, or (at
+** your option) any later version.
+**
+** This library is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+** Lesser General Public License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public
+** License along with this library; if not, <http://www.gnu.org/licenses/>.
+**
+*/
+
+#pragma once
+
+// Standard Imports
+#include <atomic>
+#include <memory>
+#include <vector>
+
+// Fulcrum Resource Imports
+#include "fulcrum_recordring.h"
+#include "fulcrum_transport.h"
+
+// Counters for the fan-out hub
+struct fulcrum_hub_stats {
+	unsigned long long Published;		// Writes put in the ring
+	unsigned long long Overwritten;		// Writes the ring dropped before every subscriber had them
+	unsigned long long Accepted;		// Subscribers that connected
+	unsigned long long Refused;			// Subscribers turned away because every slot was taken
+	unsigned long long DroppedSlow;		// Subscribers cut off for falling behind
+	unsigned long long Lapped;			// Writes subscribers skipped because they fell behind
+	unsigned long long Subscribers;		// Subscribers connected right now
+};
+
+// Fans output out to more than one reader (the Injector UI, a recorder, an analyzer). Writes are put
+// in one shared ring once, and each subscriber sends from its own cursor on its own thread. The ring
+// overwrites its oldest records, so the producer never waits on anybody. A subscriber that falls a whole
+// ring behind either skips ahead (counted under Lapped) or is cut off so it can reconnect and start over.
+// New subscribers start from the oldest record still in the ring
+class fulcrum_pipehub {
+public:
+	fulcrum_pipehub();
+	~fulcrum_pipehub();
+
+	// Takes subscribers from a listening transport. The caller still owns it and has to keep it around until Stop()
+	bool Start(fulcrum_transport* pListener, size_t nRingBytes, size_t nMaxSubscribers, bool fDropSlow);
+	void Stop(DWORD dwWaitMilliseconds);
+	bool IsRunning() const { return m_hListenThread != NULL; }
+
+	// Queues one write for every subscriber. Returns false when the write was too big for the ring
+	bool Publish(const void* pData, size_t nBytes);
+
+	fulcrum_hub_stats Stats() const;
+
+private:
+	// One connected reader. Slots are built once at Start() and reused as readers come and go
+	struct subscriber {
+		fulcrum_pipehub* pHub;
+		fulcrum_transport* pTransport;
+		HANDLE hThread;
+		HANDLE hWake;
+		std::atomic<bool> fActive;
+		std::atomic<bool> fSleeping;
+	};
+
+	static DWORD WINAPI ListenThread(LPVOID lpParameter);
+	static DWORD WINAPI SubscriberThread(LPVOID lpParameter);
+	subscriber* FreeSlot();
+
+	// Listener and the shared ring
+	fulcrum_transport* m_pListener;
+	std::unique_ptr<fulcrum_recordring> m_pRing;
+	std::vector<std::unique_ptr<subscriber>> m_Subscribers;
+	bool m_fDropSlow;
+
+	// Threads and stop handling
+	HANDLE m_hListenThread;
+	HANDLE m_hStop;
+	std::atomic<bool> m_fStopping;
+
+	// Counters
+	std::atomic<unsigned long long> m_nAccepted;
+	std::atomic<unsigned long long> m_nRefused;
+	std::atomic<unsigned long long> m_nDroppedSlow;
+	std::atomic<unsigned long long> m_nLapped;
+};
\ No newline at end of file
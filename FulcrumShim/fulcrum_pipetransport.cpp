@@ -0,0 +1,171 @@
+/*
+**
+** Copyright (C) 2022 MEAT Inc
+** Author: Zack Walsh <neo.smith@motorengineeringandtech.com>
+**
+** This library is free software; you can redistribute it and/or modify
+** it under the terms of the GNU Lesser General Public License as published
+** by the Free Software Foundation, either version 3 of the License, or (at
+** your option) any later version.
+**
+** This library is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+** Lesser General Public License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public
+** License along with this library; if not, <http://www.gnu.org/licenses/>.
+**
+*/
+
+// Standard Imports
+#include "stdafx.h"
+
+// Fulcrum Resource Imports
+#include "fulcrum_pipetransport.h"
+#include "fulcrum_loader.h"		// for TSTRING
+
+// Builds one more instance of the output pipe
+static HANDLE fulcrumPipe_CreateInstance(LPCTSTR szPipeName)
+{
+	return CreateNamedPipe(
+		szPipeName,							// Name of the pipe
+		PIPE_ACCESS_OUTBOUND |				// Pipe direction (Out only)
+		FILE_FLAG_OVERLAPPED,				// Overlapped so a stuck write or connect can be cancelled
+		PIPE_TYPE_MESSAGE | PIPE_WAIT,		// Pipe types for sending output
+		100,							    // Number of instances (Set to 100 since we need to be aware of open and closes)
+		FULCRUM_PIPE_BUFFER_SIZE,			// Output buffer size
+		FULCRUM_PIPE_BUFFER_SIZE,			// Input buffer size
+		NMPWAIT_USE_DEFAULT_WAIT,			// Timeout Time value
+		NULL								// Default security wait
+	);
+}
+
+// One end of a named pipe. Only one thread uses it at a time, so one event covers every overlapped call
+class fulcrum_pipe_transport : public fulcrum_transport {
+public:
+	fulcrum_pipe_transport(HANDLE hPipe, bool fServer, LPCTSTR szPipeName)
+		: m_hPipe(hPipe), m_fServer(fServer), m_strPipeName(szPipeName)
+	{
+		m_hIoDone = CreateEvent(NULL, TRUE, FALSE, NULL);
+		m_hCancel = CreateEvent(NULL, TRUE, FALSE, NULL);
+	}
+	virtual ~fulcrum_pipe_transport()
+	{
+		CloseHandle(m_hPipe);
+		if (m_hIoDone != NULL) CloseHandle(m_hIoDone);
+		if (m_hCancel != NULL) CloseHandle(m_hCancel);
+	}
+
+	// A client end is connected from the moment it opens. A server waits for the Injector
+	virtual bool WaitForPeer()
+	{
+		if (WaitForSingleObject(m_hCancel, 0) == WAIT_OBJECT_0) return false;
+		if (!m_fServer) return true;
+
+		DWORD dwIgnored = 0; bool fCancelled = false;
+		OVERLAPPED connectOverlapped; BeginIo(connectOverlapped);
+		BOOL fConnected = FinishIo(ConnectNamedPipe(m_hPipe, &connectOverlapped), connectOverlapped, dwIgnored, fCancelled);
+
+		// Connected before we asked counts too
+		return !fCancelled && (fConnected || GetLastError() == ERROR_PIPE_CONNECTED);
+	}
+
+	// Resets the instance the last client left behind so the next one can connect
+	virtual void DropPeer()
+	{
+		if (m_fServer) DisconnectNamedPipe(m_hPipe);
+	}
+
+	// The connected instance goes to the caller and a fresh instance of the same pipe takes over listening
+	virtual fulcrum_transport* AcceptPeer()
+	{
+		if (!m_fServer || !WaitForPeer()) return NULL;
+
+		HANDLE hNextPipe = fulcrumPipe_CreateInstance(m_strPipeName.c_str());
+		if (hNextPipe == NULL || hNextPipe == INVALID_HANDLE_VALUE) { DropPeer(); return NULL; }
+		HANDLE hPeerPipe = m_hPipe;
+		m_hPipe = hNextPipe;
+		return new fulcrum_pipe_transport(hPeerPipe, true, m_strPipeName.c_str());
+	}
+
+	virtual fulcrum_pipe_result Send(const void* pData, size_t nBytes)
+	{
+		DWORD dwWritten = 0; bool fCancelled = false;
+		OVERLAPPED writeOverlapped; BeginIo(writeOverlapped);
+		if (FinishIo(WriteFile(m_hPipe, pData, (DWORD)nBytes, NULL, &writeOverlapped), writeOverlapped, dwWritten, fCancelled))
+			return PIPE_WRITE_SENT;
+		if (fCancelled) return PIPE_WRITE_STOPPED;
+
+		// Losing the Injector isn't a failed write. The write waits for it to come back
+		DWORD dwError = GetLastError();
+		if (dwError == ERROR_BROKEN_PIPE || dwError == ERROR_NO_DATA || dwError == ERROR_PIPE_NOT_CONNECTED || dwError == ERROR_PIPE_LISTENING)
+			return PIPE_WRITE_DISCONNECTED;
+		return PIPE_WRITE_FAILED;
+	}
+
+	// A message bigger than the buffer comes back as ERROR_MORE_DATA. The rest is picked up next call
+	virtual size_t Receive(void* pBuffer, size_t nBytes)
+	{
+		DWORD dwRead = 0; bool fCancelled = false;
+		OVERLAPPED readOverlapped; BeginIo(readOverlapped);
+		BOOL fResult = FinishIo(ReadFile(m_hPipe, pBuffer, (DWORD)nBytes, NULL, &readOverlapped), readOverlapped, dwRead, fCancelled);
+		if (!fResult && GetLastError() != ERROR_MORE_DATA) return 0;
+		return dwRead;
+	}
+
+	virtual void Cancel()
+	{
+		SetEvent(m_hCancel);
+	}
+
+private:
+	// Sets up the overlapped block for the next call
+	void BeginIo(OVERLAPPED& ioOverlapped)
+	{
+		ZeroMemory(&ioOverlapped, sizeof(ioOverlapped));
+		ioOverlapped.hEvent = m_hIoDone;
+		ResetEvent(m_hIoDone);
+	}
+
+	// Waits for a call that went pending. A cancel aborts it instead
+	BOOL FinishIo(BOOL fResult, OVERLAPPED& ioOverlapped, DWORD& dwBytes, bool& fCancelled)
+	{
+		fCancelled = false;
+		if (!fResult)
+		{
+			DWORD dwError = GetLastError();
+			if (dwError != ERROR_IO_PENDING && dwError != ERROR_MORE_DATA) return FALSE;
+			HANDLE hWaitHandles[2] = { m_hIoDone, m_hCancel };
+			if (dwError == ERROR_IO_PENDING && WaitForMultipleObjects(2, hWaitHandles, FALSE, INFINITE) != WAIT_OBJECT_0) {
+				CancelIo(m_hPipe);
+				fCancelled = true;
+			}
+		}
+		return GetOverlappedResult(m_hPipe, &ioOverlapped, &dwBytes, TRUE);
+	}
+
+	HANDLE m_hPipe;
+	HANDLE m_hIoDone;
+	HANDLE m_hCancel;
+	bool m_fServer;
+	tstring m_strPipeName;
+};
+
+// ---------------------------------------------------------------------------------------------------------------------------------
+
+// Builds the output pipe the Injector connects to
+fulcrum_transport* fulcrumTransport_CreatePipeServer(LPCTSTR szPipeName)
+{
+	HANDLE hPipe = fulcrumPipe_CreateInstance(szPipeName);
+	if (hPipe == NULL || hPipe == INVALID_HANDLE_VALUE) return NULL;
+	return new fulcrum_pipe_transport(hPipe, true, szPipeName);
+}
+
+// Opens the Injector's input pipe
+fulcrum_transport* fulcrumTransport_CreatePipeClient(LPCTSTR szPipeName)
+{
+	HANDLE hPipe = CreateFile(szPipeName, GENERIC_READ, 0, NULL, CREATE_ALWAYS, FILE_FLAG_OVERLAPPED, NULL);
+	if (hPipe == NULL || hPipe == INVALID_HANDLE_VALUE) return NULL;
+	return new fulcrum_pipe_transport(hPipe, false, szPipeName);
+}
\ No newline at end of file
@@ -21,31 +21,18 @@
 #pragma once
 
 // Standard Imports
-#include <memory>
 #include <tchar.h>
-#include <varargs.h>
-#include <stdexcept>
 
-// Implementation of a circular buffer. Two simple interfaces:
-//   Put(): Add a string to the log
-//   Get(): Write the entire log to a file
-// Based on DSP Goodies by Alessandro Gallo (http://ag-works.net/)
-class fulcrum_cfifo {
-public: 
-	fulcrum_cfifo()
-	: m_nSize(sizeof(data) / sizeof(data[0]))
-	, m_nItems(0)
-	, m_iWriteNext(0)
-	, m_iReadNext(0)
-	, m_pBuffer(data) { }
-	  void Put(LPCTSTR szMsg);
-	  void Get(FILE* fp);
+// Fulcrum Resource Imports
+#include "fulcrum_transport.h"
 
-private:
-	size_t m_nSize;
-	size_t m_nItems;
-	size_t m_iWriteNext;
-	size_t m_iReadNext;
-	LPTSTR m_pBuffer;
-	TCHAR data[1024 * 128]; // Circular buffer for debug log
-};
\ No newline at end of file
+// Named pipes shared with the Injector. We create the output pipe and open the Injector's input pipe
+#define FULCRUM_OUTPUT_PIPE_NAME _T("\\\\.\\pipe\\2CC3F0FB08354929BB453151BBAA5A15")
+#define FULCRUM_INPUT_PIPE_NAME _T("\\\\.\\pipe\\1D16333944F74A928A932417074DD2B3")
+#define FULCRUM_PIPE_BUFFER_SIZE (1024 * 16)
+
+// Windows named pipe transports. Both ends are opened for overlapped IO so Cancel() can break into
+// a read, write or connect that's stuck waiting on the Injector. Return NULL (with the error left in
+// GetLastError) when the pipe can't be created or opened
+fulcrum_transport* fulcrumTransport_CreatePipeServer(LPCTSTR szPipeName);
+fulcrum_transport* fulcrumTransport_CreatePipeClient(LPCTSTR szPipeName);
\ No newline at end of file
@@ -0,0 +1,337 @@
+/*
+**
+** Copyright (C) 2022 MEAT Inc
+** Author: Zack Walsh <neo.smith@motorengineeringandtech.com>
+**
+** This library is free software; you can redistribute it and/or modify
+** it under the terms of the GNU Lesser General Public License as published
+** by the Free Software Foundation, either version 3 of the License, or (at
+** your option) any later version.
+**
+** This library is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+** Lesser General Public License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public
+** License along with this library; if not, <http://www.gnu.org/licenses/>.
+**
+*/
+
+// Standard Imports
+#include "stdafx.h"
+#include <string.h>
+
+// Fulcrum Resource Imports
+#include "fulcrum_pipewriter.h"
+#include "config.h"
+
+// CTOR and DCTOR. Nothing runs until Start()
+fulcrum_pipewriter::fulcrum_pipewriter()
+	: m_pTransport(NULL)
+	, m_Policy(PIPE_POLICY_DROP_NEWEST)
+	, m_hSpillFile(INVALID_HANDLE_VALUE)
+	, m_nSpillWriteOffset(0)
+	, m_nSpillReadOffset(0)
+	, m_nSpillLimit(0)
+	, m_fSpilling(false)
+	, m_hWriterThread(NULL)
+	, m_hWake(NULL)
+	, m_hSpace(NULL)
+	, m_hStop(NULL)
+	, m_fStopping(false)
+	, m_fClientConnected(false)
+	, m_nQueued(0)
+	, m_nWritten(0)
+	, m_nDroppedNewest(0)
+	, m_nSpilled(0)
+	, m_nBlocked(0)
+	, m_nWriteErrors(0)
+	, m_nReconnects(0)
+{
+	InitializeCriticalSection(&m_SpillLock);
+}
+fulcrum_pipewriter::~fulcrum_pipewriter()
+{
+	Stop(0);
+	DeleteCriticalSection(&m_SpillLock);
+}
+
+// ---------------------------------------------------------------------------------------------------------------------------------
+
+// Builds the queue and events and boots the writer thread
+bool fulcrum_pipewriter::Start(fulcrum_transport* pTransport, size_t nQueueBytes, fulcrum_pipe_policy queuePolicy, unsigned long long nSpillLimit)
+{
+	if (IsRunning()) return true;
+
+	// Only drop oldest lets the queue overwrite itself. Everything else has to know when it's full
+	m_pTransport = pTransport;
+	m_Policy = queuePolicy;
+	m_nSpillLimit = nSpillLimit;
+	m_pQueue.reset(new fulcrum_recordring(nQueueBytes, queuePolicy == PIPE_POLICY_DROP_OLDEST ? RING_OVERWRITE_OLDEST : RING_REJECT_NEWEST));
+	m_fStopping.store(false, std::memory_order_relaxed);
+	m_fClientConnected.store(false, std::memory_order_relaxed);
+
+	// The writer runs until Stop(), which an app unloading the shim never calls
+	fulcrum_pinModule();
+	m_hWake = CreateEvent(NULL, FALSE, FALSE, NULL);
+	m_hSpace = CreateEvent(NULL, FALSE, FALSE, NULL);
+	m_hStop = CreateEvent(NULL, TRUE, FALSE, NULL);
+	if (m_hWake != NULL && m_hSpace != NULL && m_hStop != NULL)
+		m_hWriterThread = CreateThread(NULL, 0, WriterThread, this, 0, NULL);
+	if (m_hWriterThread != NULL) return true;
+
+	// Couldn't get going. Close whatever we did get
+	HANDLE hEvents[3] = { m_hWake, m_hSpace, m_hStop };
+	for (int i = 0; i < 3; i++) if (hEvents[i] != NULL) CloseHandle(hEvents[i]);
+	m_hWake = m_hSpace = m_hStop = NULL;
+	return false;
+}
+
+// Gives the writer until the wait runs out to send what's queued, then cancels whatever it's stuck on
+void fulcrum_pipewriter::Stop(DWORD dwWaitMilliseconds)
+{
+	if (!IsRunning()) return;
+
+	m_fStopping.store(true, std::memory_order_release);
+	SetEvent(m_hSpace);
+	SetEvent(m_hWake);
+	if (WaitForSingleObject(m_hWriterThread, dwWaitMilliseconds) == WAIT_TIMEOUT)
+	{
+		SetEvent(m_hStop);
+		m_pTransport->Cancel();
+		WaitForSingleObject(m_hWriterThread, INFINITE);
+	}
+
+	CloseHandle(m_hWriterThread); m_hWriterThread = NULL;
+	CloseHandle(m_hWake); CloseHandle(m_hSpace); CloseHandle(m_hStop);
+	m_hWake = m_hSpace = m_hStop = NULL;
+	m_pTransport = NULL;
+
+	// The spill file deletes itself once it's closed
+	EnterCriticalSection(&m_SpillLock);
+	if (m_hSpillFile != INVALID_HANDLE_VALUE) CloseHandle(m_hSpillFile);
+	m_hSpillFile = INVALID_HANDLE_VALUE;
+	m_nSpillWriteOffset = m_nSpillReadOffset = 0;
+	m_fSpilling.store(false, std::memory_order_relaxed);
+	LeaveCriticalSection(&m_SpillLock);
+}
+
+// ---------------------------------------------------------------------------------------------------------------------------------
+
+// Queues a write, handing it to the full queue policy when there's no room
+bool fulcrum_pipewriter::Write(const void* pData, size_t nBytes)
+{
+	if (!IsRunning() || nBytes == 0) return false;
+
+	// Once we're spilling everything goes to the file until the writer has caught up on it. A write the file
+	// won't take is dropped, since queueing it would send it ahead of what already spilled. Only the spill
+	// policy ever spills, so there's no blocking here. If ReadSpill() caught up in the meantime the queue is fine
+	if (m_fSpilling.load(std::memory_order_acquire))
+	{
+		if (Spill(pData, nBytes)) {
+			SetEvent(m_hWake);
+			return true;
+		}
+		if (m_fSpilling.load(std::memory_order_acquire)) {
+			m_nDroppedNewest.fetch_add(1, std::memory_order_relaxed);
+			return false;
+		}
+	}
+
+	bool fCountedBlock = false;
+	for (;;)
+	{
+		if (m_pQueue->Put(0, pData, nBytes)) {
+			m_nQueued.fetch_add(1, std::memory_order_relaxed);
+			SetEvent(m_hWake);
+			return true;
+		}
+		if (m_Policy == PIPE_POLICY_SPILL && Spill(pData, nBytes)) {
+			SetEvent(m_hWake);
+			return true;
+		}
+
+		// Writes too big for the queue can't wait for room. Neither can anything once we're stopping
+		if (m_Policy != PIPE_POLICY_BLOCK || nBytes > m_pQueue->Capacity() / 2 || m_fStopping.load(std::memory_order_acquire)) {
+			m_nDroppedNewest.fetch_add(1, std::memory_order_relaxed);
+			return false;
+		}
+
+		// Wait for the writer to free some space up
+		if (!fCountedBlock) { m_nBlocked.fetch_add(1, std::memory_order_relaxed); fCountedBlock = true; }
+		SetEvent(m_hWake);
+		WaitForSingleObject(m_hSpace, 10);
+	}
+}
+
+// Appends a write to the spill file as a length and the bytes. The file is opened the first time we need it
+bool fulcrum_pipewriter::Spill(const void* pData, size_t nBytes)
+{
+	EnterCriticalSection(&m_SpillLock);
+	if (m_hSpillFile == INVALID_HANDLE_VALUE)
+	{
+		TCHAR szTempPath[MAX_PATH], szSpillPath[MAX_PATH];
+		GetTempPath(_countof(szTempPath), szTempPath);
+		_stprintf_s(szSpillPath, _countof(szSpillPath), _T("%sFulcrumShim_%lu.pipeSpill"), szTempPath, GetCurrentProcessId());
+		m_strSpillPath = szSpillPath;
+		m_hSpillFile = CreateFile(szSpillPath, GENERIC_READ | GENERIC_WRITE, 0, NULL, CREATE_ALWAYS,
+			FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE, NULL);
+	}
+
+	bool fSpilled = false;
+	uint32_t nLength = (uint32_t)nBytes;
+	if (m_hSpillFile != INVALID_HANDLE_VALUE && m_nSpillWriteOffset + sizeof(nLength) + nBytes <= m_nSpillLimit)
+	{
+		// Each write says where it goes so the writer thread can read back from its own spot
+		DWORD dwWritten = 0;
+		OVERLAPPED spillOverlapped; ZeroMemory(&spillOverlapped, sizeof(spillOverlapped));
+		spillOverlapped.Offset = (DWORD)m_nSpillWriteOffset;
+		spillOverlapped.OffsetHigh = (DWORD)(m_nSpillWriteOffset >> 32);
+		fSpilled = WriteFile(m_hSpillFile, &nLength, sizeof(nLength), &dwWritten, &spillOverlapped) && dwWritten == sizeof(nLength);
+
+		unsigned long long nDataOffset = m_nSpillWriteOffset + sizeof(nLength);
+		spillOverlapped.Offset = (DWORD)nDataOffset;
+		spillOverlapped.OffsetHigh = (DWORD)(nDataOffset >> 32);
+		fSpilled = fSpilled && WriteFile(m_hSpillFile, pData, nLength, &dwWritten, &spillOverlapped) && dwWritten == nLength;
+		if (fSpilled) {
+			m_nSpillWriteOffset = nDataOffset + nLength;
+			m_fSpilling.store(true, std::memory_order_release);
+			m_nSpilled.fetch_add(1, std::memory_order_relaxed);
+		}
+	}
+	LeaveCriticalSection(&m_SpillLock);
+	return fSpilled;
+}
+
+// Reads back the oldest spilled write. Once the file is used up it starts over empty and spilling stops
+bool fulcrum_pipewriter::ReadSpill(std::vector<unsigned char>& spillRecord)
+{
+	EnterCriticalSection(&m_SpillLock);
+	bool fRead = false;
+	if (m_nSpillReadOffset < m_nSpillWriteOffset)
+	{
+		DWORD dwRead = 0; uint32_t nLength = 0;
+		OVERLAPPED spillOverlapped; ZeroMemory(&spillOverlapped, sizeof(spillOverlapped));
+		spillOverlapped.Offset = (DWORD)m_nSpillReadOffset;
+		spillOverlapped.OffsetHigh = (DWORD)(m_nSpillReadOffset >> 32);
+		fRead = ReadFile(m_hSpillFile, &nLength, sizeof(nLength), &dwRead, &spillOverlapped) && dwRead == sizeof(nLength);
+
+		unsigned long long nDataOffset = m_nSpillReadOffset + sizeof(nLength);
+		fRead = fRead && nDataOffset + nLength <= m_nSpillWriteOffset;
+		if (fRead)
+		{
+			spillRecord.resize(nLength);
+			spillOverlapped.Offset = (DWORD)nDataOffset;
+			spillOverlapped.OffsetHigh = (DWORD)(nDataOffset >> 32);
+			fRead = ReadFile(m_hSpillFile, &spillRecord[0], nLength, &dwRead, &spillOverlapped) && dwRead == nLength;
+		}
+
+		// A bad read means the rest of the file can't be trusted. Give up on it
+		m_nSpillReadOffset = fRead ? nDataOffset + nLength : m_nSpillWriteOffset;
+	}
+	if (m_nSpillReadOffset >= m_nSpillWriteOffset) {
+		m_nSpillReadOffset = m_nSpillWriteOffset = 0;
+		m_fSpilling.store(false, std::memory_order_release);
+	}
+	LeaveCriticalSection(&m_SpillLock);
+	return fRead;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------------------
+
+// Waits for the Injector to open its end of the pipe. Failures are retried on a growing delay.
+// Returns false only when we're told to stop
+bool fulcrum_pipewriter::WaitForClient()
+{
+	DWORD dwRetryDelay = PIPE_RETRY_MIN_MS;
+	for (;;)
+	{
+		if (m_pTransport->WaitForPeer()) {
+			m_fClientConnected.store(true, std::memory_order_release);
+			return true;
+		}
+
+		// The last client left behind a closed instance. Reset it and wait again after a bit
+		m_pTransport->DropPeer();
+		if (WaitForSingleObject(m_hStop, dwRetryDelay) == WAIT_OBJECT_0) return false;
+		dwRetryDelay = dwRetryDelay * 2 > PIPE_RETRY_MAX_MS ? PIPE_RETRY_MAX_MS : dwRetryDelay * 2;
+	}
+}
+
+// Sends a single write and waits for it. A stop request cancels the write instead
+fulcrum_pipe_result fulcrum_pipewriter::SendWrite(const unsigned char* pData, size_t nBytes)
+{
+	fulcrum_pipe_result writeResult = m_pTransport->Send(pData, nBytes);
+	if (writeResult == PIPE_WRITE_SENT) m_nWritten.fetch_add(1, std::memory_order_relaxed);
+	if (writeResult == PIPE_WRITE_FAILED) m_nWriteErrors.fetch_add(1, std::memory_order_relaxed);
+	return writeResult;
+}
+
+// Keeps trying a write until it's sent, fails outright, or we stop. Returns false once we're stopping
+bool fulcrum_pipewriter::SendHeld(const std::vector<unsigned char>& heldWrite)
+{
+	if (heldWrite.empty()) return true;
+	for (;;)
+	{
+		if (!m_fClientConnected.load(std::memory_order_acquire) && !WaitForClient()) return false;
+		fulcrum_pipe_result writeResult = SendWrite(&heldWrite[0], heldWrite.size());
+		if (writeResult == PIPE_WRITE_STOPPED) return false;
+		if (writeResult != PIPE_WRITE_DISCONNECTED) return true;
+
+		// The Injector went away. Free up this instance so it can connect again
+		m_fClientConnected.store(false, std::memory_order_release);
+		m_nReconnects.fetch_add(1, std::memory_order_relaxed);
+		m_pTransport->DropPeer();
+	}
+}
+
+// Main routine for the pipe writer thread. Queued writes go first since anything
+// in the spill file was written after everything that's still in the queue
+DWORD WINAPI fulcrum_pipewriter::WriterThread(LPVOID lpParameter)
+{
+	fulcrum_pipewriter* pWriter = (fulcrum_pipewriter*)lpParameter;
+	fulcrum_ringcursor queueCursor; fulcrum_ringrecord queueRecord;
+	std::vector<unsigned char> spillRecord;
+	pWriter->m_pQueue->Attach(queueCursor);
+
+	for (;;)
+	{
+		if (WaitForSingleObject(pWriter->m_hStop, 0) == WAIT_OBJECT_0) break;
+
+		// Records are copied out, so their space can go back to the producers before we send them
+		if (pWriter->m_pQueue->Read(queueCursor, queueRecord))
+		{
+			pWriter->m_pQueue->Trim(queueCursor);
+			SetEvent(pWriter->m_hSpace);
+			if (!pWriter->SendHeld(queueRecord.Data)) break;
+			continue;
+		}
+		if (pWriter->m_fSpilling.load(std::memory_order_acquire) && pWriter->ReadSpill(spillRecord))
+		{
+			if (!pWriter->SendHeld(spillRecord)) break;
+			continue;
+		}
+
+		// Everything's sent. Leave if we're stopping, otherwise sleep until there's more
+		if (pWriter->m_fStopping.load(std::memory_order_acquire)) break;
+		WaitForSingleObject(pWriter->m_hWake, 50);
+	}
+	return 0;
+}
+
+// Counters for the pipe queue
+fulcrum_pipe_stats fulcrum_pipewriter::Stats() const
+{
+	fulcrum_pipe_stats pipeStats;
+	pipeStats.Queued = m_nQueued.load(std::memory_order_relaxed);
+	pipeStats.Written = m_nWritten.load(std::memory_order_relaxed);
+	pipeStats.DroppedNewest = m_nDroppedNewest.load(std::memory_order_relaxed);
+	pipeStats.DroppedOldest = m_pQueue ? m_pQueue->Overwritten() : 0;
+	pipeStats.Spilled = m_nSpilled.load(std::memory_order_relaxed);
+	pipeStats.Blocked = m_nBlocked.load(std::memory_order_relaxed);
+	pipeStats.WriteErrors = m_nWriteErrors.load(std::memory_order_relaxed);
+	pipeStats.Reconnects = m_nReconnects.load(std::memory_order_relaxed);
+	pipeStats.ClientConnected = m_fClientConnected.load(std::memory_order_relaxed);
+	return pipeStats;
+}
\ No newline at end of file
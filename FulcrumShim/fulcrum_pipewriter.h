@@ -0,0 +1,115 @@
+/*
+**
+** Copyright (C) 2022 MEAT Inc
+** Author: Zack Walsh <neo.smith@motorengineeringandtech.com>
+**
+** This library is free software; you can redistribute it and/or modify
+** it under the terms of the GNU Lesser General Public License as published
+** by the Free Software Foundation, either version 3 of the License, or (at
+** your option) any later version.
+**
+** This library is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+** Lesser General Public License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public
+** License along with this library; if not, <http://www.gnu.org/licenses/>.
+**
+*/
+
+#pragma once
+
+// Standard Imports
+#include <atomic>
+#include <memory>
+#include <stdint.h>
+#include <tchar.h>
+#include <vector>
+
+// Fulcrum Resource Imports
+#include "fulcrum_recordring.h"
+#include "fulcrum_transport.h"
+#include "fulcrum_loader.h"		// for TSTRING
+
+// What a full pipe queue does with a new write
+enum fulcrum_pipe_policy {
+	PIPE_POLICY_DROP_NEWEST = 0,	// Keep what's queued and throw the new write away
+	PIPE_POLICY_DROP_OLDEST = 1,	// Throw away the oldest queued writes to make room
+	PIPE_POLICY_SPILL = 2,			// Write the overflow to a temp file and send it once the queue catches up
+	PIPE_POLICY_BLOCK = 3,			// Wait for room. Only for when losing output is worse than stalling the app
+};
+
+// Counters for the pipe queue. Each full queue event is counted under the policy that handled it
+struct fulcrum_pipe_stats {
+	unsigned long long Queued;
+	unsigned long long Written;
+	unsigned long long DroppedNewest;
+	unsigned long long DroppedOldest;
+	unsigned long long Spilled;
+	unsigned long long Blocked;
+	unsigned long long WriteErrors;
+	unsigned long long Reconnects;
+	bool ClientConnected;
+};
+
+// Sends pipe writes from a background thread so the caller never waits on the Injector. Writes
+// are queued in a bounded record ring and each one goes out as its own transport Send(), which
+// keeps message boundaries and lets shutdown cancel a stuck write.
+// While the Injector isn't connected writes stay queued (under the full queue policy) and go
+// out in order once it connects again
+class fulcrum_pipewriter {
+public:
+	fulcrum_pipewriter();
+	~fulcrum_pipewriter();
+
+	// Takes over sending on a transport. The caller still owns it and has to keep it around until Stop()
+	bool Start(fulcrum_transport* pTransport, size_t nQueueBytes, fulcrum_pipe_policy queuePolicy, unsigned long long nSpillLimit);
+	void Stop(DWORD dwWaitMilliseconds);
+	bool IsRunning() const { return m_hWriterThread != NULL; }
+
+	// Queues one write. Returns false when the write was thrown away
+	bool Write(const void* pData, size_t nBytes);
+
+	fulcrum_pipe_stats Stats() const;
+
+private:
+	static DWORD WINAPI WriterThread(LPVOID lpParameter);
+	fulcrum_pipe_result SendWrite(const unsigned char* pData, size_t nBytes);
+	bool SendHeld(const std::vector<unsigned char>& heldWrite);
+	bool WaitForClient();
+	bool Spill(const void* pData, size_t nBytes);
+	bool ReadSpill(std::vector<unsigned char>& spillRecord);
+
+	// Transport and queue
+	fulcrum_transport* m_pTransport;
+	fulcrum_pipe_policy m_Policy;
+	std::unique_ptr<fulcrum_recordring> m_pQueue;
+
+	// Spill file. Once anything spills every later write goes there too until it's all been sent,
+	// so nothing gets ahead of what spilled before it. The lock covers the file and its offsets
+	CRITICAL_SECTION m_SpillLock;
+	HANDLE m_hSpillFile;
+	tstring m_strSpillPath;
+	unsigned long long m_nSpillWriteOffset;
+	unsigned long long m_nSpillReadOffset;
+	unsigned long long m_nSpillLimit;
+	std::atomic<bool> m_fSpilling;
+
+	// Writer thread and its events
+	HANDLE m_hWriterThread;
+	HANDLE m_hWake;
+	HANDLE m_hSpace;
+	HANDLE m_hStop;
+	std::atomic<bool> m_fStopping;
+	std::atomic<bool> m_fClientConnected;
+
+	// Counters. Dropped oldest comes from the queue itself
+	std::atomic<unsigned long long> m_nQueued;
+	std::atomic<unsigned long long> m_nWritten;
+	std::atomic<unsigned long long> m_nDroppedNewest;
+	std::atomic<unsigned long long> m_nSpilled;
+	std::atomic<unsigned long long> m_nBlocked;
+	std::atomic<unsigned long long> m_nWriteErrors;
+	std::atomic<unsigned long long> m_nReconnects;
+};
\ No newline at end of file
@@ -0,0 +1,187 @@
+/*
+**
+** Copyright (C) 2022 MEAT Inc
+** Author: Zack Walsh <neo.smith@motorengineeringandtech.com>
+**
+** This library is free software; you can redistribute it and/or modify
+** it under the terms of the GNU Lesser General Public License as published
+** by the Free Software Foundation, either version 3 of the License, or (at
+** your option) any later version.
+**
+** This library is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+** Lesser General Public License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public
+** License along with this library; if not, <http://www.gnu.org/licenses/>.
+**
+*/
+
+
+// Standard Imports
+#include "stdafx.h"
+#include <string.h>
+
+// Fulcrum Resource Imports
+#include "fulcrum_recordring.h"
+
+// Builds the ring. Capacity is rounded up to a power of two so positions can be masked
+fulcrum_recordring::fulcrum_recordring(size_t nCapacity, fulcrum_ring_policy ringPolicy)
+	: m_Policy(ringPolicy)
+	, m_Head(0)
+	, m_Tail(0)
+	, m_nStored(0)
+	, m_nOverwritten(0)
+	, m_nRejected(0)
+{
+	m_nCapacity = 4096;
+	while (m_nCapacity < nCapacity && m_nCapacity < 0x40000000) m_nCapacity <<= 1;
+	m_nMask = m_nCapacity - 1;
+
+	// Zeroed stamps never match a position so the empty ring reads as empty
+	m_pBuffer = new unsigned char[m_nCapacity];
+	memset(m_pBuffer, 0, m_nCapacity);
+}
+fulcrum_recordring::~fulcrum_recordring()
+{
+	delete[] m_pBuffer;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------------------
+
+// Fills in a reserved record and publishes it by writing the stamp last
+void fulcrum_recordring::Commit(uint32_t nPosition, uint32_t nSequence, uint32_t recordKind, const void* pData, uint32_t nLength)
+{
+	record_header* pHeader = HeaderAt(nPosition);
+	pHeader->Sequence.store(nSequence, std::memory_order_relaxed);
+	pHeader->Length.store(nLength, std::memory_order_relaxed);
+	pHeader->Kind.store(recordKind, std::memory_order_relaxed);
+	if (pData != NULL && nLength > 0) memcpy((unsigned char*)(pHeader + 1), pData, nLength);
+	pHeader->Stamp.store(nPosition + 1, std::memory_order_release);
+}
+
+// Moves the tail past the oldest record. Fails if that record is still being written.
+// Losing the race to another producer still counts as success since the tail moved either way
+bool fulcrum_recordring::EvictOldest(uint64_t tailState, bool fOverwrite)
+{
+	uint32_t nTail = StatePosition(tailState);
+	record_header* pHeader = HeaderAt(nTail);
+	if (pHeader->Stamp.load(std::memory_order_acquire) != nTail + 1) return false;
+
+	// If the tail already moved on these may be junk, but then the swap below fails anyway
+	uint32_t recordKind = pHeader->Kind.load(std::memory_order_relaxed);
+	uint32_t nLength = pHeader->Length.load(std::memory_order_relaxed);
+	uint32_t nSequence = StateSequence(tailState);
+	uint64_t nextState = PackState(nTail + RecordSize(nLength), recordKind == PaddingKind ? nSequence : nSequence + 1);
+	if (m_Tail.compare_exchange_strong(tailState, nextState, std::memory_order_acq_rel) && recordKind != PaddingKind && fOverwrite)
+		m_nOverwritten.fetch_add(1, std::memory_order_relaxed);
+
+	return true;
+}
+
+// Stores a record. Returns false if the record had to be dropped
+bool fulcrum_recordring::Put(uint32_t recordKind, const void* pData, size_t nBytes)
+{
+	// Records larger than half the ring could never be guaranteed a spot
+	if (nBytes > m_nCapacity / 2 || RecordSize((uint32_t)nBytes) > m_nCapacity / 2) {
+		m_nRejected.fetch_add(1, std::memory_order_relaxed);
+		return false;
+	}
+
+	uint32_t nLength = (uint32_t)nBytes;
+	uint32_t nSize = RecordSize(nLength);
+	for (;;)
+	{
+		// Tail first. It can only move forward, so the space we see is never more than we really have
+		uint64_t tailState = m_Tail.load(std::memory_order_acquire);
+		uint64_t headState = m_Head.load(std::memory_order_acquire);
+		uint32_t nHead = StatePosition(headState);
+
+		// Records never wrap. If this one doesn't fit before the end of the buffer pad out the rest
+		uint32_t nRoom = m_nCapacity - (nHead & m_nMask);
+		uint32_t nPadding = nRoom < nSize ? nRoom : 0;
+		if (nHead + nPadding + nSize - StatePosition(tailState) > m_nCapacity)
+		{
+			// Full. Either make room or give up on this record
+			if (m_Policy == RING_REJECT_NEWEST || !EvictOldest(tailState, true)) {
+				m_nRejected.fetch_add(1, std::memory_order_relaxed);
+				return false;
+			}
+			continue;
+		}
+
+		// Claim the space and the next sequence number together
+		uint32_t nSequence = StateSequence(headState);
+		uint64_t nextState = PackState(nHead + nPadding + nSize, nSequence + 1);
+		if (!m_Head.compare_exchange_weak(headState, nextState, std::memory_order_acq_rel)) continue;
+
+		if (nPadding > 0) Commit(nHead, nSequence, PaddingKind, NULL, nPadding - (uint32_t)sizeof(record_header));
+		Commit(nHead + nPadding, nSequence, recordKind, pData, nLength);
+		m_nStored.fetch_add(1, std::memory_order_relaxed);
+		return true;
+	}
+}
+
+// ---------------------------------------------------------------------------------------------------------------------------------
+
+// Points a cursor at the oldest record still stored
+void fulcrum_recordring::Attach(fulcrum_ringcursor& ringCursor) const
+{
+	uint64_t tailState = m_Tail.load(std::memory_order_acquire);
+	ringCursor.Position = StatePosition(tailState);
+	ringCursor.Sequence = StateSequence(tailState);
+	ringCursor.Missed = 0;
+}
+
+// Copies the next record for a cursor. Returns false when the cursor has caught up with the writers
+bool fulcrum_recordring::Read(fulcrum_ringcursor& ringCursor, fulcrum_ringrecord& ringRecord) const
+{
+	for (;;)
+	{
+		// If the ring lapped us, skip to the oldest record and count what we lost
+		uint64_t tailState = m_Tail.load(std::memory_order_acquire);
+		if ((int32_t)(ringCursor.Position - StatePosition(tailState)) < 0) {
+			ringCursor.Missed += (uint32_t)(StateSequence(tailState) - ringCursor.Sequence);
+			ringCursor.Position = StatePosition(tailState);
+			ringCursor.Sequence = StateSequence(tailState);
+		}
+
+		// Nothing to read until the record here has been committed
+		record_header* pHeader = HeaderAt(ringCursor.Position);
+		if (pHeader->Stamp.load(std::memory_order_acquire) != ringCursor.Position + 1) return false;
+
+		uint32_t recordKind = pHeader->Kind.load(std::memory_order_relaxed);
+		uint32_t nLength = pHeader->Length.load(std::memory_order_relaxed);
+		uint32_t nSequence = pHeader->Sequence.load(std::memory_order_relaxed);
+		uint32_t nRoom = m_nCapacity - (ringCursor.Position & m_nMask) - (uint32_t)sizeof(record_header);
+		if (recordKind != PaddingKind && nLength <= nRoom) {
+			ringRecord.Data.resize(nLength);
+			if (nLength > 0) memcpy(&ringRecord.Data[0], (const unsigned char*)(pHeader + 1), nLength);
+		}
+
+		// Make sure a producer didn't reuse the space while we were copying it
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if ((int32_t)(ringCursor.Position - StatePosition(m_Tail.load(std::memory_order_relaxed))) < 0) continue;
+		if (nLength > nRoom) return false;
+
+		ringCursor.Position += RecordSize(nLength);
+		if (recordKind == PaddingKind) continue;
+
+		ringCursor.Sequence = nSequence + 1;
+		ringRecord.Sequence = nSequence;
+		ringRecord.Kind = recordKind;
+		return true;
+	}
+}
+
+// Frees every record before a cursor. Used by consumers which own the data in the ring
+void fulcrum_recordring::Trim(const fulcrum_ringcursor& ringCursor)
+{
+	for (;;)
+	{
+		uint64_t tailState = m_Tail.load(std::memory_order_acquire);
+		if ((int32_t)(ringCursor.Position - StatePosition(tailState)) <= 0) return;
+		if (!EvictOldest(tailState, false)) return;
+	}
+}
\ No newline at end of file
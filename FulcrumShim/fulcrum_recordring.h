@@ -0,0 +1,110 @@
+/*
+**
+** Copyright (C) 2022 MEAT Inc
+** Author: Zack Walsh <neo.smith@motorengineeringandtech.com>
+**
+** This library is free software; you can redistribute it and/or modify
+** it under the terms of the GNU Lesser General Public License as published
+** by the Free Software Foundation, either version 3 of the License, or (at
+** your option) any later version.
+**
+** This library is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+** Lesser General Public License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public
+** License along with this library; if not, <http://www.gnu.org/licenses/>.
+**
+*/
+
+
+#pragma once
+
+// Standard Imports
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+// What a full ring does with a new record
+enum fulcrum_ring_policy {
+	RING_OVERWRITE_OLDEST = 0,	// Throw away the oldest records to make room
+	RING_REJECT_NEWEST = 1,		// Keep what we have and drop the new record
+};
+
+// Read position for one consumer. Each consumer keeps its own so they never interfere.
+// A zeroed cursor starts at the very first record the ring ever stored
+struct fulcrum_ringcursor {
+	uint32_t Position;				// Byte position of the next record to read
+	uint32_t Sequence;				// Sequence number we expect to read next
+	unsigned long long Missed;		// Records overwritten before this cursor got to them
+};
+
+// Copy of a record read out of the ring
+struct fulcrum_ringrecord {
+	uint32_t Sequence;					// Sequence number assigned when the record was stored
+	uint32_t Kind;						// Caller defined record type
+	std::vector<unsigned char> Data;	// Record bytes
+};
+
+// Lock-free ring of variable length records. Any number of threads may Put() at once and any number
+// of cursors may read at their own pace. Every record gets a sequence number so readers know exactly
+// how many records they lost when the ring wrapped past them. Records which are still being written
+// are never overwritten; a Put() which would need to do that is dropped instead. With the reject
+// policy space only comes back when a consumer calls Trim() for the records it's done with
+class fulcrum_recordring {
+public:
+	fulcrum_recordring(size_t nCapacity, fulcrum_ring_policy ringPolicy);
+	~fulcrum_recordring();
+
+	// Producer side. Safe to call from any number of threads at once
+	bool Put(uint32_t recordKind, const void* pData, size_t nBytes);
+
+	// Consumer side. Each cursor may only be used by one thread at a time
+	void Attach(fulcrum_ringcursor& ringCursor) const;
+	bool Read(fulcrum_ringcursor& ringCursor, fulcrum_ringrecord& ringRecord) const;
+	void Trim(const fulcrum_ringcursor& ringCursor);
+
+	// Counters for ring health
+	size_t Capacity() const { return m_nCapacity; }
+	unsigned long long Stored() const { return m_nStored.load(std::memory_order_relaxed); }
+	unsigned long long Overwritten() const { return m_nOverwritten.load(std::memory_order_relaxed); }
+	unsigned long long Rejected() const { return m_nRejected.load(std::memory_order_relaxed); }
+	unsigned long long Dropped() const { return Overwritten() + Rejected(); }
+
+private:
+	// Header in front of every record. Stamp is written last so readers never see half a record
+	struct record_header {
+		std::atomic<uint32_t> Stamp;		// Position + 1 once the record is committed
+		std::atomic<uint32_t> Sequence;		// Sequence number of the record
+		std::atomic<uint32_t> Length;		// Bytes of data following the header
+		std::atomic<uint32_t> Kind;			// Caller's record type, or PaddingKind
+	};
+
+	// Padding fills the end of the buffer when a record doesn't fit before the wrap
+	static const uint32_t PaddingKind = 0xFFFFFFFF;
+	static const uint32_t RecordAlign = sizeof(record_header);
+
+	// Head and tail pack the byte position (low half) and sequence number (high half) into one
+	// word so both can be swapped together. Positions wrap at 4GB and are only ever compared by difference
+	static uint64_t PackState(uint32_t nPosition, uint32_t nSequence) { return ((uint64_t)nSequence << 32) | nPosition; }
+	static uint32_t StatePosition(uint64_t ringState) { return (uint32_t)ringState; }
+	static uint32_t StateSequence(uint64_t ringState) { return (uint32_t)(ringState >> 32); }
+
+	record_header* HeaderAt(uint32_t nPosition) const { return (record_header*)(m_pBuffer + (nPosition & m_nMask)); }
+	static uint32_t RecordSize(uint32_t nLength) { return (uint32_t)((sizeof(record_header) + nLength + RecordAlign - 1) & ~(size_t)(RecordAlign - 1)); }
+	bool EvictOldest(uint64_t tailState, bool fOverwrite);
+	void Commit(uint32_t nPosition, uint32_t nSequence, uint32_t recordKind, const void* pData, uint32_t nLength);
+
+	unsigned char* m_pBuffer;
+	uint32_t m_nCapacity;
+	uint32_t m_nMask;
+	fulcrum_ring_policy m_Policy;
+
+	alignas(64) std::atomic<uint64_t> m_Head;	// Next free byte and the sequence it gets
+	alignas(64) std::atomic<uint64_t> m_Tail;	// Oldest record still stored and its sequence
+	std::atomic<unsigned long long> m_nStored;
+	std::atomic<unsigned long long> m_nOverwritten;
+	std::atomic<unsigned long long> m_nRejected;
+};
\ No newline at end of file
@@ -0,0 +1,325 @@
+/*
+**
+** Copyright (C) 2022 MEAT Inc
+** Author: Zack Walsh <neo.smith@motorengineeringandtech.com>
+**
+** This library is free software; you can redistribute it and/or modify
+** it under the terms of the GNU Lesser General Public License as published
+** by the Free Software Foundation, either version 3 of the License, or (at
+** your option) any later version.
+**
+** This library is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+** Lesser General Public License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public
+** License along with this library; if not, <http://www.gnu.org/licenses/>.
+**
+*/
+
+
+// Standard Imports
+#include "stdafx.h"
+#include <stddef.h>
+#include <string.h>
+#include <vector>
+
+// Fulcrum Resource Imports
+#include "fulcrum_segment.h"
+
+// Size of the headers at the start of every segment
+static const size_t SegmentHeaderSize = sizeof(fulcrum_capture_file_header) + sizeof(fulcrum_capture_segment_header);
+
+// Mappings are sized in whole allocation granules
+static const size_t SegmentGranularity = 64 * 1024;
+
+// CTOR and DCTOR. Nothing is opened until the first capture starts
+fulcrum_segment::fulcrum_segment()
+	: m_nSegmentSize(FULCRUM_SEGMENT_DEFAULT_SIZE)
+	, m_nSegmentIndex(0)
+	, m_nFileFlags(0)
+	, m_hFile(INVALID_HANDLE_VALUE)
+	, m_hMapping(NULL)
+	, m_pView(NULL)
+	, m_nMappedSize(0)
+	, m_nWriteOffset(0)
+	, m_nFlushedOffset(0)
+	, m_nNextIndexOffset(0)
+	, m_nRecordCount(0)
+	, m_nLastTimestamp(0)
+	, m_hFlusherThread(NULL)
+	, m_hFlusherWake(NULL)
+	, m_hFlusherDone(NULL)
+	, m_fFlusherStopping(false)
+{
+	InitializeCriticalSection(&m_FlushLock);
+}
+fulcrum_segment::~fulcrum_segment()
+{
+	// The flusher must already be stopped by Shutdown(). Only the process teardown gets here otherwise
+	Close();
+	DeleteCriticalSection(&m_FlushLock);
+}
+
+// ---------------------------------------------------------------------------------------------------------------------------------
+
+// Segment 0 keeps the name it was given. The rest get a number before the extension
+tstring fulcrum_segment::SegmentPath(uint32_t nSegmentIndex) const
+{
+	if (nSegmentIndex == 0) return m_strBasePath + m_strExtension;
+
+	TCHAR szSuffix[16];
+	_stprintf_s(szSuffix, _countof(szSuffix), _T("_%03u"), nSegmentIndex);
+	return m_strBasePath + szSuffix + m_strExtension;
+}
+
+// Bytes needed for a footer index with a given number of entries
+size_t fulcrum_segment::IndexRecordSize(size_t nEntries)
+{
+	return sizeof(fulcrum_capture_record_header) +
+		sizeof(fulcrum_capture_field_header) + sizeof(uint32_t) + nEntries * sizeof(fulcrum_capture_index_entry) +
+		sizeof(fulcrum_capture_field_header) + sizeof(uint64_t);
+}
+
+// Creates the next segment file at full size, maps it, and writes its headers
+bool fulcrum_segment::OpenSegment(size_t nFirstRecordSize)
+{
+	// Oversized records get a segment big enough to hold them
+	size_t nMapSize = (size_t)m_nSegmentSize;
+	size_t nNeeded = SegmentHeaderSize + nFirstRecordSize + IndexRecordSize(1);
+	if (nMapSize < nNeeded) nMapSize = nNeeded;
+	nMapSize = (nMapSize + SegmentGranularity - 1) & ~(SegmentGranularity - 1);
+
+	tstring strPath = SegmentPath(m_nSegmentIndex);
+	HANDLE hFile = CreateFile(strPath.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (hFile == INVALID_HANDLE_VALUE) return false;
+
+	// Mapping past the end of the file grows it, so this preallocates the whole segment
+	unsigned long long nMapSize64 = nMapSize;
+	HANDLE hMapping = CreateFileMapping(hFile, NULL, PAGE_READWRITE, (DWORD)(nMapSize64 >> 32), (DWORD)nMapSize64, NULL);
+	unsigned char* pView = hMapping == NULL ? NULL : (unsigned char*)MapViewOfFile(hMapping, FILE_MAP_WRITE, 0, 0, nMapSize);
+	if (pView == NULL) {
+		if (hMapping != NULL) CloseHandle(hMapping);
+		CloseHandle(hFile);
+		DeleteFile(strPath.c_str());
+		return false;
+	}
+
+	// Same file header a flat capture has, flagged as a segment, then the segment header
+	fulcrum_capture_file_header fileHeader;
+	memcpy(fileHeader.Magic, FULCRUM_CAPTURE_MAGIC, FULCRUM_CAPTURE_MAGIC_SIZE);
+	fileHeader.Version = FULCRUM_CAPTURE_VERSION;
+	fileHeader.HeaderSize = (uint16_t)SegmentHeaderSize;
+	fileHeader.Flags = FULCRUM_CAPTURE_FLAG_SEGMENTED | m_nFileFlags;
+	fileHeader.TimestampUnits = FULCRUM_CAPTURE_TIMESTAMP_UNITS;
+	fulcrum_capture_segment_header segmentHeader;
+	segmentHeader.SegmentIndex = m_nSegmentIndex;
+	segmentHeader.Reserved = 0;
+	segmentHeader.FirstRecord = m_nRecordCount;
+	segmentHeader.FirstTimestamp = 0;
+	memcpy(pView, &fileHeader, sizeof(fileHeader));
+	memcpy(pView + sizeof(fileHeader), &segmentHeader, sizeof(segmentHeader));
+
+	// Swap the new segment in where the flusher can see it
+	EnterCriticalSection(&m_FlushLock);
+	m_hFile = hFile;
+	m_hMapping = hMapping;
+	m_pView = pView;
+	m_nMappedSize = nMapSize;
+	m_nWriteOffset.store(SegmentHeaderSize, std::memory_order_release);
+	m_nFlushedOffset = 0;
+	LeaveCriticalSection(&m_FlushLock);
+
+	m_IndexEntries.clear();
+	m_nNextIndexOffset = 0;
+	return true;
+}
+
+// Writes the footer index, pushes the segment to disk, and trims off the space we didn't use
+void fulcrum_segment::FinishSegment()
+{
+	if (m_pView == NULL) return;
+
+	// Index record. Space for it was held back by every Append()
+	size_t nIndexOffset = m_nWriteOffset.load(std::memory_order_relaxed);
+	size_t nIndexSize = IndexRecordSize(m_IndexEntries.size());
+	unsigned char* pWrite = m_pView + nIndexOffset;
+
+	fulcrum_capture_record_header recordHeader;
+	recordHeader.Length = (uint32_t)nIndexSize;
+	recordHeader.Type = CAPTURE_SEGMENT_INDEX;
+	recordHeader.Function = CAPTURE_FN_NONE;
+	recordHeader.Timestamp = m_nLastTimestamp;
+	recordHeader.ThreadID = GetCurrentThreadId();
+	recordHeader.FieldCount = 2;
+	memcpy(pWrite, &recordHeader, sizeof(recordHeader)); pWrite += sizeof(recordHeader);
+
+	fulcrum_capture_field_header fieldHeader;
+	uint32_t nEntries = (uint32_t)m_IndexEntries.size();
+	fieldHeader.Tag = FIELD_INDEX_ENTRIES;
+	fieldHeader.Index = 0;
+	fieldHeader.Flags = 0;
+	fieldHeader.Length = (uint32_t)(sizeof(nEntries) + nEntries * sizeof(fulcrum_capture_index_entry));
+	memcpy(pWrite, &fieldHeader, sizeof(fieldHeader)); pWrite += sizeof(fieldHeader);
+	memcpy(pWrite, &nEntries, sizeof(nEntries)); pWrite += sizeof(nEntries);
+	if (nEntries > 0) memcpy(pWrite, &m_IndexEntries[0], nEntries * sizeof(fulcrum_capture_index_entry));
+	pWrite += nEntries * sizeof(fulcrum_capture_index_entry);
+
+	uint64_t indexOffset = nIndexOffset;
+	fieldHeader.Tag = FIELD_INDEX_OFFSET;
+	fieldHeader.Length = sizeof(indexOffset);
+	memcpy(pWrite, &fieldHeader, sizeof(fieldHeader)); pWrite += sizeof(fieldHeader);
+	memcpy(pWrite, &indexOffset, sizeof(indexOffset));
+
+	// Unmap before trimming. The file can't shrink while a view of it is open
+	size_t nFileSize = nIndexOffset + nIndexSize;
+	EnterCriticalSection(&m_FlushLock);
+	FlushViewOfFile(m_pView, nFileSize);
+	UnmapViewOfFile(m_pView);
+	CloseHandle(m_hMapping);
+
+	LARGE_INTEGER fileEnd; fileEnd.QuadPart = (LONGLONG)nFileSize;
+	if (SetFilePointerEx(m_hFile, fileEnd, NULL, FILE_BEGIN)) SetEndOfFile(m_hFile);
+	CloseHandle(m_hFile);
+
+	m_pView = NULL;
+	m_hMapping = NULL;
+	m_hFile = INVALID_HANDLE_VALUE;
+	m_nMappedSize = 0;
+	LeaveCriticalSection(&m_FlushLock);
+	m_nSegmentIndex++;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------------------
+
+// Starts a new capture at segment 0
+bool fulcrum_segment::Open(LPCTSTR szFirstPath, uint64_t nSegmentSize, uint32_t nFileFlags)
+{
+	Close();
+
+	// Split off the extension so later segments can be numbered
+	m_strBasePath = szFirstPath;
+	m_strExtension.clear();
+	size_t iExtension = m_strBasePath.find_last_of(_T('.'));
+	size_t iDirectory = m_strBasePath.find_last_of(_T("\\/"));
+	if (iExtension != tstring::npos && (iDirectory == tstring::npos || iExtension > iDirectory)) {
+		m_strExtension = m_strBasePath.substr(iExtension);
+		m_strBasePath.resize(iExtension);
+	}
+
+	m_nSegmentSize = nSegmentSize;
+	m_nSegmentIndex = 0;
+	m_nFileFlags = nFileFlags;
+	m_nRecordCount = 0;
+	m_nLastTimestamp = 0;
+
+	// Boot the flusher the first time we have anything for it to do
+	if (m_hFlusherThread == NULL) {
+		m_hFlusherWake = CreateEvent(NULL, FALSE, FALSE, NULL);
+		m_hFlusherDone = CreateEvent(NULL, TRUE, FALSE, NULL);
+		m_hFlusherThread = CreateThread(NULL, 0, FlusherThread, this, 0, NULL);
+	}
+
+	return OpenSegment(0);
+}
+void fulcrum_segment::Close()
+{
+	FinishSegment();
+}
+
+// Finishes the current segment and starts the next one even though it isn't full yet
+bool fulcrum_segment::Roll()
+{
+	if (m_pView == NULL) return false;
+	FinishSegment();
+	return OpenSegment(0);
+}
+
+// True when a record of this size fits in the current segment without rolling over
+bool fulcrum_segment::HasRoom(size_t nBytes) const
+{
+	if (m_pView == NULL) return false;
+	return m_nWriteOffset.load(std::memory_order_relaxed) + nBytes + IndexRecordSize(m_IndexEntries.size() + 1) <= m_nMappedSize;
+}
+
+// Copies one record into the mapped segment. Rolls over to the next segment when this one is full
+bool fulcrum_segment::Append(const unsigned char* pRecord, size_t nBytes)
+{
+	if (m_pView == NULL) return false;
+
+	uint64_t recordTimestamp = 0;
+	if (nBytes >= sizeof(fulcrum_capture_record_header))
+		recordTimestamp = ((const fulcrum_capture_record_header*)pRecord)->Timestamp;
+
+	// Always leave room for the footer index, including an entry for this record
+	size_t nOffset = m_nWriteOffset.load(std::memory_order_relaxed);
+	if (nOffset + nBytes + IndexRecordSize(m_IndexEntries.size() + 1) > m_nMappedSize)
+	{
+		FinishSegment();
+		if (!OpenSegment(nBytes)) return false;
+		nOffset = m_nWriteOffset.load(std::memory_order_relaxed);
+	}
+
+	// The first record of a segment fills in its starting time
+	if (nOffset == SegmentHeaderSize) {
+		size_t nTimestampOffset = sizeof(fulcrum_capture_file_header) + offsetof(fulcrum_capture_segment_header, FirstTimestamp);
+		memcpy(m_pView + nTimestampOffset, &recordTimestamp, sizeof(recordTimestamp));
+	}
+
+	// Drop an index entry every so often so readers can seek without walking the whole file
+	if (nOffset >= m_nNextIndexOffset) {
+		fulcrum_capture_index_entry indexEntry;
+		indexEntry.Offset = nOffset;
+		indexEntry.RecordNumber = m_nRecordCount;
+		indexEntry.Timestamp = recordTimestamp;
+		m_IndexEntries.push_back(indexEntry);
+		m_nNextIndexOffset = nOffset + FULCRUM_SEGMENT_INDEX_INTERVAL;
+	}
+
+	memcpy(m_pView + nOffset, pRecord, nBytes);
+	m_nWriteOffset.store(nOffset + nBytes, std::memory_order_release);
+	m_nLastTimestamp = recordTimestamp;
+	m_nRecordCount++;
+	return true;
+}
+
+// Flushing is left to the flusher thread
+void fulcrum_segment::Flush()
+{
+	if (m_hFlusherWake != NULL) SetEvent(m_hFlusherWake);
+}
+void fulcrum_segment::Shutdown(DWORD dwWaitMilliseconds)
+{
+	Close();
+	if (m_hFlusherThread == NULL) return;
+
+	// Wait on the done event rather than the thread. The loader lock may be held if the DLL is unloading
+	m_fFlusherStopping.store(true, std::memory_order_release);
+	SetEvent(m_hFlusherWake);
+	WaitForSingleObject(m_hFlusherDone, dwWaitMilliseconds);
+}
+
+// Pushes dirty pages of the current segment to disk once a second or whenever we're asked to
+DWORD WINAPI fulcrum_segment::FlusherThread(LPVOID lpParameter)
+{
+	fulcrum_segment* pSegment = (fulcrum_segment*)lpParameter;
+	while (!pSegment->m_fFlusherStopping.load(std::memory_order_acquire))
+	{
+		WaitForSingleObject(pSegment->m_hFlusherWake, 1000);
+
+		EnterCriticalSection(&pSegment->m_FlushLock);
+		if (pSegment->m_pView != NULL)
+		{
+			size_t nWritten = pSegment->m_nWriteOffset.load(std::memory_order_acquire);
+			if (nWritten > pSegment->m_nFlushedOffset) {
+				FlushViewOfFile(pSegment->m_pView + pSegment->m_nFlushedOffset, nWritten - pSegment->m_nFlushedOffset);
+				pSegment->m_nFlushedOffset = nWritten;
+			}
+		}
+		LeaveCriticalSection(&pSegment->m_FlushLock);
+	}
+
+	SetEvent(pSegment->m_hFlusherDone);
+	return 0;
+}
\ No newline at end of file
@@ -0,0 +1,105 @@
+/*
+**
+** Copyright (C) 2022 MEAT Inc
+** Author: Zack Walsh <neo.smith@motorengineeringandtech.com>
+**
+** This library is free software; you can redistribute it and/or modify
+** it under the terms of the GNU Lesser General Public License as published
+** by the Free Software Foundation, either version 3 of the License, or (at
+** your option) any later version.
+**
+** This library is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+** Lesser General Public License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public
+** License along with this library; if not, <http://www.gnu.org/licenses/>.
+**
+*/
+
+
+#pragma once
+
+// Standard Imports
+#include <atomic>
+#include <stdint.h>
+#include <tchar.h>
+#include <vector>
+
+// Fulcrum Resource Imports
+#include "fulcrum_loader.h"		// for TSTRING
+#include "fulcrum_capture_format.h"
+
+// Default size for capture segments and how often the footer index gets an entry
+#define FULCRUM_SEGMENT_DEFAULT_SIZE (32 * 1024 * 1024)
+#define FULCRUM_SEGMENT_INDEX_INTERVAL (256 * 1024)
+
+// Writes a capture into preallocated, memory mapped segment files. Each record is appended with a
+// single memcpy into the mapped view. When a segment fills up we write its footer index, trim the
+// file down to what was used, and carry on in the next one (name_001.shimBin, name_002.shimBin, ...).
+// Dirty pages are pushed to disk by a flusher thread so the writer never waits on the disk
+class fulcrum_segment {
+public:
+	fulcrum_segment();
+	~fulcrum_segment();
+
+	// Starts a new capture. The first segment uses the path as given
+	bool Open(LPCTSTR szFirstPath, uint64_t nSegmentSize = FULCRUM_SEGMENT_DEFAULT_SIZE, uint32_t nFileFlags = 0);
+	void Close();
+	bool IsOpen() const { return m_pView != NULL; }
+
+	// Appends a complete capture record. Only one thread may append at a time
+	bool Append(const unsigned char* pRecord, size_t nBytes);
+	bool HasRoom(size_t nBytes) const;
+
+	// Closes out the current segment early and moves on to the next one
+	bool Roll();
+
+	// Asks the flusher thread to push what we've written so far out to disk
+	void Flush();
+
+	// Finishes the capture and stops the flusher thread. Called when the DLL is going away
+	void Shutdown(DWORD dwWaitMilliseconds);
+
+	// Counters for the capture
+	uint32_t SegmentCount() const { return m_nSegmentIndex + (IsOpen() ? 1 : 0); }
+	uint32_t SegmentIndex() const { return m_nSegmentIndex; }
+	uint64_t SegmentBytes() const { return m_nWriteOffset.load(std::memory_order_relaxed); }
+	uint64_t RecordCount() const { return m_nRecordCount; }
+
+private:
+	tstring SegmentPath(uint32_t nSegmentIndex) const;
+	bool OpenSegment(size_t nFirstRecordSize);
+	void FinishSegment();
+	static size_t IndexRecordSize(size_t nEntries);
+	static DWORD WINAPI FlusherThread(LPVOID lpParameter);
+
+	// Path pieces for naming segments
+	tstring m_strBasePath;
+	tstring m_strExtension;
+	uint64_t m_nSegmentSize;
+	uint32_t m_nSegmentIndex;
+	uint32_t m_nFileFlags;
+
+	// Current segment. The flush lock covers swapping these out while the flusher is using them
+	HANDLE m_hFile;
+	HANDLE m_hMapping;
+	unsigned char* m_pView;
+	size_t m_nMappedSize;
+	std::atomic<size_t> m_nWriteOffset;
+	size_t m_nFlushedOffset;
+	CRITICAL_SECTION m_FlushLock;
+
+	// Footer index for the current segment
+	std::vector<fulcrum_capture_index_entry> m_IndexEntries;
+	size_t m_nNextIndexOffset;
+	uint64_t m_nRecordCount;
+	uint64_t m_nLastTimestamp;
+
+	// Flusher thread. Started with the first segment and left running until Shutdown()
+	HANDLE m_hFlusherThread;
+	HANDLE m_hFlusherWake;
+	HANDLE m_hFlusherDone;
+	std::atomic<bool> m_fFlusherStopping;
+};
\ No newline at end of file
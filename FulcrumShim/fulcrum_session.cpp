@@ -0,0 +1,376 @@
+/*
+**
+** Copyright (C) 2022 MEAT Inc
+** Author: Zack Walsh <neo.smith@motorengineeringandtech.com>
+**
+** This library is free software; you can redistribute it and/or modify
+** it under the terms of the GNU Lesser General Public License as published
+** by the Free Software Foundation, either version 3 of the License, or (at
+** your option) any later version.
+**
+** This library is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+** Lesser General Public License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public
+** License along with this library; if not, <http://www.gnu.org/licenses/>.
+**
+*/
+
+
+// Standard Imports
+#include "stdafx.h"
+#include <tchar.h>
+#include <vector>
+
+// Fulcrum Resource Imports
+#include "fulcrum_session.h"
+#include "fulcrum_capture_format.h"
+#include "fulcrum_lz.h"
+
+// Space held back in a capture segment for the format definitions a record may need written first
+static const size_t SessionDefineReserve = 16 * 1024;
+
+// How often the manifest gets rewritten while a segment is being written (milliseconds)
+static const unsigned long long ManifestInterval = 5000;
+
+// Longest a partly filled compressed block waits before it's written anyway (milliseconds)
+static const unsigned long long BlockMaxAge = 1000;
+
+// FILETIME ticks per second
+static const unsigned long long TicksPerSecond = 10000000ULL;
+
+// CTOR and DCTOR. Nothing is opened until the first session starts
+fulcrum_session::fulcrum_session()
+	: m_nSegmentIndex(0)
+	, m_fpLog(NULL)
+	, m_nLogBytes(0)
+	, m_nBlockSize(0)
+	, m_nBlockRecords(0)
+	, m_nBlockTimestamp(0)
+	, m_nBlockTicks(0)
+	, m_nManifestTicks(0)
+{
+	m_Limits.MaxSegmentBytes = 0;
+	m_Limits.MaxSegmentSeconds = 0;
+	m_Limits.MaxSegments = 0;
+	m_Limits.MaxTotalBytes = 0;
+}
+fulcrum_session::~fulcrum_session()
+{
+	Close();
+}
+
+// ---------------------------------------------------------------------------------------------------------------------------------
+
+// Segment 0 keeps the name it was given. The rest get a number before the extension
+tstring fulcrum_session::SegmentPath(uint32_t nSegmentIndex, LPCTSTR szExtension) const
+{
+	if (nSegmentIndex == 0) return m_strBasePath + szExtension;
+
+	TCHAR szSuffix[16];
+	_stprintf_s(szSuffix, _countof(szSuffix), _T("_%03u"), nSegmentIndex);
+	return m_strBasePath + szSuffix + szExtension;
+}
+
+// Current wall clock time in FILETIME ticks
+unsigned long long fulcrum_session::CurrentTime()
+{
+	FILETIME fileTime;
+	GetSystemTimeAsFileTime(&fileTime);
+	return ((unsigned long long)fileTime.dwHighDateTime << 32) | fileTime.dwLowDateTime;
+}
+
+// Opens the text log for the current segment and adds the segment to our list
+bool fulcrum_session::OpenLogFile()
+{
+	tstring strLogPath = SegmentPath(m_nSegmentIndex, m_strLogExtension.c_str());
+	_tfopen_s(&m_fpLog, strLogPath.c_str(), _T("w, ccs=UTF-8"));
+	if (m_fpLog == NULL) return false;
+
+	fulcrum_session_segment newSegment;
+	newSegment.Index = m_nSegmentIndex;
+	newSegment.LogPath = strLogPath;
+	if (m_Capture.IsOpen()) newSegment.CapturePath = SegmentPath(m_nSegmentIndex, _T(FULCRUM_CAPTURE_EXTENSION));
+	newSegment.FirstTime = 0;
+	newSegment.LastTime = 0;
+	newSegment.Lines = 0;
+	newSegment.Captures = 0;
+	newSegment.LogBytes = 0;
+	newSegment.CaptureBytes = 0;
+	newSegment.Open = true;
+	m_Segments.push_back(newSegment);
+	m_nLogBytes = 0;
+
+	// Point anyone reading a later segment back at the one before it
+	if (m_nSegmentIndex > 0) {
+		tstring strPrevious = SegmentPath(m_nSegmentIndex - 1, m_strLogExtension.c_str());
+		int nLength = _ftprintf(m_fpLog, _T("-->       Session log segment %u. Continued from %s\n"),
+			m_nSegmentIndex, strPrevious.c_str() + strPrevious.find_last_of(_T("\\/")) + 1);
+		if (nLength > 0) m_nLogBytes += nLength;
+	}
+
+	return true;
+}
+
+// Closes the text log for the current segment
+void fulcrum_session::FinishLogFile()
+{
+	if (m_fpLog == NULL) return;
+	fclose(m_fpLog);
+	m_fpLog = NULL;
+	if (!m_Segments.empty()) m_Segments.back().Open = false;
+}
+
+// Moves the text log and capture on to the next segment
+void fulcrum_session::Roll()
+{
+	// Pending records belong to the segment we're leaving. The capture may have
+	// already rolled itself over when a record didn't fit
+	WriteBlock();
+	FinishLogFile();
+	if (m_Capture.IsOpen() && m_Capture.SegmentIndex() == m_nSegmentIndex) m_Capture.Roll();
+	m_nSegmentIndex++;
+
+	OpenLogFile();
+	ApplyRetention();
+	WriteManifest();
+}
+
+// Deletes the oldest segments until the session is back inside its retention limits.
+// The segment being written is never deleted
+void fulcrum_session::ApplyRetention()
+{
+	while (m_Segments.size() > 1)
+	{
+		uint64_t nTotalBytes = 0;
+		for (size_t segmentIndex = 0; segmentIndex < m_Segments.size(); segmentIndex++)
+			nTotalBytes += m_Segments[segmentIndex].LogBytes + m_Segments[segmentIndex].CaptureBytes;
+
+		bool fTooMany = m_Limits.MaxSegments != 0 && m_Segments.size() > m_Limits.MaxSegments;
+		bool fTooLarge = m_Limits.MaxTotalBytes != 0 && nTotalBytes > m_Limits.MaxTotalBytes;
+		if (!fTooMany && !fTooLarge) break;
+
+		const fulcrum_session_segment& oldestSegment = m_Segments.front();
+		DeleteFile(oldestSegment.LogPath.c_str());
+		if (!oldestSegment.CapturePath.empty()) DeleteFile(oldestSegment.CapturePath.c_str());
+		m_Segments.erase(m_Segments.begin());
+	}
+}
+
+// Rewrites the manifest. Written to a temp file first so readers never see half of one
+void fulcrum_session::WriteManifest()
+{
+	m_nManifestTicks = GetTickCount64();
+	if (m_Segments.empty()) return;
+
+	tstring strManifestPath = m_strBasePath + _T(FULCRUM_MANIFEST_EXTENSION);
+	tstring strTempPath = strManifestPath + _T(".tmp");
+	FILE* fpManifest = NULL;
+	_tfopen_s(&fpManifest, strTempPath.c_str(), _T("w, ccs=UTF-8"));
+	if (fpManifest == NULL) return;
+
+	_fputts(_T("# FulcrumShim session manifest. One line per segment still on disk, oldest first. Times are local\n"), fpManifest);
+	_fputts(_T("# Segment\tState\tFirst Time\tLast Time\tLines\tCaptures\tLog Bytes\tCapture Bytes\tLog File\tCapture File\n"), fpManifest);
+	for (size_t segmentIndex = 0; segmentIndex < m_Segments.size(); segmentIndex++)
+	{
+		// Times are left as a dash until the segment has something in it
+		const fulcrum_session_segment& sessionSegment = m_Segments[segmentIndex];
+		TCHAR szTimes[2][32];
+		unsigned long long segmentTimes[2] = { sessionSegment.FirstTime, sessionSegment.LastTime };
+		for (int timeIndex = 0; timeIndex < 2; timeIndex++)
+		{
+			FILETIME utcTime, localTime; SYSTEMTIME systemTime;
+			utcTime.dwLowDateTime = (DWORD)segmentTimes[timeIndex];
+			utcTime.dwHighDateTime = (DWORD)(segmentTimes[timeIndex] >> 32);
+			if (segmentTimes[timeIndex] == 0 || !FileTimeToLocalFileTime(&utcTime, &localTime) || !FileTimeToSystemTime(&localTime, &systemTime))
+				_tcscpy_s(szTimes[timeIndex], _countof(szTimes[timeIndex]), _T("-"));
+			else _stprintf_s(szTimes[timeIndex], _countof(szTimes[timeIndex]), _T("%04u-%02u-%02u %02u:%02u:%02u.%03u"),
+				systemTime.wYear, systemTime.wMonth, systemTime.wDay,
+				systemTime.wHour, systemTime.wMinute, systemTime.wSecond, systemTime.wMilliseconds);
+		}
+
+		// Files are listed by name only. They always sit next to the manifest
+		LPCTSTR szLogFile = sessionSegment.LogPath.c_str() + sessionSegment.LogPath.find_last_of(_T("\\/")) + 1;
+		LPCTSTR szCaptureFile = sessionSegment.CapturePath.empty() ? _T("-") :
+			sessionSegment.CapturePath.c_str() + sessionSegment.CapturePath.find_last_of(_T("\\/")) + 1;
+		_ftprintf(fpManifest, _T("%u\t%s\t%s\t%s\t%llu\t%llu\t%llu\t%llu\t%s\t%s\n"),
+			sessionSegment.Index, sessionSegment.Open ? _T("Open") : _T("Closed"), szTimes[0], szTimes[1],
+			sessionSegment.Lines, sessionSegment.Captures, sessionSegment.LogBytes, sessionSegment.CaptureBytes,
+			szLogFile, szCaptureFile);
+	}
+
+	fclose(fpManifest);
+	MoveFileEx(strTempPath.c_str(), strManifestPath.c_str(), MOVEFILE_REPLACE_EXISTING);
+}
+
+// Bytes a compressed block record can take up for a given amount of record data
+size_t fulcrum_session::BlockRecordSize(size_t nRawBytes)
+{
+	return sizeof(fulcrum_capture_record_header) + sizeof(fulcrum_capture_field_header) +
+		sizeof(fulcrum_capture_block_header) + fulcrumLZ_Bound(nRawBytes);
+}
+
+// Appends a finished record to the capture segment and keeps the text in step if the capture rolled itself over
+bool fulcrum_session::AppendCapture(const unsigned char* pRecord, size_t nBytes)
+{
+	if (m_Segments.empty() || !m_Capture.Append(pRecord, nBytes)) return false;
+	if (m_Capture.SegmentIndex() != m_nSegmentIndex) Roll();
+	m_Segments.back().CaptureBytes = m_Capture.SegmentBytes();
+	return true;
+}
+
+// Packs the pending records into one block record and appends it. Blocks that don't shrink are stored as they are
+void fulcrum_session::WriteBlock()
+{
+	if (m_Block.empty()) return;
+
+	const size_t nHeaderSize = sizeof(fulcrum_capture_record_header) + sizeof(fulcrum_capture_field_header) + sizeof(fulcrum_capture_block_header);
+	m_PackedBlock.resize(BlockRecordSize(m_Block.size()));
+	size_t nPacked = fulcrumLZ_Compress(&m_Block[0], m_Block.size(), &m_PackedBlock[nHeaderSize], m_PackedBlock.size() - nHeaderSize);
+	bool fStored = nPacked == 0 || nPacked >= m_Block.size();
+	if (fStored) {
+		memcpy(&m_PackedBlock[nHeaderSize], &m_Block[0], m_Block.size());
+		nPacked = m_Block.size();
+	}
+
+	fulcrum_capture_record_header recordHeader;
+	recordHeader.Length = (uint32_t)(nHeaderSize + nPacked);
+	recordHeader.Type = CAPTURE_COMPRESSED_BLOCK;
+	recordHeader.Function = CAPTURE_FN_NONE;
+	recordHeader.Timestamp = m_nBlockTimestamp;
+	recordHeader.ThreadID = GetCurrentThreadId();
+	recordHeader.FieldCount = 1;
+	fulcrum_capture_field_header fieldHeader;
+	fieldHeader.Tag = FIELD_BLOCK_DATA;
+	fieldHeader.Index = 0;
+	fieldHeader.Flags = fStored ? FIELD_FLAG_STORED : 0;
+	fieldHeader.Length = (uint32_t)(sizeof(fulcrum_capture_block_header) + nPacked);
+	fulcrum_capture_block_header blockHeader;
+	blockHeader.RawSize = (uint32_t)m_Block.size();
+	blockHeader.RecordCount = m_nBlockRecords;
+	memcpy(&m_PackedBlock[0], &recordHeader, sizeof(recordHeader));
+	memcpy(&m_PackedBlock[sizeof(recordHeader)], &fieldHeader, sizeof(fieldHeader));
+	memcpy(&m_PackedBlock[sizeof(recordHeader) + sizeof(fieldHeader)], &blockHeader, sizeof(blockHeader));
+
+	// Empty the block before appending. Appending can roll the session, which writes the pending block
+	m_Block.clear();
+	m_nBlockRecords = 0;
+	AppendCapture(&m_PackedBlock[0], recordHeader.Length);
+}
+
+// ---------------------------------------------------------------------------------------------------------------------------------
+
+// Starts a new session at segment 0
+bool fulcrum_session::Open(LPCTSTR szLogPath, const fulcrum_session_limits& sessionLimits, size_t nBlockSize)
+{
+	Close();
+
+	// Split off the extension so later segments can be numbered
+	m_strBasePath = szLogPath;
+	m_strLogExtension.clear();
+	size_t iExtension = m_strBasePath.find_last_of(_T('.'));
+	size_t iDirectory = m_strBasePath.find_last_of(_T("\\/"));
+	if (iExtension != tstring::npos && (iDirectory == tstring::npos || iExtension > iDirectory)) {
+		m_strLogExtension = m_strBasePath.substr(iExtension);
+		m_strBasePath.resize(iExtension);
+	}
+
+	m_Limits = sessionLimits;
+	m_nSegmentIndex = 0;
+	m_Segments.clear();
+	m_nBlockSize = nBlockSize;
+
+	// The capture is optional. The session carries on with just the text if it can't be made
+	uint32_t nCaptureFlags = m_nBlockSize != 0 ? FULCRUM_CAPTURE_FLAG_COMPRESSED : 0;
+	m_Capture.Open(SegmentPath(0, _T(FULCRUM_CAPTURE_EXTENSION)).c_str(), FULCRUM_SEGMENT_DEFAULT_SIZE, nCaptureFlags);
+	if (!OpenLogFile()) { m_Capture.Close(); return false; }
+
+	WriteManifest();
+	return true;
+}
+void fulcrum_session::Close()
+{
+	WriteBlock();
+	FinishLogFile();
+	m_Capture.Close();
+	if (m_Segments.empty()) return;
+
+	WriteManifest();
+	m_Segments.clear();
+}
+
+// Checks the size and time limits for the current segment before the next record goes into it
+bool fulcrum_session::RollIfNeeded(size_t nCaptureBytes)
+{
+	if (m_Segments.empty()) return false;
+	const fulcrum_session_segment& currentSegment = m_Segments.back();
+	bool fHasRecords = currentSegment.Lines != 0 || currentSegment.Captures != 0;
+
+	// Empty segments are never rolled, so a capture too big for any segment still gets one to itself
+	bool fRoll = false;
+	if (fHasRecords) {
+		if (m_Limits.MaxSegmentBytes != 0 && m_nLogBytes >= m_Limits.MaxSegmentBytes) fRoll = true;
+		if (m_Limits.MaxSegmentSeconds != 0 && CurrentTime() - currentSegment.FirstTime >= m_Limits.MaxSegmentSeconds * TicksPerSecond) fRoll = true;
+		if (nCaptureBytes != 0 && m_nBlockSize != 0) nCaptureBytes = BlockRecordSize(m_Block.size() + nCaptureBytes);
+		if (nCaptureBytes != 0 && m_Capture.IsOpen() && !m_Capture.HasRoom(nCaptureBytes + SessionDefineReserve)) fRoll = true;
+	}
+
+	if (fRoll) { Roll(); return true; }
+
+	// Keep the manifest close to current for anyone watching the session live
+	if (GetTickCount64() - m_nManifestTicks >= ManifestInterval) WriteManifest();
+	return false;
+}
+
+// Writes a line of text into the current segment
+void fulcrum_session::WriteText(LPCTSTR szText, size_t nLength)
+{
+	if (m_fpLog == NULL) return;
+	_fputts(szText, m_fpLog);
+	m_nLogBytes += nLength;
+
+	fulcrum_session_segment& currentSegment = m_Segments.back();
+	currentSegment.LastTime = CurrentTime();
+	if (currentSegment.FirstTime == 0) currentSegment.FirstTime = currentSegment.LastTime;
+	currentSegment.LogBytes = m_nLogBytes;
+	currentSegment.Lines++;
+}
+
+// Writes a capture record into the current segment, or into the pending block when we're compressing
+bool fulcrum_session::WriteCapture(const unsigned char* pRecord, size_t nBytes)
+{
+	if (m_Segments.empty() || !m_Capture.IsOpen()) return false;
+	if (m_nBlockSize == 0) {
+		if (!AppendCapture(pRecord, nBytes)) return false;
+	}
+	else {
+		if (m_Block.empty()) {
+			m_nBlockTicks = GetTickCount64();
+			m_nBlockTimestamp = nBytes >= sizeof(fulcrum_capture_record_header) ? ((const fulcrum_capture_record_header*)pRecord)->Timestamp : 0;
+		}
+		m_Block.insert(m_Block.end(), pRecord, pRecord + nBytes);
+		m_nBlockRecords++;
+		if (m_Block.size() >= m_nBlockSize) WriteBlock();
+	}
+
+	fulcrum_session_segment& currentSegment = m_Segments.back();
+	currentSegment.LastTime = CurrentTime();
+	if (currentSegment.FirstTime == 0) currentSegment.FirstTime = currentSegment.LastTime;
+	currentSegment.Captures++;
+	return true;
+}
+
+// Pushes both files for the current segment out to disk
+void fulcrum_session::Flush()
+{
+	if (!m_Block.empty() && GetTickCount64() - m_nBlockTicks >= BlockMaxAge) WriteBlock();
+	if (m_fpLog != NULL) fflush(m_fpLog);
+	m_Capture.Flush();
+}
+void fulcrum_session::Shutdown(DWORD dwWaitMilliseconds)
+{
+	Close();
+	m_Capture.Shutdown(dwWaitMilliseconds);
+}
\ No newline at end of file
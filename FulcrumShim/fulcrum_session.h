@@ -0,0 +1,130 @@
+/*
+**
+** Copyright (C) 2022 MEAT Inc
+** Author: Zack Walsh <neo.smith@motorengineeringandtech.com>
+**
+** This library is free software; you can redistribute it and/or modify
+** it under the terms of the GNU Lesser General Public License as published
+** by the Free Software Foundation, either version 3 of the License, or (at
+** your option) any later version.
+**
+** This library is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+** Lesser General Public License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public
+** License along with this library; if not, <http://www.gnu.org/licenses/>.
+**
+*/
+
+
+#pragma once
+
+// Standard Imports
+#include <stdint.h>
+#include <stdio.h>
+#include <tchar.h>
+#include <vector>
+
+// Fulcrum Resource Imports
+#include "fulcrum_loader.h"		// for TSTRING
+#include "fulcrum_segment.h"
+
+// Extension of the manifest written next to a session's log files
+#define FULCRUM_MANIFEST_EXTENSION ".shimManifest"
+
+// When a session rolls over to a new segment and how much of it we keep around. 0 turns a limit off
+struct fulcrum_session_limits {
+	uint64_t MaxSegmentBytes;		// Text bytes in one .shimLog segment
+	uint32_t MaxSegmentSeconds;		// Wall clock time covered by one segment
+	uint32_t MaxSegments;			// Segments kept on disk, including the one being written
+	uint64_t MaxTotalBytes;			// Log and capture bytes kept on disk, including the one being written
+};
+
+// One segment of a session as listed in the manifest
+struct fulcrum_session_segment {
+	uint32_t Index;
+	tstring LogPath;
+	tstring CapturePath;
+	unsigned long long FirstTime;	// FILETIME ticks of the first write (0 if nothing was written)
+	unsigned long long LastTime;	// FILETIME ticks of the last write
+	uint64_t Lines;
+	uint64_t Captures;
+	uint64_t LogBytes;
+	uint64_t CaptureBytes;
+	bool Open;
+};
+
+// Writes a session's .shimLog text and .shimBin capture as rolling segments. Both roll over together
+// (name.shimLog/.shimBin, then name_001.shimLog/.shimBin, ...) once a segment goes past its size or time
+// limit. A manifest next to them lists every segment with its time range and message counts so the
+// Injector can open only the part of a session it wants. Captures can be compressed in blocks on
+// the way into their segment. Only the log writer thread may use this
+class fulcrum_session {
+public:
+	fulcrum_session();
+	~fulcrum_session();
+
+	// Starts a session. The first segment uses the log path as given. A block size turns on
+	// capture compression, with records packed into blocks of about that many bytes
+	bool Open(LPCTSTR szLogPath, const fulcrum_session_limits& sessionLimits, size_t nBlockSize = 0);
+	void Close();
+	bool IsOpen() const { return m_fpLog != NULL; }
+	bool CaptureOpen() const { return m_Capture.IsOpen(); }
+
+	// Rolls over to a new segment when the next record would put this one past its limits.
+	// Returns true when it did, so anything tied to the old segment can be written again
+	bool RollIfNeeded(size_t nCaptureBytes);
+
+	// Writes to the current segment
+	FILE* LogFile() const { return m_fpLog; }
+	void WriteText(LPCTSTR szText, size_t nLength);
+	bool WriteCapture(const unsigned char* pRecord, size_t nBytes);
+
+	// Pushes what we've written out to disk, along with a compressed block once it's been waiting a while
+	void Flush();
+	bool HasPendingBlock() const { return !m_Block.empty(); }
+
+	// Finishes the session and stops the capture flusher. Called when the DLL is going away
+	void Shutdown(DWORD dwWaitMilliseconds);
+
+	// Segment counters
+	uint32_t SegmentIndex() const { return m_nSegmentIndex; }
+	size_t SegmentsKept() const { return m_Segments.size(); }
+
+private:
+	tstring SegmentPath(uint32_t nSegmentIndex, LPCTSTR szExtension) const;
+	bool OpenLogFile();
+	void FinishLogFile();
+	void Roll();
+	void ApplyRetention();
+	bool AppendCapture(const unsigned char* pRecord, size_t nBytes);
+	void WriteBlock();
+	static size_t BlockRecordSize(size_t nRawBytes);
+	void WriteManifest();
+	static unsigned long long CurrentTime();
+
+	// Path pieces for naming segments and the limits we roll and retain by
+	tstring m_strBasePath;
+	tstring m_strLogExtension;
+	fulcrum_session_limits m_Limits;
+	uint32_t m_nSegmentIndex;
+
+	// Current segment files. Captures go through the memory mapped segment writer
+	FILE* m_fpLog;
+	fulcrum_segment m_Capture;
+	uint64_t m_nLogBytes;
+
+	// Capture records waiting to be compressed into the next block, and the buffer the block is packed into
+	size_t m_nBlockSize;
+	std::vector<unsigned char> m_Block;
+	std::vector<unsigned char> m_PackedBlock;
+	uint32_t m_nBlockRecords;
+	uint64_t m_nBlockTimestamp;
+	unsigned long long m_nBlockTicks;
+
+	// Every segment still on disk, oldest first. The last one is the one being written
+	std::vector<fulcrum_session_segment> m_Segments;
+	unsigned long long m_nManifestTicks;
+};
\ No newline at end of file
@@ -0,0 +1,118 @@
+/*
+**
+** Copyright (C) 2022 MEAT Inc
+** Author: Zack Walsh <neo.smith@motorengineeringandtech.com>
+**
+** This library is free software; you can redistribute it and/or modify
+** it under the terms of the GNU Lesser General Public License as published
+** by the Free Software Foundation, either version 3 of the License, or (at
+** your option) any later version.
+**
+** This library is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+** Lesser General Public License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public
+** License along with this library; if not, <http://www.gnu.org/licenses/>.
+**
+*/
+
+// Standard Imports
+#include "stdafx.h"
+#include <string.h>
+
+// Fulcrum Resource Imports
+#include "fulcrum_shmring.h"
+
+// CTOR and DCTOR. Nothing is mapped until Create()
+fulcrum_shmring::fulcrum_shmring()
+	: m_hMapping(NULL)
+	, m_hDoorbell(NULL)
+	, m_pHeader(NULL)
+	, m_pData(NULL)
+	, m_nCapacity(0)
+	, m_fPublished(false)
+	, m_nDropped(0)
+{
+}
+fulcrum_shmring::~fulcrum_shmring()
+{
+	Close();
+}
+
+// ---------------------------------------------------------------------------------------------------------------------------------
+
+// Builds the mapping and the doorbell and fills in the header for the Injector to find
+bool fulcrum_shmring::Create(uint32_t nCapacity)
+{
+	if (IsOpen()) return true;
+
+	// Capacity has to be a power of two so indexes can be masked into the ring
+	uint32_t nRingSize = 4096;
+	while (nRingSize < nCapacity && nRingSize < 0x40000000) nRingSize <<= 1;
+
+	DWORD dwMapSize = (DWORD)(sizeof(fulcrum_shmring_header) + nRingSize);
+	HANDLE hMapping = CreateFileMapping(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0, dwMapSize, FULCRUM_SHMRING_NAME);
+	if (hMapping == NULL) return false;
+	if (GetLastError() == ERROR_ALREADY_EXISTS) {
+		// Some other process loaded the shim first. That one keeps the ring, we stay on the pipe
+		CloseHandle(hMapping);
+		return false;
+	}
+
+	unsigned char* pView = (unsigned char*)MapViewOfFile(hMapping, FILE_MAP_WRITE, 0, 0, dwMapSize);
+	HANDLE hDoorbell = pView == NULL ? NULL : CreateEvent(NULL, FALSE, FALSE, FULCRUM_SHMRING_DOORBELL_NAME);
+	if (hDoorbell == NULL) {
+		if (pView != NULL) UnmapViewOfFile(pView);
+		CloseHandle(hMapping);
+		return false;
+	}
+
+	// New mappings come back zeroed
+	fulcrum_shmring_header* pHeader = (fulcrum_shmring_header*)pView;
+	fulcrumShmRing_Init(pHeader, nRingSize, GetCurrentProcessId());
+
+	m_hMapping = hMapping;
+	m_hDoorbell = hDoorbell;
+	m_pHeader = pHeader;
+	m_pData = pView + sizeof(fulcrum_shmring_header);
+	m_nCapacity = nRingSize;
+	m_fPublished = false;
+	return true;
+}
+void fulcrum_shmring::Close()
+{
+	if (m_pHeader != NULL) UnmapViewOfFile(m_pHeader);
+	if (m_hMapping != NULL) CloseHandle(m_hMapping);
+	if (m_hDoorbell != NULL) CloseHandle(m_hDoorbell);
+	m_pHeader = NULL; m_pData = NULL;
+	m_hMapping = NULL; m_hDoorbell = NULL;
+	m_nCapacity = 0;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------------------
+
+// The Injector says it's there by writing its version into the header
+bool fulcrum_shmring::Connected() const
+{
+	if (m_pHeader == NULL) return false;
+	return m_pHeader->ConsumerVersion.load(std::memory_order_acquire) == FULCRUM_SHMRING_VERSION;
+}
+
+// Copies an entry in at the write index and publishes it. Drops are counted here as well as in the header
+bool fulcrum_shmring::Publish(fulcrum_shmring_kind entryKind, const void* pData, size_t nBytes)
+{
+	if (m_pHeader == NULL) return false;
+	if (!fulcrumShmRing_Publish(m_pHeader, m_pData, entryKind, pData, nBytes)) { m_nDropped++; return false; }
+	m_fPublished = true;
+	return true;
+}
+
+// One doorbell per batch instead of one per entry
+void fulcrum_shmring::Ring()
+{
+	if (!m_fPublished || m_hDoorbell == NULL) return;
+	m_fPublished = false;
+	SetEvent(m_hDoorbell);
+}
\ No newline at end of file
@@ -0,0 +1,70 @@
+/*
+**
+** Copyright (C) 2022 MEAT Inc
+** Author: Zack Walsh <neo.smith@motorengineeringandtech.com>
+**
+** This library is free software; you can redistribute it and/or modify
+** it under the terms of the GNU Lesser General Public License as published
+** by the Free Software Foundation, either version 3 of the License, or (at
+** your option) any later version.
+**
+** This library is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+** Lesser General Public License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public
+** License along with this library; if not, <http://www.gnu.org/licenses/>.
+**
+*/
+
+#pragma once
+
+// Standard Imports
+#include <stdint.h>
+#include <tchar.h>
+
+// Fulcrum Resource Imports
+#include "fulcrum_shmring_layout.h"
+
+// Shared memory transport for the Injector. The shim is the only producer and the Injector the only
+// consumer. Entries are copied straight into the mapped ring and the doorbell event is set once per
+// batch, so nothing goes through the kernel per line the way pipe writes do. The ring itself is laid
+// out and indexed by fulcrum_shmring_layout.h; this class only owns the mapping and the doorbell.
+//
+// Handshake: the shim creates the mapping and fills in the header. The Injector maps it and stores
+// its version in ConsumerVersion. Until that matches FULCRUM_SHMRING_VERSION (or once the Injector
+// sets it back to 0) the shim keeps using the named pipe.
+#define FULCRUM_SHMRING_NAME _T("Local\\FulcrumShimRing_2CC3F0FB08354929BB453151BBAA5A15")
+#define FULCRUM_SHMRING_DOORBELL_NAME _T("Local\\FulcrumShimRing_2CC3F0FB08354929BB453151BBAA5A15_Doorbell")
+
+class fulcrum_shmring {
+public:
+	fulcrum_shmring();
+	~fulcrum_shmring();
+
+	// Sets up the mapping and doorbell. Fails if another process already owns a ring with this name
+	bool Create(uint32_t nCapacity);
+	void Close();
+	bool IsOpen() const { return m_pHeader != NULL; }
+
+	// True once the Injector has attached with a version we understand
+	bool Connected() const;
+
+	// Copies one entry into the ring. Never waits. Returns false when the ring is full
+	bool Publish(fulcrum_shmring_kind entryKind, const void* pData, size_t nBytes);
+
+	// Wakes the Injector if anything was published since the last ring
+	void Ring();
+
+	unsigned long long Dropped() const { return m_nDropped; }
+
+private:
+	HANDLE m_hMapping;
+	HANDLE m_hDoorbell;
+	fulcrum_shmring_header* m_pHeader;
+	unsigned char* m_pData;
+	uint32_t m_nCapacity;
+	bool m_fPublished;
+	unsigned long long m_nDropped;
+};
\ No newline at end of file
@@ -0,0 +1,101 @@
+/*
+**
+** Copyright (C) 2022 MEAT Inc
+** Author: Zack Walsh <neo.smith@motorengineeringandtech.com>
+**
+** This library is free software; you can redistribute it and/or modify
+** it under the terms of the GNU Lesser General Public License as published
+** by the Free Software Foundation, either version 3 of the License, or (at
+** your option) any later version.
+**
+** This library is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+** Lesser General Public License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public
+** License along with this library; if not, <http://www.gnu.org/licenses/>.
+**
+*/
+
+// Standard Imports
+#include <string.h>
+
+// Fulcrum Resource Imports
+#include "fulcrum_shmring_layout.h"
+
+// Entries are padded out so the next one starts aligned
+static size_t fulcrumShmRing_EntrySize(size_t nBytes)
+{
+	return (sizeof(fulcrum_shmring_entry) + nBytes + FULCRUM_SHMRING_ALIGNMENT - 1) & ~(size_t)(FULCRUM_SHMRING_ALIGNMENT - 1);
+}
+
+// The magic goes in last so a reader never sees half a header
+void fulcrumShmRing_Init(fulcrum_shmring_header* pHeader, uint32_t nCapacity, uint32_t nProducerProcessID)
+{
+	pHeader->Version = FULCRUM_SHMRING_VERSION;
+	pHeader->Capacity = nCapacity;
+	pHeader->ProducerProcessID = nProducerProcessID;
+	pHeader->ConsumerVersion.store(0, std::memory_order_relaxed);
+	pHeader->WriteIndex.store(0, std::memory_order_relaxed);
+	pHeader->ReadIndex.store(0, std::memory_order_relaxed);
+	pHeader->DroppedEntries.store(0, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	memcpy(pHeader->Magic, FULCRUM_SHMRING_MAGIC, FULCRUM_SHMRING_MAGIC_SIZE);
+}
+
+// ---------------------------------------------------------------------------------------------------------------------------------
+
+// Room is checked for the pad and the entry together, so a pad is never written for an entry that then gets dropped
+bool fulcrumShmRing_Publish(fulcrum_shmring_header* pHeader, unsigned char* pData, fulcrum_shmring_kind entryKind, const void* pEntryData, size_t nBytes)
+{
+	uint32_t nCapacity = pHeader->Capacity;
+	size_t nEntrySize = fulcrumShmRing_EntrySize(nBytes);
+	if (nEntrySize > nCapacity / 2) { pHeader->DroppedEntries.fetch_add(1, std::memory_order_relaxed); return false; }
+
+	uint32_t nWriteIndex = pHeader->WriteIndex.load(std::memory_order_relaxed);
+	uint32_t nReadIndex = pHeader->ReadIndex.load(std::memory_order_acquire);
+	uint32_t nPosition = nWriteIndex & (nCapacity - 1);
+	uint32_t nTail = nCapacity - nPosition;
+	uint32_t nNeeded = (uint32_t)nEntrySize + (nTail < nEntrySize ? nTail : 0);
+	if (nCapacity - (nWriteIndex - nReadIndex) < nNeeded) { pHeader->DroppedEntries.fetch_add(1, std::memory_order_relaxed); return false; }
+
+	if (nTail < nEntrySize)
+	{
+		fulcrum_shmring_entry padEntry = { nTail - (uint32_t)sizeof(fulcrum_shmring_entry), SHMRING_PAD, 0 };
+		memcpy(pData + nPosition, &padEntry, sizeof(padEntry));
+		nWriteIndex += nTail;
+		nPosition = 0;
+	}
+
+	fulcrum_shmring_entry ringEntry = { (uint32_t)nBytes, (uint16_t)entryKind, 0 };
+	memcpy(pData + nPosition, &ringEntry, sizeof(ringEntry));
+	if (nBytes > 0) memcpy(pData + nPosition + sizeof(ringEntry), pEntryData, nBytes);
+
+	// Release makes the entry visible before the index that covers it
+	pHeader->WriteIndex.store(nWriteIndex + (uint32_t)nEntrySize, std::memory_order_release);
+	return true;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------------------
+
+// Pads are handed back as soon as they're seen since there's nothing in them to read
+const fulcrum_shmring_entry* fulcrumShmRing_Peek(fulcrum_shmring_header* pHeader, const unsigned char* pData)
+{
+	uint32_t nReadIndex = pHeader->ReadIndex.load(std::memory_order_relaxed);
+	while (nReadIndex != pHeader->WriteIndex.load(std::memory_order_acquire))
+	{
+		const fulcrum_shmring_entry* pEntry = (const fulcrum_shmring_entry*)(pData + (nReadIndex & (pHeader->Capacity - 1)));
+		if (pEntry->Kind != SHMRING_PAD) return pEntry;
+		nReadIndex += (uint32_t)fulcrumShmRing_EntrySize(pEntry->Length);
+		pHeader->ReadIndex.store(nReadIndex, std::memory_order_release);
+	}
+	return NULL;
+}
+
+// Release keeps the producer from reusing the room before we're done reading it
+void fulcrumShmRing_Release(fulcrum_shmring_header* pHeader, const fulcrum_shmring_entry* pEntry)
+{
+	uint32_t nReadIndex = pHeader->ReadIndex.load(std::memory_order_relaxed);
+	pHeader->ReadIndex.store(nReadIndex + (uint32_t)fulcrumShmRing_EntrySize(pEntry->Length), std::memory_order_release);
+}
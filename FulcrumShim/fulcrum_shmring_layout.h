@@ -0,0 +1,79 @@
+/*
+**
+** Copyright (C) 2022 MEAT Inc
+** Author: Zack Walsh <neo.smith@motorengineeringandtech.com>
+**
+** This library is free software; you can redistribute it and/or modify
+** it under the terms of the GNU Lesser General Public License as published
+** by the Free Software Foundation, either version 3 of the License, or (at
+** your option) any later version.
+**
+** This library is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+** Lesser General Public License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public
+** License along with this library; if not, <http://www.gnu.org/licenses/>.
+**
+*/
+
+#pragma once
+
+// Standard Imports
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+
+// Layout of the shared memory ring and the index math on it. fulcrum_shmring maps the ring and rings the
+// doorbell on Windows; everything here works on plain memory with no Windows headers, so the Injector's
+// side of the format and the tests can use the same code the shim publishes with.
+//
+//   Mapping: fulcrum_shmring_header, then Capacity data bytes
+//   Entry:   fulcrum_shmring_entry, then Length bytes, padded to FULCRUM_SHMRING_ALIGNMENT
+//
+// Indexes are free running byte counts, the ring position is the index masked by Capacity - 1.
+// An entry never wraps. One that won't fit before the end of the ring gets a pad entry in front
+// of it covering the rest of the ring, and starts over at the beginning.
+#define FULCRUM_SHMRING_MAGIC "FULCRUMR"
+#define FULCRUM_SHMRING_MAGIC_SIZE 8
+#define FULCRUM_SHMRING_VERSION 1
+#define FULCRUM_SHMRING_ALIGNMENT 8
+
+// Types of entries in the ring
+enum fulcrum_shmring_kind {
+	SHMRING_PAD = 0,			// Filler up to the end of the ring. Skip it and carry on from the start
+	SHMRING_TEXT = 1,			// Log line in UTF-8. Same text the pipe would have carried
+	SHMRING_CAPTURE = 2,		// Binary capture record (see fulcrum_capture_format.h)
+};
+
+// Sits at the start of the mapping. Each index lives on its own cache line
+struct fulcrum_shmring_header {
+	char Magic[FULCRUM_SHMRING_MAGIC_SIZE];
+	uint32_t Version;
+	uint32_t Capacity;					// Data bytes after this header. Always a power of two
+	uint32_t ProducerProcessID;
+	std::atomic<uint32_t> ConsumerVersion;
+	alignas(64) std::atomic<uint32_t> WriteIndex;
+	alignas(64) std::atomic<uint32_t> ReadIndex;
+	alignas(64) std::atomic<uint32_t> DroppedEntries;
+};
+
+// Leads every entry. Entries start on FULCRUM_SHMRING_ALIGNMENT boundaries
+struct fulcrum_shmring_entry {
+	uint32_t Length;			// Data bytes after this header
+	uint16_t Kind;
+	uint16_t Reserved;
+};
+
+// Fills in the header of a zeroed ring. Capacity has to be a power of two of at least 4096 bytes
+void fulcrumShmRing_Init(fulcrum_shmring_header* pHeader, uint32_t nCapacity, uint32_t nProducerProcessID);
+
+// Producer side. Copies one entry in at the write index and publishes it. Never waits. Returns false
+// and counts it in DroppedEntries when there isn't room, or the entry is over half the ring
+bool fulcrumShmRing_Publish(fulcrum_shmring_header* pHeader, unsigned char* pData, fulcrum_shmring_kind entryKind, const void* pEntryData, size_t nBytes);
+
+// Consumer side. Peek returns the next entry, stepping over pads, or NULL when the ring is empty.
+// The entry stays in place until Release() hands its room back to the producer
+const fulcrum_shmring_entry* fulcrumShmRing_Peek(fulcrum_shmring_header* pHeader, const unsigned char* pData);
+void fulcrumShmRing_Release(fulcrum_shmring_header* pHeader, const fulcrum_shmring_entry* pEntry);
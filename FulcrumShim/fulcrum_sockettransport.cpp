@@ -0,0 +1,261 @@
+/*
+**
+** Copyright (C) 2022 MEAT Inc
+** Author: Zack Walsh <neo.smith@motorengineeringandtech.com>
+**
+** This library is free software; you can redistribute it and/or modify
+** it under the terms of the GNU Lesser General Public License as published
+** by the Free Software Foundation, either version 3 of the License, or (at
+** your option) any later version.
+**
+** This library is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+** Lesser General Public License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public
+** License along with this library; if not, <http://www.gnu.org/licenses/>.
+**
+*/
+
+// Standard Imports
+#include <stdio.h>
+#include <string.h>
+#include <atomic>
+#include <mutex>
+
+// Winsock has had AF_UNIX since Windows 10 1803. Everywhere else it's plain POSIX sockets
+#ifdef _WIN32
+#include <winsock2.h>
+#include <afunix.h>
+#pragma comment(lib, "Ws2_32.lib")
+typedef SOCKET fulcrum_socket;
+#define FULCRUM_NO_SOCKET INVALID_SOCKET
+#define FULCRUM_SHUT_BOTH SD_BOTH
+#define FULCRUM_SEND_FLAGS 0
+#define fulcrumSocket_Close closesocket
+#else
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+typedef int fulcrum_socket;
+#define FULCRUM_NO_SOCKET (-1)
+#define FULCRUM_SHUT_BOTH SHUT_RDWR
+#define FULCRUM_SEND_FLAGS MSG_NOSIGNAL
+#define fulcrumSocket_Close close
+#endif
+
+// Fulcrum Resource Imports
+#include "fulcrum_transport.h"
+
+// How long the listener waits between checks for a cancel
+#define FULCRUM_SOCKET_ACCEPT_POLL_MS 100
+
+// ---------------------------------------------------------------------------------------------------------------------------------
+
+// Winsock has to be started once per user. POSIX doesn't need anything
+static bool fulcrumSocket_Startup()
+{
+#ifdef _WIN32
+	WSADATA wsaData;
+	return WSAStartup(MAKEWORD(2, 2), &wsaData) == 0;
+#else
+	return true;
+#endif
+}
+static void fulcrumSocket_Cleanup()
+{
+#ifdef _WIN32
+	WSACleanup();
+#endif
+}
+
+// Builds the socket address for a path. False when the path won't fit
+static bool fulcrumSocket_Address(const char* szPath, sockaddr_un& socketAddress)
+{
+	memset(&socketAddress, 0, sizeof(socketAddress));
+	socketAddress.sun_family = AF_UNIX;
+	if (szPath == NULL || strlen(szPath) >= sizeof(socketAddress.sun_path)) return false;
+	strcpy(socketAddress.sun_path, szPath);
+	return true;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------------------
+
+// Unix domain socket transport. A server has a listen socket and picks up peers from it,
+// a client only ever has the one socket it connected with. Peers a server hands out through
+// AcceptPeer() are server side too, so dropping them hangs up on the reader
+class fulcrum_socket_transport : public fulcrum_transport {
+public:
+	fulcrum_socket_transport(fulcrum_socket listenSocket, fulcrum_socket peerSocket, bool fServerSide)
+		: m_ListenSocket(listenSocket), m_PeerSocket(peerSocket), m_fServerSide(fServerSide), m_nMessageLeft(0), m_fCancelled(false) { }
+	virtual ~fulcrum_socket_transport()
+	{
+		if (m_PeerSocket != FULCRUM_NO_SOCKET) fulcrumSocket_Close(m_PeerSocket);
+		if (m_ListenSocket != FULCRUM_NO_SOCKET) fulcrumSocket_Close(m_ListenSocket);
+		fulcrumSocket_Cleanup();
+	}
+
+	virtual bool WaitForPeer()
+	{
+		{
+			std::lock_guard<std::mutex> peerLock(m_PeerLock);
+			if (m_fCancelled.load(std::memory_order_acquire)) return false;
+			if (m_PeerSocket != FULCRUM_NO_SOCKET) return true;
+			if (m_ListenSocket == FULCRUM_NO_SOCKET) return false;
+		}
+
+		fulcrum_socket peerSocket = AcceptSocket();
+		if (peerSocket == FULCRUM_NO_SOCKET) return false;
+
+		std::lock_guard<std::mutex> peerLock(m_PeerLock);
+		if (m_fCancelled.load(std::memory_order_acquire)) { fulcrumSocket_Close(peerSocket); return false; }
+		m_PeerSocket = peerSocket;
+		m_nMessageLeft = 0;
+		return true;
+	}
+
+	// Each accepted socket becomes a transport of its own. It gets its own Winsock reference
+	virtual fulcrum_transport* AcceptPeer()
+	{
+		if (m_ListenSocket == FULCRUM_NO_SOCKET) return NULL;
+		fulcrum_socket peerSocket = AcceptSocket();
+		if (peerSocket == FULCRUM_NO_SOCKET) return NULL;
+		if (!fulcrumSocket_Startup()) { fulcrumSocket_Close(peerSocket); return NULL; }
+		return new fulcrum_socket_transport(FULCRUM_NO_SOCKET, peerSocket, true);
+	}
+
+	// A client keeps its socket since it has no way to get another one
+	virtual void DropPeer()
+	{
+		std::lock_guard<std::mutex> peerLock(m_PeerLock);
+		if (!m_fServerSide || m_PeerSocket == FULCRUM_NO_SOCKET) return;
+		fulcrumSocket_Close(m_PeerSocket);
+		m_PeerSocket = FULCRUM_NO_SOCKET;
+	}
+
+	// Length first, then the message. Any socket error means the peer is gone
+	virtual fulcrum_pipe_result Send(const void* pData, size_t nBytes)
+	{
+		if (m_fCancelled.load(std::memory_order_acquire)) return PIPE_WRITE_STOPPED;
+		if (m_PeerSocket == FULCRUM_NO_SOCKET) return PIPE_WRITE_DISCONNECTED;
+		if (nBytes > 0xFFFFFFFFU) return PIPE_WRITE_FAILED;
+
+		unsigned char lengthBytes[4];
+		for (int i = 0; i < 4; i++) lengthBytes[i] = (unsigned char)(nBytes >> (8 * i));
+		bool fSent = SendAll(lengthBytes, sizeof(lengthBytes)) && SendAll((const char*)pData, nBytes);
+		if (fSent) return PIPE_WRITE_SENT;
+		return m_fCancelled.load(std::memory_order_acquire) ? PIPE_WRITE_STOPPED : PIPE_WRITE_DISCONNECTED;
+	}
+
+	// Hands out what's left of the current message, reading the next length once it runs out
+	virtual size_t Receive(void* pBuffer, size_t nBytes)
+	{
+		if (nBytes == 0 || m_PeerSocket == FULCRUM_NO_SOCKET) return 0;
+		while (m_nMessageLeft == 0)
+		{
+			unsigned char lengthBytes[4];
+			if (!ReceiveAll(lengthBytes, sizeof(lengthBytes))) return 0;
+			for (int i = 0; i < 4; i++) m_nMessageLeft |= (size_t)lengthBytes[i] << (8 * i);
+		}
+
+		int nWanted = (int)(nBytes < m_nMessageLeft ? nBytes : m_nMessageLeft);
+		if (nWanted < 0) nWanted = 0x7FFFFFFF;
+		int nReceived = recv(m_PeerSocket, (char*)pBuffer, nWanted, 0);
+		if (nReceived <= 0) return 0;
+		m_nMessageLeft -= nReceived;
+		return (size_t)nReceived;
+	}
+
+	// Shutting the peer down wakes a blocked send or recv. The listener notices the flag on its next poll
+	virtual void Cancel()
+	{
+		std::lock_guard<std::mutex> peerLock(m_PeerLock);
+		m_fCancelled.store(true, std::memory_order_release);
+		if (m_PeerSocket != FULCRUM_NO_SOCKET) shutdown(m_PeerSocket, FULCRUM_SHUT_BOTH);
+	}
+
+private:
+	// Waits on the listen socket a bit at a time so a cancel is noticed
+	fulcrum_socket AcceptSocket()
+	{
+		while (!m_fCancelled.load(std::memory_order_acquire))
+		{
+			fd_set readSockets; FD_ZERO(&readSockets); FD_SET(m_ListenSocket, &readSockets);
+			timeval pollTime = { 0, FULCRUM_SOCKET_ACCEPT_POLL_MS * 1000 };
+			int nReady = select((int)m_ListenSocket + 1, &readSockets, NULL, NULL, &pollTime);
+			if (nReady < 0) return FULCRUM_NO_SOCKET;
+			if (nReady > 0) return accept(m_ListenSocket, NULL, NULL);
+		}
+		return FULCRUM_NO_SOCKET;
+	}
+
+	bool SendAll(const unsigned char* pBytes, size_t nBytes) { return SendAll((const char*)pBytes, nBytes); }
+	bool SendAll(const char* pBytes, size_t nBytes)
+	{
+		while (nBytes > 0)
+		{
+			int nChunk = nBytes > 0x10000000 ? 0x10000000 : (int)nBytes;
+			int nSent = send(m_PeerSocket, pBytes, nChunk, FULCRUM_SEND_FLAGS);
+			if (nSent <= 0) return false;
+			pBytes += nSent; nBytes -= nSent;
+		}
+		return true;
+	}
+	bool ReceiveAll(unsigned char* pBytes, size_t nBytes)
+	{
+		while (nBytes > 0)
+		{
+			int nReceived = recv(m_PeerSocket, (char*)pBytes, (int)nBytes, 0);
+			if (nReceived <= 0) return false;
+			pBytes += nReceived; nBytes -= nReceived;
+		}
+		return true;
+	}
+
+	// The peer socket only changes on the thread using the transport. The lock keeps Cancel from racing it
+	fulcrum_socket m_ListenSocket;
+	fulcrum_socket m_PeerSocket;
+	bool m_fServerSide;
+	std::mutex m_PeerLock;
+	size_t m_nMessageLeft;
+	std::atomic<bool> m_fCancelled;
+};
+
+// ---------------------------------------------------------------------------------------------------------------------------------
+
+// Listens on the path. Anything left there by an earlier run is removed first
+fulcrum_transport* fulcrumTransport_CreateSocketServer(const char* szPath)
+{
+	sockaddr_un socketAddress;
+	if (!fulcrumSocket_Address(szPath, socketAddress) || !fulcrumSocket_Startup()) return NULL;
+
+	fulcrum_socket listenSocket = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (listenSocket != FULCRUM_NO_SOCKET)
+	{
+		remove(szPath);
+		if (bind(listenSocket, (sockaddr*)&socketAddress, sizeof(socketAddress)) == 0 && listen(listenSocket, 1) == 0)
+			return new fulcrum_socket_transport(listenSocket, FULCRUM_NO_SOCKET, true);
+		fulcrumSocket_Close(listenSocket);
+	}
+	fulcrumSocket_Cleanup();
+	return NULL;
+}
+
+// Connects to a server already listening on the path
+fulcrum_transport* fulcrumTransport_CreateSocketClient(const char* szPath)
+{
+	sockaddr_un socketAddress;
+	if (!fulcrumSocket_Address(szPath, socketAddress) || !fulcrumSocket_Startup()) return NULL;
+
+	fulcrum_socket peerSocket = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (peerSocket != FULCRUM_NO_SOCKET)
+	{
+		if (connect(peerSocket, (sockaddr*)&socketAddress, sizeof(socketAddress)) == 0)
+			return new fulcrum_socket_transport(FULCRUM_NO_SOCKET, peerSocket, false);
+		fulcrumSocket_Close(peerSocket);
+	}
+	fulcrumSocket_Cleanup();
+	return NULL;
+}
\ No newline at end of file
@@ -0,0 +1,196 @@
+/*
+**
+** Copyright (C) 2022 MEAT Inc
+** Author: Zack Walsh <neo.smith@motorengineeringandtech.com>
+**
+** This library is free software; you can redistribute it and/or modify
+** it under the terms of the GNU Lesser General Public License as published
+** by the Free Software Foundation, either version 3 of the License, or (at
+** your option) any later version.
+**
+** This library is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+** Lesser General Public License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public
+** License along with this library; if not, <http://www.gnu.org/licenses/>.
+**
+*/
+
+
+// Standard Imports
+#include "stdafx.h"
+#include <atomic>
+#include <new>
+#include <string.h>
+#include <thread>
+#include <vector>
+
+// Fulcrum Resource Imports
+#include "fulcrum_staging.h"
+
+// Header stored in front of every staged record. Record bytes follow, padded out to 8 bytes
+// with room for a terminator so text records can be used as strings where they sit
+struct fulcrum_stageentry {
+	uint64_t Sequence;
+	uint32_t Kind;
+	uint32_t Length;
+};
+
+// Bytes a record of a given length takes up in a staging buffer
+static size_t fulcrumStageEntrySize(size_t nBytes)
+{
+	return sizeof(fulcrum_stageentry) + ((nBytes + sizeof(TCHAR) + 7) & ~(size_t)7);
+}
+
+// CTOR and DCTOR. Thread buffers are left alone when we go away since threads may still be
+// exiting (and handing their buffer back) while the DLL tears down its statics
+fulcrum_staging::fulcrum_staging()
+	: m_nNextSequence(0)
+	, m_pBuffers(NULL)
+	, m_nDropped(0)
+	, m_nCollectedSequence(0)
+	, m_nReleaseSequence(0)
+{
+}
+fulcrum_staging::~fulcrum_staging()
+{
+}
+
+// ---------------------------------------------------------------------------------------------------------------------------------
+
+// Spins for a buffer lock. It's only ever contended by the writer collecting, which holds it for a swap
+void fulcrum_staging::LockBuffer(stagebuffer* pBuffer)
+{
+	while (pBuffer->Locked.exchange(true, std::memory_order_acquire)) std::this_thread::yield();
+}
+
+// Finds the calling thread's buffer. The first call on a thread reuses one a finished thread left behind or makes a new one
+fulcrum_staging::stagebuffer* fulcrum_staging::ThreadBuffer()
+{
+	// Gives the buffer back when the thread exits
+	struct stagebuffer_owner {
+		stagebuffer* pBuffer;
+		~stagebuffer_owner() { if (pBuffer != NULL) pBuffer->InUse.store(false, std::memory_order_release); }
+	};
+	thread_local stagebuffer_owner threadBuffer = { NULL };
+	if (threadBuffer.pBuffer != NULL && threadBuffer.pBuffer->Owner == this) return threadBuffer.pBuffer;
+
+	for (stagebuffer* pBuffer = m_pBuffers.load(std::memory_order_acquire); pBuffer != NULL; pBuffer = pBuffer->Next)
+	{
+		bool fExpected = false;
+		if (!pBuffer->InUse.compare_exchange_strong(fExpected, true)) continue;
+		threadBuffer.pBuffer = pBuffer;
+		return pBuffer;
+	}
+
+	// Nothing free so build a new buffer and push it on the front of the list
+	stagebuffer* pBuffer = new (std::nothrow) stagebuffer;
+	if (pBuffer == NULL) return NULL;
+	pBuffer->Locked.store(false, std::memory_order_relaxed);
+	pBuffer->InUse.store(true, std::memory_order_relaxed);
+	pBuffer->Owner = this;
+	pBuffer->Next = m_pBuffers.load(std::memory_order_relaxed);
+	while (!m_pBuffers.compare_exchange_weak(pBuffer->Next, pBuffer, std::memory_order_release, std::memory_order_relaxed));
+
+	threadBuffer.pBuffer = pBuffer;
+	return pBuffer;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------------------
+
+// Copies a record into this thread's buffer and numbers it
+bool fulcrum_staging::Stage(fulcrum_logrecord_kind recordKind, const void* pData, size_t nBytes)
+{
+	stagebuffer* pBuffer = ThreadBuffer();
+	if (pBuffer == NULL) { m_nDropped.fetch_add(1, std::memory_order_relaxed); return false; }
+
+	// Make room first. Growing the buffer is the only thing in here that can fail.
+	// New space comes back zeroed, which leaves the terminator and padding in place
+	size_t nEntrySize = fulcrumStageEntrySize(nBytes);
+	LockBuffer(pBuffer);
+	size_t iWrite = pBuffer->Batch.size();
+	bool fHasRoom = iWrite + nEntrySize <= FULCRUM_STAGE_LIMIT;
+	if (fHasRoom) {
+		try { pBuffer->Batch.resize(iWrite + nEntrySize); }
+		catch (const std::bad_alloc&) { fHasRoom = false; }
+	}
+	if (!fHasRoom) {
+		UnlockBuffer(pBuffer);
+		m_nDropped.fetch_add(1, std::memory_order_relaxed);
+		return false;
+	}
+
+	// Number the record while we hold the lock. The writer relies on this to know when it has
+	// collected every record below a sequence number
+	fulcrum_stageentry stageEntry;
+	stageEntry.Sequence = m_nNextSequence.fetch_add(1, std::memory_order_seq_cst);
+	stageEntry.Kind = (uint32_t)recordKind;
+	stageEntry.Length = (uint32_t)nBytes;
+	memcpy(&pBuffer->Batch[iWrite], &stageEntry, sizeof(stageEntry));
+	if (nBytes > 0) memcpy(&pBuffer->Batch[iWrite + sizeof(stageEntry)], pData, nBytes);
+	UnlockBuffer(pBuffer);
+	return true;
+}
+
+// Takes every thread's staged records. The sequencer is read first: any record numbered below it
+// was staged under its thread's lock before we took that lock, so it's in the batch we swap out
+void fulcrum_staging::Collect(bool fEverything)
+{
+	m_nCollectedSequence = m_nNextSequence.load(std::memory_order_seq_cst);
+	m_nReleaseSequence = fEverything ? UINT64_MAX : m_nCollectedSequence;
+
+	for (stagebuffer* pBuffer = m_pBuffers.load(std::memory_order_acquire); pBuffer != NULL; pBuffer = pBuffer->Next)
+	{
+		// Swap an empty batch in so the lock is only held for a pointer swap and the thread keeps an allocation
+		std::vector<unsigned char> spareBatch;
+		if (!m_SpareBatches.empty()) { spareBatch.swap(m_SpareBatches.back()); m_SpareBatches.pop_back(); }
+		LockBuffer(pBuffer);
+		if (!pBuffer->Batch.empty()) pBuffer->Batch.swap(spareBatch);
+		UnlockBuffer(pBuffer);
+
+		// Nothing was staged. Keep the spare for next time
+		if (spareBatch.empty()) {
+			if (spareBatch.capacity() > 0) m_SpareBatches.push_back(std::move(spareBatch));
+			continue;
+		}
+
+		stagerun collectedRun;
+		collectedRun.Bytes.swap(spareBatch);
+		collectedRun.Offset = 0;
+		m_Runs.push_back(std::move(collectedRun));
+	}
+}
+
+// Hands back the lowest numbered record we've collected, as long as nothing numbered before it is still out
+bool fulcrum_staging::Next(fulcrum_stagedrecord& stagedRecord)
+{
+	// Retire finished runs so their storage goes back to the threads
+	for (size_t iRun = 0; iRun < m_Runs.size(); )
+	{
+		if (m_Runs[iRun].Offset < m_Runs[iRun].Bytes.size()) { iRun++; continue; }
+		m_Runs[iRun].Bytes.clear();
+		m_SpareBatches.push_back(std::move(m_Runs[iRun].Bytes));
+		m_Runs.erase(m_Runs.begin() + iRun);
+	}
+
+	// Each run is already in order so the next record is at the front of one of them
+	stagerun* pOldestRun = NULL;
+	fulcrum_stageentry stageEntry, oldestEntry;
+	for (size_t iRun = 0; iRun < m_Runs.size(); iRun++)
+	{
+		memcpy(&stageEntry, &m_Runs[iRun].Bytes[m_Runs[iRun].Offset], sizeof(stageEntry));
+		if (pOldestRun != NULL && stageEntry.Sequence >= oldestEntry.Sequence) continue;
+		pOldestRun = &m_Runs[iRun];
+		oldestEntry = stageEntry;
+	}
+	if (pOldestRun == NULL || oldestEntry.Sequence >= m_nReleaseSequence) return false;
+
+	stagedRecord.Sequence = oldestEntry.Sequence;
+	stagedRecord.Kind = (fulcrum_logrecord_kind)oldestEntry.Kind;
+	stagedRecord.Length = oldestEntry.Length;
+	stagedRecord.pData = &pOldestRun->Bytes[pOldestRun->Offset + sizeof(oldestEntry)];
+	pOldestRun->Offset += fulcrumStageEntrySize(oldestEntry.Length);
+	return true;
+}
\ No newline at end of file
@@ -0,0 +1,109 @@
+/*
+**
+** Copyright (C) 2022 MEAT Inc
+** Author: Zack Walsh <neo.smith@motorengineeringandtech.com>
+**
+** This library is free software; you can redistribute it and/or modify
+** it under the terms of the GNU Lesser General Public License as published
+** by the Free Software Foundation, either version 3 of the License, or (at
+** your option) any later version.
+**
+** This library is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+** Lesser General Public License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public
+** License along with this library; if not, <http://www.gnu.org/licenses/>.
+**
+*/
+
+
+#pragma once
+
+// Standard Imports
+#include <atomic>
+#include <stdint.h>
+#include <tchar.h>
+#include <vector>
+
+// Most bytes a single thread can have staged before its records start getting dropped
+#define FULCRUM_STAGE_LIMIT (1024 * 1024)
+
+// Types of records threads can stage for the writer thread
+enum fulcrum_logrecord_kind {
+	LOGRECORD_TEXT = 0,			// Formatted text line for the log file and pipe
+	LOGRECORD_OPEN_FILE = 1,	// Redirect all future output into the named file
+	LOGRECORD_SAVE_FILE = 2,	// Dump the buffered output into the named file and close it
+	LOGRECORD_CAPTURE = 3,		// Binary capture record for the .shimBin file
+};
+
+// A record handed back to the writer thread. Data is only valid until the next call to Next()
+struct fulcrum_stagedrecord {
+	uint64_t Sequence;				// Global order the record was staged in
+	fulcrum_logrecord_kind Kind;	// What the writer thread should do with this record
+	size_t Length;					// Number of bytes in the record (no terminator)
+	const unsigned char* pData;		// Record bytes inside the staging run
+
+	// Text records are always stored with a trailing terminator
+	const unsigned char* Data() const { return pData; }
+	LPCTSTR Text() const { return (LPCTSTR)pData; }
+	size_t TextLength() const { return Length / sizeof(TCHAR); }
+};
+
+// Per-thread staging buffers for log records. Each thread appends to its own buffer under a lock
+// nobody else takes except the writer thread when it collects, so logging threads never fight
+// over a shared queue. Every record gets a number from one global sequencer when it's staged and
+// the writer merges the collected buffers back into that order, so the log and capture still show
+// calls exactly in the order they happened no matter which thread made them
+class fulcrum_staging {
+public:
+	fulcrum_staging();
+	~fulcrum_staging();
+
+	// Producer side. Safe to call from any number of threads at once. Returns false when dropped
+	bool Stage(fulcrum_logrecord_kind recordKind, const void* pData, size_t nBytes);
+
+	// Consumer side. Only the writer thread may call these. Collect() takes every thread's staged
+	// records in bulk, then Next() hands them back in sequence order. Records staged while we
+	// collected are held back until the records in front of them have been collected too.
+	// Collecting everything releases those as well, for when the writer is shutting down
+	void Collect(bool fEverything = false);
+	bool Next(fulcrum_stagedrecord& stagedRecord);
+	bool HasNew() const { return m_nNextSequence.load(std::memory_order_seq_cst) != m_nCollectedSequence; }
+
+	// Counters for staging health
+	unsigned long long Staged() const { return m_nNextSequence.load(std::memory_order_relaxed); }
+	unsigned long long Dropped() const { return m_nDropped.load(std::memory_order_relaxed); }
+
+private:
+	// Staging buffer owned by one thread. Buffers are never freed, threads that exit hand theirs on
+	struct stagebuffer {
+		std::atomic<bool> Locked;
+		std::atomic<bool> InUse;
+		std::vector<unsigned char> Batch;
+		stagebuffer* Next;
+		fulcrum_staging* Owner;
+	};
+
+	// Batch collected from one thread. Records in it are already in sequence order
+	struct stagerun {
+		std::vector<unsigned char> Bytes;
+		size_t Offset;
+	};
+
+	stagebuffer* ThreadBuffer();
+	static void LockBuffer(stagebuffer* pBuffer);
+	static void UnlockBuffer(stagebuffer* pBuffer) { pBuffer->Locked.store(false, std::memory_order_release); }
+
+	// Sequencer and every buffer any thread has ever used
+	std::atomic<uint64_t> m_nNextSequence;
+	std::atomic<stagebuffer*> m_pBuffers;
+	std::atomic<unsigned long long> m_nDropped;
+
+	// Writer side merge state
+	std::vector<stagerun> m_Runs;
+	std::vector<std::vector<unsigned char> > m_SpareBatches;
+	uint64_t m_nCollectedSequence;
+	uint64_t m_nReleaseSequence;
+};
\ No newline at end of file
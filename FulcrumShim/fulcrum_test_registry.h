@@ -0,0 +1,78 @@
+/*
+**
+** Copyright (C) 2022 MEAT Inc
+** Author: Zack Walsh <neo.smith@motorengineeringandtech.com>
+**
+** This library is free software; you can redistribute it and/or modify
+** it under the terms of the GNU Lesser General Public License as published
+** by the Free Software Foundation, either version 3 of the License, or (at
+** your option) any later version.
+**
+** This library is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+** Lesser General Public License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public
+** License along with this library; if not, <http://www.gnu.org/licenses/>.
+**
+*/
+
+#pragma once
+
+// Standard Imports
+#include <stdint.h>
+#include <map>
+#include <string>
+#include <vector>
+
+// Fulcrum Resource Imports
+#include "fulcrum_catalog.h"
+
+// Registry kept in memory for the catalog tests and benchmark. Keys are stored by their full path, and
+// every write moves a key's last write time on the way the real registry does. Counts the keys opened for values
+class fulcrum_test_registry : public fulcrum_registry_provider {
+public:
+	fulcrum_test_registry() : m_nValueReads(0) { }
+	virtual bool ListSubkeys(const std::wstring& keyPath, std::vector<fulcrum_registry_subkey>& subkeyList)
+	{
+		bool fFound = false;
+		for (std::map<std::wstring, fulcrum_test_key>::const_iterator testKey = m_Keys.begin(); testKey != m_Keys.end(); ++testKey)
+		{
+			if (testKey->first.compare(0, keyPath.size() + 1, keyPath + L"\\") != 0) continue;
+			fulcrum_registry_subkey foundKey = { testKey->first.substr(keyPath.size() + 1), testKey->second.LastWrite };
+			subkeyList.push_back(foundKey);
+			fFound = true;
+		}
+		return fFound;
+	}
+	virtual bool ReadValues(const std::wstring& keyPath, fulcrum_registry_values& keyValues)
+	{
+		std::map<std::wstring, fulcrum_test_key>::const_iterator testKey = m_Keys.find(keyPath);
+		if (testKey == m_Keys.end()) return false;
+		keyValues = testKey->second.Values;
+		m_nValueReads++;
+		return true;
+	}
+
+	// Adds or rewrites a vendor key
+	void SetVendor(const std::wstring& keyPath, const std::wstring& strName, const std::wstring& strLibrary)
+	{
+		fulcrum_test_key& testKey = m_Keys[keyPath];
+		testKey.LastWrite++;
+		testKey.Values[L"Vendor"] = L"Fulcrum Test";
+		testKey.Values[L"Name"] = strName;
+		testKey.Values[L"FunctionLibrary"] = strLibrary;
+	}
+	void DeleteVendor(const std::wstring& keyPath) { m_Keys.erase(keyPath); }
+	unsigned long ValueReads() const { return m_nValueReads; }
+
+private:
+	struct fulcrum_test_key {
+		fulcrum_test_key() : LastWrite(0) { }
+		uint64_t LastWrite;
+		fulcrum_registry_values Values;
+	};
+	std::map<std::wstring, fulcrum_test_key> m_Keys;
+	unsigned long m_nValueReads;
+};
@@ -0,0 +1,507 @@
+/*
+**
+** Copyright (C) 2022 MEAT Inc
+** Author: Zack Walsh <neo.smith@motorengineeringandtech.com>
+**
+** This library is free software; you can redistribute it and/or modify
+** it under the terms of the GNU Lesser General Public License as published
+** by the Free Software Foundation, either version 3 of the License, or (at
+** your option) any later version.
+**
+** This library is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+** Lesser General Public License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public
+** License along with this library; if not, <http://www.gnu.org/licenses/>.
+**
+*/
+
+
+// Unit tests for the parts of the shim that build without MFC. Built by FulcrumTests.vcxproj on Windows and by the
+// fulcrum_tests target in CMakeLists.txt everywhere else, where ctest runs each section on its own. Every failed
+// check is printed, and the exit code is non zero if any of them failed
+
+// Standard Imports
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Fulcrum Resource Imports
+#include "fulcrum_catalog.h"
+#include "fulcrum_frame.h"
+#include "fulcrum_shmring_layout.h"
+#include "fulcrum_transport.h"
+#include "fulcrum_test_registry.h"
+
+// Checks that failed across every section we ran
+static int nChecksFailed = 0;
+
+// Records one check. Only failures are printed
+#define FULCRUM_TEST_CHECK(checkExpr) fulcrumTest_Check((checkExpr), #checkExpr, __FILE__, __LINE__)
+static void fulcrumTest_Check(bool fPassed, const char* szCheck, const char* szFile, int nLine)
+{
+	if (fPassed) return;
+	printf("  FAILED %s:%d: %s\n", szFile, nLine, szCheck);
+	nChecksFailed++;
+}
+
+// ------------------------------------------------------------------------------------------------
+
+// Both trees the catalog reads, and a registry with 16 vendors split between them
+static const wchar_t* catalogRoots[] = { L"Software\\PassThruSupport.04.04", L"Software\\WOW6432Node\\PassThruSupport.05.00" };
+static void fulcrumTest_FillRegistry(fulcrum_test_registry& testRegistry)
+{
+	for (int vendorIndex = 0; vendorIndex < 16; vendorIndex++)
+	{
+		std::wstring strVendor = L"Vendor" + std::to_wstring(vendorIndex);
+		testRegistry.SetVendor(std::wstring(catalogRoots[vendorIndex % 2]) + L"\\" + strVendor, strVendor, strVendor + L".dll");
+	}
+}
+
+// Interface catalog against the fake registry. A refresh only opens keys that are new or changed, drops the
+// ones that went away, and a saved catalog comes back the same or not at all
+static void fulcrumTest_Catalog()
+{
+	fulcrum_test_registry testRegistry;
+	fulcrumTest_FillRegistry(testRegistry);
+
+	// First refresh reads every key and tags names with the tree they came from
+	fulcrum_catalog interfaceCatalog;
+	FULCRUM_TEST_CHECK(interfaceCatalog.Refresh(testRegistry));
+	FULCRUM_TEST_CHECK(interfaceCatalog.Entries().size() == 16);
+	FULCRUM_TEST_CHECK(testRegistry.ValueReads() == 16);
+	FULCRUM_TEST_CHECK(interfaceCatalog.KeysRead() == 16);
+	std::map<std::wstring, fulcrum_catalog_entry>::const_iterator firstEntry = interfaceCatalog.Entries().find(std::wstring(catalogRoots[1]) + L"\\Vendor1");
+	FULCRUM_TEST_CHECK(firstEntry != interfaceCatalog.Entries().end());
+	if (firstEntry != interfaceCatalog.Entries().end())
+	{
+		FULCRUM_TEST_CHECK(firstEntry->second.Name == L"Vendor1 (v05.00)");
+		FULCRUM_TEST_CHECK(firstEntry->second.FunctionLibrary == L"Vendor1.dll");
+		FULCRUM_TEST_CHECK(firstEntry->second.Vendor == L"Fulcrum Test");
+		FULCRUM_TEST_CHECK(firstEntry->second.ConfigApplication.empty());
+	}
+
+	// Nothing changed, so nothing gets opened
+	FULCRUM_TEST_CHECK(!interfaceCatalog.Refresh(testRegistry));
+	FULCRUM_TEST_CHECK(testRegistry.ValueReads() == 16);
+
+	// One key rewritten, one added, one removed. Only the two that are new or changed get opened
+	testRegistry.SetVendor(std::wstring(catalogRoots[0]) + L"\\Vendor0", L"Vendor0 Updated", L"Vendor0.dll");
+	testRegistry.SetVendor(std::wstring(catalogRoots[1]) + L"\\Vendor16", L"Vendor16", L"Vendor16.dll");
+	testRegistry.DeleteVendor(std::wstring(catalogRoots[1]) + L"\\Vendor1");
+	FULCRUM_TEST_CHECK(interfaceCatalog.Refresh(testRegistry));
+	FULCRUM_TEST_CHECK(interfaceCatalog.Entries().size() == 16);
+	FULCRUM_TEST_CHECK(testRegistry.ValueReads() == 18);
+	FULCRUM_TEST_CHECK(interfaceCatalog.Entries().count(std::wstring(catalogRoots[1]) + L"\\Vendor1") == 0);
+	std::map<std::wstring, fulcrum_catalog_entry>::const_iterator updatedEntry = interfaceCatalog.Entries().find(std::wstring(catalogRoots[0]) + L"\\Vendor0");
+	FULCRUM_TEST_CHECK(updatedEntry != interfaceCatalog.Entries().end() && updatedEntry->second.Name == L"Vendor0 Updated (v04.04)");
+
+	// Saved and parsed again it has to need nothing read
+	std::vector<uint8_t> catalogData;
+	interfaceCatalog.Serialize(catalogData);
+	fulcrum_catalog savedCatalog;
+	FULCRUM_TEST_CHECK(savedCatalog.Parse(&catalogData[0], catalogData.size()));
+	FULCRUM_TEST_CHECK(savedCatalog.Entries().size() == interfaceCatalog.Entries().size());
+	FULCRUM_TEST_CHECK(!savedCatalog.Refresh(testRegistry));
+	FULCRUM_TEST_CHECK(savedCatalog.KeysRead() == 0);
+
+	// Anything short, from another version or without the magic is thrown out whole
+	for (size_t nLength = 0; nLength < catalogData.size(); nLength++)
+	{
+		bool fParsed = savedCatalog.Parse(&catalogData[0], nLength);
+		if (fParsed || !savedCatalog.Entries().empty()) { FULCRUM_TEST_CHECK(!"truncated catalog was accepted"); break; }
+	}
+	std::vector<uint8_t> badData(catalogData);
+	badData[FULCRUM_CATALOG_MAGIC_SIZE] ^= 0xFF;
+	FULCRUM_TEST_CHECK(!savedCatalog.Parse(&badData[0], badData.size()) && savedCatalog.Entries().empty());
+	badData = catalogData;
+	badData[0] ^= 0xFF;
+	FULCRUM_TEST_CHECK(!savedCatalog.Parse(&badData[0], badData.size()) && savedCatalog.Entries().empty());
+	FULCRUM_TEST_CHECK(!savedCatalog.Parse(NULL, 0));
+
+	// A catalog that was thrown out reads every key again
+	FULCRUM_TEST_CHECK(savedCatalog.Refresh(testRegistry));
+	FULCRUM_TEST_CHECK(savedCatalog.KeysRead() == 16);
+}
+
+// ------------------------------------------------------------------------------------------------
+
+// Builds one sealed frame onto the end of a stream
+static void fulcrumTest_AppendFrame(std::vector<uint8_t>& frameStream, uint16_t frameType, uint32_t nSequence, const char* szPayload)
+{
+	size_t nStart = frameStream.size();
+	uint32_t nLength = (uint32_t)strlen(szPayload);
+	frameStream.resize(nStart + sizeof(fulcrum_frame_header) + nLength);
+	memcpy(&frameStream[nStart + sizeof(fulcrum_frame_header)], szPayload, nLength);
+	fulcrumFrame_Seal((fulcrum_frame_header*)&frameStream[nStart], frameType, nSequence, &frameStream[nStart + sizeof(fulcrum_frame_header)], nLength);
+}
+
+// Pulls every frame the decoder has ready and joins their payloads with '|' so a whole stream can be checked at once
+static std::string fulcrumTest_DrainFrames(fulcrum_frame_decoder& frameDecoder)
+{
+	std::string strPayloads;
+	fulcrum_frame nextFrame;
+	for (int frameIndex = 0; frameDecoder.Next(nextFrame); frameIndex++)
+	{
+		if (frameIndex > 0) strPayloads += "|";
+		strPayloads.append((const char*)nextFrame.Payload, nextFrame.Length);
+	}
+	return strPayloads;
+}
+
+// Frame decoder. Frames come out whole however the bytes are split, garbage and damaged frames are skipped
+// until the next good one, and holes in the sequence numbers are counted as missed frames
+static void fulcrumTest_Frame()
+{
+	// Fed a byte at a time every frame still comes out whole, with its type and sequence
+	std::vector<uint8_t> frameStream;
+	fulcrumTest_AppendFrame(frameStream, FRAME_TEXT, 0, "first");
+	fulcrumTest_AppendFrame(frameStream, FRAME_COMMAND, 1, "");
+	fulcrumTest_AppendFrame(frameStream, FRAME_TEXT, 2, "third");
+	fulcrum_frame_decoder byteDecoder;
+	fulcrum_frame nextFrame;
+	std::vector<fulcrum_frame> decodedFrames;
+	std::string strPayloads;
+	for (size_t byteIndex = 0; byteIndex < frameStream.size(); byteIndex++)
+	{
+		byteDecoder.Feed(&frameStream[byteIndex], 1);
+		while (byteDecoder.Next(nextFrame))
+		{
+			decodedFrames.push_back(nextFrame);
+			strPayloads += std::string((const char*)nextFrame.Payload, nextFrame.Length) + ";";
+		}
+	}
+	FULCRUM_TEST_CHECK(decodedFrames.size() == 3);
+	FULCRUM_TEST_CHECK(strPayloads == "first;;third;");
+	if (decodedFrames.size() == 3)
+	{
+		FULCRUM_TEST_CHECK(decodedFrames[0].Type == FRAME_TEXT && decodedFrames[0].Sequence == 0);
+		FULCRUM_TEST_CHECK(decodedFrames[1].Type == FRAME_COMMAND && decodedFrames[1].Sequence == 1 && decodedFrames[1].Length == 0);
+		FULCRUM_TEST_CHECK(decodedFrames[2].Type == FRAME_TEXT && decodedFrames[2].Sequence == 2);
+	}
+	FULCRUM_TEST_CHECK(byteDecoder.FramesDecoded() == 3 && byteDecoder.FramesMissed() == 0);
+	FULCRUM_TEST_CHECK(byteDecoder.BytesSkipped() == 0 && byteDecoder.CrcErrors() == 0);
+
+	// Joining late, in the middle of a frame, skips to the next magic without counting anything as missed
+	fulcrum_frame_decoder lateDecoder;
+	lateDecoder.Feed(&frameStream[3], frameStream.size() - 3);
+	FULCRUM_TEST_CHECK(fulcrumTest_DrainFrames(lateDecoder) == "|third");
+	FULCRUM_TEST_CHECK(lateDecoder.BytesSkipped() == sizeof(fulcrum_frame_header) + 5 - 3);
+	FULCRUM_TEST_CHECK(lateDecoder.FramesMissed() == 0);
+
+	// Garbage in front of a frame, including a stray magic with a length past the limit, is skipped byte by byte
+	std::vector<uint8_t> noisyStream(7, 0xA5);
+	fulcrum_frame_header oversizedHeader;
+	fulcrumFrame_Seal(&oversizedHeader, FRAME_TEXT, 0, NULL, 0);
+	oversizedHeader.Length = FULCRUM_FRAME_MAX_PAYLOAD + 1;
+	noisyStream.insert(noisyStream.end(), (const uint8_t*)&oversizedHeader, (const uint8_t*)(&oversizedHeader + 1));
+	fulcrumTest_AppendFrame(noisyStream, FRAME_TEXT, 0, "clean");
+	fulcrum_frame_decoder noisyDecoder;
+	noisyDecoder.Feed(&noisyStream[0], noisyStream.size());
+	FULCRUM_TEST_CHECK(fulcrumTest_DrainFrames(noisyDecoder) == "clean");
+	FULCRUM_TEST_CHECK(noisyDecoder.BytesSkipped() == 7 + sizeof(fulcrum_frame_header));
+	FULCRUM_TEST_CHECK(noisyDecoder.CrcErrors() == 0);
+
+	// A damaged payload fails its CRC. The decoder resyncs on the frame after it and counts the one it lost
+	std::vector<uint8_t> damagedStream;
+	fulcrumTest_AppendFrame(damagedStream, FRAME_TEXT, 0, "zero");
+	size_t nDamagedAt = damagedStream.size() + sizeof(fulcrum_frame_header);
+	fulcrumTest_AppendFrame(damagedStream, FRAME_TEXT, 1, "one");
+	fulcrumTest_AppendFrame(damagedStream, FRAME_TEXT, 2, "two");
+	damagedStream[nDamagedAt] ^= 0x01;
+	fulcrum_frame_decoder damagedDecoder;
+	damagedDecoder.Feed(&damagedStream[0], damagedStream.size());
+	FULCRUM_TEST_CHECK(fulcrumTest_DrainFrames(damagedDecoder) == "zero|two");
+	FULCRUM_TEST_CHECK(damagedDecoder.CrcErrors() == 1);
+	FULCRUM_TEST_CHECK(damagedDecoder.BytesSkipped() == sizeof(fulcrum_frame_header) + 3);
+	FULCRUM_TEST_CHECK(damagedDecoder.FramesDecoded() == 2 && damagedDecoder.FramesMissed() == 1);
+
+	// Gaps add up, wrap past the top of the sequence, and a sender that starts over isn't counted as a loss
+	std::vector<uint8_t> gapStream;
+	fulcrumTest_AppendFrame(gapStream, FRAME_TEXT, 0xFFFFFFFE, "a");
+	fulcrumTest_AppendFrame(gapStream, FRAME_TEXT, 1, "b");
+	fulcrumTest_AppendFrame(gapStream, FRAME_TEXT, 4, "c");
+	fulcrumTest_AppendFrame(gapStream, FRAME_TEXT, 0, "d");
+	fulcrumTest_AppendFrame(gapStream, FRAME_TEXT, 1, "e");
+	fulcrum_frame_decoder gapDecoder;
+	FULCRUM_TEST_CHECK(gapDecoder.GapRate() == 0.0);
+	gapDecoder.Feed(&gapStream[0], gapStream.size());
+	FULCRUM_TEST_CHECK(fulcrumTest_DrainFrames(gapDecoder) == "a|b|c|d|e");
+	FULCRUM_TEST_CHECK(gapDecoder.FramesDecoded() == 5);
+	FULCRUM_TEST_CHECK(gapDecoder.FramesMissed() == 4);
+	FULCRUM_TEST_CHECK(gapDecoder.GapRate() == 4 / 9.0);
+}
+
+// ------------------------------------------------------------------------------------------------
+
+// Receives into a small buffer until one whole message is in. Loopback and socket ends both hand a big
+// message back in pieces, so this is how a reader that knows the size puts it together
+static std::string fulcrumTest_ReceiveMessage(fulcrum_transport& readEnd, size_t nMessage, size_t nChunk)
+{
+	std::string strMessage;
+	std::vector<char> chunkBuffer(nChunk);
+	while (strMessage.size() < nMessage)
+	{
+		size_t nRead = readEnd.Receive(&chunkBuffer[0], nChunk);
+		if (nRead == 0) break;
+		strMessage.append(&chunkBuffer[0], nRead);
+	}
+	return strMessage;
+}
+
+// In-memory loopback. Message boundaries hold, a full buffer blocks the sender, and closing or cancelling
+// either end wakes the other one
+static void fulcrumTest_Loopback()
+{
+	std::unique_ptr<fulcrum_transport> writeEnd, readEnd;
+	fulcrumTransport_CreateLoopback(16, writeEnd, readEnd);
+	FULCRUM_TEST_CHECK(writeEnd->WaitForPeer() && readEnd->WaitForPeer());
+	FULCRUM_TEST_CHECK(writeEnd->AcceptPeer() == NULL);
+
+	// A read never runs into the next message, even with room to spare
+	char readBuffer[64];
+	FULCRUM_TEST_CHECK(writeEnd->Send("abc", 3) == PIPE_WRITE_SENT);
+	FULCRUM_TEST_CHECK(writeEnd->Send("defgh", 5) == PIPE_WRITE_SENT);
+	FULCRUM_TEST_CHECK(readEnd->Receive(readBuffer, sizeof(readBuffer)) == 3 && memcmp(readBuffer, "abc", 3) == 0);
+	FULCRUM_TEST_CHECK(readEnd->Receive(readBuffer, 2) == 2 && memcmp(readBuffer, "de", 2) == 0);
+	FULCRUM_TEST_CHECK(readEnd->Receive(readBuffer, sizeof(readBuffer)) == 3 && memcmp(readBuffer, "fgh", 3) == 0);
+
+	// Ends only go one way
+	FULCRUM_TEST_CHECK(readEnd->Send("x", 1) == PIPE_WRITE_FAILED);
+	FULCRUM_TEST_CHECK(writeEnd->Receive(readBuffer, sizeof(readBuffer)) == 0);
+
+	// Past the capacity the sender waits for the reader. A message bigger than the whole buffer goes once it's empty
+	std::string strLarge(40, 'L');
+	FULCRUM_TEST_CHECK(writeEnd->Send("0123456789", 10) == PIPE_WRITE_SENT);
+	std::atomic<bool> fLargeSent(false);
+	std::thread senderThread([&]() { fLargeSent.store(writeEnd->Send(strLarge.data(), strLarge.size()) == PIPE_WRITE_SENT); });
+	std::this_thread::sleep_for(std::chrono::milliseconds(50));
+	FULCRUM_TEST_CHECK(!fLargeSent.load());
+	FULCRUM_TEST_CHECK(fulcrumTest_ReceiveMessage(*readEnd, 10, 4) == "0123456789");
+	senderThread.join();
+	FULCRUM_TEST_CHECK(fLargeSent.load());
+	FULCRUM_TEST_CHECK(fulcrumTest_ReceiveMessage(*readEnd, strLarge.size(), 7) == strLarge);
+
+	// Cancelling the read end wakes a reader that is waiting and fails every read after it
+	std::atomic<size_t> nBlockedRead(1);
+	std::thread readerThread([&]() { nBlockedRead.store(readEnd->Receive(readBuffer, sizeof(readBuffer))); });
+	std::this_thread::sleep_for(std::chrono::milliseconds(20));
+	readEnd->Cancel();
+	readerThread.join();
+	FULCRUM_TEST_CHECK(nBlockedRead.load() == 0);
+	FULCRUM_TEST_CHECK(!readEnd->WaitForPeer());
+
+	// Cancelling the write end stops sends
+	writeEnd->Cancel();
+	FULCRUM_TEST_CHECK(writeEnd->Send("x", 1) == PIPE_WRITE_STOPPED);
+	FULCRUM_TEST_CHECK(!writeEnd->WaitForPeer());
+
+	// What was queued still comes out after the write end closes, then reads come back empty
+	fulcrumTransport_CreateLoopback(16, writeEnd, readEnd);
+	FULCRUM_TEST_CHECK(writeEnd->Send("last", 4) == PIPE_WRITE_SENT);
+	writeEnd.reset();
+	FULCRUM_TEST_CHECK(!readEnd->WaitForPeer());
+	FULCRUM_TEST_CHECK(readEnd->Receive(readBuffer, sizeof(readBuffer)) == 4 && memcmp(readBuffer, "last", 4) == 0);
+	FULCRUM_TEST_CHECK(readEnd->Receive(readBuffer, sizeof(readBuffer)) == 0);
+
+	// With the read end gone the writer is told nobody is there
+	fulcrumTransport_CreateLoopback(16, writeEnd, readEnd);
+	readEnd.reset();
+	FULCRUM_TEST_CHECK(writeEnd->Send("x", 1) == PIPE_WRITE_DISCONNECTED);
+}
+
+// Unix domain sockets, with both ends in this process. Messages keep their boundaries across the length prefix,
+// a server that drops its peer hangs up on the client, and a cancel gets a server out of waiting for one
+#define FULCRUM_TEST_SOCKET_PATH "fulcrum_tests.sock"
+static void fulcrumTest_Socket()
+{
+	std::unique_ptr<fulcrum_transport> socketServer(fulcrumTransport_CreateSocketServer(FULCRUM_TEST_SOCKET_PATH));
+	FULCRUM_TEST_CHECK(socketServer.get() != NULL);
+	if (!socketServer) return;
+
+	// The server waits for the client on its own thread
+	std::atomic<bool> fServerConnected(false);
+	std::thread acceptThread([&]() { fServerConnected.store(socketServer->WaitForPeer()); });
+	std::unique_ptr<fulcrum_transport> socketClient(fulcrumTransport_CreateSocketClient(FULCRUM_TEST_SOCKET_PATH));
+	if (!socketClient) socketServer->Cancel();
+	acceptThread.join();
+	FULCRUM_TEST_CHECK(socketClient.get() != NULL && fServerConnected.load());
+	if (!socketClient || !fServerConnected.load()) { socketServer.reset(); remove(FULCRUM_TEST_SOCKET_PATH); return; }
+	FULCRUM_TEST_CHECK(socketClient->WaitForPeer());
+
+	// Both ways, read back in pieces smaller than the message and never past its end
+	char readBuffer[64];
+	std::string strLarge(100000, 'S');
+	FULCRUM_TEST_CHECK(socketServer->Send("hello", 5) == PIPE_WRITE_SENT);
+	FULCRUM_TEST_CHECK(socketServer->Send("", 0) == PIPE_WRITE_SENT);
+	FULCRUM_TEST_CHECK(socketServer->Send("world", 5) == PIPE_WRITE_SENT);
+	FULCRUM_TEST_CHECK(socketClient->Receive(readBuffer, 3) == 3 && memcmp(readBuffer, "hel", 3) == 0);
+	FULCRUM_TEST_CHECK(socketClient->Receive(readBuffer, sizeof(readBuffer)) == 2 && memcmp(readBuffer, "lo", 2) == 0);
+	FULCRUM_TEST_CHECK(socketClient->Receive(readBuffer, sizeof(readBuffer)) == 5 && memcmp(readBuffer, "world", 5) == 0);
+	std::thread largeThread([&]() { socketClient->Send(strLarge.data(), strLarge.size()); });
+	FULCRUM_TEST_CHECK(fulcrumTest_ReceiveMessage(*socketServer, strLarge.size(), 4096) == strLarge);
+	largeThread.join();
+
+	// Dropping the peer on the server hangs up on the client. The client keeps its socket when it drops
+	socketClient->DropPeer();
+	FULCRUM_TEST_CHECK(socketClient->WaitForPeer());
+	socketServer->DropPeer();
+	FULCRUM_TEST_CHECK(socketClient->Receive(readBuffer, sizeof(readBuffer)) == 0);
+	socketClient.reset();
+
+	// Waiting for a new peer gives up once cancelled, and so does every send after it
+	std::atomic<bool> fWaitResult(true);
+	std::thread waitThread([&]() { fWaitResult.store(socketServer->WaitForPeer()); });
+	std::this_thread::sleep_for(std::chrono::milliseconds(20));
+	socketServer->Cancel();
+	waitThread.join();
+	FULCRUM_TEST_CHECK(!fWaitResult.load());
+	FULCRUM_TEST_CHECK(socketServer->Send("x", 1) == PIPE_WRITE_STOPPED);
+
+	// Nothing is listening once the server is gone
+	socketServer.reset();
+	remove(FULCRUM_TEST_SOCKET_PATH);
+	socketClient.reset(fulcrumTransport_CreateSocketClient(FULCRUM_TEST_SOCKET_PATH));
+	FULCRUM_TEST_CHECK(socketClient.get() == NULL);
+}
+
+// ------------------------------------------------------------------------------------------------
+
+// A ring in plain memory laid out the same as the mapping
+struct fulcrum_test_ring {
+	fulcrum_shmring_header Header;
+	unsigned char Data[4096];
+};
+
+// Publishes an entry of nBytes filled with one byte value
+static bool fulcrumTest_PublishFilled(fulcrum_test_ring& testRing, size_t nBytes, unsigned char fillByte)
+{
+	std::vector<unsigned char> entryData(nBytes, fillByte);
+	return fulcrumShmRing_Publish(&testRing.Header, testRing.Data, SHMRING_CAPTURE, entryData.empty() ? NULL : &entryData[0], nBytes);
+}
+
+// Peeks the next entry and checks it is nBytes of fillByte before releasing it
+static bool fulcrumTest_ConsumeFilled(fulcrum_test_ring& testRing, size_t nBytes, unsigned char fillByte)
+{
+	const fulcrum_shmring_entry* pEntry = fulcrumShmRing_Peek(&testRing.Header, testRing.Data);
+	if (pEntry == NULL || pEntry->Kind != SHMRING_CAPTURE || pEntry->Length != nBytes) return false;
+	const unsigned char* pEntryData = (const unsigned char*)(pEntry + 1);
+	bool fMatched = std::count(pEntryData, pEntryData + nBytes, fillByte) == (std::ptrdiff_t)nBytes;
+	fulcrumShmRing_Release(&testRing.Header, pEntry);
+	return fMatched;
+}
+
+// Shared memory ring indexes on a plain buffer. Entries stay aligned, one that won't fit before the end gets a pad
+// and starts over at the front, and anything that doesn't fit is dropped without touching the write index
+static void fulcrumTest_ShmRing()
+{
+	std::unique_ptr<fulcrum_test_ring> testRing(new fulcrum_test_ring());
+	fulcrum_shmring_header& ringHeader = testRing->Header;
+	fulcrumShmRing_Init(&ringHeader, sizeof(testRing->Data), 1234);
+	FULCRUM_TEST_CHECK(memcmp(ringHeader.Magic, FULCRUM_SHMRING_MAGIC, FULCRUM_SHMRING_MAGIC_SIZE) == 0);
+	FULCRUM_TEST_CHECK(ringHeader.Version == FULCRUM_SHMRING_VERSION && ringHeader.Capacity == 4096 && ringHeader.ProducerProcessID == 1234);
+	FULCRUM_TEST_CHECK(fulcrumShmRing_Peek(&ringHeader, testRing->Data) == NULL);
+
+	// One text entry, padded out to the alignment
+	FULCRUM_TEST_CHECK(fulcrumShmRing_Publish(&ringHeader, testRing->Data, SHMRING_TEXT, "abc", 3));
+	FULCRUM_TEST_CHECK(ringHeader.WriteIndex.load() == 16);
+	const fulcrum_shmring_entry* pEntry = fulcrumShmRing_Peek(&ringHeader, testRing->Data);
+	FULCRUM_TEST_CHECK(pEntry != NULL && pEntry->Kind == SHMRING_TEXT && pEntry->Length == 3 && memcmp(pEntry + 1, "abc", 3) == 0);
+	if (pEntry != NULL) fulcrumShmRing_Release(&ringHeader, pEntry);
+	FULCRUM_TEST_CHECK(ringHeader.ReadIndex.load() == 16);
+	FULCRUM_TEST_CHECK(fulcrumShmRing_Peek(&ringHeader, testRing->Data) == NULL);
+
+	// Walk up to 16 bytes short of the end. An entry that needs 32 gets a 16 byte pad and lands at the front
+	bool fWalked = true;
+	for (int entryIndex = 0; entryIndex < 254 && fWalked; entryIndex++)
+		fWalked = fulcrumTest_PublishFilled(*testRing, 8, (unsigned char)entryIndex) && fulcrumTest_ConsumeFilled(*testRing, 8, (unsigned char)entryIndex);
+	FULCRUM_TEST_CHECK(fWalked);
+	FULCRUM_TEST_CHECK(ringHeader.WriteIndex.load() == 4080 && ringHeader.ReadIndex.load() == 4080);
+	FULCRUM_TEST_CHECK(fulcrumTest_PublishFilled(*testRing, 20, 0xEE));
+	const fulcrum_shmring_entry* pPadEntry = (const fulcrum_shmring_entry*)(testRing->Data + 4080);
+	FULCRUM_TEST_CHECK(pPadEntry->Kind == SHMRING_PAD && pPadEntry->Length == 16 - sizeof(fulcrum_shmring_entry));
+	FULCRUM_TEST_CHECK(ringHeader.WriteIndex.load() == 4096 + 32);
+	pEntry = fulcrumShmRing_Peek(&ringHeader, testRing->Data);
+	FULCRUM_TEST_CHECK(pEntry == (const fulcrum_shmring_entry*)testRing->Data);
+	FULCRUM_TEST_CHECK(ringHeader.ReadIndex.load() == 4096);
+	FULCRUM_TEST_CHECK(fulcrumTest_ConsumeFilled(*testRing, 20, 0xEE));
+	FULCRUM_TEST_CHECK(ringHeader.ReadIndex.load() == 4096 + 32);
+
+	// Half the ring is the most one entry can take, and two of those fill it exactly
+	fulcrumShmRing_Init(&ringHeader, sizeof(testRing->Data), 1234);
+	FULCRUM_TEST_CHECK(!fulcrumTest_PublishFilled(*testRing, 2048 - sizeof(fulcrum_shmring_entry) + 1, 0x01));
+	FULCRUM_TEST_CHECK(ringHeader.DroppedEntries.load() == 1 && ringHeader.WriteIndex.load() == 0);
+	FULCRUM_TEST_CHECK(fulcrumTest_PublishFilled(*testRing, 2048 - sizeof(fulcrum_shmring_entry), 0x02));
+	FULCRUM_TEST_CHECK(fulcrumTest_PublishFilled(*testRing, 2048 - sizeof(fulcrum_shmring_entry), 0x03));
+	FULCRUM_TEST_CHECK(!fulcrumTest_PublishFilled(*testRing, 0, 0x04));
+	FULCRUM_TEST_CHECK(ringHeader.DroppedEntries.load() == 2 && ringHeader.WriteIndex.load() == 4096);
+	FULCRUM_TEST_CHECK(fulcrumTest_ConsumeFilled(*testRing, 2048 - sizeof(fulcrum_shmring_entry), 0x02));
+	FULCRUM_TEST_CHECK(fulcrumTest_ConsumeFilled(*testRing, 2048 - sizeof(fulcrum_shmring_entry), 0x03));
+
+	// The pad counts against the free space. An entry that would fit in what's free, but not once it's padded
+	// to the front, is dropped and leaves no pad behind
+	fulcrumShmRing_Init(&ringHeader, sizeof(testRing->Data), 1234);
+	FULCRUM_TEST_CHECK(fulcrumTest_PublishFilled(*testRing, 1024 - sizeof(fulcrum_shmring_entry), 0x05));
+	FULCRUM_TEST_CHECK(fulcrumTest_ConsumeFilled(*testRing, 1024 - sizeof(fulcrum_shmring_entry), 0x05));
+	FULCRUM_TEST_CHECK(fulcrumTest_PublishFilled(*testRing, 2048 - sizeof(fulcrum_shmring_entry), 0x06));
+	memset(testRing->Data + 3072, 0xCC, sizeof(fulcrum_shmring_entry));
+	FULCRUM_TEST_CHECK(!fulcrumTest_PublishFilled(*testRing, 1600, 0x07));
+	FULCRUM_TEST_CHECK(ringHeader.DroppedEntries.load() == 1 && ringHeader.WriteIndex.load() == 3072);
+	FULCRUM_TEST_CHECK(testRing->Data[3072] == 0xCC);
+
+	// Indexes run free and wrap past 32 bits without the ring noticing
+	fulcrumShmRing_Init(&ringHeader, sizeof(testRing->Data), 1234);
+	ringHeader.WriteIndex.store(0xFFFFFFF0); ringHeader.ReadIndex.store(0xFFFFFFF0);
+	FULCRUM_TEST_CHECK(fulcrumTest_PublishFilled(*testRing, 8, 0x08));
+	FULCRUM_TEST_CHECK(fulcrumTest_PublishFilled(*testRing, 8, 0x09));
+	FULCRUM_TEST_CHECK(ringHeader.WriteIndex.load() == 16);
+	FULCRUM_TEST_CHECK(fulcrumTest_ConsumeFilled(*testRing, 8, 0x08));
+	FULCRUM_TEST_CHECK(fulcrumTest_ConsumeFilled(*testRing, 8, 0x09));
+	FULCRUM_TEST_CHECK(ringHeader.ReadIndex.load() == 16 && fulcrumShmRing_Peek(&ringHeader, testRing->Data) == NULL);
+}
+
+// ------------------------------------------------------------------------------------------------
+
+// Sections by the name ctest runs them under
+static const struct {
+	const char* Name;
+	void (*Run)();
+} testSections[] = {
+	{ "catalog", fulcrumTest_Catalog },
+	{ "frame", fulcrumTest_Frame },
+	{ "loopback", fulcrumTest_Loopback },
+	{ "socket", fulcrumTest_Socket },
+	{ "shmring", fulcrumTest_ShmRing },
+};
+
+int main(int argc, char* argv[])
+{
+	// Runs every section, or only the ones named on the command line
+	int nSectionsRun = 0;
+	for (size_t sectionIndex = 0; sectionIndex < sizeof(testSections) / sizeof(testSections[0]); sectionIndex++)
+	{
+		bool fSelected = argc < 2;
+		for (int argIndex = 1; argIndex < argc; argIndex++) fSelected = fSelected || strcmp(argv[argIndex], testSections[sectionIndex].Name) == 0;
+		if (!fSelected) continue;
+
+		int nFailedBefore = nChecksFailed;
+		printf("%s:\n", testSections[sectionIndex].Name);
+		testSections[sectionIndex].Run();
+		printf("  %s\n", nChecksFailed == nFailedBefore ? "passed" : "FAILED");
+		nSectionsRun++;
+	}
+
+	if (nSectionsRun == 0) { printf("No test sections matched\n"); return 1; }
+	return nChecksFailed == 0 ? 0 : 1;
+}
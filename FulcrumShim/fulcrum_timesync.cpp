@@ -0,0 +1,195 @@
+/*
+**
+** Copyright (C) 2022 MEAT Inc
+** Author: Zack Walsh <neo.smith@motorengineeringandtech.com>
+**
+** This library is free software; you can redistribute it and/or modify
+** it under the terms of the GNU Lesser General Public License as published
+** by the Free Software Foundation, either version 3 of the License, or (at
+** your option) any later version.
+**
+** This library is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+** Lesser General Public License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public
+** License along with this library; if not, <http://www.gnu.org/licenses/>.
+**
+*/
+
+// Standard Imports
+#include <map>
+#include <mutex>
+
+// Fulcrum Resource Imports
+#include "fulcrum_timesync.h"
+
+// Nominal rate of the device counter against the host clock. Nanoseconds per microsecond
+#define FULCRUM_TIMESYNC_NOMINAL_RATE 1000.0
+
+// Everything known about one device's counter
+struct fulcrum_timesync_tracker {
+	bool Started;
+	uint64_t LastDevice;		// Newest unwrapped counter value seen
+
+	// Finished windows as a ring, then the one being filled. Each holds the read with the
+	// lowest host time minus nominal device time, paired with the newest message in that read
+	fulcrum_timesync_point Windows[FULCRUM_TIMESYNC_WINDOWS];
+	size_t WindowCount;
+	size_t WindowNext;
+	bool Sampled;
+	fulcrum_timesync_point Current;
+	uint64_t CurrentStart;
+
+	// Fitted mapping. Host = HostBase + (Device - DeviceBase) * Rate
+	uint64_t DeviceBase;
+	uint64_t HostBase;
+	double Rate;
+};
+
+// Trackers are shared between every channel on a device, so they get a lock of their own
+static std::mutex timesyncLock;
+static std::map<unsigned long, fulcrum_timesync_tracker> deviceTrackers;
+static std::map<unsigned long, unsigned long> channelDevices;
+
+// ---------------------------------------------------------------------------------------------------------------------------------
+
+// Host time minus nominal device time. Lower means the read came back sooner after the device stamped it
+static int64_t fulcrumTimesync_Offset(const fulcrum_timesync_point& syncPoint)
+{
+	return (int64_t)syncPoint.HostTime - (int64_t)(syncPoint.DeviceTime * (uint64_t)FULCRUM_TIMESYNC_NOMINAL_RATE);
+}
+
+// Takes whichever copy of the counter lands closest to the newest value we've seen. A jump back of up to
+// half the counter is a message read late on another channel, anything further forward is a wrap
+static uint64_t fulcrumTimesync_Unwrap(fulcrum_timesync_tracker& syncTracker, uint32_t msgTimestamp)
+{
+	if (!syncTracker.Started)
+	{
+		syncTracker.Started = true;
+		syncTracker.LastDevice = msgTimestamp;
+		return msgTimestamp;
+	}
+
+	int32_t countDelta = (int32_t)(msgTimestamp - (uint32_t)syncTracker.LastDevice);
+	if (countDelta < 0 && (uint64_t)(-(int64_t)countDelta) > syncTracker.LastDevice) return 0;
+	uint64_t unwrappedTime = syncTracker.LastDevice + (int64_t)countDelta;
+	if (countDelta > 0) syncTracker.LastDevice = unwrappedTime;
+	return unwrappedTime;
+}
+
+// Adds the best sample from a read to the windows and fits the line again. The fit is a least squares line
+// through the window minimums. Until there are two of them, or when the rate comes out further off than
+// any real crystal would be, the newest minimum is used with the nominal rate
+static void fulcrumTimesync_Sample(fulcrum_timesync_tracker& syncTracker, const fulcrum_timesync_point& syncSample)
+{
+	if (!syncTracker.Sampled)
+	{
+		syncTracker.Sampled = true;
+		syncTracker.Current = syncSample;
+		syncTracker.CurrentStart = syncSample.HostTime;
+	}
+	else if (syncSample.HostTime - syncTracker.CurrentStart >= FULCRUM_TIMESYNC_WINDOW_NS)
+	{
+		syncTracker.Windows[syncTracker.WindowNext] = syncTracker.Current;
+		syncTracker.WindowNext = (syncTracker.WindowNext + 1) % FULCRUM_TIMESYNC_WINDOWS;
+		if (syncTracker.WindowCount < FULCRUM_TIMESYNC_WINDOWS) syncTracker.WindowCount++;
+		syncTracker.Current = syncSample;
+		syncTracker.CurrentStart = syncSample.HostTime;
+	}
+	else if (fulcrumTimesync_Offset(syncSample) < fulcrumTimesync_Offset(syncTracker.Current))
+	{
+		syncTracker.Current = syncSample;
+	}
+
+	// Sums are taken relative to the current window so they stay small enough for a double
+	syncTracker.DeviceBase = syncTracker.Current.DeviceTime;
+	syncTracker.HostBase = syncTracker.Current.HostTime;
+	syncTracker.Rate = FULCRUM_TIMESYNC_NOMINAL_RATE;
+	if (syncTracker.WindowCount == 0) return;
+
+	double sumDevice = 0, sumHost = 0, sumDeviceDevice = 0, sumDeviceHost = 0;
+	size_t pointCount = syncTracker.WindowCount + 1;
+	for (size_t pointIndex = 0; pointIndex < pointCount; pointIndex++)
+	{
+		const fulcrum_timesync_point& syncPoint = pointIndex < syncTracker.WindowCount ? syncTracker.Windows[pointIndex] : syncTracker.Current;
+		double deviceDelta = (double)((int64_t)syncPoint.DeviceTime - (int64_t)syncTracker.DeviceBase);
+		double hostDelta = (double)((int64_t)syncPoint.HostTime - (int64_t)syncTracker.HostBase);
+		sumDevice += deviceDelta; sumHost += hostDelta;
+		sumDeviceDevice += deviceDelta * deviceDelta; sumDeviceHost += deviceDelta * hostDelta;
+	}
+
+	double deviceSpread = sumDeviceDevice - sumDevice * sumDevice / pointCount;
+	if (deviceSpread <= 0) return;
+	double fitRate = (sumDeviceHost - sumDevice * sumHost / pointCount) / deviceSpread;
+	double rateLimit = FULCRUM_TIMESYNC_NOMINAL_RATE * FULCRUM_TIMESYNC_MAX_PPM / 1000000.0;
+	if (fitRate < FULCRUM_TIMESYNC_NOMINAL_RATE - rateLimit || fitRate > FULCRUM_TIMESYNC_NOMINAL_RATE + rateLimit) return;
+
+	// The line goes through the middle of the points. Rebase it there
+	double deviceMean = sumDevice / pointCount, hostMean = sumHost / pointCount;
+	syncTracker.Rate = fitRate;
+	syncTracker.DeviceBase += (int64_t)deviceMean;
+	syncTracker.HostBase += (int64_t)(hostMean - (deviceMean - (int64_t)deviceMean) * fitRate);
+}
+
+// Maps an unwrapped device time onto the host clock. Nothing can reach us after the read it came back in
+// returned, so that's as late as a message is allowed to land
+static uint64_t fulcrumTimesync_Map(const fulcrum_timesync_tracker& syncTracker, uint64_t deviceTime, uint64_t readTimestamp)
+{
+	double deviceDelta = (double)((int64_t)deviceTime - (int64_t)syncTracker.DeviceBase);
+	double hostTime = (double)syncTracker.HostBase + deviceDelta * syncTracker.Rate;
+	if (hostTime <= 0) return 0;
+	if (hostTime >= (double)readTimestamp) return readTimestamp;
+	return (uint64_t)hostTime;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------------------
+
+void fulcrumTimesync_AttachChannel(unsigned long ChannelID, unsigned long DeviceID)
+{
+	std::lock_guard<std::mutex> syncLock(timesyncLock);
+	channelDevices[ChannelID] = DeviceID;
+}
+void fulcrumTimesync_DetachChannel(unsigned long ChannelID)
+{
+	std::lock_guard<std::mutex> syncLock(timesyncLock);
+	channelDevices.erase(ChannelID);
+}
+void fulcrumTimesync_DropDevice(unsigned long DeviceID)
+{
+	std::lock_guard<std::mutex> syncLock(timesyncLock);
+	deviceTrackers.erase(DeviceID);
+	for (auto channelEntry = channelDevices.begin(); channelEntry != channelDevices.end(); )
+	{
+		if (channelEntry->second == DeviceID) channelEntry = channelDevices.erase(channelEntry);
+		else ++channelEntry;
+	}
+}
+
+// Unwraps every message first so the newest one can go in as this read's sample, then maps them all with the new fit
+bool fulcrumTimesync_Observe(unsigned long ChannelID, const PASSTHRU_MSG* pMsgs, unsigned long numMsgs, uint64_t readTimestamp,
+	unsigned long& deviceID, fulcrum_timesync_point* pMsgTimes)
+{
+	std::lock_guard<std::mutex> syncLock(timesyncLock);
+	auto channelEntry = channelDevices.find(ChannelID);
+	if (channelEntry == channelDevices.end()) return false;
+	deviceID = channelEntry->second;
+
+	auto trackerEntry = deviceTrackers.find(deviceID);
+	if (trackerEntry == deviceTrackers.end())
+		trackerEntry = deviceTrackers.insert(std::make_pair(deviceID, fulcrum_timesync_tracker())).first;
+	fulcrum_timesync_tracker& syncTracker = trackerEntry->second;
+
+	fulcrum_timesync_point syncSample = { 0, readTimestamp };
+	for (unsigned long i = 0; i < numMsgs; i++)
+	{
+		pMsgTimes[i].DeviceTime = fulcrumTimesync_Unwrap(syncTracker, pMsgs[i].Timestamp);
+		if (pMsgTimes[i].DeviceTime > syncSample.DeviceTime) syncSample.DeviceTime = pMsgTimes[i].DeviceTime;
+	}
+
+	if (numMsgs > 0) fulcrumTimesync_Sample(syncTracker, syncSample);
+	for (unsigned long i = 0; i < numMsgs; i++)
+		pMsgTimes[i].HostTime = fulcrumTimesync_Map(syncTracker, pMsgTimes[i].DeviceTime, readTimestamp);
+	return true;
+}
\ No newline at end of file
@@ -0,0 +1,62 @@
+/*
+**
+** Copyright (C) 2022 MEAT Inc
+** Author: Zack Walsh <neo.smith@motorengineeringandtech.com>
+**
+** This library is free software; you can redistribute it and/or modify
+** it under the terms of the GNU Lesser General Public License as published
+** by the Free Software Foundation, either version 3 of the License, or (at
+** your option) any later version.
+**
+** This library is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+** Lesser General Public License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public
+** License along with this library; if not, <http://www.gnu.org/licenses/>.
+**
+*/
+
+#pragma once
+
+// Standard Imports
+#include <stdint.h>
+
+// Fulcrum Resource Imports
+#include "fulcrum_j2534.h"
+
+// PASSTHRU_MSG.Timestamp is a 32 bit microsecond counter kept by the device. It wraps about every 71 minutes
+// and starts wherever the device likes, so on its own it can't be lined up with anything the shim logs.
+// Every device gets a tracker that unwraps its counter to 64 bits and fits a line from device time onto
+// fulcrumClock_Now(), which takes care of the two clocks drifting apart. Channels share their device's
+// counter, so they're tied to it when they connect. No Windows dependencies, same as the clock
+
+// Length of one sync window. Each window keeps the read that came back soonest after the device stamped
+// its newest message, which is the one held up least by the driver and the USB stack
+#define FULCRUM_TIMESYNC_WINDOW_NS 10000000000ULL
+
+// Windows the fit is run over, about five minutes of traffic at the length above
+#define FULCRUM_TIMESYNC_WINDOWS 32
+
+// Furthest the fitted rate may stray from nominal before it's thrown out, in parts per million
+#define FULCRUM_TIMESYNC_MAX_PPM 1000
+
+// Times for one message. Laid out the same way they're stored in FIELD_MSG_TIMES
+struct fulcrum_timesync_point {
+	uint64_t DeviceTime;		// Unwrapped device counter in microseconds
+	uint64_t HostTime;			// Same moment on fulcrumClock_Now() in nanoseconds
+};
+
+// Ties a channel to the device it was connected on. Reads on channels that were never attached aren't synced
+void fulcrumTimesync_AttachChannel(unsigned long ChannelID, unsigned long DeviceID);
+void fulcrumTimesync_DetachChannel(unsigned long ChannelID);
+
+// Forgets a device and every channel on it. A device that's opened again starts its counter over
+void fulcrumTimesync_DropDevice(unsigned long DeviceID);
+
+// Feeds one read into the tracker for the channel's device. readTimestamp is when the read returned.
+// Fills pMsgTimes with one point per message and hands back the device. Returns false when the channel
+// has no device, in which case nothing is filled
+bool fulcrumTimesync_Observe(unsigned long ChannelID, const PASSTHRU_MSG* pMsgs, unsigned long numMsgs, uint64_t readTimestamp,
+	unsigned long& deviceID, fulcrum_timesync_point* pMsgTimes);
\ No newline at end of file
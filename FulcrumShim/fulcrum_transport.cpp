@@ -0,0 +1,131 @@
+/*
+**
+** Copyright (C) 2022 MEAT Inc
+** Author: Zack Walsh <neo.smith@motorengineeringandtech.com>
+**
+** This library is free software; you can redistribute it and/or modify
+** it under the terms of the GNU Lesser General Public License as published
+** by the Free Software Foundation, either version 3 of the License, or (at
+** your option) any later version.
+**
+** This library is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+** Lesser General Public License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public
+** License along with this library; if not, <http://www.gnu.org/licenses/>.
+**
+*/
+
+// Standard Imports
+#include <string.h>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+// Fulcrum Resource Imports
+#include "fulcrum_transport.h"
+
+// ---------------------------------------------------------------------------------------------------------------------------------
+
+// What the two ends of a loopback share. Ends are indexed write end first
+struct fulcrum_loopback_channel {
+	std::mutex Lock;
+	std::condition_variable Changed;
+	std::deque<std::vector<unsigned char>> Messages;
+	size_t FrontOffset = 0;		// How much of the front message has been received already
+	size_t QueuedBytes = 0;
+	size_t Capacity = 0;
+	bool EndOpen[2] = { true, true };
+	bool EndCancelled[2] = { false, false };
+};
+
+// One end of an in-memory loopback. The write end only sends and the read end only receives
+class fulcrum_loopback_transport : public fulcrum_transport {
+public:
+	fulcrum_loopback_transport(std::shared_ptr<fulcrum_loopback_channel> pChannel, int nEnd)
+		: m_pChannel(pChannel), m_nEnd(nEnd) { }
+	virtual ~fulcrum_loopback_transport()
+	{
+		std::lock_guard<std::mutex> channelLock(m_pChannel->Lock);
+		m_pChannel->EndOpen[m_nEnd] = false;
+		m_pChannel->Changed.notify_all();
+	}
+
+	virtual bool WaitForPeer()
+	{
+		std::lock_guard<std::mutex> channelLock(m_pChannel->Lock);
+		return !m_pChannel->EndCancelled[m_nEnd] && m_pChannel->EndOpen[1 - m_nEnd];
+	}
+	virtual void DropPeer() { }
+
+	virtual fulcrum_pipe_result Send(const void* pData, size_t nBytes)
+	{
+		if (m_nEnd != 0) return PIPE_WRITE_FAILED;
+		if (nBytes == 0) return PIPE_WRITE_SENT;
+
+		// Wait for room. A message bigger than the whole buffer still goes once the buffer is empty
+		fulcrum_loopback_channel& channel = *m_pChannel;
+		std::unique_lock<std::mutex> channelLock(channel.Lock);
+		channel.Changed.wait(channelLock, [&channel, nBytes] {
+			return channel.EndCancelled[0] || !channel.EndOpen[1] ||
+				channel.QueuedBytes == 0 || channel.QueuedBytes + nBytes <= channel.Capacity;
+		});
+		if (channel.EndCancelled[0]) return PIPE_WRITE_STOPPED;
+		if (!channel.EndOpen[1]) return PIPE_WRITE_DISCONNECTED;
+
+		const unsigned char* pBytes = (const unsigned char*)pData;
+		channel.Messages.push_back(std::vector<unsigned char>(pBytes, pBytes + nBytes));
+		channel.QueuedBytes += nBytes;
+		channel.Changed.notify_all();
+		return PIPE_WRITE_SENT;
+	}
+
+	virtual size_t Receive(void* pBuffer, size_t nBytes)
+	{
+		if (m_nEnd != 1 || nBytes == 0) return 0;
+
+		// Whatever is queued still comes out after the write end closes
+		fulcrum_loopback_channel& channel = *m_pChannel;
+		std::unique_lock<std::mutex> channelLock(channel.Lock);
+		channel.Changed.wait(channelLock, [&channel] {
+			return channel.EndCancelled[1] || !channel.Messages.empty() || !channel.EndOpen[0];
+		});
+		if (channel.EndCancelled[1] || channel.Messages.empty()) return 0;
+
+		std::vector<unsigned char>& frontMessage = channel.Messages.front();
+		size_t nCopied = frontMessage.size() - channel.FrontOffset;
+		if (nCopied > nBytes) nCopied = nBytes;
+		memcpy(pBuffer, &frontMessage[channel.FrontOffset], nCopied);
+		channel.FrontOffset += nCopied;
+		channel.QueuedBytes -= nCopied;
+		if (channel.FrontOffset == frontMessage.size()) {
+			channel.Messages.pop_front();
+			channel.FrontOffset = 0;
+		}
+		channel.Changed.notify_all();
+		return nCopied;
+	}
+
+	virtual void Cancel()
+	{
+		std::lock_guard<std::mutex> channelLock(m_pChannel->Lock);
+		m_pChannel->EndCancelled[m_nEnd] = true;
+		m_pChannel->Changed.notify_all();
+	}
+
+private:
+	std::shared_ptr<fulcrum_loopback_channel> m_pChannel;
+	int m_nEnd;
+};
+
+// Builds both ends of a loopback around one shared channel
+void fulcrumTransport_CreateLoopback(size_t nCapacity, std::unique_ptr<fulcrum_transport>& pWriteEnd, std::unique_ptr<fulcrum_transport>& pReadEnd)
+{
+	std::shared_ptr<fulcrum_loopback_channel> pChannel = std::make_shared<fulcrum_loopback_channel>();
+	pChannel->Capacity = nCapacity;
+	pWriteEnd.reset(new fulcrum_loopback_transport(pChannel, 0));
+	pReadEnd.reset(new fulcrum_loopback_transport(pChannel, 1));
+}
\ No newline at end of file
@@ -0,0 +1,79 @@
+/*
+**
+** Copyright (C) 2022 MEAT Inc
+** Author: Zack Walsh <neo.smith@motorengineeringandtech.com>
+**
+** This library is free software; you can redistribute it and/or modify
+** it under the terms of the GNU Lesser General Public License as published
+** by the Free Software Foundation, either version 3 of the License, or (at
+** your option) any later version.
+**
+** This library is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+** Lesser General Public License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public
+** License along with this library; if not, <http://www.gnu.org/licenses/>.
+**
+*/
+
+#pragma once
+
+// Standard Imports
+#include <stddef.h>
+#include <stdint.h>
+#include <memory>
+
+// Transports carry the bytes for fulcrum_pipe. The pipe and its writer thread only talk to this
+// interface, so the jpipe serialization and framing run the same over a Windows named pipe, a
+// Unix domain socket, or an in-memory loopback. Like the frame decoder this header has no Windows
+// dependencies, and neither do the loopback and socket backends, so tests and benchmarks for the
+// pipe code can be built on Linux.
+//
+// Every transport keeps message boundaries. One Send() is one message, and Receive() hands back
+// a message in pieces when it is bigger than the buffer it was given.
+
+// How a single send went
+enum fulcrum_pipe_result {
+	PIPE_WRITE_SENT = 0,
+	PIPE_WRITE_FAILED = 1,			// Counted and thrown away
+	PIPE_WRITE_DISCONNECTED = 2,	// Nobody on the other end. Send it again once somebody is
+	PIPE_WRITE_STOPPED = 3,			// Cancelled because we're shutting down
+};
+
+class fulcrum_transport {
+public:
+	virtual ~fulcrum_transport() {}
+
+	// Blocks until somebody is on the other end. False when that failed or we were cancelled.
+	// Client ends are connected when they are built so this just returns true for them
+	virtual bool WaitForPeer() = 0;
+
+	// Lets go of the current peer so a new one can connect
+	virtual void DropPeer() = 0;
+
+	// Listening ends that can serve more than one peer hand each new one back as a transport of its
+	// own and go on listening. Blocks like WaitForPeer(). NULL when that failed, we were cancelled,
+	// or this transport only ever takes one peer
+	virtual fulcrum_transport* AcceptPeer() { return NULL; }
+
+	// Sends one message and waits for it to go
+	virtual fulcrum_pipe_result Send(const void* pData, size_t nBytes) = 0;
+
+	// Reads up to nBytes of the next message. Returns 0 once the other end is gone or we were cancelled
+	virtual size_t Receive(void* pBuffer, size_t nBytes) = 0;
+
+	// Wakes anything blocked in the calls above and fails every later one. Safe to call from any thread
+	virtual void Cancel() = 0;
+};
+
+// In-memory loopback. Whatever goes into the write end comes out of the read end. Sends block
+// once nCapacity bytes are waiting, the same as a full pipe buffer would
+void fulcrumTransport_CreateLoopback(size_t nCapacity, std::unique_ptr<fulcrum_transport>& pWriteEnd, std::unique_ptr<fulcrum_transport>& pReadEnd);
+
+// Unix domain sockets. The server end listens on szPath and serves one peer at a time, the
+// client end connects to szPath. Each message goes out with a 4 byte length in front of it.
+// Returns NULL when the socket can't be set up
+fulcrum_transport* fulcrumTransport_CreateSocketServer(const char* szPath);
+fulcrum_transport* fulcrumTransport_CreateSocketClient(const char* szPath);
\ No newline at end of file